@@ -0,0 +1,81 @@
+// Copyright (c) 2021-2022 The Studscoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "amount.h"
+#include "arith_uint256.h"
+#include "txmempool.h"
+
+#include <list>
+#include <vector>
+
+static const size_t MEMPOOL_BENCH_TXS = 100000;
+static const size_t MEMPOOL_BENCH_CHAIN_LENGTH = 4;
+
+// Chains of MEMPOOL_BENCH_CHAIN_LENGTH one input, two output transactions, parents first
+static std::vector<CTransaction> MakeMempoolBenchTxs()
+{
+    std::vector<CTransaction> vtx;
+    vtx.reserve(MEMPOOL_BENCH_TXS);
+    uint256 hashPrev;
+    for (size_t i = 0; i < MEMPOOL_BENCH_TXS; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        if (i % MEMPOOL_BENCH_CHAIN_LENGTH == 0) {
+            tx.vin[0].prevout = COutPoint(ArithToUint256(arith_uint256(i + 1)), 0);
+        } else {
+            tx.vin[0].prevout = COutPoint(hashPrev, 1);
+        }
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(2);
+        tx.vout[0].nValue = 1000;
+        tx.vout[0].scriptPubKey = CScript() << OP_1;
+        tx.vout[1].nValue = 10 * COIN;
+        tx.vout[1].scriptPubKey = CScript() << OP_1;
+        vtx.emplace_back(tx);
+        hashPrev = vtx.back().GetHash();
+    }
+    return vtx;
+}
+
+static void AddToMempool(CTxMemPool& pool, const std::vector<CTransaction>& vtx)
+{
+    LOCK(pool.cs);
+    for (const CTransaction& tx : vtx) {
+        const bool fNoInputsOf = pool.HasNoInputsOf(tx);
+        pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 1000, 0, 0.0, 1, fNoInputsOf, fNoInputsOf ? tx.GetValueOut() : 0, false, 1), false);
+    }
+}
+
+// Accept then mine 100k transactions
+static void MempoolAcceptRemove(benchmark::State& state)
+{
+    const std::vector<CTransaction> vtx = MakeMempoolBenchTxs();
+    CTxMemPool pool(CFeeRate(1000));
+    while (state.KeepRunning()) {
+        AddToMempool(pool, vtx);
+        std::list<CTransaction> conflicts;
+        pool.removeForBlock(vtx, 2, conflicts, false);
+        assert(pool.size() == 0);
+    }
+}
+
+// Input lookups of a full mempool, as done for every input in AcceptToMemoryPool
+static void MempoolSpendLookup(benchmark::State& state)
+{
+    const std::vector<CTransaction> vtx = MakeMempoolBenchTxs();
+    CTxMemPool pool(CFeeRate(1000));
+    AddToMempool(pool, vtx);
+    LOCK(pool.cs);
+    size_t nFound = 0;
+    while (state.KeepRunning()) {
+        for (const CTransaction& tx : vtx)
+            nFound += pool.mapNextTx.count(tx.vin[0].prevout);
+    }
+    assert(nFound > 0);
+}
+
+BENCHMARK(MempoolAcceptRemove);
+BENCHMARK(MempoolSpendLookup);
@@ -0,0 +1,132 @@
+// Copyright (c) 2021-2022 The Studscoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "netbase.h"
+#include "netpoller.h"
+#include "util.h"
+
+#include <assert.h>
+#include <vector>
+
+#ifndef WIN32
+#include <netinet/tcp.h>
+
+// Peers sending a message between two iterations of the socket handler
+static const size_t POLLER_BENCH_ACTIVE = 10;
+
+// Loopback connections, the accepted ends are the ones being polled
+class CLoopbackConnections
+{
+public:
+    std::vector<SOCKET> vAccepted;
+    std::vector<SOCKET> vConnected;
+
+    explicit CLoopbackConnections(size_t nConnections)
+    {
+        // both ends of every connection live in this process
+        const int nFD = RaiseFileDescriptorLimit(2 * nConnections + 100);
+        nConnections = std::min(nConnections, (size_t)std::max(nFD - 100, 0) / 2);
+
+        SOCKET hListen = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        assert(hListen != INVALID_SOCKET);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        socklen_t len = sizeof(addr);
+        bool fOk = bind(hListen, (struct sockaddr*)&addr, sizeof(addr)) == 0 &&
+                   listen(hListen, SOMAXCONN) == 0 &&
+                   getsockname(hListen, (struct sockaddr*)&addr, &len) == 0;
+        assert(fOk);
+
+        for (size_t i = 0; i < nConnections; i++) {
+            SOCKET hConnect = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            assert(hConnect != INVALID_SOCKET);
+            fOk = connect(hConnect, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+            assert(fOk);
+            int nOne = 1;
+            setsockopt(hConnect, IPPROTO_TCP, TCP_NODELAY, (void*)&nOne, sizeof(int));
+            SOCKET hAccepted = accept(hListen, NULL, NULL);
+            assert(hAccepted != INVALID_SOCKET);
+            SetSocketNonBlocking(hAccepted, true);
+            vConnected.push_back(hConnect);
+            vAccepted.push_back(hAccepted);
+        }
+        CloseSocket(hListen);
+    }
+
+    ~CLoopbackConnections()
+    {
+        for (SOCKET& hSocket : vConnected)
+            CloseSocket(hSocket);
+        for (SOCKET& hSocket : vAccepted)
+            CloseSocket(hSocket);
+    }
+};
+
+// One iteration of the socket handler with nConnections idle peers but a few
+static void SocketEvents(benchmark::State& state, const std::string& strMode, size_t nConnections)
+{
+    CLoopbackConnections conns(nConnections);
+    std::unique_ptr<CSocketPoller> poller = MakeSocketPoller(strMode);
+    assert(strMode == poller->Name());
+    for (SOCKET hSocket : conns.vAccepted) {
+        bool fAdded = poller->Add(hSocket, false);
+        assert(fAdded);
+    }
+
+    std::vector<CSocketPoller::Event> vEvents;
+    // the initial writable edges
+    poller->Wait(0, vEvents);
+
+    const char chMessage = 'x';
+    size_t nNext = 0;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < POLLER_BENCH_ACTIVE; i++) {
+            ssize_t nSent = send(conns.vConnected[nNext], &chMessage, 1, MSG_NOSIGNAL);
+            assert(nSent == 1);
+            nNext = (nNext + 1) % conns.vConnected.size();
+        }
+
+        size_t nReceived = 0;
+        while (nReceived < POLLER_BENCH_ACTIVE) {
+            for (SOCKET hSocket : conns.vAccepted)
+                poller->SetInterest(hSocket, true, false);
+            poller->Wait(50, vEvents);
+            for (const CSocketPoller::Event& event : vEvents) {
+                char pchBuf[16];
+                if (event.fRecv && recv(event.hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT) > 0)
+                    nReceived++;
+            }
+        }
+    }
+}
+
+// select() can only take descriptors below FD_SETSIZE
+static void SocketEventsSelect450(benchmark::State& state)
+{
+    SocketEvents(state, "select", 450);
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static void SocketEventsEpoll450(benchmark::State& state)
+{
+    SocketEvents(state, "epoll", 450);
+}
+
+static void SocketEventsEpoll2000(benchmark::State& state)
+{
+    SocketEvents(state, "epoll", 2000);
+}
+#endif
+
+BENCHMARK(SocketEventsSelect450);
+#ifdef HAVE_SYS_EPOLL_H
+BENCHMARK(SocketEventsEpoll450);
+BENCHMARK(SocketEventsEpoll2000);
+#endif
+#endif // WIN32
@@ -0,0 +1,61 @@
+// Copyright (c) 2021-2022 The Studscoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "libzerocoin/Coin.h"
+#include "libzerocoin/CoinRandomnessSchnorrSignature.h"
+#include "random.h"
+
+static libzerocoin::ZerocoinParams* BenchZerocoinParams()
+{
+    SelectParams(CBaseChainParams::MAIN);
+    return Params().GetConsensus().Zerocoin_Params(false);
+}
+
+// Pedersen commitment g^s * h^r mod p, the way it was computed before the fixed base tables
+static void ZerocoinCommitmentPowMod(benchmark::State& state)
+{
+    const libzerocoin::IntegerGroupParams& group = BenchZerocoinParams()->coinCommitmentGroup;
+    const CBigNum s = CBigNum::randBignum(group.groupOrder);
+    const CBigNum r = CBigNum::randBignum(group.groupOrder);
+    while (state.KeepRunning()) {
+        group.g.pow_mod(s, group.modulus).mul_mod(group.h.pow_mod(r, group.modulus), group.modulus);
+    }
+}
+
+static void ZerocoinCommitmentFixedBase(benchmark::State& state)
+{
+    const libzerocoin::IntegerGroupParams& group = BenchZerocoinParams()->coinCommitmentGroup;
+    const CBigNum s = CBigNum::randBignum(group.groupOrder);
+    const CBigNum r = CBigNum::randBignum(group.groupOrder);
+    while (state.KeepRunning()) {
+        group.pow_g(s).mul_mod(group.pow_h(r), group.modulus);
+    }
+}
+
+static void ZerocoinMint(benchmark::State& state)
+{
+    libzerocoin::ZerocoinParams* params = BenchZerocoinParams();
+    while (state.KeepRunning()) {
+        libzerocoin::PrivateCoin coin(params, libzerocoin::ZQ_ONE);
+    }
+}
+
+static void ZerocoinSchnorrVerify(benchmark::State& state)
+{
+    libzerocoin::ZerocoinParams* params = BenchZerocoinParams();
+    libzerocoin::PrivateCoin coin(params, libzerocoin::ZQ_ONE);
+    const uint256 msghash = GetRandHash();
+    libzerocoin::CoinRandomnessSchnorrSignature sig(params, coin.getRandomness(), msghash);
+    while (state.KeepRunning()) {
+        sig.Verify(params, coin.getSerialNumber(), coin.getPublicCoin().getValue(), msghash);
+    }
+}
+
+BENCHMARK(ZerocoinCommitmentPowMod);
+BENCHMARK(ZerocoinCommitmentFixedBase);
+BENCHMARK(ZerocoinMint);
+BENCHMARK(ZerocoinSchnorrVerify);
@@ -7,16 +7,117 @@
 
 #include "chainparams.h"
 #include "consensus/consensus.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "guiinterface.h"        // for ui_interface
 #include "init.h"                // for ShutdownRequested()
 #include "invalid.h"
 #include "main.h"
+#include "random.h"
 #include "script/interpreter.h"
+#include "script/sigcache.h"
 #include "spork.h"               // for sporkManager
 #include "txdb.h"
 #include "upgrades.h"            // for IsActivationHeight
 #include "utilmoneystr.h"        // for FormatMoney
 
+#include <boost/thread.hpp>
+
+namespace {
+/**
+ * Cache of valid zerocoin spend signatures, so a spend checked once (VerifyDB,
+ * TestBlockValidity, a block connected again after a reorg) isn't verified again
+ */
+class CZerocoinSpendCache
+{
+private:
+    //! Entries are SHA256(nonce || signature hash || serial || public key || signature)
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    bool fSetup;
+    boost::shared_mutex cs_zcspendcache;
+
+public:
+    CZerocoinSpendCache() : fSetup(false)
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const libzerocoin::CoinSpend& spend)
+    {
+        const uint256 hashSig = spend.signatureHash();
+        const std::vector<unsigned char> vchSerial = spend.getCoinSerialNumber().getvch();
+        const CPubKey pubkey = spend.getPubKey();
+        const std::vector<unsigned char> vchSig = spend.getSignature();
+        CSHA256 hasher;
+        hasher.Write(nonce.begin(), 32).Write(hashSig.begin(), 32);
+        if (!vchSerial.empty())
+            hasher.Write(vchSerial.data(), vchSerial.size());
+        if (pubkey.size())
+            hasher.Write(pubkey.begin(), pubkey.size());
+        if (!vchSig.empty())
+            hasher.Write(vchSig.data(), vchSig.size());
+        hasher.Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_zcspendcache);
+        return fSetup && setValid.contains(entry, false);
+    }
+
+    void Set(const uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_zcspendcache);
+        if (fSetup)
+            setValid.insert(entry);
+    }
+
+    uint32_t setup_bytes(size_t n)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_zcspendcache);
+        if (fSetup)
+            return 0;
+        fSetup = true;
+        return setValid.setup_bytes(n);
+    }
+};
+
+static CZerocoinSpendCache zerocoinSpendCache;
+
+bool HasValidSpendSignature(const libzerocoin::CoinSpend* spend)
+{
+    uint256 entry;
+    zerocoinSpendCache.ComputeEntry(entry, *spend);
+    if (zerocoinSpendCache.Get(entry))
+        return true;
+    if (!spend->HasValidSignature())
+        return false;
+    zerocoinSpendCache.Set(entry);
+    return true;
+}
+}
+
+void InitZerocoinSpendCache()
+{
+    size_t nElems = zerocoinSpendCache.setup_bytes((size_t)DEFAULT_ZC_SPEND_CACHE_SIZE << 20);
+    if (!nElems)
+        return;
+    LogPrint(BCLog::LEGACYZC, "Using %zu MiB for the zerocoin spend cache, able to store %zu elements\n",
+            (nElems * sizeof(uint256)) >> 20, nElems);
+}
+
+bool CZerocoinSpendCheck::operator()()
+{
+    // runs on the check queue threads, nothing may escape
+    try {
+        return ContextualCheckZerocoinSpendNoSerialCheck(*ptxTo, spend.get(), nHeight, UINT256_ZERO);
+    } catch (const std::exception& e) {
+        return error("%s : spend check of tx %s failed: %s", __func__, ptxTo->GetHash().GetHex(), e.what());
+    }
+}
+
 
 bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool fFakeSerialAttack)
 {
@@ -156,7 +257,7 @@ bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const lib
     //Check to see if the zSTUDS is properly signed
     if (consensus.NetworkUpgradeActive(nHeight, Consensus::UPGRADE_ZC_V2)) {
         try {
-            if (!spend->HasValidSignature())
+            if (!HasValidSpendSignature(spend))
                 return error("%s: V2 zSTUDS spend does not have a valid signature\n", __func__);
         } catch (const libzerocoin::InvalidSerialException& e) {
             // Check if we are in the range of the attack
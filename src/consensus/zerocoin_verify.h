@@ -11,6 +11,8 @@
 #include "script/interpreter.h"
 #include "zpivchain.h"
 
+#include <memory>
+
 /** Context-independent validity checks */
 bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool fFakeSerialAttack = false);
 // Fake Serial attack Range
@@ -24,4 +26,37 @@ bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const lib
 bool RecalculatePIVSupply(int nHeightStart, bool fSkipZpiv = true);
 CAmount GetInvalidUTXOValue();
 
+/** Size in MiB of the cache of verified zerocoin spend signatures */
+static const unsigned int DEFAULT_ZC_SPEND_CACHE_SIZE = 4;
+void InitZerocoinSpendCache();
+
+/**
+ * Closure representing the signature and serial checks of one zerocoin spend,
+ * so ConnectBlock can verify the spends of a block on the check queue threads.
+ * The serial double spend check stays on the caller, it needs the zerocoin DB.
+ */
+class CZerocoinSpendCheck
+{
+private:
+    std::shared_ptr<const libzerocoin::CoinSpend> spend;
+    const CTransaction* ptxTo;
+    int nHeight;
+
+public:
+    CZerocoinSpendCheck() : ptxTo(nullptr), nHeight(0) {}
+    CZerocoinSpendCheck(const std::shared_ptr<const libzerocoin::CoinSpend>& spendIn, const CTransaction& txToIn, int nHeightIn) :
+        spend(spendIn),
+        ptxTo(&txToIn),
+        nHeight(nHeightIn) {}
+
+    bool operator()();
+
+    void swap(CZerocoinSpendCheck& check)
+    {
+        spend.swap(check.spend);
+        std::swap(ptxTo, check.ptxTo);
+        std::swap(nHeight, check.nHeight);
+    }
+};
+
 #endif //PIVX_CONSENSUS_ZEROCOIN_VERIFY_H
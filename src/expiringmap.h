@@ -0,0 +1,254 @@
+// Copyright (c) 2021-2022 The Studscoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_EXPIRINGMAP_H
+#define BITCOIN_EXPIRINGMAP_H
+
+#include "memusage.h"
+#include "serialize.h"
+#include "utiltime.h"
+#include "version.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <list>
+#include <stdexcept>
+#include <unordered_map>
+
+/** Snapshot of the size and churn of an expiringmap */
+struct expiringmap_stats {
+    size_t nEntries;
+    size_t nUsage;
+    uint64_t nExpired;
+    uint64_t nEvicted;
+};
+
+/** STL-like map container for seen network objects.
+ *  Entries are kept in the order they were inserted (or last touched) and are
+ *  dropped once they are older than the lifetime, or oldest first whenever the
+ *  estimated memory usage exceeds the limit. Both happen on insertion, in
+ *  amortized O(1).
+ */
+template <typename K, typename V, typename Hash>
+class expiringmap
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<const key_type, mapped_type> value_type;
+    typedef typename std::list<value_type>::iterator iterator;
+    typedef typename std::list<value_type>::const_iterator const_iterator;
+    typedef typename std::list<value_type>::size_type size_type;
+
+private:
+    struct entry_info {
+        iterator it;
+        int64_t nTime;
+        size_t nUsage;
+    };
+
+    // entries, oldest first
+    std::list<value_type> list;
+    std::unordered_map<K, entry_info, Hash> index;
+
+    int64_t nLifetime;
+    size_t nMaxUsage;
+    size_t nUsage;
+    uint64_t nExpired;
+    uint64_t nEvicted;
+
+    static size_t EntryUsage(const value_type& x)
+    {
+        return memusage::MallocUsage(sizeof(typename std::list<value_type>::value_type) + 2 * sizeof(void*)) +
+               memusage::MallocUsage(sizeof(memusage::unordered_node<std::pair<const K, entry_info> >)) +
+               ::GetSerializeSize(x.second, SER_NETWORK, PROTOCOL_VERSION);
+    }
+
+    void Trim(int64_t nNow)
+    {
+        while (!list.empty()) {
+            typename std::unordered_map<K, entry_info, Hash>::iterator itIndex = index.find(list.front().first);
+            assert(itIndex != index.end());
+            if (nLifetime && itIndex->second.nTime < nNow - nLifetime) {
+                nExpired++;
+            } else if (nMaxUsage && nUsage > nMaxUsage) {
+                nEvicted++;
+            } else {
+                break;
+            }
+            nUsage -= itIndex->second.nUsage;
+            index.erase(itIndex);
+            list.pop_front();
+        }
+    }
+
+public:
+    /**
+     * @param[in] nLifetimeIn   Seconds after which an entry expires (0 for no expiry).
+     * @param[in] nMaxUsageIn   Estimated memory usage above which the oldest entries are evicted (0 for no limit).
+     */
+    expiringmap(int64_t nLifetimeIn = 0, size_t nMaxUsageIn = 0) :
+        nLifetime(nLifetimeIn), nMaxUsage(nMaxUsageIn), nUsage(0), nExpired(0), nEvicted(0) {}
+
+    iterator begin() { return list.begin(); }
+    iterator end() { return list.end(); }
+    const_iterator begin() const { return list.begin(); }
+    const_iterator end() const { return list.end(); }
+    size_type size() const { return index.size(); }
+    bool empty() const { return index.empty(); }
+    size_type count(const key_type& k) const { return index.count(k); }
+
+    iterator find(const key_type& k)
+    {
+        typename std::unordered_map<K, entry_info, Hash>::iterator itIndex = index.find(k);
+        return itIndex == index.end() ? list.end() : itIndex->second.it;
+    }
+
+    const_iterator find(const key_type& k) const
+    {
+        typename std::unordered_map<K, entry_info, Hash>::const_iterator itIndex = index.find(k);
+        return itIndex == index.end() ? list.end() : const_iterator(itIndex->second.it);
+    }
+
+    mapped_type& at(const key_type& k)
+    {
+        iterator it = find(k);
+        if (it == list.end())
+            throw std::out_of_range("expiringmap::at");
+        return it->second;
+    }
+
+    const mapped_type& at(const key_type& k) const
+    {
+        const_iterator it = find(k);
+        if (it == list.end())
+            throw std::out_of_range("expiringmap::at");
+        return it->second;
+    }
+
+    std::pair<iterator, bool> insert(const value_type& x)
+    {
+        const int64_t nNow = GetTime();
+        typename std::unordered_map<K, entry_info, Hash>::iterator itIndex = index.find(x.first);
+        if (itIndex != index.end())
+            return std::make_pair(itIndex->second.it, false);
+
+        iterator it = list.insert(list.end(), x);
+        entry_info info;
+        info.it = it;
+        info.nTime = nNow;
+        info.nUsage = EntryUsage(x);
+        index.emplace(x.first, info);
+        nUsage += info.nUsage;
+        Trim(nNow);
+        // the new entry alone may exceed the limit
+        const bool fKept = index.count(x.first) > 0;
+        return std::make_pair(fKept ? it : list.end(), fKept);
+    }
+
+    mapped_type& operator[](const key_type& k)
+    {
+        iterator it = find(k);
+        if (it == list.end()) {
+            it = insert(value_type(k, mapped_type())).first;
+            assert(it != list.end());
+        }
+        return it->second;
+    }
+
+    /** Mark an entry as fresh again, after it was updated */
+    void touch(const key_type& k)
+    {
+        typename std::unordered_map<K, entry_info, Hash>::iterator itIndex = index.find(k);
+        if (itIndex == index.end())
+            return;
+        list.splice(list.end(), list, itIndex->second.it);
+        itIndex->second.nTime = GetTime();
+        nUsage -= itIndex->second.nUsage;
+        itIndex->second.nUsage = EntryUsage(*itIndex->second.it);
+        nUsage += itIndex->second.nUsage;
+    }
+
+    iterator erase(iterator it)
+    {
+        typename std::unordered_map<K, entry_info, Hash>::iterator itIndex = index.find(it->first);
+        assert(itIndex != index.end());
+        nUsage -= itIndex->second.nUsage;
+        index.erase(itIndex);
+        return list.erase(it);
+    }
+
+    size_type erase(const key_type& k)
+    {
+        typename std::unordered_map<K, entry_info, Hash>::iterator itIndex = index.find(k);
+        if (itIndex == index.end())
+            return 0;
+        nUsage -= itIndex->second.nUsage;
+        list.erase(itIndex->second.it);
+        index.erase(itIndex);
+        return 1;
+    }
+
+    void clear()
+    {
+        list.clear();
+        index.clear();
+        nUsage = 0;
+    }
+
+    /** Drop the entries that expired, without waiting for the next insertion */
+    void expire() { Trim(GetTime()); }
+
+    /** Age every entry from the time fnTime gives for its value (never in the future)
+     *  rather than from its insertion, e.g. once the entries were loaded from disk */
+    template <typename F>
+    void SetTimes(F fnTime)
+    {
+        const int64_t nNow = GetTime();
+        for (auto& x : index)
+            x.second.nTime = std::min(fnTime(x.second.it->second), nNow);
+        list.sort([this](const value_type& a, const value_type& b) {
+            return index.find(a.first)->second.nTime < index.find(b.first)->second.nTime;
+        });
+        Trim(nNow);
+    }
+
+    size_t DynamicMemoryUsage() const { return nUsage + memusage::MallocUsage(sizeof(void*) * index.bucket_count()); }
+    uint64_t GetExpiredCount() const { return nExpired; }
+    uint64_t GetEvictedCount() const { return nEvicted; }
+
+    expiringmap_stats GetStats() const
+    {
+        expiringmap_stats stats;
+        stats.nEntries = size();
+        stats.nUsage = DynamicMemoryUsage();
+        stats.nExpired = nExpired;
+        stats.nEvicted = nEvicted;
+        return stats;
+    }
+
+    // serialized like std::map
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        WriteCompactSize(s, size());
+        for (const value_type& x : list)
+            s << x.first << x.second;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        clear();
+        unsigned int nSize = ReadCompactSize(s);
+        for (unsigned int i = 0; i < nSize; i++) {
+            K k;
+            V v;
+            s >> k >> v;
+            insert(value_type(k, v));
+        }
+    }
+};
+
+#endif // BITCOIN_EXPIRINGMAP_H
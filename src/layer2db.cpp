@@ -0,0 +1,94 @@
+// Copyright (c) 2021-2022 The Studscoin Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "layer2db.h"
+
+#include "chainparams.h"
+#include "protocol.h"
+#include "util.h"
+#include "utiltime.h"
+
+CLayer2DB* pLayer2DB = NULL;
+
+CLayer2DB::CLayer2DB(size_t nCacheSize, bool fMemory, bool fWipe) :
+    CDBWrapper(GetDataDir() / "layer2", nCacheSize, fMemory, fWipe),
+    nPendingWrites(0),
+    nErasedSinceCompaction(0)
+{
+}
+
+CLayer2DB::SectionState CLayer2DB::ReadSectionHeader(const std::string& strSection) const
+{
+    std::vector<unsigned char> vchMessageStart;
+    if (!Read(std::make_pair(DB_L2_SECTION, strSection), vchMessageStart))
+        return SECTION_MISSING;
+
+    const CMessageHeader::MessageStartChars& pchMessageStart = Params().MessageStart();
+    if (vchMessageStart != std::vector<unsigned char>(pchMessageStart, pchMessageStart + MESSAGE_START_SIZE))
+        return SECTION_WRONG_NETWORK;
+
+    return SECTION_OK;
+}
+
+void CLayer2DB::WriteSectionHeader(CDBBatch& batch, const std::string& strSection)
+{
+    const CMessageHeader::MessageStartChars& pchMessageStart = Params().MessageStart();
+    batch.Write(std::make_pair(DB_L2_SECTION, strSection),
+                std::vector<unsigned char>(pchMessageStart, pchMessageStart + MESSAGE_START_SIZE));
+}
+
+void CLayer2DB::EraseMissing(CDBBatch& batch, char chPrefix, const std::set<std::vector<unsigned char> >& setKeys)
+{
+    LOCK(cs);
+    std::map<std::vector<unsigned char>, uint256>& mapHashes = mapFlushed[chPrefix];
+    std::map<std::vector<unsigned char>, uint256>::iterator it = mapHashes.begin();
+    while (it != mapHashes.end()) {
+        if (setKeys.count(it->first)) {
+            ++it;
+            continue;
+        }
+        std::vector<unsigned char> vchKey(it->first);
+        batch.Erase(CFlatData(vchKey));
+        vPendingErased.emplace_back(chPrefix, vchKey);
+        mapHashes.erase(it++);
+    }
+}
+
+bool CLayer2DB::Commit(CDBBatch& batch, const std::string& strSection)
+{
+    LOCK(cs);
+    int64_t nStart = GetTimeMillis();
+    WriteSectionHeader(batch, strSection);
+
+    bool fOk;
+    try {
+        fOk = WriteBatch(batch, true);
+    } catch (const dbwrapper_error& e) {
+        fOk = error("%s : %s", __func__, e.what());
+    }
+
+    if (!fOk) {
+        // we don't know what made it to disk: rewrite everything and retry the erasures next time
+        for (auto& itPrefix : mapFlushed)
+            for (auto& itKey : itPrefix.second)
+                itKey.second.SetNull();
+        for (const auto& itErased : vPendingErased)
+            mapFlushed[itErased.first][itErased.second].SetNull();
+    } else {
+        LogPrint(BCLog::MASTERNODE, "Flushed %s to layer 2 store: %u written, %u erased  %dms\n",
+                 strSection, nPendingWrites, vPendingErased.size(), GetTimeMillis() - nStart);
+        nErasedSinceCompaction += vPendingErased.size();
+    }
+    nPendingWrites = 0;
+    vPendingErased.clear();
+
+    if (fOk && nErasedSinceCompaction >= LAYER2DB_COMPACT_ERASED) {
+        nStart = GetTimeMillis();
+        CompactRange((unsigned char)0x00, (unsigned char)0xff);
+        LogPrint(BCLog::MASTERNODE, "Compacted layer 2 store after %u erasures  %dms\n", nErasedSinceCompaction, GetTimeMillis() - nStart);
+        nErasedSinceCompaction = 0;
+    }
+
+    return fOk;
+}
@@ -0,0 +1,152 @@
+// Copyright (c) 2021-2022 The Studscoin Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LAYER2DB_H
+#define LAYER2DB_H
+
+#include "dbwrapper.h"
+#include "fs.h"
+#include "hash.h"
+#include "sync.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+
+class CLayer2DB;
+
+extern CLayer2DB* pLayer2DB;
+
+//! Erased entries after which the store is compacted on the next flush
+static const unsigned int LAYER2DB_COMPACT_ERASED = 10000;
+
+/** Key prefixes of the layer 2 store */
+static const char DB_L2_SECTION = 'S';
+static const char DB_MN_LIST = 'm';
+static const char DB_MN_DSQ_COUNT = 'd';
+static const char DB_MN_ASKED_US = 'a';
+static const char DB_MN_WE_ASKED = 'w';
+static const char DB_MN_WE_ASKED_ENTRY = 'e';
+static const char DB_MN_SEEN_BROADCAST = 'b';
+static const char DB_MN_SEEN_PING = 'p';
+static const char DB_MNW_VOTES = 'v';
+static const char DB_MNW_BLOCKS = 'k';
+static const char DB_BUDGET_SEEN_PROPOSALS = 'P';
+static const char DB_BUDGET_SEEN_VOTES = 'V';
+static const char DB_BUDGET_SEEN_FINALIZED = 'F';
+static const char DB_BUDGET_SEEN_FINALIZED_VOTES = 'f';
+static const char DB_BUDGET_ORPHAN_VOTES = 'O';
+static const char DB_BUDGET_ORPHAN_FINALIZED_VOTES = 'o';
+static const char DB_BUDGET_PROPOSALS = 'R';
+static const char DB_BUDGET_FINALIZED = 'B';
+
+/** Persistent store of the masternode, payment and budget caches.
+ *  Every cached object lives under its own key, so a flush only writes the
+ *  entries that changed since the previous one and a crash loses at most
+ *  the changes made after the last periodic flush.
+ */
+class CLayer2DB : public CDBWrapper
+{
+public:
+    enum SectionState {
+        SECTION_MISSING,
+        SECTION_OK,
+        SECTION_WRONG_NETWORK
+    };
+
+    CLayer2DB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+private:
+    CLayer2DB(const CLayer2DB&);
+    void operator=(const CLayer2DB&);
+
+    // protects the flush bookkeeping, the periodic flush may race the one at shutdown
+    mutable RecursiveMutex cs;
+    // hash of the value last written under each (serialized) key, by prefix
+    std::map<char, std::map<std::vector<unsigned char>, uint256> > mapFlushed;
+    // entries written and erased by the batch being built
+    unsigned int nPendingWrites;
+    std::vector<std::pair<char, std::vector<unsigned char> > > vPendingErased;
+    // entries erased since the store was last compacted
+    unsigned int nErasedSinceCompaction;
+
+public:
+    /** Check the header written by the last flush of a section */
+    SectionState ReadSectionHeader(const std::string& strSection) const;
+    void WriteSectionHeader(CDBBatch& batch, const std::string& strSection);
+
+    /** Load every entry stored under chPrefix into a map-like container, false if one of them is malformed */
+    template <typename M>
+    bool ReadMap(char chPrefix, M& mapOut)
+    {
+        typedef typename M::key_type K;
+        typedef typename M::mapped_type V;
+
+        LOCK(cs);
+        std::map<std::vector<unsigned char>, uint256>& mapHashes = mapFlushed[chPrefix];
+        boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+        pcursor->Seek(chPrefix);
+        while (pcursor->Valid()) {
+            char chKey;
+            if (!pcursor->GetKey(chKey) || chKey != chPrefix)
+                break;
+            std::pair<char, K> key;
+            V value;
+            if (!pcursor->GetKey(key) || !pcursor->GetValue(value))
+                return false;
+
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            ssKey << key;
+            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            ssValue << value;
+            mapHashes[std::vector<unsigned char>(ssKey.begin(), ssKey.end())] = Hash(ssValue.begin(), ssValue.end());
+
+            mapOut.insert(std::make_pair(key.second, value));
+            pcursor->Next();
+        }
+        return true;
+    }
+
+    /** Queue a write of the entry if it differs from the flushed one, and record its key in setKeys */
+    template <typename K, typename V>
+    void WriteIfChanged(CDBBatch& batch, char chPrefix, const K& key, const V& value, std::set<std::vector<unsigned char> >& setKeys)
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << std::make_pair(chPrefix, key);
+        std::vector<unsigned char> vchKey(ssKey.begin(), ssKey.end());
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        ssValue << value;
+        const uint256 hashValue = Hash(ssValue.begin(), ssValue.end());
+
+        LOCK(cs);
+        uint256& hashFlushed = mapFlushed[chPrefix][vchKey];
+        if (hashFlushed != hashValue) {
+            batch.Write(CFlatData(vchKey), CFlatData(&ssValue[0], &ssValue[0] + ssValue.size()));
+            hashFlushed = hashValue;
+            nPendingWrites++;
+        }
+        setKeys.insert(vchKey);
+    }
+
+    /** Queue the writes and erasures that bring the section chPrefix in line with mapIn */
+    template <typename M>
+    void WriteMap(CDBBatch& batch, char chPrefix, const M& mapIn)
+    {
+        std::set<std::vector<unsigned char> > setKeys;
+        for (const auto& it : mapIn)
+            WriteIfChanged(batch, chPrefix, it.first, it.second, setKeys);
+        EraseMissing(batch, chPrefix, setKeys);
+    }
+
+    /** Queue the erasure of every flushed entry of chPrefix not listed in setKeys */
+    void EraseMissing(CDBBatch& batch, char chPrefix, const std::set<std::vector<unsigned char> >& setKeys);
+
+    /** Atomically apply a flush, compacting the store once enough entries were erased */
+    bool Commit(CDBBatch& batch, const std::string& strSection);
+};
+
+#endif // LAYER2DB_H
@@ -10,10 +10,9 @@ namespace libzerocoin {
 CoinRandomnessSchnorrSignature::CoinRandomnessSchnorrSignature(
         const ZerocoinParams* zcparams, const CBigNum randomness, const uint256 msghash)
 {
-    const CBigNum p = zcparams->coinCommitmentGroup.modulus;
-    const CBigNum q = zcparams->coinCommitmentGroup.groupOrder;
-    const CBigNum h = zcparams->coinCommitmentGroup.h;
-    const CBigNum pk = h.pow_mod(randomness, p);
+    const IntegerGroupParams& group = zcparams->coinCommitmentGroup;
+    const CBigNum q = group.groupOrder;
+    const CBigNum pk = group.pow_h(randomness);
 
     alpha = 0;
     beta = 0;
@@ -23,7 +22,7 @@ CoinRandomnessSchnorrSignature::CoinRandomnessSchnorrSignature(
     while (!alpha || !beta) {
         // select random nonce k in Zq and let r = h^k mod p
         k = CBigNum::randBignum(q);
-        r = h.pow_mod(k, p);
+        r = group.pow_h(k);
 
         // challenge hash
         CHashWriter hasher(0,0);
@@ -37,10 +36,9 @@ CoinRandomnessSchnorrSignature::CoinRandomnessSchnorrSignature(
 bool CoinRandomnessSchnorrSignature::Verify(
         const ZerocoinParams* zcparams, const CBigNum& S, const CBigNum& C, const uint256 msghash) const
 {
-    const CBigNum p = zcparams->coinCommitmentGroup.modulus;
-    const CBigNum q = zcparams->coinCommitmentGroup.groupOrder;
-    const CBigNum h = zcparams->coinCommitmentGroup.h;
-    const CBigNum g = zcparams->coinCommitmentGroup.g;
+    const IntegerGroupParams& group = zcparams->coinCommitmentGroup;
+    const CBigNum p = group.modulus;
+    const CBigNum q = group.groupOrder;
 
     // Params validation.
     if (!IsValidSerial(zcparams, S)) return error("%s: Invalid serial range", __func__);
@@ -48,10 +46,10 @@ bool CoinRandomnessSchnorrSignature::Verify(
     if (beta < BN_ZERO || beta >= q) return error("%s: beta out of range", __func__);
 
     // Schnorr public key computation.
-    const CBigNum pk = C.mul_mod(g.pow_mod(-S,p),p);
+    const CBigNum pk = C.mul_mod(group.pow_g(-S),p);
 
     // Signature verification.
-    const CBigNum rv = (pk.pow_mod(alpha,p)).mul_mod(h.pow_mod(beta,p),p);
+    const CBigNum rv = (pk.pow_mod(alpha,p)).mul_mod(group.pow_h(beta),p);
     CHashWriter hasher(0,0);
     hasher << *zcparams << pk << rv << msghash;
 
@@ -37,8 +37,8 @@ public:
                 randomness(bnRandomness),
                 contents(bnSerial)
     {
-        this->commitmentValue = (params->g.pow_mod(this->contents, params->modulus).mul_mod(
-                                 params->h.pow_mod(this->randomness, params->modulus), params->modulus));
+        this->commitmentValue = (params->pow_g(this->contents).mul_mod(
+                                 params->pow_h(this->randomness), params->modulus));
     }
 
     Commitment(const IntegerGroupParams* p, const CBigNum& value):
@@ -25,6 +25,7 @@ ZerocoinParams::ZerocoinParams(CBigNum N, uint32_t securityLevel) {
 
     // Generate the parameters
     CalculateParams(*this, N, ZEROCOIN_PROTOCOL_VERSION, securityLevel);
+    this->coinCommitmentGroup.precomputeBases();
 
     this->accumulatorParams.initialized = true;
     this->initialized = true;
@@ -42,7 +43,22 @@ CBigNum IntegerGroupParams::randomElement() const {
     // The generator of the group raised
     // to a random number less than the order of the group
     // provides us with a uniformly distributed random number.
-    return this->g.pow_mod(CBigNum::randBignum(this->groupOrder),this->modulus);
+    return pow_g(CBigNum::randBignum(this->groupOrder));
+}
+
+void IntegerGroupParams::precomputeBases() {
+    // exponents are reduced mod the order, but some callers use raw 256 bit hashes
+    const unsigned int nMaxBits = std::max(this->groupOrder.bitSize(), 256);
+    this->gPowers = std::make_shared<const CBigNumFixedBase>(this->g, this->modulus, nMaxBits);
+    this->hPowers = std::make_shared<const CBigNumFixedBase>(this->h, this->modulus, nMaxBits);
+}
+
+CBigNum IntegerGroupParams::pow_g(const CBigNum& e) const {
+    return this->gPowers ? this->gPowers->pow_mod(e) : this->g.pow_mod(e, this->modulus);
+}
+
+CBigNum IntegerGroupParams::pow_h(const CBigNum& e) const {
+    return this->hPowers ? this->hPowers->pow_mod(e) : this->h.pow_mod(e, this->modulus);
 }
 
 } /* namespace libzerocoin */
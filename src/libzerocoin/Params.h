@@ -17,6 +17,8 @@
 #include "bignum.h"
 #include "ZerocoinDefines.h"
 
+#include <memory>
+
 namespace libzerocoin {
 
 class IntegerGroupParams {
@@ -32,6 +34,23 @@ public:
 	 * @return a random element in the group.
 	 */
 	CBigNum randomElement() const;
+
+	/**
+	 * Precomputes the powers of both generators, so that
+	 * pow_g and pow_h don't need any squaring.
+	 */
+	void precomputeBases();
+
+	/**
+	 * g^e mod modulus
+	 */
+	CBigNum pow_g(const CBigNum& e) const;
+
+	/**
+	 * h^e mod modulus
+	 */
+	CBigNum pow_h(const CBigNum& e) const;
+
 	bool initialized;
 
 	/**
@@ -63,7 +82,16 @@ public:
 		    READWRITE(h);
 		    READWRITE(modulus);
 		    READWRITE(groupOrder);
+		    if (ser_action.ForRead()) {
+		        gPowers.reset();
+		        hPowers.reset();
+		    }
 	}	
+
+private:
+	// shared between copies, the bases never change once computed
+	std::shared_ptr<const CBigNumFixedBase> gPowers;
+	std::shared_ptr<const CBigNumFixedBase> hPowers;
 };
 
 class AccumulatorAndProofParams {
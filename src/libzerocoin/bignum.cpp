@@ -62,3 +62,50 @@ const CBigNum CBigNum::operator--(int)
     --(*this);
     return ret;
 }
+
+CBigNumFixedBase::CBigNumFixedBase(const CBigNum& baseIn, const CBigNum& modulusIn, unsigned int nMaxBitsIn, unsigned int nWindowIn) :
+    base(baseIn % modulusIn),
+    modulus(modulusIn),
+    nWindow(nWindowIn),
+    nMaxBits(nMaxBitsIn)
+{
+    if (nWindow < 1 || nWindow > 8)
+        throw bignum_error("CBigNumFixedBase : window out of range");
+
+    const unsigned int nRows = (nMaxBits + nWindow - 1) / nWindow;
+    const unsigned int nCols = 1 << nWindow;
+    vTable.reserve(nRows * nCols);
+
+    // base^(2^(w*i)), the generator of row i
+    CBigNum rowBase = base;
+    for (unsigned int i = 0; i < nRows; i++) {
+        CBigNum x = BN_ONE;
+        for (unsigned int j = 0; j < nCols; j++) {
+            vTable.push_back(x);
+            x = x.mul_mod(rowBase, modulus);
+        }
+        rowBase = x;
+    }
+}
+
+CBigNum CBigNumFixedBase::pow_mod(const CBigNum& e) const
+{
+    if (e < BN_ZERO) {
+        // g^-x = (g^x)^-1
+        return pow_mod(-e).inverse(modulus);
+    }
+    if (e.bitSize() > (int)nMaxBits)
+        return base.pow_mod(e, modulus);
+
+    const unsigned int nRows = (nMaxBits + nWindow - 1) / nWindow;
+    const unsigned int nCols = 1 << nWindow;
+    CBigNum ret = BN_ONE;
+    for (unsigned int i = 0; i < nRows; i++) {
+        unsigned int nDigit = 0;
+        for (unsigned int j = 0; j < nWindow; j++)
+            nDigit |= (unsigned int)e.testBit(i * nWindow + j) << j;
+        if (nDigit)
+            ret = ret.mul_mod(vTable[i * nCols + nDigit], modulus);
+    }
+    return ret;
+}
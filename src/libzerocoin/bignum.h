@@ -82,6 +82,13 @@ public:
      * @return the size
      */
     int bitSize() const;
+
+    /**Tests a bit of the underlying bignum.
+     *
+     * @param n the position of the bit, 0 being the least significant
+     * @return true if the bit is set
+     */
+    bool testBit(unsigned int n) const;
     void setulong(unsigned long n);
     unsigned long getulong() const;
     unsigned int getuint() const;
@@ -349,4 +356,39 @@ const CBigNum BN_ONE = CBigNum(1);
 const CBigNum BN_TWO = CBigNum(2);
 const CBigNum BN_THREE = CBigNum(3);
 
+/** Precomputed powers of a fixed base, for the exponentiations with group generators.
+ *  Row i of the table holds base^(j * 2^(w*i)) for every w bit digit j, so base^e
+ *  is the product of one entry per digit of e, without any squaring.
+ *  Only built with CBigNum arithmetic, so it works the same with both backends.
+ *  Note the table lookups depend on the digits of the exponent.
+ */
+class CBigNumFixedBase
+{
+private:
+    CBigNum base;
+    CBigNum modulus;
+    unsigned int nWindow;
+    unsigned int nMaxBits;
+    std::vector<CBigNum> vTable;
+
+public:
+    /**
+     * @param[in] baseIn      the fixed base
+     * @param[in] modulusIn   the modulus
+     * @param[in] nMaxBitsIn  the widest exponent the table covers
+     * @param[in] nWindowIn   bits of the exponent per row of the table
+     */
+    CBigNumFixedBase(const CBigNum& baseIn, const CBigNum& modulusIn, unsigned int nMaxBitsIn, unsigned int nWindowIn = 5);
+
+    /**
+     * modular exponentiation: base^e mod m
+     * Falls back to CBigNum::pow_mod for exponents wider than the table.
+     * @param e exponent
+     */
+    CBigNum pow_mod(const CBigNum& e) const;
+
+    const CBigNum& getBase() const { return base; }
+    size_t size() const { return vTable.size(); }
+};
+
 #endif
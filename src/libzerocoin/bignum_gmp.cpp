@@ -99,6 +99,11 @@ int CBigNum::bitSize() const
     return  mpz_sizeinbase(bn, 2);
 }
 
+bool CBigNum::testBit(unsigned int n) const
+{
+    return mpz_tstbit(bn, n);
+}
+
 void CBigNum::setulong(unsigned long n)
 {
     mpz_set_ui(bn, n);
@@ -13,6 +13,7 @@
 
 #include "addrman.h"
 #include "amount.h"
+#include "blockencodings.h"
 #include "blocksignature.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -102,6 +103,9 @@ size_t nCoinCacheUsage = 5000 * 300;
 /* If the tip is older than this (in seconds), the node is considered to be in initial block download. */
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 
+/* Average delay (in seconds) between the transaction announcements to a peer. */
+int64_t nInvBroadcastInterval = AVG_INVENTORY_BROADCAST_INTERVAL;
+
 /** Fees smaller than this (in uSTUDS) are considered zero fee (for relaying, mining and transaction creation)
  * We are ~100 times smaller then bitcoin now (2015-06-23), set minRelayTxFee only 10 times higher
  * so it's still 10 times lower comparing to bitcoin.
@@ -216,9 +220,40 @@ struct QueuedBlock {
 };
 std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
+/** Peers asked to announce new blocks as cmpctblock, the last one to deliver a new tip at the back. Protected by cs_main. */
+static const unsigned int MAX_CMPCTBLOCK_HB_PEERS = 3;
+std::list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
 /** Number of blocks in flight with validated headers. */
 int nQueuedValidatedHeaders = 0;
 
+/** Blocks announced by getblocks results, in chain order, spread over the download windows of the
+ *  peers that announced them. Heights are estimated from the order of the announcements. Protected by cs_main. */
+struct QueuedDownload {
+    uint256 hash;
+    int nHeight;
+    int64_t nTime;
+};
+std::deque<QueuedDownload> dqBlocksToDownload;
+//! The hashes still to be received and the peers that announced them, entries of dqBlocksToDownload that aren't in there anymore are stale.
+std::map<uint256, std::set<NodeId> > mapBlocksToDownload;
+//! The peer that sent the last getblocks result, and whether there may be more after it.
+NodeId nodeBlocksAnnouncer = -1;
+bool fBlocksAnnouncerHasMore = false;
+//! The last announced block the peers are asked for the next ones after.
+uint256 hashBlocksContinuation;
+
+/** Blocks received out of order from different peers, by parent hash. Protected by cs_main. */
+struct BlockAwaitingParent {
+    NodeId nodeid;
+    int64_t nTime;
+    size_t nSize;
+    std::shared_ptr<const CBlock> pblock;
+};
+std::multimap<uint256, BlockAwaitingParent> mapBlocksAwaitingParent;
+std::set<uint256> setBlocksAwaitingParent;
+size_t nBlocksAwaitingParentSize = 0;
+
 /** Number of preferable block download peers. */
 int nPreferredDownload = 0;
 
@@ -344,6 +379,8 @@ struct CNodeState {
     uint256 hashLastUnknownBlock;
     //! The last full block we both have.
     CBlockIndex* pindexLastCommonBlock;
+    //! The best header we have sent our peer.
+    CBlockIndex* pindexBestHeaderSent;
     //! Whether we've started headers synchronization with this peer.
     bool fSyncStarted;
     //! Since when we're stalling block download progress (in microseconds), or 0.
@@ -352,6 +389,33 @@ struct CNodeState {
     int nBlocksInFlight;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Whether we've announced new blocks to this peer with headers rather than inv.
+    bool fPreferHeaders;
+    //! Blocks this peer may have in flight at once, sized from the measurements below.
+    int nDownloadWindow;
+    //! Blocks received from this peer that we asked it for, and their size.
+    uint64_t nBlocksDownloaded;
+    uint64_t nBytesDownloaded;
+    //! Moving averages of the time from a block request to its receipt (in microseconds), of the time
+    //! taken by the transfer of a block (in microseconds), and of the transfer rate (in bytes per second).
+    int64_t nAvgBlockLatency;
+    int64_t nAvgBlockInterval;
+    int64_t nDownloadRate;
+    //! When the last block we asked for was received from this peer (in microseconds), or 0.
+    int64_t nLastBlockReceived;
+    //! Blocks stuck at this peer that were asked from a faster one.
+    uint64_t nBlocksReassigned;
+    //! When the getblocks sent to this peer that has no result yet was sent (in seconds), or 0. Only its result
+    //! may announce more than MAX_BLOCKS_TO_ANNOUNCE blocks, for up to GETBLOCKS_RESULT_TIMEOUT seconds.
+    int64_t nGetBlocksSent;
+    //! The last announced block this peer was asked for the next ones after.
+    uint256 hashBlocksAsked;
+    //! Whether this peer wants new blocks announced as cmpctblock rather than inv.
+    bool fPreferHeaderAndIDs;
+    //! Whether this peer will send us cmpctblocks if we request them.
+    bool fProvidesHeaderAndIDs;
+    //! The block of the last cmpctblock from this peer, waiting for its missing transactions.
+    std::unique_ptr<PartiallyDownloadedBlock> partialBlock;
 
     CNodeBlocks nodeBlocks;
 
@@ -362,10 +426,24 @@ struct CNodeState {
         pindexBestKnownBlock = NULL;
         hashLastUnknownBlock.SetNull();
         pindexLastCommonBlock = NULL;
+        pindexBestHeaderSent = NULL;
         fSyncStarted = false;
         nStallingSince = 0;
         nBlocksInFlight = 0;
         fPreferredDownload = false;
+        nDownloadWindow = MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+        nBlocksDownloaded = 0;
+        nBytesDownloaded = 0;
+        nAvgBlockLatency = 0;
+        nAvgBlockInterval = 0;
+        nDownloadRate = 0;
+        nLastBlockReceived = 0;
+        nBlocksReassigned = 0;
+        nGetBlocksSent = 0;
+        hashBlocksAsked.SetNull();
+        fPreferHeaders = false;
+        fPreferHeaderAndIDs = false;
+        fProvidesHeaderAndIDs = false;
     }
 };
 
@@ -440,19 +518,59 @@ void FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTime)
         mapBlocksInFlight.erase(entry.hash);
     EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
+    lNodesAnnouncingHeaderAndIDs.remove(nodeid);
+    // Any peer may ask for the rest of the chain now
+    if (nodeBlocksAnnouncer == nodeid)
+        nodeBlocksAnnouncer = -1;
+    // and the blocks only this peer announced won't be downloaded anymore
+    for (std::map<uint256, std::set<NodeId> >::iterator it = mapBlocksToDownload.begin(); it != mapBlocksToDownload.end();) {
+        it->second.erase(nodeid);
+        if (it->second.empty())
+            it = mapBlocksToDownload.erase(it);
+        else
+            it++;
+    }
 
     mapNodeState.erase(nodeid);
 }
 
+/** Measure the block download from a peer, and size its download window from it. Requires cs_main. */
+void UpdateBlockDownloadStats(CNodeState* state, const QueuedBlock& queued, unsigned int nBlockSize, int64_t nNow)
+{
+    const int64_t nLatency = std::max<int64_t>(nNow - queued.nTime, 1);
+    // A peer sends the blocks we asked for one after the other: the transfer of this one
+    // started when it was asked for, or when the previous one was received
+    const int64_t nInterval = std::max<int64_t>(nNow - std::max(queued.nTime, state->nLastBlockReceived), 1);
+    const int64_t nRate = (int64_t)nBlockSize * 1000000 / nInterval;
+    if (state->nBlocksDownloaded == 0) {
+        state->nAvgBlockLatency = nLatency;
+        state->nAvgBlockInterval = nInterval;
+        state->nDownloadRate = nRate;
+    } else {
+        state->nAvgBlockLatency += (nLatency - state->nAvgBlockLatency) / 8;
+        state->nAvgBlockInterval += (nInterval - state->nAvgBlockInterval) / 8;
+        state->nDownloadRate += (nRate - state->nDownloadRate) / 8;
+    }
+    state->nBlocksDownloaded++;
+    state->nBytesDownloaded += nBlockSize;
+    state->nLastBlockReceived = nNow;
+    state->nDownloadWindow = std::max<int64_t>(BLOCK_DOWNLOAD_WINDOW_MIN, std::min<int64_t>(BLOCK_DOWNLOAD_WINDOW_MAX,
+                                 BLOCK_DOWNLOAD_TARGET_TIME * 1000000 / std::max<int64_t>(state->nAvgBlockInterval, 1)));
+}
+
 // Requires cs_main.
-void MarkBlockAsReceived(const uint256& hash)
+void MarkBlockAsReceived(const uint256& hash, NodeId nodeFrom = -1, unsigned int nBlockSize = 0)
 {
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
     if (itInFlight != mapBlocksInFlight.end()) {
         CNodeState* state = State(itInFlight->second.first);
+        if (nBlockSize > 0 && itInFlight->second.first == nodeFrom)
+            UpdateBlockDownloadStats(state, *itInFlight->second.second, nBlockSize, GetTimeMicros());
         nQueuedValidatedHeaders -= itInFlight->second.second->fValidatedHeaders;
         state->vBlocksInFlight.erase(itInFlight->second.second);
         state->nBlocksInFlight--;
+        if (state->partialBlock && state->partialBlock->header.GetHash() == hash)
+            state->partialBlock.reset();
         state->nStallingSince = 0;
         mapBlocksInFlight.erase(itInFlight);
     }
@@ -509,6 +627,21 @@ void UpdateBlockAvailability(NodeId nodeid, const uint256& hash)
     }
 }
 
+bool HasHeader(const CBlockIndex* pindexBestKnown, const CBlockIndex* pindexBestSent, const CBlockIndex* pindex)
+{
+    if (pindexBestKnown && pindex == pindexBestKnown->GetAncestor(pindex->nHeight))
+        return true;
+    if (pindexBestSent && pindex == pindexBestSent->GetAncestor(pindex->nHeight))
+        return true;
+    return false;
+}
+
+// Requires cs_main
+bool PeerHasHeader(CNodeState* state, CBlockIndex* pindex)
+{
+    return HasHeader(state->pindexBestKnownBlock, state->pindexBestHeaderSent, pindex);
+}
+
 /** Find the last common ancestor two blocks have.
  *  Both pa and pb must be non-NULL. */
 CBlockIndex* LastCommonAncestor(CBlockIndex* pa, CBlockIndex* pb)
@@ -613,8 +746,213 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
     }
 }
 
+/** Send a getblocks to a peer, whose result may then announce up to MAX_GETBLOCKS_RESULTS blocks. Only one
+ *  result is expected at a time, within GETBLOCKS_RESULT_TIMEOUT seconds. */
+void PushGetBlocks(CNode* pto, CConnman& connman, const CBlockLocator& locator, const uint256& hashStop)
+{
+    {
+        LOCK(cs_main);
+        CNodeState* state = State(pto->GetId());
+        if (state != NULL)
+            state->nGetBlocksSent = GetTime();
+    }
+    connman.PushMessage(pto, CNetMsgMaker(pto->GetSendVersion()).Make(NetMsgType::GETBLOCKS, locator, hashStop));
+}
+
+/** Drop the entries at the front of the download queue that were received, or that were queued
+ *  BLOCK_DOWNLOAD_EXPIRY ago and aren't in flight. Requires cs_main. */
+void PruneBlocksToDownload()
+{
+    const int64_t nExpired = GetTime() - BLOCK_DOWNLOAD_EXPIRY;
+    while (!dqBlocksToDownload.empty()) {
+        const QueuedDownload& front = dqBlocksToDownload.front();
+        if (mapBlocksToDownload.count(front.hash)) {
+            if (front.nTime > nExpired || mapBlocksInFlight.count(front.hash))
+                break;
+            LogPrint(BCLog::NET, "Block %s (%d) expired from the download queue\n", front.hash.ToString(), front.nHeight);
+            mapBlocksToDownload.erase(front.hash);
+        }
+        dqBlocksToDownload.pop_front();
+    }
+}
+
+/** Queue the blocks of a getblocks result for download from the peer that sent it. Requires cs_main. */
+void QueueBlocksToDownload(NodeId nodeid, const std::vector<uint256>& vHashes, bool fHasMore)
+{
+    PruneBlocksToDownload();
+    if (dqBlocksToDownload.empty()) {
+        // A new batch following our tip, the other peers get asked for it too
+        hashBlocksContinuation = chainActive.Tip()->GetBlockHash();
+        State(nodeid)->hashBlocksAsked = hashBlocksContinuation;
+    }
+
+    const int64_t nNow = GetTime();
+    int nHeight = dqBlocksToDownload.empty() ? chainActive.Height() : dqBlocksToDownload.back().nHeight;
+    bool fFull = false;
+    for (const uint256& hash : vHashes) {
+        std::map<uint256, std::set<NodeId> >::iterator it = mapBlocksToDownload.find(hash);
+        if (it == mapBlocksToDownload.end()) {
+            // Past a block that didn't fit, the order of the queue would be broken
+            if (fFull || mapBlocksToDownload.size() >= MAX_BLOCKS_TO_DOWNLOAD) {
+                fFull = true;
+                continue;
+            }
+            it = mapBlocksToDownload.emplace(hash, std::set<NodeId>()).first;
+            dqBlocksToDownload.push_back({hash, ++nHeight, nNow});
+        }
+        it->second.insert(nodeid);
+    }
+    nodeBlocksAnnouncer = nodeid;
+    fBlocksAnnouncerHasMore = fHasMore && !fFull;
+}
+
+/** Fill the download window of a peer from the queued blocks it announced, first taking over the
+ *  ones that are stuck at a slower peer. Requires cs_main. */
+void ScheduleBlockDownloads(CNode* pto, CNodeState& state, std::vector<CInv>& vGetData, int64_t nNow)
+{
+    PruneBlocksToDownload();
+    if (dqBlocksToDownload.empty())
+        return;
+
+    const NodeId nodeid = pto->GetId();
+    // Blocks beyond the next one to connect would only be dropped while there's no room to keep them
+    const bool fRoomAwaitingParent = nBlocksAwaitingParentSize + MAX_BLOCK_SIZE_CURRENT <= MAX_BLOCKS_AWAITING_PARENT_SIZE;
+    int nScanned = 0;
+    for (std::deque<QueuedDownload>::iterator it = dqBlocksToDownload.begin(); it != dqBlocksToDownload.end(); it++) {
+        if (state.nBlocksInFlight >= state.nDownloadWindow)
+            break;
+        if (!fRoomAwaitingParent && it != dqBlocksToDownload.begin())
+            break;
+        // Only a peer that announced a block is known to have it
+        std::map<uint256, std::set<NodeId> >::const_iterator itQueued = mapBlocksToDownload.find(it->hash);
+        if (itQueued == mapBlocksToDownload.end() || !itQueued->second.count(nodeid) || setBlocksAwaitingParent.count(it->hash))
+            continue;
+
+        std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(it->hash);
+        if (itInFlight != mapBlocksInFlight.end()) {
+            // Only the blocks the chain is waiting for are worth asking twice
+            if (itInFlight->second.first == nodeid || ++nScanned > BLOCK_DOWNLOAD_WINDOW_MAX || state.nBlocksDownloaded == 0)
+                continue;
+            CNodeState* stateSlow = State(itInFlight->second.first);
+            const int64_t nWaiting = nNow - itInFlight->second.second->nTime;
+            const int64_t nTimeout = std::max(BLOCK_STUCK_TIMEOUT * 1000000, 4 * stateSlow->nAvgBlockLatency);
+            const bool fFaster = stateSlow->nBlocksDownloaded == 0 || state.nAvgBlockInterval < stateSlow->nAvgBlockInterval;
+            if (nWaiting < nTimeout || (!fFaster && nWaiting < 2 * nTimeout))
+                continue;
+
+            LogPrint(BCLog::NET, "Block %s is stuck at peer=%d for %d ms, asking peer=%d\n", it->hash.ToString(),
+                     itInFlight->second.first, nWaiting / 1000, nodeid);
+            stateSlow->nDownloadWindow = std::max(BLOCK_DOWNLOAD_WINDOW_MIN, stateSlow->nDownloadWindow / 2);
+            stateSlow->nBlocksReassigned++;
+        }
+
+        vGetData.push_back(CInv(MSG_BLOCK, it->hash));
+        MarkBlockAsInFlight(nodeid, it->hash);
+    }
+}
+
+/** Ask the peer that sent the last getblocks result for the next one before the download runs dry,
+ *  and every other peer that may have them for the same blocks, so that it can be asked for them too. Requires cs_main. */
+void MaybeRequestMoreBlocks(CNode* pto, CNodeState& state, CConnman& connman)
+{
+    if (dqBlocksToDownload.empty() || pto->nStartingHeight <= chainActive.Height())
+        return;
+    if ((nodeBlocksAnnouncer == -1 || pto->GetId() == nodeBlocksAnnouncer) && fBlocksAnnouncerHasMore &&
+        mapBlocksToDownload.size() < BLOCK_DOWNLOAD_REFILL)
+        hashBlocksContinuation = dqBlocksToDownload.back().hash;
+    if (hashBlocksContinuation.IsNull() || state.hashBlocksAsked == hashBlocksContinuation)
+        return;
+
+    state.hashBlocksAsked = hashBlocksContinuation;
+    CBlockLocator locator = chainActive.GetLocator();
+    locator.vHave.insert(locator.vHave.begin(), hashBlocksContinuation);
+    LogPrint(BCLog::NET, "getblocks after %s to peer=%d\n", hashBlocksContinuation.ToString(), pto->id);
+    PushGetBlocks(pto, connman, locator, UINT256_ZERO);
+}
+
+/** Keep a block we asked for that arrived before its parent, from another peer. Requires cs_main. */
+bool StashBlockAwaitingParent(NodeId nodeid, const CBlock& block)
+{
+    const uint256 hash = block.GetHash();
+    if (!mapBlocksToDownload.count(hash) || setBlocksAwaitingParent.count(hash))
+        return false;
+
+    const int64_t nNow = GetTime();
+    for (std::multimap<uint256, BlockAwaitingParent>::iterator it = mapBlocksAwaitingParent.begin(); it != mapBlocksAwaitingParent.end();) {
+        if (it->second.nTime < nNow - BLOCK_AWAITING_PARENT_EXPIRY) {
+            nBlocksAwaitingParentSize -= it->second.nSize;
+            setBlocksAwaitingParent.erase(it->second.pblock->GetHash());
+            it = mapBlocksAwaitingParent.erase(it);
+        } else
+            it++;
+    }
+
+    const size_t nSize = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+    MarkBlockAsReceived(hash, nodeid, nSize);
+    if (nBlocksAwaitingParentSize + nSize > MAX_BLOCKS_AWAITING_PARENT_SIZE) {
+        // It will be asked for again once the chain caught up
+        LogPrint(BCLog::NET, "%s : no room for block %s from peer=%d\n", __func__, hash.ToString(), nodeid);
+        return true;
+    }
+    BlockAwaitingParent entry = {nodeid, nNow, nSize, std::make_shared<const CBlock>(block)};
+    mapBlocksAwaitingParent.emplace(block.hashPrevBlock, entry);
+    setBlocksAwaitingParent.insert(hash);
+    nBlocksAwaitingParentSize += nSize;
+    return true;
+}
+
 } // anon namespace
 
+bool FindHeadersToAnnounce(const CChain& chain, const std::vector<CBlockIndex*>& vToAnnounce, const CBlockIndex* pindexBestKnown,
+                           const CBlockIndex* pindexBestSent, std::vector<CBlockIndex*>& vHeaders)
+{
+    if (vToAnnounce.size() > MAX_BLOCKS_TO_ANNOUNCE)
+        return false;
+
+    bool fFoundStartingHeader = false;
+    CBlockIndex* pBestIndex = NULL;
+    // Try to find first header that our peer doesn't have, and
+    // then send all headers past that one. If we come across any
+    // headers that aren't on the chain, give up.
+    for (CBlockIndex* pindex : vToAnnounce) {
+        if (chain[pindex->nHeight] != pindex) {
+            // Bail out if we reorged away from this block
+            return false;
+        }
+        if (pBestIndex != NULL && pindex->pprev != pBestIndex) {
+            // This means that the list of blocks to announce don't
+            // connect to each other.
+            // This shouldn't really be possible to hit during
+            // regular operation (because reorgs should take us to
+            // a chain that has some block not on the prior chain,
+            // which should be caught by the prior check), but one
+            // way this could happen is by using invalidateblock /
+            // reconsiderblock repeatedly on the tip, causing it to
+            // be added multiple times to vBlockHashesToAnnounce.
+            // Robustly deal with this rare situation by reverting
+            // to an inv.
+            return false;
+        }
+        pBestIndex = pindex;
+        if (fFoundStartingHeader) {
+            // add this to the headers message
+            vHeaders.push_back(pindex);
+        } else if (HasHeader(pindexBestKnown, pindexBestSent, pindex)) {
+            continue; // keep looking for the first new block
+        } else if (pindex->pprev == NULL || HasHeader(pindexBestKnown, pindexBestSent, pindex->pprev)) {
+            // Peer doesn't have this header but they do have the prior one.
+            // Start sending headers.
+            fFoundStartingHeader = true;
+            vHeaders.push_back(pindex);
+        } else {
+            // Peer doesn't have this header or the prior one -- nothing will
+            // connect, so bail out.
+            return false;
+        }
+    }
+    return true;
+}
+
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats)
 {
     LOCK(cs_main);
@@ -628,6 +966,16 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats)
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.nBlocksInFlight = state->nBlocksInFlight;
+    stats.nDownloadWindow = state->nDownloadWindow;
+    stats.nBlocksDownloaded = state->nBlocksDownloaded;
+    stats.nBytesDownloaded = state->nBytesDownloaded;
+    stats.nAvgBlockLatency = state->nAvgBlockLatency;
+    stats.nDownloadRate = state->nDownloadRate;
+    stats.nBlocksReassigned = state->nBlocksReassigned;
+    stats.nBlocksAnnounced = 0;
+    for (const std::pair<const uint256, std::set<NodeId> >& entry : mapBlocksToDownload)
+        stats.nBlocksAnnounced += entry.second.count(nodeid);
     return true;
 }
 
@@ -635,6 +983,7 @@ void RegisterNodeSignals(CNodeSignals& nodeSignals)
 {
     nodeSignals.ProcessMessages.connect(&ProcessMessages);
     nodeSignals.SendMessages.connect(&SendMessages);
+    nodeSignals.ProcessOffloadedMessage.connect(&ProcessMasternodeMessage);
     nodeSignals.InitializeNode.connect(&InitializeNode);
     nodeSignals.FinalizeNode.connect(&FinalizeNode);
 }
@@ -643,6 +992,7 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals)
 {
     nodeSignals.ProcessMessages.disconnect(&ProcessMessages);
     nodeSignals.SendMessages.disconnect(&SendMessages);
+    nodeSignals.ProcessOffloadedMessage.disconnect(&ProcessMasternodeMessage);
     nodeSignals.InitializeNode.disconnect(&InitializeNode);
     nodeSignals.FinalizeNode.disconnect(&FinalizeNode);
 }
@@ -833,7 +1183,7 @@ std::string FormatStateMessage(const CValidationState &state)
 }
 
 bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                              bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool ignoreFees,
+                              bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool ignoreFees,
                               std::vector<COutPoint>& coins_to_uncache)
 {
     AssertLockHeld(cs_main);
@@ -1005,7 +1355,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
             }
         }
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainHeight, pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbaseOrCoinstake, nSigOps);
+        CTxMemPoolEntry entry(tx, nFees, nAcceptTime, dPriority, chainHeight, pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbaseOrCoinstake, nSigOps);
         unsigned int nSize = entry.GetTxSize();
 
         // Don't accept it if it can't get into a block
@@ -1117,11 +1467,11 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
     return true;
 }
 
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool fIgnoreFees)
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                                bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool fIgnoreFees)
 {
     std::vector<COutPoint> coins_to_uncache;
-    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, fOverrideMempoolLimit, fRejectAbsurdFee, fIgnoreFees, coins_to_uncache);
+    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, fOverrideMempoolLimit, fRejectAbsurdFee, fIgnoreFees, coins_to_uncache);
     if (!res) {
         for (const COutPoint& outpoint: coins_to_uncache)
             pcoinsTip->Uncache(outpoint);
@@ -1129,6 +1479,12 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return res;
 }
 
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                        bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool fIgnoreFees)
+{
+    return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), fOverrideMempoolLimit, fRejectAbsurdFee, fIgnoreFees);
+}
+
 bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool isDSTX)
 {
     AssertLockHeld(cs_main);
@@ -1458,6 +1814,74 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
     return true;
 }
 
+CRawBlockReader::~CRawBlockReader()
+{
+    if (file)
+        fclose(file);
+}
+
+void CRawBlockReader::Prefetch(std::vector<CDiskBlockPos> vPos)
+{
+    std::sort(vPos.begin(), vPos.end(), [](const CDiskBlockPos& a, const CDiskBlockPos& b) {
+        return a.nFile < b.nFile || (a.nFile == b.nFile && a.nPos < b.nPos);
+    });
+    // one read ahead per file, from the first block to the last
+    for (size_t i = 0; i < vPos.size();) {
+        size_t j = i;
+        while (j + 1 < vPos.size() && vPos[j + 1].nFile == vPos[i].nFile)
+            j++;
+        const unsigned int nStart = vPos[i].nPos - std::min(vPos[i].nPos, 8U);
+        const unsigned int nLength = vPos[j].nPos - nStart + BLOCK_READ_AHEAD_TAIL;
+        if (vPos[i].nFile != nFile) {
+            FILE* fileAhead = OpenBlockFile(CDiskBlockPos(vPos[i].nFile, 0), true);
+            if (fileAhead) {
+                ReadAheadFileRange(fileAhead, nStart, nLength);
+                fclose(fileAhead);
+            }
+        } else
+            ReadAheadFileRange(file, nStart, nLength);
+        i = j + 1;
+    }
+}
+
+bool CRawBlockReader::Read(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos)
+{
+    if (pos.IsNull() || pos.nPos < 8)
+        return error("%s : invalid block position %d:%u", __func__, pos.nFile, pos.nPos);
+    if (pos.nFile != nFile) {
+        if (file)
+            fclose(file);
+        nFile = -1;
+        file = OpenBlockFile(CDiskBlockPos(pos.nFile, 0), true);
+        if (!file)
+            return error("%s : OpenBlockFile failed for %d:%u", __func__, pos.nFile, pos.nPos);
+        nFile = pos.nFile;
+        nFilePos = 0;
+    }
+    // the block is preceded by the message start and its size
+    if (nFilePos != pos.nPos - 8) {
+        if (fseek(file, pos.nPos - 8, SEEK_SET))
+            return error("%s : fseek failed for %d:%u", __func__, pos.nFile, pos.nPos);
+    }
+    // until it's known where the file is at
+    nFilePos = std::numeric_limits<unsigned int>::max();
+
+    unsigned char pchHeader[8];
+    if (fread(pchHeader, 1, sizeof(pchHeader), file) != sizeof(pchHeader))
+        return error("%s : I/O error reading %d:%u", __func__, pos.nFile, pos.nPos);
+    if (memcmp(pchHeader, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+        return error("%s : no block at %d:%u", __func__, pos.nFile, pos.nPos);
+    const unsigned int nSize = ReadLE32(pchHeader + MESSAGE_START_SIZE);
+    if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
+        return error("%s : bad block size %u at %d:%u", __func__, nSize, pos.nFile, pos.nPos);
+
+    vchBlock.resize(nSize);
+    if (fread(vchBlock.data(), 1, nSize, file) != nSize)
+        return error("%s : I/O error reading %d:%u", __func__, pos.nFile, pos.nPos);
+    nFilePos = pos.nPos + nSize;
+    return true;
+}
+
 
 double ConvertBitsToDouble(unsigned int nBits)
 {
@@ -2111,6 +2535,7 @@ void static FlushBlockFile(bool fFinalize = false)
 bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigned int nAddSize);
 
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CCheckQueue<CZerocoinSpendCheck> zerocoincheckqueue(16);
 
 void ThreadScriptCheck()
 {
@@ -2118,6 +2543,17 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+void ThreadZerocoinCheck()
+{
+    util::ThreadRename("pivx-zccheck");
+    zerocoincheckqueue.Thread();
+}
+
+bool ZerocoinSpendsPossible()
+{
+    return Params().GetConsensus().vUpgrades[Consensus::UPGRADE_ZC].nActivationHeight != Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT;
+}
+
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
@@ -2172,6 +2608,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+    // zerocoin spends are checked regardless of the checkpoints
+    CCheckQueueControl<CZerocoinSpendCheck> zccontrol(nScriptCheckThreads ? &zerocoincheckqueue : nullptr);
 
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
@@ -2231,7 +2669,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             }
 
             //Check for double spending of serial #'s
-            std::set<CBigNum> setSerials;
+            std::vector<CZerocoinSpendCheck> vZerocoinChecks;
             for (const CTxIn& txIn : tx.vin) {
                 bool isPublicSpend = txIn.IsZerocoinPublicSpend();
                 bool isPrivZerocoinSpend = txIn.IsZerocoinSpend();
@@ -2243,26 +2681,35 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                     return false;
                 }
 
+                std::shared_ptr<libzerocoin::CoinSpend> spend;
                 if (isPublicSpend) {
                     libzerocoin::ZerocoinParams* params = consensus.Zerocoin_Params(false);
-                    PublicCoinSpend publicSpend(params);
-                    if (!ZPIVModule::ParseZerocoinPublicSpend(txIn, tx, state, publicSpend)){
+                    std::shared_ptr<PublicCoinSpend> publicSpend = std::make_shared<PublicCoinSpend>(params);
+                    if (!ZPIVModule::ParseZerocoinPublicSpend(txIn, tx, state, *publicSpend)){
                         return false;
                     }
-                    nValueIn += publicSpend.getDenomination() * COIN;
-                    //queue for db write after the 'justcheck' section has concluded
-                    vSpends.emplace_back(std::make_pair(publicSpend, tx.GetHash()));
-                    if (!ContextualCheckZerocoinSpend(tx, &publicSpend, pindex->nHeight, hashBlock))
-                        return state.DoS(100, error("%s: failed to add block %s with invalid public zc spend", __func__, tx.GetHash().GetHex()), REJECT_INVALID);
+                    spend = publicSpend;
                 } else {
-                    libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn);
-                    nValueIn += spend.getDenomination() * COIN;
-                    //queue for db write after the 'justcheck' section has concluded
-                    vSpends.emplace_back(std::make_pair(spend, tx.GetHash()));
-                    if (!ContextualCheckZerocoinSpend(tx, &spend, pindex->nHeight, hashBlock))
-                        return state.DoS(100, error("%s: failed to add block %s with invalid zerocoinspend", __func__, tx.GetHash().GetHex()), REJECT_INVALID);
+                    spend = std::make_shared<libzerocoin::CoinSpend>(TxInToZerocoinSpend(txIn));
+                }
+                nValueIn += spend->getDenomination() * COIN;
+                //queue for db write after the 'justcheck' section has concluded
+                vSpends.emplace_back(std::make_pair(*spend, tx.GetHash()));
+
+                //Reject serials that are already in the blockchain, the signature and range checks can run in parallel
+                int nHeightSpent = 0;
+                if (IsSerialInBlockchain(spend->getCoinSerialNumber(), nHeightSpent))
+                    return state.DoS(100, error("%s: failed to add block %s with zSTUDS serial %s already spent in block %d", __func__,
+                                                tx.GetHash().GetHex(), spend->getCoinSerialNumber().GetHex(), nHeightSpent), REJECT_INVALID);
+                CZerocoinSpendCheck check(spend, tx, pindex->nHeight);
+                if (nScriptCheckThreads) {
+                    vZerocoinChecks.emplace_back();
+                    check.swap(vZerocoinChecks.back());
+                } else if (!check()) {
+                    return state.DoS(100, error("%s: failed to add block %s with invalid zerocoinspend", __func__, tx.GetHash().GetHex()), REJECT_INVALID);
                 }
             }
+            zccontrol.Add(vZerocoinChecks);
 
         } else if (!tx.IsCoinBase()) {
             if (!view.HaveInputs(tx))
@@ -2337,6 +2784,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     if (!control.Wait())
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
+    if (!zccontrol.Wait())
+        return state.DoS(100, error("%s: failed to add block %s with invalid zerocoinspend", __func__, hashBlock.GetHex()), REJECT_INVALID);
     int64_t nTime2 = GetTimeMicros();
     nTimeVerify += nTime2 - nTimeStart;
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs - 1), nTimeVerify * 0.000001);
@@ -2576,6 +3025,127 @@ void FlushStateToDisk()
     FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+
+bool LoadMempool()
+{
+    const int64_t nExpiryTimeout = GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat", "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    int64_t nCount = 0, nFailed = 0, nExpired = 0, nAlreadyThere = 0;
+    const int64_t nStart = GetTimeMicros();
+    const int64_t nNow = GetTime();
+    try {
+        uint64_t nVersion;
+        file >> nVersion;
+        if (nVersion != MEMPOOL_DUMP_VERSION)
+            return error("%s : unknown mempool file version %u", __func__, nVersion);
+
+        // priorities first, so that they count when the transactions are accepted
+        std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+        file >> mapDeltas;
+        for (const auto& it : mapDeltas)
+            mempool.PrioritiseTransaction(it.first, it.first.ToString(), it.second.first, it.second.second);
+
+        // entries were dumped parents first
+        uint64_t nEntries;
+        file >> nEntries;
+        while (nEntries--) {
+            CTransaction tx;
+            int64_t nTime;
+            file >> tx;
+            file >> nTime;
+
+            if (nTime + nExpiryTimeout <= nNow) {
+                nExpired++;
+            } else if (mempool.exists(tx.GetHash())) {
+                nAlreadyThere++;
+            } else {
+                LOCK(cs_main);
+                CValidationState state;
+                if (AcceptToMemoryPoolWithTime(mempool, state, tx, true, nullptr, nTime))
+                    nCount++;
+                else
+                    nFailed++;
+            }
+            if (ShutdownRequested())
+                return false;
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there  %.2fms\n",
+              nCount, nFailed, nExpired, nAlreadyThere, 0.001 * (GetTimeMicros() - nStart));
+    return true;
+}
+
+bool DumpMempool()
+{
+    const int64_t nStart = GetTimeMicros();
+
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    std::vector<std::pair<CTransaction, int64_t> > vEntries;
+    {
+        LOCK(mempool.cs);
+        mapDeltas.insert(mempool.mapDeltas.begin(), mempool.mapDeltas.end());
+
+        // order the entries parents first, so that they can be accepted again one by one
+        vEntries.reserve(mempool.mapTx.size());
+        std::map<CTxMemPool::txiter, size_t, CTxMemPool::CompareIteratorByHash> mapParentsLeft;
+        std::vector<CTxMemPool::txiter> vReady;
+        for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it) {
+            const size_t nParents = mempool.GetMemPoolParents(it).size();
+            if (nParents)
+                mapParentsLeft.emplace(it, nParents);
+            else
+                vReady.push_back(it);
+        }
+        while (!vReady.empty()) {
+            CTxMemPool::txiter it = vReady.back();
+            vReady.pop_back();
+            vEntries.emplace_back(it->GetTx(), it->GetTime());
+            for (CTxMemPool::txiter child : mempool.GetMemPoolChildren(it)) {
+                if (--mapParentsLeft[child] == 0)
+                    vReady.push_back(child);
+            }
+        }
+    }
+
+    const int64_t nMid = GetTimeMicros();
+    try {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat.new", "wb");
+        if (!filestr)
+            return false;
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << MEMPOOL_DUMP_VERSION;
+        file << mapDeltas;
+        file << (uint64_t)vEntries.size();
+        for (const auto& entry : vEntries) {
+            file << entry.first;
+            file << entry.second;
+        }
+
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Dumped mempool: %u transactions, %.2fms to copy, %.2fms to dump\n",
+              vEntries.size(), 0.001 * (nMid - nStart), 0.001 * (GetTimeMicros() - nMid));
+    return true;
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex* pindexNew)
 {
@@ -3011,13 +3581,26 @@ bool ActivateBestChain(CValidationState& state, const CBlock* pblock, bool fAlre
             // Notifications/callbacks that can run without cs_main
             if (!fInitialDownload) {
                 uint256 hashNewTip = pindexNewTip->GetBlockHash();
+                // Find the hashes of all blocks that weren't previously in the best chain.
+                std::vector<uint256> vHashes;
+                CBlockIndex* pindexToAnnounce = pindexNewTip;
+                while (pindexToAnnounce != pindexFork) {
+                    vHashes.push_back(pindexToAnnounce->GetBlockHash());
+                    pindexToAnnounce = pindexToAnnounce->pprev;
+                    if (vHashes.size() == MAX_BLOCKS_TO_ANNOUNCE) {
+                        // Limit announcements in case of a huge reorganization.
+                        // Rely on the peer's synchronization mechanism in that case.
+                        break;
+                    }
+                }
                 // Relay inventory, but don't relay old inventory during initial block download.
                 int nBlockEstimate = Checkpoints::GetTotalBlocksEstimate();
                 {
                     if (connman) {
-                        connman->ForEachNode([pindexNewTip, nBlockEstimate, hashNewTip](CNode* pnode) {
+                        connman->ForEachNode([pindexNewTip, nBlockEstimate, &vHashes](CNode* pnode) {
                             if (pindexNewTip->nHeight > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate)) {
-                                pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                                for (std::vector<uint256>::const_reverse_iterator it = vHashes.rbegin(); it != vHashes.rend(); ++it)
+                                    pnode->PushBlockHash(*it);
                             }
                         });
                     }
@@ -4016,13 +4599,13 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, const CBlock* pblock
     const int newHeight = chainActive.Height() + 1;
     const bool enableP2PKH = consensus.NetworkUpgradeActive(newHeight, Consensus::UPGRADE_P2PKH_BLOCK_SIGNATURES);
     if (!CheckBlockSignature(*pblock, enableP2PKH))
-        return error("%s : bad proof-of-stake block signature", __func__);
+        return state.DoS(100, error("%s : bad proof-of-stake block signature", __func__), REJECT_INVALID, "bad-blk-signature");
 
     if (pblock->GetHash() != consensus.hashGenesisBlock && pfrom != NULL) {
         //if we get this far, check if the prev block is our prev block, if not then request sync and return false
         BlockMap::iterator mi = mapBlockIndex.find(pblock->hashPrevBlock);
         if (mi == mapBlockIndex.end()) {
-            g_connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::GETBLOCKS, chainActive.GetLocator(), UINT256_ZERO));
+            PushGetBlocks(pfrom, *g_connman, chainActive.GetLocator(), UINT256_ZERO);
             return false;
         }
     }
@@ -4030,7 +4613,8 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, const CBlock* pblock
     {
         LOCK(cs_main);
 
-        MarkBlockAsReceived(pblock->GetHash());
+        MarkBlockAsReceived(pblock->GetHash(), pfrom ? pfrom->GetId() : -1, ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION));
+        mapBlocksToDownload.erase(pblock->GetHash());
         if (!checked) {
             return error ("%s : CheckBlock FAILED for block %s, %s", __func__, pblock->GetHash().GetHex(), FormatStateMessage(state));
         }
@@ -4778,10 +5362,11 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 
     case MSG_BLOCK:
         return mapBlockIndex.count(inv.hash);
+    // The masternode and spork lookups lock the maps the message worker threads update
     case MSG_SPORK:
-        return mapSporks.count(inv.hash);
+        return sporkManager.HaveSeenSpork(inv.hash);
     case MSG_MASTERNODE_WINNER:
-        if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
+        if (masternodePayments.HaveSeenPaymentVote(inv.hash)) {
             masternodeSync.AddedMasternodeWinner(inv.hash);
             return true;
         }
@@ -4811,13 +5396,13 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
         }
         return false;
     case MSG_MASTERNODE_ANNOUNCE:
-        if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)) {
+        if (mnodeman.HaveSeenMasternodeBroadcast(inv.hash)) {
             masternodeSync.AddedMasternodeList(inv.hash);
             return true;
         }
         return false;
     case MSG_MASTERNODE_PING:
-        return mnodeman.mapSeenMasternodePing.count(inv.hash);
+        return mnodeman.HaveSeenMasternodePing(inv.hash);
     }
     // Don't know what it is, just say we already got one
     return true;
@@ -4859,6 +5444,62 @@ static void RelayAddress(const CAddress& addr, bool fReachable, CConnman& connma
     connman.ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
+/** Blocks framed by the latest getdata replies and announcements, newest first, either whole
+ *  or as cmpctblock. A new block is usually asked for by most peers at once: they all get
+ *  queued the same send buffers. */
+static const unsigned int MAX_SERVED_BLOCK_MESSAGES = 4;
+static std::deque<std::pair<std::tuple<uint256, int, bool>, CSharedNetMsg> > dqServedBlocks; // protected by cs_main
+
+/** The block as stored on disk, if its header matches the index, into a recycled send buffer */
+static bool ReadServedBlock(CSerializedNetMsg& msg, const CBlockIndex* pindex, CRawBlockReader& reader)
+{
+    msg.command = NetMsgType::BLOCK;
+    msg.data = GetSendBufferPool().Get();
+    if (!reader.Read(msg.data, pindex->GetBlockPos()))
+        return false;
+    try {
+        CBlockHeader header;
+        const char* pchData = (const char*)msg.data.data();
+        CDataStream ssHeader(pchData, pchData + std::min(msg.data.size(), (size_t)(80 + 32)), SER_NETWORK, PROTOCOL_VERSION);
+        ssHeader >> header;
+        if (header.GetHash() == pindex->GetBlockHash())
+            return true;
+    } catch (const std::exception&) {
+    }
+    return error("%s : the block at %d:%u isn't %s", __func__, pindex->GetBlockPos().nFile, pindex->GetBlockPos().nPos, pindex->GetBlockHash().ToString());
+}
+
+static CSharedNetMsg GetServedBlockMessage(const CBlockIndex* pindex, int nSendVersion, bool fCompact, CConnman& connman, CRawBlockReader* reader = nullptr)
+{
+    AssertLockHeld(cs_main);
+    const std::tuple<uint256, int, bool> key(pindex->GetBlockHash(), nSendVersion, fCompact);
+    for (const auto& entry : dqServedBlocks) {
+        if (entry.first == key)
+            return entry.second;
+    }
+
+    // A whole block goes out as it is on disk, without being decoded and encoded again
+    CSerializedNetMsg msgRaw;
+    if (!fCompact && reader && ReadServedBlock(msgRaw, pindex, *reader)) {
+        dqServedBlocks.emplace_front(key, connman.ShareMessage(std::move(msgRaw)));
+        if (dqServedBlocks.size() > MAX_SERVED_BLOCK_MESSAGES)
+            dqServedBlocks.pop_back();
+        return dqServedBlocks.front().second;
+    }
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex))
+        assert(!"cannot load block from disk");
+    CNetMsgMaker msgMaker(nSendVersion);
+    if (fCompact)
+        dqServedBlocks.emplace_front(key, connman.ShareMessage(msgMaker.Make(NetMsgType::CMPCTBLOCK, CBlockHeaderAndShortTxIDs(block))));
+    else
+        dqServedBlocks.emplace_front(key, connman.ShareMessage(msgMaker.Make(NetMsgType::BLOCK, block)));
+    if (dqServedBlocks.size() > MAX_SERVED_BLOCK_MESSAGES)
+        dqServedBlocks.pop_back();
+    return dqServedBlocks.front().second;
+}
+
 void static ProcessGetData(CNode* pfrom, CConnman& connman, std::atomic<bool>& interruptMsgProc)
 {
     AssertLockNotHeld(cs_main);
@@ -4868,6 +5509,19 @@ void static ProcessGetData(CNode* pfrom, CConnman& connman, std::atomic<bool>& i
     CNetMsgMaker msgMaker(pfrom->GetSendVersion());
     LOCK(cs_main);
 
+    // A peer catching up asks for a run of blocks, mostly stored one after the other
+    CRawBlockReader reader;
+    std::vector<CDiskBlockPos> vReadAhead;
+    for (std::deque<CInv>::iterator itAhead = it; itAhead != pfrom->vRecvGetData.end() && vReadAhead.size() < MAX_BLOCKS_READ_AHEAD; itAhead++) {
+        if (itAhead->type != MSG_BLOCK)
+            continue;
+        BlockMap::iterator mi = mapBlockIndex.find(itAhead->hash);
+        if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA))
+            vReadAhead.push_back(mi->second->GetBlockPos());
+    }
+    if (vReadAhead.size() > 1)
+        reader.Prefetch(vReadAhead);
+
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->fPauseSend)
@@ -4879,7 +5533,7 @@ void static ProcessGetData(CNode* pfrom, CConnman& connman, std::atomic<bool>& i
                 return;
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK) {
                 bool send = false;
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
                 if (mi != mapBlockIndex.end()) {
@@ -4898,14 +5552,18 @@ void static ProcessGetData(CNode* pfrom, CConnman& connman, std::atomic<bool>& i
                 }
                 // Don't send not-validated blocks
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
-                        assert(!"cannot load block from disk");
                     if (inv.type == MSG_BLOCK)
-                        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
-                    else // MSG_FILTERED_BLOCK)
+                        connman.PushMessage(pfrom, GetServedBlockMessage(mi->second, pfrom->GetSendVersion(), false, connman, &reader));
+                    else if (inv.type == MSG_CMPCT_BLOCK) {
+                        // Only a block being relayed is likely to be in the peer's mempool
+                        const bool fCompact = mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH;
+                        connman.PushMessage(pfrom, GetServedBlockMessage(mi->second, pfrom->GetSendVersion(), fCompact, connman, &reader));
+                    } else // MSG_FILTERED_BLOCK)
                     {
+                        // Send block from disk
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second))
+                            assert(!"cannot load block from disk");
                         bool send = false;
                         CMerkleBlock merkleBlock;
                         {
@@ -4965,19 +5623,15 @@ void static ProcessGetData(CNode* pfrom, CConnman& connman, std::atomic<bool>& i
                     }
                 }
                 if (!pushed && inv.type == MSG_SPORK) {
-                    if (mapSporks.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapSporks[inv.hash];
+                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    if (sporkManager.GetSporkSerialized(inv.hash, ss)) {
                         connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::SPORK, ss));
                         pushed = true;
                     }
                 }
                 if (!pushed && inv.type == MSG_MASTERNODE_WINNER) {
-                    if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << masternodePayments.mapMasternodePayeeVotes[inv.hash];
+                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    if (masternodePayments.GetPaymentVoteSerialized(inv.hash, ss)) {
                         connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::MNWINNER, ss));
                         pushed = true;
                     }
@@ -5011,20 +5665,16 @@ void static ProcessGetData(CNode* pfrom, CConnman& connman, std::atomic<bool>& i
                 }
 
                 if (!pushed && inv.type == MSG_MASTERNODE_ANNOUNCE) {
-                    if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodeBroadcast[inv.hash];
+                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    if (mnodeman.GetMasternodeBroadcastSerialized(inv.hash, ss)) {
                         connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::MNBROADCAST, ss));
                         pushed = true;
                     }
                 }
 
                 if (!pushed && inv.type == MSG_MASTERNODE_PING) {
-                    if (mnodeman.mapSeenMasternodePing.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodePing[inv.hash];
+                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    if (mnodeman.GetMasternodePingSerialized(inv.hash, ss)) {
                         connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::MNPING, ss));
                         pushed = true;
                     }
@@ -5035,7 +5685,7 @@ void static ProcessGetData(CNode* pfrom, CConnman& connman, std::atomic<bool>& i
                 }
             }
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
                 break;
         }
     }
@@ -5054,6 +5704,108 @@ void static ProcessGetData(CNode* pfrom, CConnman& connman, std::atomic<bool>& i
     }
 }
 
+/** Ask a peer that delivered a new tip to announce its next blocks as cmpctblock, sending the
+ *  oldest of the high-bandwidth peers back to inv announcements when there are too many. */
+static void MaybeSetPeerAsAnnouncingHeaderAndIDs(CNode* pfrom, CConnman& connman)
+{
+    AssertLockHeld(cs_main);
+    CNodeState* nodestate = State(pfrom->GetId());
+    if (!nodestate || !nodestate->fProvidesHeaderAndIDs)
+        return;
+
+    for (std::list<NodeId>::iterator it = lNodesAnnouncingHeaderAndIDs.begin(); it != lNodesAnnouncingHeaderAndIDs.end(); it++) {
+        if (*it == pfrom->GetId()) {
+            lNodesAnnouncingHeaderAndIDs.erase(it);
+            lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
+            return;
+        }
+    }
+    if (lNodesAnnouncingHeaderAndIDs.size() >= MAX_CMPCTBLOCK_HB_PEERS) {
+        connman.ForNode(lNodesAnnouncingHeaderAndIDs.front(), [&connman](CNode* pnodeStop) {
+            connman.PushMessage(pnodeStop, CNetMsgMaker(pnodeStop->GetSendVersion()).Make(NetMsgType::SENDCMPCT, false, CMPCTBLOCKS_VERSION));
+            return true;
+        });
+        lNodesAnnouncingHeaderAndIDs.pop_front();
+    }
+    connman.PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::SENDCMPCT, true, CMPCTBLOCKS_VERSION));
+    lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
+}
+
+/** Process the blocks stashed by StashBlockAwaitingParent() now that their parent may be connected */
+static void ProcessBlocksAwaitingParent(const uint256& hashParent, CConnman& connman)
+{
+    std::deque<uint256> dqParents;
+    dqParents.push_back(hashParent);
+    while (!dqParents.empty()) {
+        std::vector<BlockAwaitingParent> vChildren;
+        {
+            LOCK(cs_main);
+            const uint256 hash = dqParents.front();
+            dqParents.pop_front();
+            if (!mapBlockIndex.count(hash))
+                continue;
+            std::pair<std::multimap<uint256, BlockAwaitingParent>::iterator, std::multimap<uint256, BlockAwaitingParent>::iterator> range = mapBlocksAwaitingParent.equal_range(hash);
+            for (std::multimap<uint256, BlockAwaitingParent>::iterator it = range.first; it != range.second; it++) {
+                nBlocksAwaitingParentSize -= it->second.nSize;
+                setBlocksAwaitingParent.erase(it->second.pblock->GetHash());
+                vChildren.push_back(it->second);
+            }
+            mapBlocksAwaitingParent.erase(range.first, range.second);
+        }
+
+        for (const BlockAwaitingParent& child : vChildren) {
+            CValidationState state;
+            ProcessNewBlock(state, nullptr, child.pblock.get(), nullptr, &connman);
+            int nDoS;
+            if (state.IsInvalid(nDoS)) {
+                if (nDoS > 0) {
+                    LOCK(cs_main);
+                    Misbehaving(child.nodeid, nDoS);
+                }
+                continue;
+            }
+            dqParents.push_back(child.pblock->GetHash());
+        }
+    }
+}
+
+/** Process a block received whole, or rebuilt from a cmpctblock */
+static void ProcessBlockFromPeer(CNode* pfrom, const CBlock& block, const std::string& strCommand, CConnman& connman)
+{
+    const uint256 hashBlock = block.GetHash();
+    CValidationState state;
+    ProcessNewBlock(state, pfrom, &block, nullptr, &connman);
+    int nDoS;
+    if (state.IsInvalid(nDoS)) {
+        assert(state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
+        connman.PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::REJECT, strCommand, state.GetRejectCode(),
+                                       state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), hashBlock));
+        if (nDoS > 0) {
+            TRY_LOCK(cs_main, lockMain);
+            if (lockMain) Misbehaving(pfrom->GetId(), nDoS);
+        }
+    } else {
+        // The first peer to deliver a new tip gets the next ones announced without a round trip
+        LOCK(cs_main);
+        if (State(pfrom->GetId()))
+            UpdateBlockAvailability(pfrom->GetId(), hashBlock);
+        if (!IsInitialBlockDownload() && chainActive.Tip()->GetBlockHash() == hashBlock)
+            MaybeSetPeerAsAnnouncingHeaderAndIDs(pfrom, connman);
+    }
+    ProcessBlocksAwaitingParent(hashBlock, connman);
+
+    //disconnect this node if its old protocol version
+    pfrom->DisconnectOldProtocol(pfrom->nVersion, ActiveProtocol(), strCommand);
+}
+
+/** The messages that write the budget seen maps */
+static bool IsBudgetMessage(const std::string& strCommand)
+{
+    return strCommand == NetMsgType::BUDGETPROPOSAL || strCommand == NetMsgType::BUDGETVOTE ||
+           strCommand == NetMsgType::BUDGETVOTESYNC || strCommand == NetMsgType::FINALBUDGET ||
+           strCommand == NetMsgType::FINALBUDGETVOTE;
+}
+
 bool fRequestedSporksIDB = false;
 bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vRecv, int64_t nTimeReceived, CConnman& connman, std::atomic<bool>& interruptMsgProc)
 {
@@ -5266,10 +6018,39 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             LOCK(cs_main);
             State(pfrom->GetId())->fCurrentlyConnected = true;
         }
+
+        if (pfrom->nVersion >= SENDHEADERS_VERSION) {
+            // Tell our peer we prefer to receive headers rather than inv's
+            connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDHEADERS));
+        }
+        if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
+            // We can reconstruct blocks from cmpctblock, but want them announced
+            // that way only once the peer proved to be a fast source of new blocks
+            connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDCMPCT, false, CMPCTBLOCKS_VERSION));
+        }
         pfrom->fSuccessfullyConnected = true;
     }
 
 
+    else if (strCommand == NetMsgType::SENDHEADERS) {
+        LOCK(cs_main);
+        State(pfrom->GetId())->fPreferHeaders = true;
+    }
+
+
+    else if (strCommand == NetMsgType::SENDCMPCT) {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == CMPCTBLOCKS_VERSION) {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            nodestate->fProvidesHeaderAndIDs = true;
+            nodestate->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+        }
+    }
+
+
     else if (strCommand == NetMsgType::ADDR) {
         std::vector<CAddress> vAddr;
         vRecv >> vAddr;
@@ -5326,6 +6107,8 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         LOCK(cs_main);
 
         std::vector<CInv> vToFetch;
+        std::vector<uint256> vBlocksAnnounced;
+        unsigned int nBlockInvs = 0;
 
         for (unsigned int nInv = 0; nInv < vInv.size(); nInv++) {
             const CInv& inv = vInv[nInv];
@@ -5343,8 +6126,11 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
 
             if (inv.type == MSG_BLOCK) {
+                nBlockInvs++;
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
-                if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
+                if (!fAlreadyHave && vBlocksAnnounced.size() < MAX_GETBLOCKS_RESULTS)
+                    vBlocksAnnounced.push_back(inv.hash);
+                if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash) && !setBlocksAwaitingParent.count(inv.hash)) {
                     // Add this to the list of blocks to request
                     vToFetch.push_back(inv);
                     LogPrint(BCLog::NET, "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
@@ -5352,6 +6138,23 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             }
         }
 
+        if (nBlockInvs > MAX_BLOCKS_TO_ANNOUNCE) {
+            // Only a getblocks result announces that many blocks, they get spread over the peers that announced them.
+            // A tip announcement arriving in between doesn't take the place of the result.
+            CNodeState* nodestate = State(pfrom->GetId());
+            const bool fGetBlocksResult = nodestate->nGetBlocksSent > GetTime() - GETBLOCKS_RESULT_TIMEOUT;
+            nodestate->nGetBlocksSent = 0;
+            if (fGetBlocksResult && !fImporting && !fReindex)
+                QueueBlocksToDownload(pfrom->GetId(), vBlocksAnnounced, nBlockInvs >= MAX_GETBLOCKS_RESULTS);
+            else
+                LogPrint(BCLog::NET, "ignoring unsolicited inv of %u blocks from peer=%d\n", nBlockInvs, pfrom->id);
+            return true;
+        }
+
+        // A single new block is most likely the next tip, with its transactions already in our mempool
+        if (vToFetch.size() == 1 && State(pfrom->GetId())->fProvidesHeaderAndIDs && !IsInitialBlockDownload())
+            vToFetch[0].type = MSG_CMPCT_BLOCK;
+
         if (!vToFetch.empty())
             connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vToFetch));
     }
@@ -5396,7 +6199,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         // Send the rest of the chain
         if (pindex)
             pindex = chainActive.Next(pindex);
-        int nLimit = 500;
+        int nLimit = MAX_GETBLOCKS_RESULTS;
         LogPrint(BCLog::NET, "getblocks %d to %s limit %d from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), nLimit, pfrom->id);
         for (; pindex; pindex = chainActive.Next(pindex)) {
             if (pindex->GetBlockHash() == hashStop) {
@@ -5656,41 +6459,258 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         CInv inv(MSG_BLOCK, hashBlock);
         LogPrint(BCLog::NET, "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
 
+        bool fAwaitingParent = false;
+        {
+            LOCK(cs_main);
+            // Blocks downloaded from several peers arrive out of order
+            fAwaitingParent = !mapBlockIndex.count(block.hashPrevBlock) && StashBlockAwaitingParent(pfrom->GetId(), block);
+        }
+        if (fAwaitingParent) {
+            LogPrint(BCLog::NET, "block %s from peer=%d is waiting for its parent %s\n", hashBlock.ToString(), pfrom->id, block.hashPrevBlock.ToString());
+            pfrom->AddInventoryKnown(inv);
+        }
         //sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
-        if (!mapBlockIndex.count(block.hashPrevBlock)) {
+        else if (!mapBlockIndex.count(block.hashPrevBlock)) {
             if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
                 //we already asked for this block, so lets work backwards and ask for the previous block
-                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::GETBLOCKS, chainActive.GetLocator(), block.hashPrevBlock));
+                PushGetBlocks(pfrom, connman, chainActive.GetLocator(), block.hashPrevBlock);
                 pfrom->vBlockRequested.push_back(block.hashPrevBlock);
             } else {
                 //ask to sync to this block
-                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::GETBLOCKS, chainActive.GetLocator(), hashBlock));
+                PushGetBlocks(pfrom, connman, chainActive.GetLocator(), hashBlock);
                 pfrom->vBlockRequested.push_back(hashBlock);
             }
         } else {
             pfrom->AddInventoryKnown(inv);
 
-            CValidationState state;
             if (!mapBlockIndex.count(block.GetHash())) {
-                ProcessNewBlock(state, pfrom, &block, nullptr, &connman);
-                int nDoS;
-                if (state.IsInvalid(nDoS)) {
-                    assert(state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
-                    connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::REJECT, strCommand, state.GetRejectCode(),
-                                                   state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash));
-                    if (nDoS > 0) {
-                        TRY_LOCK(cs_main, lockMain);
-                        if (lockMain) Misbehaving(pfrom->GetId(), nDoS);
-                    }
-                }
-                //disconnect this node if its old protocol version
-                pfrom->DisconnectOldProtocol(pfrom->nVersion, ActiveProtocol(), strCommand);
+                ProcessBlockFromPeer(pfrom, block, strCommand, connman);
             } else {
                 LogPrint(BCLog::NET, "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, block.GetHash().GetHex());
             }
         }
     }
 
+    else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+        const uint256 hashBlock = cmpctblock.header.GetHash();
+        LogPrint(BCLog::CMPCTBLOCK, "received cmpctblock %s peer=%d\n", hashBlock.ToString(), pfrom->id);
+        pfrom->AddInventoryKnown(CInv(MSG_BLOCK, hashBlock));
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+
+            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+            if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA))
+                return true;
+
+            if (!mapBlockIndex.count(cmpctblock.header.hashPrevBlock)) {
+                // Doesn't connect, sync up to it like an unconnected block
+                PushGetBlocks(pfrom, connman, chainActive.GetLocator(), hashBlock);
+                return true;
+            }
+
+            // The header, the coinstake and the signature are all there: reject a bad
+            // proof-of-stake block before asking for anything
+            const bool enableP2PKH = Params().GetConsensus().NetworkUpgradeActive(chainActive.Height() + 1, Consensus::UPGRADE_P2PKH_BLOCK_SIGNATURES);
+            if (!CheckBlockSignature(cmpctblock.GetSignedStub(), enableP2PKH)) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("%s : bad block signature in cmpctblock %s from peer=%d", __func__, hashBlock.ToString(), pfrom->id);
+            }
+
+            std::unique_ptr<PartiallyDownloadedBlock> partialBlock(new PartiallyDownloadedBlock(&mempool));
+            ReadStatus status = partialBlock->InitData(cmpctblock);
+            if (status == READ_STATUS_INVALID) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("%s : invalid cmpctblock %s from peer=%d", __func__, hashBlock.ToString(), pfrom->id);
+            }
+
+            BlockTransactionsRequest req;
+            if (status == READ_STATUS_OK) {
+                for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                    if (!partialBlock->IsTxAvailable(i))
+                        req.indexes.push_back(i);
+                }
+                if (req.indexes.empty())
+                    status = partialBlock->FillBlock(block, std::vector<CTransaction>());
+            }
+
+            if (status == READ_STATUS_FAILED) {
+                // Short id collisions, ask for the whole block
+                std::vector<CInv> vInv(1, CInv(MSG_BLOCK, hashBlock));
+                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vInv));
+                return true;
+            }
+
+            if (!req.indexes.empty()) {
+                std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hashBlock);
+                if (itInFlight != mapBlocksInFlight.end() && itInFlight->second.first != pfrom->GetId()) {
+                    // Already on its way from another peer
+                    return true;
+                }
+
+                CNodeState* nodestate = State(pfrom->GetId());
+                if (nodestate->partialBlock)
+                    MarkBlockAsReceived(nodestate->partialBlock->header.GetHash());
+                MarkBlockAsInFlight(pfrom->GetId(), hashBlock);
+                nodestate->partialBlock = std::move(partialBlock);
+
+                req.blockhash = hashBlock;
+                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::GETBLOCKTXN, req));
+                return true;
+            }
+        }
+
+        ProcessBlockFromPeer(pfrom, block, NetMsgType::BLOCK, connman);
+    }
+
+
+    else if (strCommand == NetMsgType::GETBLOCKTXN) {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        {
+            LOCK(cs_main);
+
+            BlockMap::iterator mi = mapBlockIndex.find(req.blockhash);
+            if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrint(BCLog::NET, "Peer %d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+                return true;
+            }
+
+            if (mi->second->nHeight >= chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+                CBlock block;
+                if (!ReadBlockFromDisk(block, mi->second))
+                    assert(!"cannot load block from disk");
+
+                BlockTransactions resp(req);
+                for (size_t i = 0; i < req.indexes.size(); i++) {
+                    if (req.indexes[i] >= block.vtx.size()) {
+                        Misbehaving(pfrom->GetId(), 100);
+                        return error("%s : peer=%d sent us a getblocktxn with out-of-bounds tx indices", __func__, pfrom->id);
+                    }
+                    resp.txn[i] = block.vtx[req.indexes[i]];
+                }
+                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCKTXN, resp));
+                return true;
+            }
+        }
+
+        // Too old to be a block being relayed: serve it whole, as for a getdata,
+        // so that old blocks can't be fingerprinted through getblocktxn
+        LogPrint(BCLog::NET, "Peer %d sent us a getblocktxn for a block > %i deep\n", pfrom->id, MAX_BLOCKTXN_DEPTH);
+        pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+        ProcessGetData(pfrom, connman, interruptMsgProc);
+    }
+
+
+    else if (strCommand == NetMsgType::BLOCKTXN && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+
+            CNodeState* nodestate = State(pfrom->GetId());
+            if (!nodestate->partialBlock || nodestate->partialBlock->header.GetHash() != resp.blockhash) {
+                LogPrint(BCLog::NET, "Peer %d sent us block transactions for block we weren't expecting\n", pfrom->id);
+                return true;
+            }
+
+            ReadStatus status = nodestate->partialBlock->FillBlock(block, resp.txn);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash); // Reset in-flight state in case of whitelist
+                Misbehaving(pfrom->GetId(), 100);
+                return error("%s : peer=%d sent us invalid compact block/non-matching block transactions", __func__, pfrom->id);
+            } else if (status == READ_STATUS_FAILED) {
+                // Might have collided, fall back to getdata now, the block stays in flight from this peer
+                nodestate->partialBlock.reset();
+                std::vector<CInv> vInv(1, CInv(MSG_BLOCK, resp.blockhash));
+                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vInv));
+                return true;
+            }
+            // ProcessNewBlock marks it as received
+        }
+
+        ProcessBlockFromPeer(pfrom, block, NetMsgType::BLOCK, connman);
+    }
+
+    // Without headers-first syncing the header of a proof-of-stake block can't be checked on its
+    // own, it takes the coinstake: headers are announcements of blocks to fetch right away
+    else if (strCommand == NetMsgType::HEADERS && !fImporting && !fReindex) // Ignore headers received while importing
+    {
+        std::vector<CBlockHeader> headers;
+
+        // Bypass the normal CBlock deserialization, as we don't want to risk deserializing 2000 full blocks.
+        unsigned int nCount = ReadCompactSize(vRecv);
+        if (nCount > MAX_HEADERS_RESULTS) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 20);
+            return error("headers message size = %u", nCount);
+        }
+        headers.resize(nCount);
+        for (unsigned int n = 0; n < nCount; n++) {
+            vRecv >> headers[n];
+            ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
+        }
+
+        if (nCount == 0)
+            return true;
+
+        LOCK(cs_main);
+
+        uint256 hashLast;
+        for (const CBlockHeader& header : headers) {
+            if (!hashLast.IsNull() && header.hashPrevBlock != hashLast) {
+                Misbehaving(pfrom->GetId(), 20);
+                return error("non-continuous headers sequence");
+            }
+            hashLast = header.GetHash();
+            pfrom->AddInventoryKnown(CInv(MSG_BLOCK, hashLast));
+        }
+        UpdateBlockAvailability(pfrom->GetId(), hashLast);
+
+        if (!mapBlockIndex.count(headers[0].hashPrevBlock)) {
+            // Doesn't connect, sync up to the last one like an unconnected block
+            LogPrint(BCLog::NET, "headers from peer=%d don't connect, getblocks up to %s\n", pfrom->id, hashLast.ToString());
+            PushGetBlocks(pfrom, connman, chainActive.GetLocator(), hashLast);
+            return true;
+        }
+
+        // The regular block download takes care of them while syncing
+        if (IsInitialBlockDownload())
+            return true;
+
+        CNodeState* nodestate = State(pfrom->GetId());
+        std::vector<CInv> vToFetch;
+        for (const CBlockHeader& header : headers) {
+            if (nodestate->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER)
+                break;
+            const uint256 hash = header.GetHash();
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
+            if ((mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA)) || mapBlocksInFlight.count(hash))
+                continue;
+            vToFetch.push_back(CInv(MSG_BLOCK, hash));
+            MarkBlockAsInFlight(pfrom->GetId(), hash);
+            LogPrint(BCLog::NET, "Requesting announced block %s peer=%d\n", hash.ToString(), pfrom->id);
+        }
+
+        // A single block on top of our tip: its transactions should be in our mempool
+        if (vToFetch.size() == 1 && nodestate->fProvidesHeaderAndIDs && vToFetch[0].hash == hashLast) {
+            BlockMap::iterator mi = mapBlockIndex.find(headers.back().hashPrevBlock);
+            if (mi != mapBlockIndex.end() && mi->second && mi->second == chainActive.Tip())
+                vToFetch[0].type = MSG_CMPCT_BLOCK;
+        }
+
+        if (!vToFetch.empty())
+            connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vToFetch));
+    }
+
     // This asymmetric behavior for inbound and outbound connections was introduced
     // to prevent a fingerprinting attack: an attacker can send specific fake addresses
     // to users' AddrMan and later request them by sending getaddr messages.
@@ -5895,12 +6915,10 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         }
 
         if (found) {
-            //probably one the extensions
-            mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
-            budget.ProcessMessage(pfrom, strCommand, vRecv);
-            masternodePayments.ProcessMessageMasternodePayments(pfrom, strCommand, vRecv);
-            sporkManager.ProcessSpork(pfrom, strCommand, vRecv);
-            masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+            //probably one the extensions, they don't hold up the blocks and transactions behind them. The budget
+            //ones stay on this thread, which reads their seen maps in AlreadyHave and ProcessGetData without cs_budget
+            if (IsBudgetMessage(strCommand) || !connman.OffloadMessage(pfrom, strCommand, vRecv))
+                ProcessMasternodeMessage(pfrom, strCommand, vRecv, connman);
         } else {
             // Ignore unknown commands for extensibility
             LogPrint(BCLog::NET, "Unknown command \"%s\" from peer=%d\n", SanitizeString(strCommand), pfrom->id);
@@ -5911,6 +6929,25 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     return true;
 }
 
+void ProcessMasternodeMessage(CNode* pfrom, const std::string& strCommandIn, CDataStream& vRecv, CConnman& connman)
+{
+    std::string strCommand = strCommandIn;
+    try {
+        mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
+        budget.ProcessMessage(pfrom, strCommand, vRecv);
+        masternodePayments.ProcessMessageMasternodePayments(pfrom, strCommand, vRecv);
+        sporkManager.ProcessSpork(pfrom, strCommand, vRecv);
+        masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+    } catch (const std::ios_base::failure& e) {
+        connman.PushMessage(pfrom, CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::REJECT, strCommand, REJECT_MALFORMED, std::string("error parsing message")));
+        LogPrintf("%s(%s, %u bytes): Exception '%s' caught\n", __func__, SanitizeString(strCommand), vRecv.size(), e.what());
+    } catch (const std::exception& e) {
+        PrintExceptionContinue(&e, "ProcessMasternodeMessage()");
+    } catch (...) {
+        PrintExceptionContinue(NULL, "ProcessMasternodeMessage()");
+    }
+}
+
 // Note: whenever a protocol update is needed toggle between both implementations (comment out the formerly active one)
 //       so we can leave the existing clients untouched (old SPORK will stay on so they don't see even older clients).
 //       Those old clients won't react to the changes of the other (new) SPORK because at the time of their implementation
@@ -5998,6 +7035,7 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
 
     // Process message
     bool fRet = false;
+    const int64_t nProcessStart = GetTimeMicros();
     try {
         fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, connman, interruptMsgProc);
         if (interruptMsgProc)
@@ -6020,6 +7058,7 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
     } catch (...) {
         PrintExceptionContinue(NULL, "ProcessMessages()");
     }
+    connman.RecordMessageProcessed(pfrom, strCommand, GetTimeMicros() - nProcessStart);
 
     if (!fRet)
         LogPrintf("ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->id);
@@ -6134,7 +7173,7 @@ bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interruptMsg
                 //CBlockIndex *pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
                 //LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
                 //pto->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexStart), UINT256_ZERO);
-                connman.PushMessage(pto, msgMaker.Make(NetMsgType::GETBLOCKS, chainActive.GetLocator(chainActive.Tip()), UINT256_ZERO));
+                PushGetBlocks(pto, connman, chainActive.GetLocator(chainActive.Tip()), UINT256_ZERO);
             }
         }
 
@@ -6145,50 +7184,144 @@ bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interruptMsg
             GetMainSignals().Broadcast(&connman);
         }
 
+        //
+        // Try sending block announcements via headers
+        //
+        {
+            // If we have less than MAX_BLOCKS_TO_ANNOUNCE in our list of block hashes we're relaying,
+            // and our peer's pindexBestHeaderSent or pindexBestKnownBlock is the parent of the first
+            // of them, then send them all as headers: the peer can ask for the blocks right away.
+            // A peer in high-bandwidth compact block mode gets a single new block as cmpctblock instead.
+            // Otherwise, announce the new tip with an inv.
+            LOCK(pto->cs_inventory);
+            ProcessBlockAvailability(pto->id); // ensure pindexBestKnownBlock is up-to-date
+            std::vector<CBlockIndex*> vToAnnounce;
+            for (const uint256& hash : pto->vBlockHashesToAnnounce) {
+                BlockMap::iterator mi = mapBlockIndex.find(hash);
+                assert(mi != mapBlockIndex.end());
+                vToAnnounce.push_back(mi->second);
+            }
+            std::vector<CBlockIndex*> vHeaders;
+            bool fRevertToInv = (!state.fPreferHeaders && !state.fPreferHeaderAndIDs) ||
+                                !FindHeadersToAnnounce(chainActive, vToAnnounce, state.pindexBestKnownBlock, state.pindexBestHeaderSent, vHeaders);
+            if (!fRevertToInv && !vHeaders.empty()) {
+                CBlockIndex* pBestIndex = vHeaders.back(); // last header queued for delivery
+                if (vHeaders.size() == 1 && state.fPreferHeaderAndIDs) {
+                    LogPrint(BCLog::NET, "%s sending cmpctblock %s to peer=%d\n", __func__, pBestIndex->GetBlockHash().ToString(), pto->id);
+                    connman.PushMessage(pto, GetServedBlockMessage(pBestIndex, pto->GetSendVersion(), true, connman));
+                    state.pindexBestHeaderSent = pBestIndex;
+                } else if (state.fPreferHeaders) {
+                    if (vHeaders.size() > 1) {
+                        LogPrint(BCLog::NET, "%s: %u headers, range (%s, %s), to peer=%d\n", __func__,
+                                 vHeaders.size(),
+                                 vHeaders.front()->GetBlockHash().ToString(),
+                                 vHeaders.back()->GetBlockHash().ToString(), pto->id);
+                    } else {
+                        LogPrint(BCLog::NET, "%s: sending header %s to peer=%d\n", __func__,
+                                 vHeaders.front()->GetBlockHash().ToString(), pto->id);
+                    }
+                    std::vector<CBlock> vBlockHeaders;
+                    for (const CBlockIndex* pindex : vHeaders)
+                        vBlockHeaders.push_back(pindex->GetBlockHeader());
+                    connman.PushMessage(pto, msgMaker.Make(NetMsgType::HEADERS, vBlockHeaders));
+                    state.pindexBestHeaderSent = pBestIndex;
+                } else
+                    fRevertToInv = true;
+            }
+            if (fRevertToInv) {
+                // If falling back to using an inv, just try to inv the tip.
+                // The last entry in vBlockHashesToAnnounce was our tip at some point
+                // in the past.
+                if (!pto->vBlockHashesToAnnounce.empty()) {
+                    const uint256& hashToAnnounce = pto->vBlockHashesToAnnounce.back();
+                    BlockMap::iterator mi = mapBlockIndex.find(hashToAnnounce);
+                    assert(mi != mapBlockIndex.end());
+                    CBlockIndex* pindex = mi->second;
+
+                    // Warn if we're announcing a block that is not on the main chain.
+                    // This should be very rare and could be optimized out.
+                    // Just log for now.
+                    if (chainActive[pindex->nHeight] != pindex) {
+                        LogPrint(BCLog::NET, "Announcing block %s not on main chain (tip=%s)\n",
+                            hashToAnnounce.ToString(), chainActive.Tip()->GetBlockHash().ToString());
+                    }
+
+                    // If the peer's chain has this block, don't inv it back.
+                    if (!PeerHasHeader(&state, pindex)) {
+                        pto->PushInventory(CInv(MSG_BLOCK, hashToAnnounce));
+                        LogPrint(BCLog::NET, "%s: sending inv peer=%d hash=%s\n", __func__,
+                            pto->id, hashToAnnounce.ToString());
+                    }
+                }
+            }
+            pto->vBlockHashesToAnnounce.clear();
+        }
+
         //
         // Message: inventory
         //
         std::vector<CInv> vInv;
-        std::vector<CInv> vInvWait;
         {
-            bool fSendTrickle = pto->fWhitelisted;
-            if (pto->nNextInvSend < nNow) {
-                fSendTrickle = true;
-                pto->nNextInvSend = PoissonNextSend(nNow, AVG_INVENTORY_BROADCAST_INTERVAL);
-            }
             LOCK(pto->cs_vSend);
             LOCK(pto->cs_inventory);
             vInv.reserve(pto->vInventoryToSend.size());
-            vInvWait.reserve(pto->vInventoryToSend.size());
             for (const CInv& inv : pto->vInventoryToSend) {
-                if (inv.type == MSG_TX && pto->filterInventoryKnown.contains(inv.hash))
-                    continue;
-
-                // trickle out tx inv to protect privacy
-                if (inv.type == MSG_TX && !fSendTrickle) {
-                    // 1/4 of tx invs blast to all immediately
-                    static uint256 hashSalt;
-                    if (hashSalt.IsNull())
-                        hashSalt = GetRandHash();
-                    uint256 hashRand = inv.hash ^ hashSalt;
-                    hashRand = Hash(BEGIN(hashRand), END(hashRand));
-                    bool fTrickleWait = ((hashRand & 3) != 0);
-
-                    if (fTrickleWait) {
-                        vInvWait.push_back(inv);
-                        continue;
-                    }
+                vInv.push_back(inv);
+                if (vInv.size() >= 1000) {
+                    connman.PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+                    vInv.clear();
                 }
+            }
+            pto->vInventoryToSend.clear();
+        }
 
-                pto->filterInventoryKnown.insert(inv.hash);
-
-                vInv.push_back(inv);
+        // Transactions are trickled out to protect privacy, in batches ordered by fee rate,
+        // twice as often to outbound peers
+        const int64_t nTrickleInterval = std::max<int64_t>(nInvBroadcastInterval >> !pto->fInbound, 1);
+        bool fSendTrickle = pto->fWhitelisted;
+        if (pto->nNextInvSend < nNow) {
+            fSendTrickle = true;
+            pto->nNextInvSend = PoissonNextSend(nNow, nTrickleInterval);
+        }
+        std::vector<uint256> vTxToSend;
+        if (fSendTrickle) {
+            LOCK(pto->cs_inventory);
+            vTxToSend.reserve(pto->setInventoryTxToSend.size());
+            for (const uint256& hash : pto->setInventoryTxToSend) {
+                if (!pto->filterInventoryKnown.contains(hash))
+                    vTxToSend.push_back(hash);
+            }
+            pto->setInventoryTxToSend.clear();
+        }
+        if (!vTxToSend.empty()) {
+            // the mempool is queried without holding the peer locks
+            mempool.SortForRelay(vTxToSend);
+            // a batch covers the peer's average interval in seconds, not the configured one
+            const size_t nMaxBroadcast = INVENTORY_BROADCAST_PER_SECOND * nTrickleInterval;
+            size_t nSent = 0;
+            LOCK(pto->cs_vSend);
+            LOCK(pto->cs_inventory);
+            for (const uint256& hash : vTxToSend) {
+                if (nSent >= nMaxBroadcast) {
+                    // the rest waits for the next trickle
+                    pto->setInventoryTxToSend.insert(hash);
+                    continue;
+                }
+                if (pto->filterInventoryKnown.contains(hash))
+                    continue;
+                pto->filterInventoryKnown.insert(hash);
+                nSent++;
+                vInv.push_back(CInv(MSG_TX, hash));
                 if (vInv.size() >= 1000) {
                     connman.PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
                     vInv.clear();
                 }
             }
-            pto->vInventoryToSend = vInvWait;
+            if (nSent > 0) {
+                pto->nTxInvSent += nSent;
+                pto->nTxInvFlushes++;
+                LogPrint(BCLog::NET, "trickled %u tx invs to peer=%d, %u left\n", nSent, pto->id, pto->setInventoryTxToSend.size());
+            }
         }
         if (!vInv.empty())
             connman.PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
@@ -6235,6 +7368,11 @@ bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interruptMsg
                 }
             }
         }
+        // The blocks of getblocks results are spread over all the peers that have them
+        if (!pto->fClient && !pto->fOneShot && !fImporting && !fReindex) {
+            ScheduleBlockDownloads(pto, state, vGetData, nNow);
+            MaybeRequestMoreBlocks(pto, state, connman);
+        }
 
         //
         // Message: getdata (non-blocks)
@@ -76,6 +76,8 @@ static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
+/** Default for -persistmempool */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
 /** Default for -txindex */
 static const bool DEFAULT_TXINDEX = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
@@ -104,11 +106,42 @@ static const int MAX_SCRIPTCHECK_THREADS = 16;
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Number of block hashes sent in one getblocks result. */
+static const unsigned int MAX_GETBLOCKS_RESULTS = 500;
+/** Bounds of the adaptive number of blocks in flight from a peer, for the blocks announced by getblocks results.
+ *  In between, a peer gets about BLOCK_DOWNLOAD_TARGET_TIME seconds of blocks at the rate it was measured at. */
+static const int BLOCK_DOWNLOAD_WINDOW_MIN = 2;
+static const int BLOCK_DOWNLOAD_WINDOW_MAX = 64;
+static const int64_t BLOCK_DOWNLOAD_TARGET_TIME = 2;
+/** Ask for the next getblocks result when fewer announced blocks than this are left to download. */
+static const unsigned int BLOCK_DOWNLOAD_REFILL = MAX_GETBLOCKS_RESULTS / 2;
+/** Most blocks of getblocks results queued for download at once. */
+static const unsigned int MAX_BLOCKS_TO_DOWNLOAD = 4 * MAX_GETBLOCKS_RESULTS;
+/** Seconds after which a queued block that isn't in flight is dropped from the download queue. */
+static const int64_t BLOCK_DOWNLOAD_EXPIRY = 20 * 60;
+/** Seconds after a getblocks within which its result is expected, a later one is taken as unsolicited. */
+static const int64_t GETBLOCKS_RESULT_TIMEOUT = 60;
+/** Seconds (at least) before a block still in flight from a peer is asked from a faster one. */
+static const int64_t BLOCK_STUCK_TIMEOUT = 2;
+/** Bytes of blocks downloaded ahead of their parent that are kept until it arrives. */
+static const size_t MAX_BLOCKS_AWAITING_PARENT_SIZE = 64 * 1024 * 1024;
+/** Seconds after which a block still waiting for its parent is dropped. */
+static const int64_t BLOCK_AWAITING_PARENT_EXPIRY = 10 * 60;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached their tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 2000;
+/** Maximum depth of a reorg announced with headers, deeper ones are announced with an inv of the new tip. */
+static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
+/** Blocks deeper than this below the tip are served whole to a cmpctblock request. */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Blocks deeper than this below the tip are served whole to a getblocktxn request. */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+/** Number of requested blocks whose block file ranges are read ahead at once when serving getdata. */
+static const unsigned int MAX_BLOCKS_READ_AHEAD = 16;
+/** Bytes read ahead past the start of the last block of a range, which has an unknown size. */
+static const unsigned int BLOCK_READ_AHEAD_TAIL = 256 * 1024;
 /** Size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
@@ -124,9 +157,11 @@ static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 static const unsigned int AVG_LOCAL_ADDRESS_BROADCAST_INTERVAL = 24 * 24 * 60;
 /** Average delay between peer address broadcasts in seconds. */
 static const unsigned int AVG_ADDRESS_BROADCAST_INTERVAL = 30;
-/** Average delay between trickled inventory broadcasts in seconds.
- *  Blocks, whitelisted receivers, and a random 25% of transactions bypass this. */
+/** Default average delay between trickled transaction inventory broadcasts in seconds,
+ *  halved for outbound peers. Blocks and whitelisted receivers bypass this. */
 static const unsigned int AVG_INVENTORY_BROADCAST_INTERVAL = 5;
+/** Maximum number of transactions announced to a peer per second of the trickle interval. */
+static const unsigned int INVENTORY_BROADCAST_PER_SECOND = 7;
 
 /** Enable bloom filter */
  static const bool DEFAULT_PEERBLOOMFILTERS = true;
@@ -172,6 +207,7 @@ extern bool fCheckBlockIndex;
 extern size_t nCoinCacheUsage;
 extern CFeeRate minRelayTxFee;
 extern int64_t nMaxTipAge;
+extern int64_t nInvBroadcastInterval;
 extern bool fVerifyingBlocks;
 
 extern bool fLargeWorkForkFound;
@@ -222,6 +258,8 @@ void UnloadBlockIndex();
 int ActiveProtocol();
 /** Process protocol messages received from a given node */
 bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interrupt);
+/** Process a masternode, budget or spork message, on a message worker thread unless there is none */
+void ProcessMasternodeMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, CConnman& connman);
 /**
  * Send queued protocol messages to be sent to a give node.
  *
@@ -233,6 +271,10 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
 bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interrupt);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the zerocoin spend checking thread */
+void ThreadZerocoinCheck();
+/** Whether blocks of this chain can hold zerocoin spends, that need the zerocoin checking threads */
+bool ZerocoinSpendsPossible();
 
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
@@ -252,6 +294,10 @@ bool ActivateBestChain(CValidationState& state, const CBlock* pblock = NULL, boo
 
 /** Create a new block index entry for a given block hash */
 CBlockIndex* InsertBlockIndex(uint256 hash);
+/** Find the headers announcing the blocks of vToAnnounce, in chain order, to a peer that knows the chain up
+ *  to pindexBestKnown and was last sent pindexBestSent. False if they should be announced with an inv instead. */
+bool FindHeadersToAnnounce(const CChain& chain, const std::vector<CBlockIndex*>& vToAnnounce, const CBlockIndex* pindexBestKnown,
+                           const CBlockIndex* pindexBestSent, std::vector<CBlockIndex*>& vHeaders);
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats);
 /** Increase a node's misbehavior score. */
@@ -259,10 +305,18 @@ void Misbehaving(NodeId nodeid, int howmuch) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
 
+/** Dump the mempool to disk, in dependency order */
+bool DumpMempool();
+/** Load the mempool from disk */
+bool LoadMempool();
+
 
 /** (try to) add transaction to memory pool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fOverrideMempoolLimit = false, bool fRejectInsaneFee = false, bool ignoreFees = false);
 
+/** (try to) add transaction to memory pool with a specified acceptance time **/
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit = false, bool fRejectInsaneFee = false, bool ignoreFees = false);
+
 bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool isDSTX = false);
 
 /** Convert CValidationState to a human-readable message for logging */
@@ -273,6 +327,14 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    int nBlocksInFlight;
+    int nDownloadWindow;
+    uint64_t nBlocksDownloaded;
+    uint64_t nBytesDownloaded;
+    int64_t nAvgBlockLatency;
+    int64_t nDownloadRate;
+    uint64_t nBlocksReassigned;
+    int nBlocksAnnounced;
 };
 
 CAmount GetMinRelayFee(const CTransaction& tx, const CTxMemPool& pool, unsigned int nBytes, bool fAllowFree);
@@ -364,6 +426,27 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 
+/** Reads blocks as stored on disk, which is how they are sent, without decoding them. The
+ *  last block file stays open: blocks stored next to each other are read sequentially. */
+class CRawBlockReader
+{
+private:
+    FILE* file = nullptr;
+    int nFile = -1;
+    // where the next read starts, in nFile
+    unsigned int nFilePos = 0;
+
+public:
+    CRawBlockReader() {}
+    ~CRawBlockReader();
+    CRawBlockReader(const CRawBlockReader&) = delete;
+    CRawBlockReader& operator=(const CRawBlockReader&) = delete;
+
+    /** Hint the OS to read ahead the parts of the block files holding these blocks */
+    void Prefetch(std::vector<CDiskBlockPos> vPos);
+    bool Read(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos);
+};
+
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -10,6 +10,7 @@
 #include "addrman.h"
 #include "chainparams.h"
 #include "fs.h"
+#include "layer2db.h"
 #include "masternode-budget.h"
 #include "masternode-sync.h"
 #include "masternode.h"
@@ -119,18 +120,22 @@ void CBudgetManager::CheckOrphanVotes()
     while (it1 != mapOrphanMasternodeBudgetVotes.end()) {
         if (budget.UpdateProposal(((*it1).second), NULL, strError)) {
             LogPrint(BCLog::MNBUDGET,"%s: Proposal/Budget is known, activating and removing orphan vote\n", __func__);
-            mapOrphanMasternodeBudgetVotes.erase(it1);
+            it1 = mapOrphanMasternodeBudgetVotes.erase(it1);
+        } else {
+            ++it1;
         }
-        ++it1;
     }
     auto it2 = mapOrphanFinalizedBudgetVotes.begin();
     while (it2 != mapOrphanFinalizedBudgetVotes.end()) {
         if (budget.UpdateFinalizedBudget(((*it2).second), NULL, strError)) {
             LogPrint(BCLog::MNBUDGET,"%s: Proposal/Budget is known, activating and removing orphan vote\n", __func__);
-            mapOrphanFinalizedBudgetVotes.erase(it2);
+            it2 = mapOrphanFinalizedBudgetVotes.erase(it2);
+        } else {
+            ++it2;
         }
-        ++it2;
     }
+    mapOrphanMasternodeBudgetVotes.expire();
+    mapOrphanFinalizedBudgetVotes.expire();
     LogPrint(BCLog::MNBUDGET,"%s: Done\n", __func__);
 }
 
@@ -254,33 +259,28 @@ CBudgetDB::CBudgetDB()
 
 bool CBudgetDB::Write(const CBudgetManager& objToSave)
 {
-    LOCK(objToSave.cs);
+    if (!pLayer2DB)
+        return false;
 
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fsbridge::fopen(pathDB, "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (const std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+    CDBBatch batch;
+    {
+        LOCK(objToSave.cs);
+        pLayer2DB->WriteMap(batch, DB_BUDGET_SEEN_PROPOSALS, objToSave.mapSeenMasternodeBudgetProposals);
+        pLayer2DB->WriteMap(batch, DB_BUDGET_SEEN_VOTES, objToSave.mapSeenMasternodeBudgetVotes);
+        pLayer2DB->WriteMap(batch, DB_BUDGET_SEEN_FINALIZED, objToSave.mapSeenFinalizedBudgets);
+        pLayer2DB->WriteMap(batch, DB_BUDGET_SEEN_FINALIZED_VOTES, objToSave.mapSeenFinalizedBudgetVotes);
+        pLayer2DB->WriteMap(batch, DB_BUDGET_ORPHAN_VOTES, objToSave.mapOrphanMasternodeBudgetVotes);
+        pLayer2DB->WriteMap(batch, DB_BUDGET_ORPHAN_FINALIZED_VOTES, objToSave.mapOrphanFinalizedBudgetVotes);
+        pLayer2DB->WriteMap(batch, DB_BUDGET_PROPOSALS, objToSave.mapProposals);
+        pLayer2DB->WriteMap(batch, DB_BUDGET_FINALIZED, objToSave.mapFinalizedBudgets);
     }
-    fileout.fclose();
 
-    LogPrint(BCLog::MNBUDGET,"Written info to budget.dat  %dms\n", GetTimeMillis() - nStart);
+    if (!pLayer2DB->Commit(batch, strMagicMessage))
+        return error("%s : Failed to write budget cache", __func__);
+
+    LogPrint(BCLog::MNBUDGET,"Written budget cache  %dms\n", GetTimeMillis() - nStart);
 
     return true;
 }
@@ -289,6 +289,55 @@ CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
 {
     LOCK(objToLoad.cs);
 
+    int64_t nStart = GetTimeMillis();
+
+    switch (pLayer2DB->ReadSectionHeader(strMagicMessage)) {
+    case CLayer2DB::SECTION_MISSING: {
+        // nothing flushed yet, pick up the flat file of older versions
+        ReadResult result = ReadFlatFile(objToLoad);
+        if (result != Ok)
+            return result;
+        break;
+    }
+    case CLayer2DB::SECTION_WRONG_NETWORK:
+        error("%s : Invalid network magic number", __func__);
+        return IncorrectMagicNumber;
+    case CLayer2DB::SECTION_OK:
+        if (!pLayer2DB->ReadMap(DB_BUDGET_SEEN_PROPOSALS, objToLoad.mapSeenMasternodeBudgetProposals) ||
+            !pLayer2DB->ReadMap(DB_BUDGET_SEEN_VOTES, objToLoad.mapSeenMasternodeBudgetVotes) ||
+            !pLayer2DB->ReadMap(DB_BUDGET_SEEN_FINALIZED, objToLoad.mapSeenFinalizedBudgets) ||
+            !pLayer2DB->ReadMap(DB_BUDGET_SEEN_FINALIZED_VOTES, objToLoad.mapSeenFinalizedBudgetVotes) ||
+            !pLayer2DB->ReadMap(DB_BUDGET_ORPHAN_VOTES, objToLoad.mapOrphanMasternodeBudgetVotes) ||
+            !pLayer2DB->ReadMap(DB_BUDGET_ORPHAN_FINALIZED_VOTES, objToLoad.mapOrphanFinalizedBudgetVotes) ||
+            !pLayer2DB->ReadMap(DB_BUDGET_PROPOSALS, objToLoad.mapProposals) ||
+            !pLayer2DB->ReadMap(DB_BUDGET_FINALIZED, objToLoad.mapFinalizedBudgets)) {
+            objToLoad.Clear();
+            error("%s : Deserialize error in budget cache", __func__);
+            return IncorrectFormat;
+        }
+        break;
+    }
+
+    // the seen votes age from their own time, not from the restart
+    objToLoad.mapSeenMasternodeBudgetVotes.SetTimes([](const CBudgetVote& vote) { return vote.GetTime(); });
+    objToLoad.mapOrphanMasternodeBudgetVotes.SetTimes([](const CBudgetVote& vote) { return vote.GetTime(); });
+    objToLoad.mapSeenFinalizedBudgetVotes.SetTimes([](const CFinalizedBudgetVote& vote) { return vote.GetTime(); });
+    objToLoad.mapOrphanFinalizedBudgetVotes.SetTimes([](const CFinalizedBudgetVote& vote) { return vote.GetTime(); });
+
+    LogPrint(BCLog::MNBUDGET,"Loaded budget cache  %dms\n", GetTimeMillis() - nStart);
+    LogPrint(BCLog::MNBUDGET,"  %s\n", objToLoad.ToString());
+    if (!fDryRun) {
+        LogPrint(BCLog::MNBUDGET,"Budget manager - cleaning....\n");
+        objToLoad.CheckAndRemove();
+        LogPrint(BCLog::MNBUDGET,"Budget manager - result:\n");
+        LogPrint(BCLog::MNBUDGET,"  %s\n", objToLoad.ToString());
+    }
+
+    return Ok;
+}
+
+CBudgetDB::ReadResult CBudgetDB::ReadFlatFile(CBudgetManager& objToLoad)
+{
     int64_t nStart = GetTimeMillis();
     // open input file, and associate with CAutoFile
     FILE* file = fsbridge::fopen(pathDB, "rb");
@@ -359,14 +408,6 @@ CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
     }
 
     LogPrint(BCLog::MNBUDGET,"Loaded info from budget.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint(BCLog::MNBUDGET,"  %s\n", objToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint(BCLog::MNBUDGET,"Budget manager - cleaning....\n");
-        objToLoad.CheckAndRemove();
-        LogPrint(BCLog::MNBUDGET,"Budget manager - result:\n");
-        LogPrint(BCLog::MNBUDGET,"  %s\n", objToLoad.ToString());
-    }
-
     return Ok;
 }
 
@@ -375,23 +416,6 @@ void DumpBudgets()
     int64_t nStart = GetTimeMillis();
 
     CBudgetDB budgetdb;
-    CBudgetManager tempBudget;
-
-    LogPrint(BCLog::MNBUDGET,"Verifying budget.dat format...\n");
-    CBudgetDB::ReadResult readResult = budgetdb.Read(tempBudget, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CBudgetDB::FileError)
-        LogPrint(BCLog::MNBUDGET,"Missing budgets file - budget.dat, will try to recreate\n");
-    else if (readResult != CBudgetDB::Ok) {
-        LogPrint(BCLog::MNBUDGET,"Error reading budget.dat: ");
-        if (readResult == CBudgetDB::IncorrectFormat)
-            LogPrint(BCLog::MNBUDGET,"magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint(BCLog::MNBUDGET,"file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
-    LogPrint(BCLog::MNBUDGET,"Writting info to budget.dat...\n");
     budgetdb.Write(budget);
 
     LogPrint(BCLog::MNBUDGET,"Budget dump finished  %dms\n", GetTimeMillis() - nStart);
@@ -425,6 +449,7 @@ bool CBudgetManager::AddProposal(CBudgetProposal& budgetProposal)
     }
 
     mapProposals.insert(std::make_pair(budgetProposal.GetHash(), budgetProposal));
+    InvalidateBudgetCache();
     LogPrint(BCLog::MNBUDGET,"%s: proposal %s added\n", __func__, budgetProposal.GetName());
     return true;
 }
@@ -463,6 +488,11 @@ void CBudgetManager::CheckAndRemove()
     // Remove invalid entries by overwriting complete map
     mapFinalizedBudgets.swap(tmpMapFinalizedBudgets);
     mapProposals.swap(tmpMapProposals);
+    InvalidateBudgetCache();
+
+    // drop the seen votes that expired
+    mapSeenMasternodeBudgetVotes.expire();
+    mapSeenFinalizedBudgetVotes.expire();
 
     LogPrint(BCLog::MNBUDGET, "%s: mapFinalizedBudgets cleanup - size after: %d\n", __func__, mapFinalizedBudgets.size());
     LogPrint(BCLog::MNBUDGET, "%s: mapProposals cleanup - size after: %d\n", __func__, mapProposals.size());
@@ -597,7 +627,8 @@ TrxValidationStatus CBudgetManager::IsTransactionValid(const CTransaction& txNew
 
     TrxValidationStatus transactionStatus = TrxValidationStatus::InValid;
     int nHighestCount = 0;
-    int nFivePercent = mnodeman.CountEnabled(ActiveProtocol()) / 20;
+    const int mnCount = mnodeman.CountEnabled(ActiveProtocol());
+    int nFivePercent = mnCount / 20;
     std::vector<CFinalizedBudget*> ret;
 
     LogPrint(BCLog::MNBUDGET,"%s: checking %lli finalized budgets\n", __func__, mapFinalizedBudgets.size());
@@ -627,7 +658,7 @@ TrxValidationStatus CBudgetManager::IsTransactionValid(const CTransaction& txNew
     // check the highest finalized budgets (+/- 10% to assist in consensus)
 
     std::string strProposals = "";
-    int nCountThreshold = nHighestCount - mnodeman.CountEnabled(ActiveProtocol()) / 10;
+    int nCountThreshold = nHighestCount - mnCount / 10;
     bool fThreshold = false;
     it = mapFinalizedBudgets.begin();
     while (it != mapFinalizedBudgets.end()) {
@@ -678,7 +709,8 @@ std::vector<CBudgetProposal*> CBudgetManager::GetAllProposals()
 
     for (auto& it: mapProposals) {
         CBudgetProposal* pbudgetProposal = &(it.second);
-        pbudgetProposal->CleanAndRemove();
+        if (pbudgetProposal->CleanAndRemove())
+            InvalidateBudgetCache();
         vBudgetProposalRet.push_back(pbudgetProposal);
     }
 
@@ -687,7 +719,6 @@ std::vector<CBudgetProposal*> CBudgetManager::GetAllProposals()
     return vBudgetProposalRet;
 }
 
-//Need to review this function
 std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
 {
     LOCK(cs);
@@ -696,6 +727,16 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
     if (nHeight <= 0)
         return std::vector<CBudgetProposal*>();
 
+    const int nBlocksPerCycle = Params().GetConsensus().nBudgetCycleBlocks;
+    int nBlockStart = nHeight - nHeight % nBlocksPerCycle + nBlocksPerCycle;
+    int nBlockEnd = nBlockStart + nBlocksPerCycle - 1;
+    int mnCount = mnodeman.CountEnabled(ActiveProtocol());
+
+    if (fBudgetCacheValid && nBudgetCacheBlockStart == nBlockStart && nBudgetCacheMnCount == mnCount &&
+        GetAdjustedTime() < nBudgetCacheExpiry) {
+        return vBudgetCache;
+    }
+
     // ------- Sort budgets by net Yes Count
     std::vector<CBudgetProposal*> vBudgetPorposalsSort;
     for (auto& it: mapProposals) {
@@ -707,15 +748,16 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
     // ------- Grab The Budgets In Order
     std::vector<CBudgetProposal*> vBudgetProposalsRet;
     CAmount nBudgetAllocated = 0;
-
-    const int nBlocksPerCycle = Params().GetConsensus().nBudgetCycleBlocks;
-    int nBlockStart = nHeight - nHeight % nBlocksPerCycle + nBlocksPerCycle;
-    int nBlockEnd = nBlockStart + nBlocksPerCycle - 1;
-    int mnCount = mnodeman.CountEnabled(ActiveProtocol());
     CAmount nTotalBudget = GetTotalBudget(nBlockStart);
+    // the ranking has to be redone as soon as a proposal becomes established
+    const int64_t nEstablishmentTime = Params().GetConsensus().nProposalEstablishmentTime;
+    int64_t nExpiry = std::numeric_limits<int64_t>::max();
 
     for (CBudgetProposal* pbudgetProposal: vBudgetPorposalsSort) {
         LogPrint(BCLog::MNBUDGET,"%s: Processing Budget %s\n", __func__, pbudgetProposal->GetName());
+        if (!pbudgetProposal->IsEstablished())
+            nExpiry = std::min(nExpiry, pbudgetProposal->nTime + nEstablishmentTime + 1);
+
         //prop start/end should be inside this period
         if (pbudgetProposal->IsPassing(nBlockStart, nBlockEnd, mnCount)) {
             LogPrint(BCLog::MNBUDGET,"%s:  -   Check 1 passed: valid=%d | %ld <= %ld | %ld >= %ld | Yeas=%d Nays=%d Count=%d | established=%d\n",
@@ -735,12 +777,18 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
         } else {
             LogPrint(BCLog::MNBUDGET,"%s:  -   Check 1 failed: valid=%d | %ld <= %ld | %ld >= %ld | Yeas=%d Nays=%d Count=%d | established=%d\n",
                     __func__, pbudgetProposal->IsValid(), pbudgetProposal->GetBlockStart(), nBlockStart, pbudgetProposal->GetBlockEnd(),
-                    nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), mnodeman.CountEnabled(ActiveProtocol()) / 10,
+                    nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), mnCount / 10,
                     pbudgetProposal->IsEstablished());
         }
 
     }
 
+    vBudgetCache = vBudgetProposalsRet;
+    fBudgetCacheValid = true;
+    nBudgetCacheBlockStart = nBlockStart;
+    nBudgetCacheMnCount = mnCount;
+    nBudgetCacheExpiry = nExpiry;
+
     return vBudgetProposalsRet;
 }
 
@@ -854,6 +902,16 @@ void CBudgetManager::AddSeenFinalizedBudgetVote(const CFinalizedBudgetVote& vote
 }
 
 
+void CBudgetManager::GetSeenCacheStats(expiringmap_stats& seenVotes, expiringmap_stats& orphanVotes,
+                                       expiringmap_stats& seenFinalizedVotes, expiringmap_stats& orphanFinalizedVotes) const
+{
+    LOCK(cs);
+    seenVotes = mapSeenMasternodeBudgetVotes.GetStats();
+    orphanVotes = mapOrphanMasternodeBudgetVotes.GetStats();
+    seenFinalizedVotes = mapSeenFinalizedBudgetVotes.GetStats();
+    orphanFinalizedVotes = mapOrphanFinalizedBudgetVotes.GetStats();
+}
+
 CDataStream CBudgetManager::GetProposalVoteSerialized(const uint256& voteHash) const
 {
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
@@ -945,7 +1003,8 @@ void CBudgetManager::NewBlock(int height)
     LogPrint(BCLog::MNBUDGET,"%s:  mapProposals cleanup - size: %d\n", __func__, mapProposals.size());
     std::map<uint256, CBudgetProposal>::iterator it2 = mapProposals.begin();
     while (it2 != mapProposals.end()) {
-        (*it2).second.CleanAndRemove();
+        if ((*it2).second.CleanAndRemove())
+            InvalidateBudgetCache();
         ++it2;
     }
 
@@ -1274,6 +1333,7 @@ bool CBudgetManager::UpdateProposal(const CBudgetVote& vote, CNode* pfrom, std::
 
             LogPrint(BCLog::MNBUDGET,"%s: Unknown proposal %d, asking for source proposal\n", __func__, nProposalHash.ToString());
             mapOrphanMasternodeBudgetVotes[nProposalHash] = vote;
+            mapOrphanMasternodeBudgetVotes.touch(nProposalHash);
 
             if (!askedForSourceProposalOrBudget.count(nProposalHash)) {
                 g_connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::BUDGETVOTESYNC, nProposalHash));
@@ -1286,7 +1346,11 @@ bool CBudgetManager::UpdateProposal(const CBudgetVote& vote, CNode* pfrom, std::
     }
 
 
-    return mapProposals[nProposalHash].AddOrUpdateVote(vote, strError);
+    if (!mapProposals[nProposalHash].AddOrUpdateVote(vote, strError))
+        return false;
+
+    InvalidateBudgetCache();
+    return true;
 }
 
 bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pfrom, std::string& strError)
@@ -1302,6 +1366,7 @@ bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pf
 
             LogPrint(BCLog::MNBUDGET,"%s: Unknown Finalized Proposal %s, asking for source budget\n", __func__, nBudgetHash.ToString());
             mapOrphanFinalizedBudgetVotes[nBudgetHash] = vote;
+            mapOrphanFinalizedBudgetVotes.touch(nBudgetHash);
 
             if (!askedForSourceProposalOrBudget.count(nBudgetHash)) {
                 g_connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::BUDGETVOTESYNC, nBudgetHash));
@@ -1318,6 +1383,7 @@ bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pf
 
 CBudgetProposal::CBudgetProposal()
 {
+    nAlloted = 0;
     strProposalName = "unknown";
     nBlockStart = 0;
     nBlockEnd = 0;
@@ -1329,6 +1395,7 @@ CBudgetProposal::CBudgetProposal()
 
 CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strURLIn, int nBlockStartIn, int nBlockEndIn, CScript addressIn, CAmount nAmountIn, uint256 nFeeTXHashIn)
 {
+    nAlloted = 0;
     strProposalName = strProposalNameIn;
     strURL = strURLIn;
     nBlockStart = nBlockStartIn;
@@ -1342,6 +1409,7 @@ CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strU
 
 CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
 {
+    nAlloted = other.nAlloted;
     strProposalName = other.strProposalName;
     strURL = other.strURL;
     nBlockStart = other.nBlockStart;
@@ -1350,7 +1418,11 @@ CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
     nAmount = other.nAmount;
     nTime = other.nTime;
     nFeeTXHash = other.nFeeTXHash;
-    mapVotes = other.mapVotes;
+    {
+        LOCK(other.cs);
+        mapVotes = other.mapVotes;
+        tally = other.tally;
+    }
     fValid = true;
     strInvalid = "";
 }
@@ -1479,8 +1551,9 @@ bool CBudgetProposal::AddOrUpdateVote(const CBudgetVote& vote, std::string& strE
     const uint256& hash = vote.GetVin().prevout.GetHash();
     const int64_t voteTime = vote.GetTime();
 
-    if (mapVotes.count(hash)) {
-        const int64_t& oldTime = mapVotes[hash].GetTime();
+    std::map<uint256, CBudgetVote>::iterator itOld = mapVotes.find(hash);
+    if (itOld != mapVotes.end()) {
+        const int64_t& oldTime = itOld->second.GetTime();
         if (oldTime > voteTime) {
             strError = strprintf("new vote older than existing vote - %s\n", vote.GetHash().ToString());
             LogPrint(BCLog::MNBUDGET, "%s: %s\n", __func__, strError);
@@ -1501,7 +1574,13 @@ bool CBudgetProposal::AddOrUpdateVote(const CBudgetVote& vote, std::string& strE
         return false;
     }
 
-    mapVotes[hash] = vote;
+    if (itOld != mapVotes.end()) {
+        tally.Count(itOld->second, -1);
+        itOld->second = vote;
+    } else {
+        mapVotes.insert(std::make_pair(hash, vote));
+    }
+    tally.Count(vote, 1);
     LogPrint(BCLog::MNBUDGET, "%s: %s %s\n", __func__, strAction.c_str(), vote.GetHash().ToString().c_str());
 
     return true;
@@ -1531,37 +1610,59 @@ void CBudgetProposal::SetSynced(bool synced)
 }
 
 // If masternode voted for a proposal, but is now invalid -- remove the vote
-void CBudgetProposal::CleanAndRemove()
+bool CBudgetProposal::CleanAndRemove()
 {
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
+    LOCK(cs);
+    bool fChanged = false;
+    for (auto& it: mapVotes) {
+        CBudgetVote& vote = it.second;
+        const bool fValidVote = mnodeman.Find(vote.GetVin()) != nullptr;
+        if (fValidVote != vote.IsValid()) {
+            tally.Count(vote, -1);
+            vote.SetValid(fValidVote);
+            tally.Count(vote, 1);
+            fChanged = true;
+        }
+    }
+    return fChanged;
+}
 
-    while (it != mapVotes.end()) {
-        CMasternode* pmn = mnodeman.Find((*it).second.GetVin());
-        (*it).second.SetValid(pmn != nullptr);
-        ++it;
+void CBudgetProposal::RecountVotes()
+{
+    LOCK(cs);
+    tally = CBudgetVoteTally();
+    for (const auto& it: mapVotes) {
+        tally.Count(it.second, 1);
     }
 }
 
-double CBudgetProposal::GetRatio() const
+int CBudgetProposal::GetYeas() const
 {
-    int yeas = GetYeas();
-    int nays = GetNays();
+    LOCK(cs);
+    return tally.nYeas;
+}
 
-    if (yeas + nays == 0) return 0.0f;
+int CBudgetProposal::GetNays() const
+{
+    LOCK(cs);
+    return tally.nNays;
+}
 
-    return ((double)(yeas) / (double)(yeas + nays));
+int CBudgetProposal::GetAbstains() const
+{
+    LOCK(cs);
+    return tally.nAbstains;
 }
 
-int CBudgetProposal::GetVoteCount(CBudgetVote::VoteDirection vd) const
+double CBudgetProposal::GetRatio() const
 {
     LOCK(cs);
-    int ret = 0;
-    for (const auto& it : mapVotes) {
-        const CBudgetVote& vote = it.second;
-        if (vote.GetDirection() == vd && vote.IsValid())
-            ret++;
-    }
-    return ret;
+    int yeas = tally.nYeas;
+    int nays = tally.nNays;
+
+    if (yeas + nays == 0) return 0.0f;
+
+    return ((double)(yeas) / (double)(yeas + nays));
 }
 
 int CBudgetProposal::GetBlockStartCycle() const
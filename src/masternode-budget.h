@@ -8,6 +8,7 @@
 #define MASTERNODE_BUDGET_H
 
 #include "base58.h"
+#include "expiringmap.h"
 #include "init.h"
 #include "key.h"
 #include "main.h"
@@ -40,6 +41,12 @@ static const CAmount PROPOSAL_FEE_TX = (50 * COIN);
 static const CAmount BUDGET_FEE_TX_OLD = (50 * COIN);
 static const CAmount BUDGET_FEE_TX = (5 * COIN);
 static const int64_t BUDGET_VOTE_UPDATE_MIN = 60 * 60;
+// seen votes are kept for about a budget cycle, orphan votes until their proposal shows up
+static const int64_t BUDGET_SEEN_VOTES_SECONDS = 31 * 24 * 60 * 60;
+static const size_t BUDGET_SEEN_VOTES_MAX_USAGE = 32 << 20;
+static const size_t BUDGET_SEEN_FINALIZED_VOTES_MAX_USAGE = 16 << 20;
+static const int64_t BUDGET_ORPHAN_VOTES_SECONDS = 24 * 60 * 60;
+static const size_t BUDGET_ORPHAN_VOTES_MAX_USAGE = 4 << 20;
 static std::map<uint256, int> mapPayment_History;
 
 extern std::vector<CBudgetProposalBroadcast> vecImmatureBudgetProposals;
@@ -127,6 +134,26 @@ public:
     }
 };
 
+/** Running count of the valid votes on a proposal, by direction */
+struct CBudgetVoteTally {
+    int nYeas;
+    int nNays;
+    int nAbstains;
+
+    CBudgetVoteTally() : nYeas(0), nNays(0), nAbstains(0) {}
+
+    // nSign is +1 to count the vote, -1 to uncount it
+    void Count(const CBudgetVote& vote, int nSign)
+    {
+        if (!vote.IsValid()) return;
+        switch (vote.GetDirection()) {
+            case CBudgetVote::VOTE_YES: nYeas += nSign; break;
+            case CBudgetVote::VOTE_NO: nNays += nSign; break;
+            case CBudgetVote::VOTE_ABSTAIN: nAbstains += nSign; break;
+        }
+    }
+};
+
 //
 // CFinalizedBudgetVote - Allow a masternode node to vote and broadcast throughout the network
 //
@@ -181,7 +208,7 @@ public:
     }
 };
 
-/** Save Budget Manager (budget.dat)
+/** Save Budget Manager (layer 2 store, budget.dat of older versions)
  */
 class CBudgetDB
 {
@@ -200,6 +227,10 @@ public:
         IncorrectFormat
     };
 
+private:
+    ReadResult ReadFlatFile(CBudgetManager& objToLoad);
+
+public:
     CBudgetDB();
     bool Write(const CBudgetManager& objToSave);
     ReadResult Read(CBudgetManager& objToLoad, bool fDryRun = false);
@@ -211,6 +242,8 @@ public:
 //
 class CBudgetManager
 {
+    friend class CBudgetDB;
+
 private:
     //hold txes until they mature enough to use
     std::map<uint256, uint256> mapCollateralTxids;
@@ -220,22 +253,40 @@ private:
     std::map<uint256, CFinalizedBudget> mapFinalizedBudgets;
 
     std::map<uint256, CBudgetProposalBroadcast> mapSeenMasternodeBudgetProposals;
-    std::map<uint256, CBudgetVote> mapSeenMasternodeBudgetVotes;
-    std::map<uint256, CBudgetVote> mapOrphanMasternodeBudgetVotes;
+    expiringmap<uint256, CBudgetVote, SaltedTxidHasher> mapSeenMasternodeBudgetVotes;
+    expiringmap<uint256, CBudgetVote, SaltedTxidHasher> mapOrphanMasternodeBudgetVotes;
     std::map<uint256, CFinalizedBudgetBroadcast> mapSeenFinalizedBudgets;
-    std::map<uint256, CFinalizedBudgetVote> mapSeenFinalizedBudgetVotes;
-    std::map<uint256, CFinalizedBudgetVote> mapOrphanFinalizedBudgetVotes;
+    expiringmap<uint256, CFinalizedBudgetVote, SaltedTxidHasher> mapSeenFinalizedBudgetVotes;
+    expiringmap<uint256, CFinalizedBudgetVote, SaltedTxidHasher> mapOrphanFinalizedBudgetVotes;
 
     void SetSynced(bool synced);
 
     // Memory Only. Updated in NewBlock (blocks arrive in order)
     std::atomic<int> nBestHeight;
 
+    // Memory Only. Ranked budget of the next cycle, kept until a proposal, a vote,
+    // the next cycle, the masternode count or a proposal becoming established changes it
+    std::vector<CBudgetProposal*> vBudgetCache;
+    bool fBudgetCacheValid;
+    int nBudgetCacheBlockStart;
+    int nBudgetCacheMnCount;
+    int64_t nBudgetCacheExpiry;
+
+    void InvalidateBudgetCache() { fBudgetCacheValid = false; }
+
 public:
     // critical section to protect the inner data structures
     mutable RecursiveMutex cs;
 
-    CBudgetManager()
+    CBudgetManager() :
+        mapSeenMasternodeBudgetVotes(BUDGET_SEEN_VOTES_SECONDS, BUDGET_SEEN_VOTES_MAX_USAGE),
+        mapOrphanMasternodeBudgetVotes(BUDGET_ORPHAN_VOTES_SECONDS, BUDGET_ORPHAN_VOTES_MAX_USAGE),
+        mapSeenFinalizedBudgetVotes(BUDGET_SEEN_VOTES_SECONDS, BUDGET_SEEN_FINALIZED_VOTES_MAX_USAGE),
+        mapOrphanFinalizedBudgetVotes(BUDGET_ORPHAN_VOTES_SECONDS, BUDGET_ORPHAN_VOTES_MAX_USAGE),
+        fBudgetCacheValid(false),
+        nBudgetCacheBlockStart(0),
+        nBudgetCacheMnCount(0),
+        nBudgetCacheExpiry(0)
     {
         mapProposals.clear();
         mapFinalizedBudgets.clear();
@@ -257,6 +308,9 @@ public:
     bool HaveSeenFinalizedBudget(const uint256& budgetHash) const { return mapSeenFinalizedBudgets.count(budgetHash); }
     bool HaveSeenFinalizedBudgetVote(const uint256& voteHash) const { return mapSeenFinalizedBudgetVotes.count(voteHash); }
 
+    void GetSeenCacheStats(expiringmap_stats& seenVotes, expiringmap_stats& orphanVotes,
+                           expiringmap_stats& seenFinalizedVotes, expiringmap_stats& orphanFinalizedVotes) const;
+
     void AddSeenProposal(const CBudgetProposalBroadcast& prop);
     void AddSeenProposalVote(const CBudgetVote& vote);
     void AddSeenFinalizedBudget(const CFinalizedBudgetBroadcast& bud);
@@ -304,6 +358,7 @@ public:
         LOCK(cs);
 
         LogPrintf("Budget object cleared\n");
+        InvalidateBudgetCache();
         mapProposals.clear();
         mapFinalizedBudgets.clear();
         mapSeenMasternodeBudgetProposals.clear();
@@ -507,7 +562,9 @@ private:
     std::string strInvalid;
 
 protected:
+    // latest vote of each masternode (by collateral hash), and the running count of the valid ones
     std::map<uint256, CBudgetVote> mapVotes;
+    CBudgetVoteTally tally;
     std::string strProposalName;
     std::string strURL;
     int nBlockStart;
@@ -550,15 +607,16 @@ public:
     int GetBlockEndCycle() const;
     const uint256& GetFeeTXHash() const { return nFeeTXHash;  }
     double GetRatio() const;
-    int GetVoteCount(CBudgetVote::VoteDirection vd) const;
-    int GetYeas() const { return GetVoteCount(CBudgetVote::VOTE_YES); }
-    int GetNays() const { return GetVoteCount(CBudgetVote::VOTE_NO); }
-    int GetAbstains() const { return GetVoteCount(CBudgetVote::VOTE_ABSTAIN); };
+    int GetYeas() const;
+    int GetNays() const;
+    int GetAbstains() const;
     CAmount GetAmount() const { return nAmount; }
     void SetAllotted(CAmount nAllotedIn) { nAlloted = nAllotedIn; }
     CAmount GetAllotted() const { return nAlloted; }
 
-    void CleanAndRemove();
+    // updates the validity of the votes, returns true if the tally changed
+    bool CleanAndRemove();
+    void RecountVotes();
 
     uint256 GetHash() const
     {
@@ -589,6 +647,8 @@ public:
 
         //for saving to the serialized db
         READWRITE(mapVotes);
+        if (ser_action.ForRead())
+            RecountVotes();
     }
 
     // compare proposals by proposal hash
@@ -624,6 +684,7 @@ public:
         swap(first.nTime, second.nTime);
         swap(first.nFeeTXHash, second.nFeeTXHash);
         first.mapVotes.swap(second.mapVotes);
+        swap(first.tally, second.tally);
     }
 
     CBudgetProposalBroadcast& operator=(CBudgetProposalBroadcast from)
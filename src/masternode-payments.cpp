@@ -8,6 +8,7 @@
 #include "addrman.h"
 #include "chainparams.h"
 #include "fs.h"
+#include "layer2db.h"
 #include "masternode-budget.h"
 #include "masternode-sync.h"
 #include "masternodeman.h"
@@ -26,6 +27,8 @@ RecursiveMutex cs_vecPayments;
 RecursiveMutex cs_mapMasternodeBlocks;
 RecursiveMutex cs_mapMasternodePayeeVotes;
 
+SaltedScriptHasher::SaltedScriptHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
 //
 // CMasternodePaymentDB
 //
@@ -38,36 +41,76 @@ CMasternodePaymentDB::CMasternodePaymentDB()
 
 bool CMasternodePaymentDB::Write(const CMasternodePayments& objToSave)
 {
+    if (!pLayer2DB)
+        return false;
+
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fsbridge::fopen(pathDB, "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (const std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+    CDBBatch batch;
+    {
+        LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
+        pLayer2DB->WriteMap(batch, DB_MNW_VOTES, objToSave.mapMasternodePayeeVotes);
+        pLayer2DB->WriteMap(batch, DB_MNW_BLOCKS, objToSave.masternodeBlocks);
     }
-    fileout.fclose();
 
-    LogPrint(BCLog::MASTERNODE,"Written info to mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
+    if (!pLayer2DB->Commit(batch, strMagicMessage))
+        return error("%s : Failed to write masternode payments cache", __func__);
+
+    LogPrint(BCLog::MASTERNODE,"Written masternode payments cache  %dms\n", GetTimeMillis() - nStart);
 
     return true;
 }
 
 CMasternodePaymentDB::ReadResult CMasternodePaymentDB::Read(CMasternodePayments& objToLoad, bool fDryRun)
+{
+    int64_t nStart = GetTimeMillis();
+
+    switch (pLayer2DB->ReadSectionHeader(strMagicMessage)) {
+    case CLayer2DB::SECTION_MISSING: {
+        // nothing flushed yet, pick up the flat file of older versions
+        ReadResult result = ReadFlatFile(objToLoad);
+        if (result != Ok)
+            return result;
+        break;
+    }
+    case CLayer2DB::SECTION_WRONG_NETWORK:
+        error("%s : Invalid network magic number", __func__);
+        return IncorrectMagicNumber;
+    case CLayer2DB::SECTION_OK: {
+        const int nHeight = WITH_LOCK(cs_main, return chainActive.Height());
+        const int nLimit = objToLoad.GetHistoryLimit();
+        LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
+        // read whole first: the window is sized from the heights stored
+        std::map<int, CMasternodeBlockPayees> mapBlocks;
+        if (!pLayer2DB->ReadMap(DB_MNW_VOTES, objToLoad.mapMasternodePayeeVotes) ||
+            !pLayer2DB->ReadMap(DB_MNW_BLOCKS, mapBlocks)) {
+            objToLoad.Clear();
+            error("%s : Deserialize error in masternode payments cache", __func__);
+            return IncorrectFormat;
+        }
+        // only the heights CleanPaymentList would keep, a stray one mustn't size the window
+        if (nHeight >= 0) {
+            mapBlocks.erase(mapBlocks.begin(), mapBlocks.lower_bound(nHeight - nLimit));
+            mapBlocks.erase(mapBlocks.upper_bound(nHeight + MNPAYMENTS_FUTURE_BLOCKS), mapBlocks.end());
+        }
+        objToLoad.masternodeBlocks.Assign(mapBlocks, std::min(nLimit + MNPAYMENTS_FUTURE_BLOCKS + 1, MNPAYMENTS_WINDOW_MAX_LOAD));
+        break;
+    }
+    }
+
+    LogPrint(BCLog::MASTERNODE,"Loaded masternode payments cache  %dms\n", GetTimeMillis() - nStart);
+    LogPrint(BCLog::MASTERNODE,"  %s\n", objToLoad.ToString());
+    if (!fDryRun) {
+        LogPrint(BCLog::MASTERNODE,"Masternode payments manager - cleaning....\n");
+        objToLoad.CleanPaymentList();
+        LogPrint(BCLog::MASTERNODE,"Masternode payments manager - result:\n");
+        LogPrint(BCLog::MASTERNODE,"  %s\n", objToLoad.ToString());
+    }
+
+    return Ok;
+}
+
+CMasternodePaymentDB::ReadResult CMasternodePaymentDB::ReadFlatFile(CMasternodePayments& objToLoad)
 {
     int64_t nStart = GetTimeMillis();
     // open input file, and associate with CAutoFile
@@ -138,14 +181,6 @@ CMasternodePaymentDB::ReadResult CMasternodePaymentDB::Read(CMasternodePayments&
     }
 
     LogPrint(BCLog::MASTERNODE,"Loaded info from mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint(BCLog::MASTERNODE,"  %s\n", objToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint(BCLog::MASTERNODE,"Masternode payments manager - cleaning....\n");
-        objToLoad.CleanPaymentList();
-        LogPrint(BCLog::MASTERNODE,"Masternode payments manager - result:\n");
-        LogPrint(BCLog::MASTERNODE,"  %s\n", objToLoad.ToString());
-    }
-
     return Ok;
 }
 
@@ -219,26 +254,9 @@ void DumpMasternodePayments()
     int64_t nStart = GetTimeMillis();
 
     CMasternodePaymentDB paymentdb;
-    CMasternodePayments tempPayments;
-
-    LogPrint(BCLog::MASTERNODE,"Verifying mnpayments.dat format...\n");
-    CMasternodePaymentDB::ReadResult readResult = paymentdb.Read(tempPayments, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CMasternodePaymentDB::FileError)
-        LogPrint(BCLog::MASTERNODE,"Missing budgets file - mnpayments.dat, will try to recreate\n");
-    else if (readResult != CMasternodePaymentDB::Ok) {
-        LogPrint(BCLog::MASTERNODE,"Error reading mnpayments.dat: ");
-        if (readResult == CMasternodePaymentDB::IncorrectFormat)
-            LogPrint(BCLog::MASTERNODE,"magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint(BCLog::MASTERNODE,"file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
-    LogPrint(BCLog::MASTERNODE,"Writting info to mnpayments.dat...\n");
     paymentdb.Write(masternodePayments);
 
-    LogPrint(BCLog::MASTERNODE,"Budget dump finished  %dms\n", GetTimeMillis() - nStart);
+    LogPrint(BCLog::MASTERNODE,"Masternode payments dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
 bool IsBlockValueValid(int nHeight, CAmount nExpectedValue, CAmount nMinted)
@@ -437,7 +455,7 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
         }
 
         int nFirstBlock = nHeight - (mnodeman.CountEnabled() * 1.25);
-        if (winner.nBlockHeight < nFirstBlock || winner.nBlockHeight > nHeight + 20) {
+        if (winner.nBlockHeight < nFirstBlock || winner.nBlockHeight > nHeight + MNPAYMENTS_FUTURE_BLOCKS) {
             LogPrint(BCLog::MASTERNODE, "mnw - winner out of range - FirstBlock %d Height %d bestHeight %d\n", nFirstBlock, winner.nBlockHeight, nHeight);
             return;
         }
@@ -499,11 +517,26 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
 
 bool CMasternodePayments::GetBlockPayee(int nBlockHeight, CScript& payee)
 {
-    if (mapMasternodeBlocks.count(nBlockHeight)) {
-        return mapMasternodeBlocks[nBlockHeight].GetPayee(payee);
-    }
+    LOCK(cs_mapMasternodeBlocks);
 
-    return false;
+    const CMasternodeBlockPayees* pblockPayees = masternodeBlocks.Find(nBlockHeight);
+    return pblockPayees && pblockPayees->GetPayee(payee);
+}
+
+bool CMasternodePayments::HasPaidPayee(int nBlockHeight, const CScript& payee)
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    CMasternodeBlockPayees* pblockPayees = masternodeBlocks.Find(nBlockHeight);
+    return pblockPayees && pblockPayees->HasPaidPayee(payee);
+}
+
+bool CMasternodePayments::HasPayeeWithVotes(int nBlockHeight, const CScript& payee, int nVotesReq)
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    const CMasternodeBlockPayees* pblockPayees = masternodeBlocks.Find(nBlockHeight);
+    return pblockPayees && pblockPayees->HasPayeeWithVotes(payee, nVotesReq);
 }
 
 // Is this masternode scheduled to get paid soon?
@@ -523,20 +556,34 @@ bool CMasternodePayments::IsScheduled(CMasternode& mn, int nNotBlockHeight)
     mnpayee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
 
     CScript payee;
-    for (int64_t h = nHeight; h <= nHeight + 8; h++) {
+    for (int h = nHeight; h <= nHeight + 8; h++) {
         if (h == nNotBlockHeight) continue;
-        if (mapMasternodeBlocks.count(h)) {
-            if (mapMasternodeBlocks[h].GetPayee(payee)) {
-                if (mnpayee == payee) {
-                    return true;
-                }
-            }
+        const CMasternodeBlockPayees* pblockPayees = masternodeBlocks.Find(h);
+        if (pblockPayees && pblockPayees->GetPayee(payee) && mnpayee == payee) {
+            return true;
         }
     }
 
     return false;
 }
 
+bool CMasternodePayments::HaveSeenPaymentVote(const uint256& hash) const
+{
+    LOCK(cs_mapMasternodePayeeVotes);
+    return mapMasternodePayeeVotes.count(hash);
+}
+
+bool CMasternodePayments::GetPaymentVoteSerialized(const uint256& hash, CDataStream& ss) const
+{
+    LOCK(cs_mapMasternodePayeeVotes);
+    std::map<uint256, CMasternodePaymentWinner>::const_iterator it = mapMasternodePayeeVotes.find(hash);
+    if (it == mapMasternodePayeeVotes.end())
+        return false;
+    ss.reserve(1000);
+    ss << it->second;
+    return true;
+}
+
 bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerIn)
 {
     uint256 blockHash;
@@ -544,26 +591,76 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
         return false;
     }
 
-    {
-        LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
+    LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
 
-        if (mapMasternodePayeeVotes.count(winnerIn.GetHash())) {
-            return false;
-        }
+    if (mapMasternodePayeeVotes.count(winnerIn.GetHash())) {
+        return false;
+    }
 
-        mapMasternodePayeeVotes[winnerIn.GetHash()] = winnerIn;
+    // a more recent block holds the slot of this one in the window
+    CMasternodeBlockPayees* pblockPayees = masternodeBlocks.Get(winnerIn.nBlockHeight);
+    if (!pblockPayees) {
+        return false;
+    }
 
-        if (!mapMasternodeBlocks.count(winnerIn.nBlockHeight)) {
-            CMasternodeBlockPayees blockPayees(winnerIn.nBlockHeight);
-            mapMasternodeBlocks[winnerIn.nBlockHeight] = blockPayees;
-        }
+    mapMasternodePayeeVotes[winnerIn.GetHash()] = winnerIn;
+    pblockPayees->AddPayee(winnerIn.payee, 1);
+
+    return true;
+}
+
+void CMasternodeBlockPayees::RebuildIndex()
+{
+    LOCK(cs_vecPayments);
+
+    mapPayeeIndex.clear();
+    nBestPayee = -1;
+    for (size_t i = 0; i < vecPayments.size(); i++) {
+        mapPayeeIndex.emplace(vecPayments[i].scriptPubKey, i);
+        if (nBestPayee < 0 || vecPayments[i].nVotes > vecPayments[nBestPayee].nVotes)
+            nBestPayee = i;
     }
+}
 
-    mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+void CMasternodeBlockPayees::AddPayee(const CScript& payeeIn, int nIncrement)
+{
+    LOCK(cs_vecPayments);
 
+    size_t nPos;
+    auto it = mapPayeeIndex.find(payeeIn);
+    if (it != mapPayeeIndex.end()) {
+        nPos = it->second;
+        vecPayments[nPos].nVotes += nIncrement;
+    } else {
+        nPos = vecPayments.size();
+        vecPayments.emplace_back(payeeIn, nIncrement);
+        mapPayeeIndex.emplace(payeeIn, nPos);
+    }
+
+    // ties go to the payee voted for first
+    const CMasternodePayee& payee = vecPayments[nPos];
+    if (nBestPayee < 0 || payee.nVotes > vecPayments[nBestPayee].nVotes ||
+        (payee.nVotes == vecPayments[nBestPayee].nVotes && (int)nPos < nBestPayee))
+        nBestPayee = nPos;
+}
+
+bool CMasternodeBlockPayees::GetPayee(CScript& payee) const
+{
+    LOCK(cs_vecPayments);
+
+    if (nBestPayee < 0) return false;
+    payee = vecPayments[nBestPayee].scriptPubKey;
     return true;
 }
 
+bool CMasternodeBlockPayees::HasPayeeWithVotes(const CScript& payee, int nVotesReq) const
+{
+    LOCK(cs_vecPayments);
+
+    auto it = mapPayeeIndex.find(payee);
+    return it != mapPayeeIndex.end() && vecPayments[it->second].nVotes >= nVotesReq;
+}
+
 
 bool CMasternodeBlockPayees::HasPaidPayee(const CScript& payee) {
 
@@ -639,8 +736,8 @@ bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew, int n
                 } else {
                     ret = true;
                 }
-                if (ret && masternodePayments.mapMasternodeBlocks.count(nBlockHeight)) {
-                    masternodePayments.mapMasternodeBlocks[nBlockHeight].paidPayee = payee.scriptPubKey;
+                if (ret) {
+                    paidPayee = payee.scriptPubKey;
                 }
                 return ret;
             }
@@ -677,12 +774,99 @@ std::string CMasternodeBlockPayees::GetRequiredPaymentsString()
     return ret;
 }
 
+CMasternodeBlockPayees* CMasternodeBlockWindow::Find(int nHeight)
+{
+    if (nHeight < 0) return NULL;
+    value_type& slot = vSlots[Slot(nHeight)];
+    return slot.first == nHeight ? &slot.second : NULL;
+}
+
+const CMasternodeBlockPayees* CMasternodeBlockWindow::Find(int nHeight) const
+{
+    if (nHeight < 0) return NULL;
+    const value_type& slot = vSlots[Slot(nHeight)];
+    return slot.first == nHeight ? &slot.second : NULL;
+}
+
+CMasternodeBlockPayees* CMasternodeBlockWindow::Get(int nHeight)
+{
+    if (nHeight < 0) return NULL;
+    value_type& slot = vSlots[Slot(nHeight)];
+    if (slot.first != nHeight) {
+        if (slot.first > nHeight) return NULL;
+        if (slot.first < 0) nEntries++;
+        slot.first = nHeight;
+        slot.second = CMasternodeBlockPayees(nHeight);
+    }
+    return &slot.second;
+}
+
+std::pair<CMasternodeBlockWindow::iterator, bool> CMasternodeBlockWindow::insert(const value_type& x)
+{
+    if (x.first < 0) return std::make_pair(end(), false);
+    const size_t nSlot = Slot(x.first);
+    value_type& slot = vSlots[nSlot];
+    if (slot.first >= x.first) {
+        iterator it = slot.first == x.first ? iterator(vSlots.begin() + nSlot, vSlots.end()) : end();
+        return std::make_pair(it, false);
+    }
+    if (slot.first < 0) nEntries++;
+    slot = x;
+    return std::make_pair(iterator(vSlots.begin() + nSlot, vSlots.end()), true);
+}
+
+size_t CMasternodeBlockWindow::erase(int nHeight)
+{
+    if (!Find(nHeight)) return 0;
+    value_type& slot = vSlots[Slot(nHeight)];
+    slot.first = -1;
+    slot.second = CMasternodeBlockPayees();
+    nEntries--;
+    return 1;
+}
+
+void CMasternodeBlockWindow::clear()
+{
+    for (value_type& slot : vSlots) {
+        slot.first = -1;
+        slot.second = CMasternodeBlockPayees();
+    }
+    nEntries = 0;
+}
+
+void CMasternodeBlockWindow::Resize(size_t nCapacity)
+{
+    assert(nCapacity > 0);
+    std::vector<value_type> vOld(nCapacity, value_type(-1, CMasternodeBlockPayees()));
+    vOld.swap(vSlots);
+    nEntries = 0;
+
+    // oldest first, so the most recent heights end up in the slots they share
+    std::sort(vOld.begin(), vOld.end(), [](const value_type& a, const value_type& b) { return a.first < b.first; });
+    for (const value_type& x : vOld) {
+        if (x.first >= 0) insert(x);
+    }
+}
+
+void CMasternodeBlockWindow::Assign(const std::map<int, CMasternodeBlockPayees>& mapBlocks, size_t nMaxSpan)
+{
+    clear();
+    auto itFirst = mapBlocks.lower_bound(0);
+    if (itFirst == mapBlocks.end()) return;
+    const size_t nSpan = std::min((size_t)(mapBlocks.rbegin()->first - itFirst->first) + 1, nMaxSpan);
+    if (nSpan > capacity())
+        Resize(nSpan);
+    for (auto it = itFirst; it != mapBlocks.end(); ++it)
+        insert(*it);
+}
+
 std::string CMasternodePayments::GetRequiredPaymentsString(int nBlockHeight)
 {
     LOCK(cs_mapMasternodeBlocks);
 
-    if (mapMasternodeBlocks.count(nBlockHeight)) {
-        return mapMasternodeBlocks[nBlockHeight].GetRequiredPaymentsString();
+    CMasternodeBlockPayees* pblockPayees = masternodeBlocks.Find(nBlockHeight);
+    if (pblockPayees) {
+        return pblockPayees->GetRequiredPaymentsString();
     }
 
     return "Unknown";
@@ -692,13 +876,20 @@ bool CMasternodePayments::IsTransactionValid(const CTransaction& txNew, int nBlo
 {
     LOCK(cs_mapMasternodeBlocks);
 
-    if (mapMasternodeBlocks.count(nBlockHeight)) {
-        return mapMasternodeBlocks[nBlockHeight].IsTransactionValid(txNew, nBlockHeight);
+    CMasternodeBlockPayees* pblockPayees = masternodeBlocks.Find(nBlockHeight);
+    if (pblockPayees) {
+        return pblockPayees->IsTransactionValid(txNew, nBlockHeight);
     }
 
     return true;
 }
 
+int CMasternodePayments::GetHistoryLimit() const
+{
+    //keep up to five cycles for historical sake
+    return std::max(int(mnodeman.size() * (sporkManager.IsSporkActive(SPORK_112_MASTERNODE_LAST_PAID_V2) ? 2 : 1.25)), MNPAYMENTS_HISTORY_MIN);
+}
+
 void CMasternodePayments::CleanPaymentList()
 {
     int nHeight;
@@ -710,8 +901,14 @@ void CMasternodePayments::CleanPaymentList()
 
     LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
 
-    //keep up to five cycles for historical sake
-    int nLimit = std::max(int(mnodeman.size() * (sporkManager.IsSporkActive(SPORK_112_MASTERNODE_LAST_PAID_V2) ? 2 : 1.25)), 1000);
+    const int nLimit = GetHistoryLimit();
+
+    // room for the history and the winners ahead of the tip, with some slack so a growing list doesn't resize it every time
+    const size_t nCapacity = nLimit + MNPAYMENTS_FUTURE_BLOCKS + 1;
+    if (nCapacity > masternodeBlocks.capacity() || nCapacity < masternodeBlocks.capacity() / 2) {
+        LogPrint(BCLog::MASTERNODE, "CMasternodePayments::CleanPaymentList - Resizing block window to %d\n", nCapacity + nCapacity / 4);
+        masternodeBlocks.Resize(nCapacity + nCapacity / 4);
+    }
 
     std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
     while (it != mapMasternodePayeeVotes.end()) {
@@ -719,9 +916,9 @@ void CMasternodePayments::CleanPaymentList()
 
         if (nHeight - winner.nBlockHeight > nLimit) {
             LogPrint(BCLog::MASTERNODE, "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
-            masternodeSync.mapSeenSyncMNW.erase((*it).first);
+            WITH_LOCK(masternodeSync.cs, masternodeSync.mapSeenSyncMNW.erase((*it).first));
             mapMasternodePayeeVotes.erase(it++);
-            mapMasternodeBlocks.erase(winner.nBlockHeight);
+            masternodeBlocks.erase(winner.nBlockHeight);
         } else {
             ++it;
         }
@@ -821,7 +1018,7 @@ void CMasternodePayments::Sync(CNode* node, int nCountNeeded)
     std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
     while (it != mapMasternodePayeeVotes.end()) {
         CMasternodePaymentWinner winner = (*it).second;
-        if (winner.nBlockHeight >= nHeight - nCountNeeded && winner.nBlockHeight <= nHeight + 20) {
+        if (winner.nBlockHeight >= nHeight - nCountNeeded && winner.nBlockHeight <= nHeight + MNPAYMENTS_FUTURE_BLOCKS) {
             node->PushInventory(CInv(MSG_MASTERNODE_WINNER, winner.GetHash()));
             nInvCount++;
         }
@@ -834,7 +1031,7 @@ std::string CMasternodePayments::ToString() const
 {
     std::ostringstream info;
 
-    info << "Votes: " << (int)mapMasternodePayeeVotes.size() << ", Blocks: " << (int)mapMasternodeBlocks.size();
+    info << "Votes: " << (int)mapMasternodePayeeVotes.size() << ", Blocks: " << (int)masternodeBlocks.size();
 
     return info.str();
 }
@@ -11,6 +11,8 @@
 #include "main.h"
 #include "masternode.h"
 
+#include <unordered_map>
+
 
 extern RecursiveMutex cs_vecPayments;
 extern RecursiveMutex cs_mapMasternodeBlocks;
@@ -24,6 +26,12 @@ extern CMasternodePayments masternodePayments;
 
 #define MNPAYMENTS_SIGNATURES_REQUIRED 6
 #define MNPAYMENTS_SIGNATURES_TOTAL 10
+//! Blocks ahead of the tip that winners are accepted for
+#define MNPAYMENTS_FUTURE_BLOCKS 20
+//! Minimum number of past blocks whose payees are kept
+#define MNPAYMENTS_HISTORY_MIN 1000
+//! Most heights a block window loaded from the payments cache is sized for
+#define MNPAYMENTS_WINDOW_MAX_LOAD 20000
 
 void ProcessMessageMasternodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 bool IsBlockPayeeValid(const CBlock& block, int nBlockHeight);
@@ -33,7 +41,7 @@ void FillBlockPayee(CMutableTransaction& txNew, const CBlockIndex* pindexPrev, b
 
 void DumpMasternodePayments();
 
-/** Save Masternode Payment Data (mnpayments.dat)
+/** Save Masternode Payment Data (layer 2 store, mnpayments.dat of older versions)
  */
 class CMasternodePaymentDB
 {
@@ -52,6 +60,10 @@ public:
         IncorrectFormat
     };
 
+private:
+    ReadResult ReadFlatFile(CMasternodePayments& objToLoad);
+
+public:
     CMasternodePaymentDB();
     bool Write(const CMasternodePayments& objToSave);
     ReadResult Read(CMasternodePayments& objToLoad, bool fDryRun = false);
@@ -85,9 +97,30 @@ public:
     }
 };
 
+class SaltedScriptHasher
+{
+private:
+    /** Salt */
+    uint64_t k0, k1;
+
+public:
+    SaltedScriptHasher();
+
+    size_t operator()(const CScript& script) const {
+        return CSipHasher(k0, k1).Write(script.data(), script.size()).Finalize();
+    }
+};
+
 // Keep track of votes for payees from masternodes
 class CMasternodeBlockPayees
 {
+private:
+    // position of each payee in vecPayments, and of the most voted one (-1 if none)
+    std::unordered_map<CScript, size_t, SaltedScriptHasher> mapPayeeIndex;
+    int nBestPayee;
+
+    void RebuildIndex();
+
 public:
     int nBlockHeight;
     std::vector<CMasternodePayee> vecPayments;
@@ -96,66 +129,126 @@ public:
     CMasternodeBlockPayees()
     {
         nBlockHeight = 0;
-        vecPayments.clear();
+        nBestPayee = -1;
     }
     CMasternodeBlockPayees(int nBlockHeightIn)
     {
         nBlockHeight = nBlockHeightIn;
-        vecPayments.clear();
+        nBestPayee = -1;
     }
 
-    void AddPayee(const CScript& payeeIn, int nIncrement)
-    {
-        LOCK(cs_vecPayments);
+    void AddPayee(const CScript& payeeIn, int nIncrement);
+    bool GetPayee(CScript& payee) const;
+    bool HasPayeeWithVotes(const CScript& payee, int nVotesReq) const;
+    bool HasPaidPayee(const CScript& payee);
+    bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
+    std::string GetRequiredPaymentsString();
 
-        for (CMasternodePayee& payee : vecPayments) {
-            if (payee.scriptPubKey == payeeIn) {
-                payee.nVotes += nIncrement;
-                return;
-            }
-        }
+    ADD_SERIALIZE_METHODS;
 
-        CMasternodePayee c(payeeIn, nIncrement);
-        vecPayments.push_back(c);
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nBlockHeight);
+        READWRITE(vecPayments);
+        if (ser_action.ForRead())
+            RebuildIndex();
     }
+};
 
-    bool GetPayee(CScript& payee)
+/** Payee votes of the blocks around the tip, in a ring buffer indexed by height.
+ *  Height h lives in slot h % capacity, so lookups are O(1) and the memory used
+ *  is bounded by the capacity. Storing a height evicts the older one sharing its
+ *  slot; a height older than the one already in its slot is not stored.
+ *  Iterates and serializes like a std::map<int, CMasternodeBlockPayees>, which
+ *  keeps the on-disk format of the payments cache.
+ */
+class CMasternodeBlockWindow
+{
+public:
+    typedef int key_type;
+    typedef CMasternodeBlockPayees mapped_type;
+    // first is the height held by the slot, -1 when it is empty
+    typedef std::pair<int, CMasternodeBlockPayees> value_type;
+
+    template <typename T, typename It>
+    class slot_iterator
     {
-        LOCK(cs_vecPayments);
+    private:
+        It it, itEnd;
 
-        int nVotes = -1;
-        for (CMasternodePayee& p : vecPayments) {
-            if (p.nVotes > nVotes) {
-                payee = p.scriptPubKey;
-                nVotes = p.nVotes;
-            }
+        void SkipEmpty()
+        {
+            while (it != itEnd && it->first < 0)
+                ++it;
         }
 
-        return (nVotes > -1);
-    }
+    public:
+        slot_iterator(It itIn, It itEndIn) : it(itIn), itEnd(itEndIn) { SkipEmpty(); }
 
-    bool HasPayeeWithVotes(const CScript& payee, int nVotesReq)
-    {
-        LOCK(cs_vecPayments);
+        T& operator*() const { return *it; }
+        T* operator->() const { return &*it; }
+        slot_iterator& operator++() { ++it; SkipEmpty(); return *this; }
+        bool operator==(const slot_iterator& other) const { return it == other.it; }
+        bool operator!=(const slot_iterator& other) const { return it != other.it; }
+    };
 
-        for (CMasternodePayee& p : vecPayments) {
-            if (p.nVotes >= nVotesReq && p.scriptPubKey == payee) return true;
-        }
+    typedef slot_iterator<value_type, std::vector<value_type>::iterator> iterator;
+    typedef slot_iterator<const value_type, std::vector<value_type>::const_iterator> const_iterator;
 
-        return false;
-    }
+private:
+    std::vector<value_type> vSlots;
+    size_t nEntries;
 
-    bool HasPaidPayee(const CScript& payee);
-    bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
-    std::string GetRequiredPaymentsString();
+    size_t Slot(int nHeight) const { return (size_t)nHeight % vSlots.size(); }
 
-    ADD_SERIALIZE_METHODS;
+public:
+    explicit CMasternodeBlockWindow(size_t nCapacity) : vSlots(nCapacity, value_type(-1, CMasternodeBlockPayees())), nEntries(0)
+    {
+        assert(nCapacity > 0);
+    }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action)
+    iterator begin() { return iterator(vSlots.begin(), vSlots.end()); }
+    iterator end() { return iterator(vSlots.end(), vSlots.end()); }
+    const_iterator begin() const { return const_iterator(vSlots.begin(), vSlots.end()); }
+    const_iterator end() const { return const_iterator(vSlots.end(), vSlots.end()); }
+    size_t size() const { return nEntries; }
+    bool empty() const { return nEntries == 0; }
+    size_t capacity() const { return vSlots.size(); }
+    size_t count(int nHeight) const { return Find(nHeight) ? 1 : 0; }
+
+    /** The payees of nHeight, NULL if it isn't stored */
+    CMasternodeBlockPayees* Find(int nHeight);
+    const CMasternodeBlockPayees* Find(int nHeight) const;
+
+    /** The payees of nHeight, created if needed. NULL if a more recent height holds its slot */
+    CMasternodeBlockPayees* Get(int nHeight);
+
+    std::pair<iterator, bool> insert(const value_type& x);
+    size_t erase(int nHeight);
+    void clear();
+
+    /** Change the number of heights the window can hold, keeping the most recent ones */
+    void Resize(size_t nCapacity);
+    /** Replace the content with the given heights, growing the window so none is lost unless they span
+     *  more than nMaxSpan heights, then the most recent ones are kept */
+    void Assign(const std::map<int, CMasternodeBlockPayees>& mapBlocks, size_t nMaxSpan = MNPAYMENTS_WINDOW_MAX_LOAD);
+
+    // serialized like std::map
+    template <typename Stream>
+    void Serialize(Stream& s) const
     {
-        READWRITE(nBlockHeight);
-        READWRITE(vecPayments);
+        WriteCompactSize(s, size());
+        for (const value_type& x : *this)
+            s << x.first << x.second;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        std::map<int, CMasternodeBlockPayees> mapBlocks;
+        s >> mapBlocks;
+        Assign(mapBlocks);
     }
 };
 
@@ -236,10 +329,11 @@ private:
 
 public:
     std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
-    std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
+    CMasternodeBlockWindow masternodeBlocks;
     std::map<COutPoint, int> mapMasternodesLastVote; //prevout, nBlockHeight
 
-    CMasternodePayments()
+    CMasternodePayments() :
+        masternodeBlocks(MNPAYMENTS_HISTORY_MIN + MNPAYMENTS_FUTURE_BLOCKS + 1)
     {
         nLastBlockHeight = 0;
     }
@@ -247,11 +341,15 @@ public:
     void Clear()
     {
         LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
-        mapMasternodeBlocks.clear();
+        masternodeBlocks.clear();
         mapMasternodePayeeVotes.clear();
     }
 
+    /** The number of past blocks CleanPaymentList keeps the payees of */
+    int GetHistoryLimit() const;
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
+    bool HaveSeenPaymentVote(const uint256& hash) const;
+    bool GetPaymentVoteSerialized(const uint256& hash, CDataStream& ss) const;
     bool ProcessBlock(int nBlockHeight);
 
     void Sync(CNode* node, int nCountNeeded);
@@ -260,6 +358,8 @@ public:
     bool GetBlockPayee(int nBlockHeight, CScript& payee);
     bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
     bool IsScheduled(CMasternode& mn, int nNotBlockHeight);
+    bool HasPaidPayee(int nBlockHeight, const CScript& payee);
+    bool HasPayeeWithVotes(int nBlockHeight, const CScript& payee, int nVotesReq);
 
     bool CanVote(const COutPoint& outMasternode, int nBlockHeight)
     {
@@ -287,7 +387,7 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action)
     {
         READWRITE(mapMasternodePayeeVotes);
-        READWRITE(mapMasternodeBlocks);
+        READWRITE(masternodeBlocks);
     }
 };
 
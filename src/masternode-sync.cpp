@@ -21,8 +21,66 @@
 class CMasternodeSync;
 CMasternodeSync masternodeSync;
 
-CMasternodeSync::CMasternodeSync()
+double CMasternodeSyncAsset::GetThroughput(int64_t nNow) const
 {
+    if (nStarted == 0) return 0;
+    const int64_t nElapsed = (nFinished > 0 ? nFinished : nNow) - nStarted;
+    return nElapsed > 0 ? (double)nItems / nElapsed : nItems;
+}
+
+void CMasternodeSyncAsset::Asked(NodeId id, int64_t nNow)
+{
+    if (nStarted == 0) nStarted = nNow;
+    if (setPeersPending.insert(id).second)
+        nPeersAsked++;
+}
+
+bool CMasternodeSyncAsset::Replied(NodeId id)
+{
+    if (!setPeersPending.erase(id))
+        return false;
+    nPeersReplied++;
+    return true;
+}
+
+void CMasternodeSyncAsset::DropPeer(NodeId id)
+{
+    if (setPeersPending.erase(id))
+        nPeersAsked--;
+}
+
+int CMasternodeSyncAsset::Check(int nSyncPeers, int64_t nNow) const
+{
+    if (nStarted == 0) return 0;
+
+    if (nItems > 0) {
+        // every peer asked reported its count and as many items were announced: complete once they had time to arrive
+        if (nPeersReplied >= nPeersAsked && nItems >= nExpected &&
+            nLastItem < nNow - MASTERNODE_SYNC_TIMEOUT)
+            return 1;
+        // hasn't received a new item for a while
+        if (nPeersAsked >= std::min(nSyncPeers, MASTERNODE_SYNC_THRESHOLD) &&
+            nLastItem < nNow - MASTERNODE_SYNC_TIMEOUT * 2)
+            return 1;
+        return 0;
+    }
+
+    // the peers have nothing for us
+    if (nPeersReplied >= std::min(nSyncPeers, MASTERNODE_SYNC_THRESHOLD) && nExpected == 0 &&
+        nPeersReplied >= nPeersAsked)
+        return 1;
+
+    // timeout
+    if (nNow - nStarted > MASTERNODE_SYNC_TIMEOUT * 5)
+        return -1;
+
+    return 0;
+}
+
+CMasternodeSync::CMasternodeSync() :
+    mapSeenSyncMNB(MASTERNODES_SEEN_SECONDS, MASTERNODES_SEEN_SYNC_MAX_USAGE)
+{
+    nSyncPeers = DEFAULT_MNSYNC_PEERS;
     Reset();
 }
 
@@ -89,9 +147,12 @@ void CMasternodeSync::Reset()
     lastMasternodeList = 0;
     lastMasternodeWinner = 0;
     lastBudgetItem = 0;
-    mapSeenSyncMNB.clear();
-    mapSeenSyncMNW.clear();
-    mapSeenSyncBudget.clear();
+    {
+        LOCK(cs);
+        mapSeenSyncMNB.clear();
+        mapSeenSyncMNW.clear();
+        mapSeenSyncBudget.clear();
+    }
     lastFailure = 0;
     nCountFailures = 0;
     sumMasternodeList = 0;
@@ -105,11 +166,21 @@ void CMasternodeSync::Reset()
     RequestedMasternodeAssets = MASTERNODE_SYNC_INITIAL;
     RequestedMasternodeAttempt = 0;
     nAssetSyncStarted = GetTime();
+    assetList.SetNull();
+    assetWinners.SetNull();
+    assetBudget.SetNull();
+    maxBudgetItemProp = 0;
+    maxBudgetItemFin = 0;
 }
 
 void CMasternodeSync::AddedMasternodeList(const uint256& hash)
 {
-    if (mnodeman.mapSeenMasternodeBroadcast.count(hash)) {
+    const bool fSeen = mnodeman.HaveSeenMasternodeBroadcast(hash);
+    LOCK(cs);
+    if (!mapSeenSyncMNB.count(hash))
+        assetList.nItems++;
+
+    if (fSeen) {
         if (mapSeenSyncMNB[hash] < MASTERNODE_SYNC_THRESHOLD) {
             lastMasternodeList = GetTime();
             mapSeenSyncMNB[hash]++;
@@ -118,11 +189,17 @@ void CMasternodeSync::AddedMasternodeList(const uint256& hash)
         lastMasternodeList = GetTime();
         mapSeenSyncMNB.insert(std::make_pair(hash, 1));
     }
+    assetList.nLastItem = lastMasternodeList;
 }
 
 void CMasternodeSync::AddedMasternodeWinner(const uint256& hash)
 {
-    if (masternodePayments.mapMasternodePayeeVotes.count(hash)) {
+    const bool fSeen = masternodePayments.HaveSeenPaymentVote(hash);
+    LOCK(cs);
+    if (!mapSeenSyncMNW.count(hash))
+        assetWinners.nItems++;
+
+    if (fSeen) {
         if (mapSeenSyncMNW[hash] < MASTERNODE_SYNC_THRESHOLD) {
             lastMasternodeWinner = GetTime();
             mapSeenSyncMNW[hash]++;
@@ -131,14 +208,20 @@ void CMasternodeSync::AddedMasternodeWinner(const uint256& hash)
         lastMasternodeWinner = GetTime();
         mapSeenSyncMNW.insert(std::make_pair(hash, 1));
     }
+    assetWinners.nLastItem = lastMasternodeWinner;
 }
 
 void CMasternodeSync::AddedBudgetItem(const uint256& hash)
 {
-    if (budget.HaveSeenProposal(hash) ||
-            budget.HaveSeenProposalVote(hash) ||
-            budget.HaveSeenFinalizedBudget(hash) ||
-            budget.HaveSeenFinalizedBudgetVote(hash)) {
+    const bool fSeen = budget.HaveSeenProposal(hash) ||
+                       budget.HaveSeenProposalVote(hash) ||
+                       budget.HaveSeenFinalizedBudget(hash) ||
+                       budget.HaveSeenFinalizedBudgetVote(hash);
+    LOCK(cs);
+    if (!mapSeenSyncBudget.count(hash))
+        assetBudget.nItems++;
+
+    if (fSeen) {
         if (mapSeenSyncBudget[hash] < MASTERNODE_SYNC_THRESHOLD) {
             lastBudgetItem = GetTime();
             mapSeenSyncBudget[hash]++;
@@ -147,6 +230,7 @@ void CMasternodeSync::AddedBudgetItem(const uint256& hash)
         lastBudgetItem = GetTime();
         mapSeenSyncBudget.insert(std::make_pair(hash, 1));
     }
+    assetBudget.nLastItem = lastBudgetItem;
 }
 
 bool CMasternodeSync::IsBudgetPropEmpty()
@@ -217,27 +301,40 @@ void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
 
         if (RequestedMasternodeAssets >= MASTERNODE_SYNC_FINISHED) return;
 
+        // the budget is synced together with the winners in parallel mode
+        const bool fBudgetRequested = RequestedMasternodeAssets == MASTERNODE_SYNC_BUDGET ||
+                                      (IsParallel() && RequestedMasternodeAssets == MASTERNODE_SYNC_MNW);
+
         //this means we will receive no further communication
         switch (nItemID) {
         case (MASTERNODE_SYNC_LIST):
             if (nItemID != RequestedMasternodeAssets) return;
             sumMasternodeList += nCount;
             countMasternodeList++;
+            if (assetList.Replied(pfrom->GetId()))
+                assetList.nExpected = std::max(assetList.nExpected, nCount);
             break;
         case (MASTERNODE_SYNC_MNW):
             if (nItemID != RequestedMasternodeAssets) return;
             sumMasternodeWinner += nCount;
             countMasternodeWinner++;
+            if (assetWinners.Replied(pfrom->GetId()))
+                assetWinners.nExpected = std::max(assetWinners.nExpected, nCount);
             break;
         case (MASTERNODE_SYNC_BUDGET_PROP):
-            if (RequestedMasternodeAssets != MASTERNODE_SYNC_BUDGET) return;
+            if (!fBudgetRequested) return;
             sumBudgetItemProp += nCount;
             countBudgetItemProp++;
+            maxBudgetItemProp = std::max(maxBudgetItemProp, nCount);
             break;
         case (MASTERNODE_SYNC_BUDGET_FIN):
-            if (RequestedMasternodeAssets != MASTERNODE_SYNC_BUDGET) return;
+            if (!fBudgetRequested) return;
             sumBudgetItemFin += nCount;
             countBudgetItemFin++;
+            maxBudgetItemFin = std::max(maxBudgetItemFin, nCount);
+            // the finalized budgets count is sent last
+            if (assetBudget.Replied(pfrom->GetId()))
+                assetBudget.nExpected = maxBudgetItemProp + maxBudgetItemFin;
             break;
         }
 
@@ -287,12 +384,129 @@ void CMasternodeSync::Process()
     if (!isRegTestNet && !IsBlockchainSynced() &&
         RequestedMasternodeAssets > MASTERNODE_SYNC_SPORKS) return;
 
+    if (IsParallel() && !isRegTestNet) {
+        SyncWithPeers();
+        return;
+    }
+
     CMasternodeSync* sync = this;
     g_connman->ForEachNodeContinueIf([sync, isRegTestNet](CNode* pnode) {
       return sync->SyncWithNode(pnode, isRegTestNet);
     });
 }
 
+void CMasternodeSync::RequestFromPeers(CMasternodeSyncAsset& asset, const std::string& strRequest, const std::function<void(CNode*)>& request)
+{
+    DropDisconnectedPeers(asset);
+    if (!asset.NeedsPeers(nSyncPeers)) return;
+
+    g_connman->ForEachNode([&](CNode* pnode) {
+        if (!asset.NeedsPeers(nSyncPeers)) return;
+        if (pnode->nVersion < ActiveProtocol() || pnode->HasFulfilledRequest(strRequest)) return;
+        pnode->FulfilledRequest(strRequest);
+
+        request(pnode);
+        asset.Asked(pnode->GetId(), GetTime());
+        LogPrint(BCLog::MASTERNODE, "CMasternodeSync::RequestFromPeers() - %s sent to peer=%d (%d/%d)\n", strRequest, pnode->GetId(), asset.nPeersAsked, nSyncPeers);
+    });
+}
+
+void CMasternodeSync::DropDisconnectedPeers(CMasternodeSyncAsset& asset)
+{
+    std::vector<NodeId> vGone;
+    for (NodeId id : asset.setPeersPending) {
+        if (!g_connman->ForNode(id, [](CNode* pnode) { return true; }))
+            vGone.push_back(id);
+    }
+    for (NodeId id : vGone) {
+        LogPrint(BCLog::MASTERNODE, "CMasternodeSync::DropDisconnectedPeers() - peer=%d left before it replied\n", id);
+        asset.DropPeer(id);
+    }
+}
+
+void CMasternodeSync::SetFailed(const std::string& strAsset)
+{
+    LogPrintf("CMasternodeSync::Process - ERROR - Sync has failed on %s, will retry later\n", strAsset);
+    RequestedMasternodeAssets = MASTERNODE_SYNC_FAILED;
+    RequestedMasternodeAttempt = 0;
+    lastFailure = GetTime();
+    nCountFailures++;
+}
+
+void CMasternodeSync::SyncWithPeers()
+{
+    if (RequestedMasternodeAssets == MASTERNODE_SYNC_SPORKS) {
+        // sporks are answered right away, move on at the next pass
+        if (RequestedMasternodeAttempt > 0) {
+            GetNextAsset();
+            return;
+        }
+        CMasternodeSyncAsset assetSporks;
+        RequestFromPeers(assetSporks, "getspork", [](CNode* pnode) {
+            g_connman->PushMessage(pnode, CNetMsgMaker(pnode->GetSendVersion()).Make(NetMsgType::GETSPORKS));
+        });
+        if (assetSporks.nPeersAsked > 0) RequestedMasternodeAttempt++;
+        return;
+    }
+
+    if (RequestedMasternodeAssets == MASTERNODE_SYNC_LIST) {
+        RequestFromPeers(assetList, "mnsync", [](CNode* pnode) {
+            mnodeman.DsegUpdate(pnode);
+        });
+        RequestedMasternodeAttempt = assetList.nPeersAsked;
+
+        const int nStatus = assetList.Check(nSyncPeers, GetTime());
+        if (nStatus == 0) return;
+        assetList.nFinished = GetTime();
+        if (nStatus < 0 && sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
+            SetFailed("MASTERNODE_SYNC_LIST");
+            return;
+        }
+        GetNextAsset();
+        return;
+    }
+
+    if (RequestedMasternodeAssets != MASTERNODE_SYNC_MNW && RequestedMasternodeAssets != MASTERNODE_SYNC_BUDGET)
+        return;
+
+    // the winners and the budget only need the masternode list: sync them together
+    if (!assetWinners.IsFinished()) {
+        RequestFromPeers(assetWinners, "mnwsync", [](CNode* pnode) {
+            int nMnCount = mnodeman.CountEnabled();
+            g_connman->PushMessage(pnode, CNetMsgMaker(pnode->GetSendVersion()).Make(NetMsgType::GETMNWINNERS, nMnCount));
+        });
+        const int nStatus = assetWinners.Check(nSyncPeers, GetTime());
+        if (nStatus != 0) {
+            assetWinners.nFinished = GetTime();
+            if (nStatus < 0 && sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
+                SetFailed("MASTERNODE_SYNC_MNW");
+                return;
+            }
+        }
+    }
+
+    if (!assetBudget.IsFinished()) {
+        RequestFromPeers(assetBudget, "busync", [](CNode* pnode) {
+            uint256 n;
+            g_connman->PushMessage(pnode, CNetMsgMaker(pnode->GetSendVersion()).Make(NetMsgType::BUDGETVOTESYNC, n));
+        });
+        // maybe there is no budgets at all, a timeout just finishes the sync
+        if (assetBudget.Check(nSyncPeers, GetTime()) != 0)
+            assetBudget.nFinished = GetTime();
+    }
+
+    if (RequestedMasternodeAssets == MASTERNODE_SYNC_MNW && assetWinners.IsFinished())
+        GetNextAsset();
+    RequestedMasternodeAttempt = RequestedMasternodeAssets == MASTERNODE_SYNC_MNW ? assetWinners.nPeersAsked : assetBudget.nPeersAsked;
+
+    if (RequestedMasternodeAssets == MASTERNODE_SYNC_BUDGET && assetBudget.IsFinished()) {
+        GetNextAsset();
+
+        // Try to activate our masternode if possible
+        activeMasternode.ManageStatus();
+    }
+}
+
 bool CMasternodeSync::SyncWithNode(CNode* pnode, bool isRegTestNet)
 {
     CNetMsgMaker msgMaker(pnode->GetSendVersion());
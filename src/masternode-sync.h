@@ -7,7 +7,13 @@
 #ifndef MASTERNODE_SYNC_H
 #define MASTERNODE_SYNC_H
 
+#include "expiringmap.h"
+#include "net.h"
+#include "saltedhasher.h"
+
 #include <atomic>
+#include <functional>
+#include <set>
 
 #define MASTERNODE_SYNC_INITIAL 0
 #define MASTERNODE_SYNC_SPORKS 1
@@ -22,9 +28,57 @@
 #define MASTERNODE_SYNC_TIMEOUT 5
 #define MASTERNODE_SYNC_THRESHOLD 2
 
+//! Peers asked for each asset at once (1 for the sequential sync). The parallel sync is opt-in, as no
+//! functional test covers it: regtest always syncs sequentially
+static const int DEFAULT_MNSYNC_PEERS = 1;
+static const int MAX_MNSYNC_PEERS = 16;
+
 class CMasternodeSync;
 extern CMasternodeSync masternodeSync;
 
+//
+// CMasternodeSyncAsset : Progress of the sync of one asset from several peers
+//
+
+class CMasternodeSyncAsset
+{
+public:
+    int64_t nStarted;  // time of the first request, 0 if not requested yet
+    int64_t nFinished; // time the asset was complete, 0 while syncing
+    int64_t nLastItem; // time the last item was announced
+    int nPeersAsked;
+    int nPeersReplied; // peers that reported their inventory count
+    int nExpected;     // highest inventory count reported by a peer
+    int nItems;        // distinct items announced
+    std::set<NodeId> setPeersPending; // peers asked that did not report their count yet
+
+    CMasternodeSyncAsset() { SetNull(); }
+
+    void SetNull()
+    {
+        nStarted = 0;
+        nFinished = 0;
+        nLastItem = 0;
+        nPeersAsked = 0;
+        nPeersReplied = 0;
+        nExpected = 0;
+        nItems = 0;
+        setPeersPending.clear();
+    }
+
+    bool IsFinished() const { return nFinished > 0; }
+    bool NeedsPeers(int nSyncPeers) const { return nPeersAsked < nSyncPeers; }
+    void Asked(NodeId id, int64_t nNow);
+    // false if the peer was not asked, or already replied
+    bool Replied(NodeId id);
+    // a peer that disconnected before it replied frees its slot for another one
+    void DropPeer(NodeId id);
+    // 1 if the asset is complete, -1 if no peer answered in time, 0 while syncing
+    int Check(int nSyncPeers, int64_t nNow) const;
+    // distinct items per second since the first request
+    double GetThroughput(int64_t nNow) const;
+};
+
 //
 // CMasternodeSync : Sync masternode assets in stages
 //
@@ -32,7 +86,11 @@ extern CMasternodeSync masternodeSync;
 class CMasternodeSync
 {
 public:
-    std::map<uint256, int> mapSeenSyncMNB;
+    // protects the seen maps and the items counted by the Added* methods, which the message handler thread
+    // and the message worker threads both call; no other lock is taken while holding it
+    RecursiveMutex cs;
+    // expires along with mnodeman.mapSeenMasternodeBroadcast
+    expiringmap<uint256, int, SaltedTxidHasher> mapSeenSyncMNB;
     std::map<uint256, int> mapSeenSyncMNW;
     std::map<uint256, int> mapSeenSyncBudget;
 
@@ -63,6 +121,15 @@ public:
     // Time when current masternode asset sync started
     int64_t nAssetSyncStarted;
 
+    // Peers asked at once for the list, winners and budget, 1 for the sequential sync
+    int nSyncPeers;
+    CMasternodeSyncAsset assetList;
+    CMasternodeSyncAsset assetWinners;
+    CMasternodeSyncAsset assetBudget;
+    // highest budget proposal/finalization counts reported by a peer
+    int maxBudgetItemProp;
+    int maxBudgetItemFin;
+
     CMasternodeSync();
 
     void AddedMasternodeList(const uint256& hash);
@@ -82,12 +149,23 @@ public:
      * Otherwise Process() calls it again for a different node.
      */
     bool SyncWithNode(CNode* pnode, bool isRegTestNet);
+    /*
+     * Parallel sync: ask up to nSyncPeers peers for the current assets at once,
+     * the winners and the budget being synced together once the list is complete.
+     */
+    void SyncWithPeers();
+    bool IsParallel() const { return nSyncPeers > 1; }
     bool IsSynced();
     bool NotCompleted();
     bool IsSporkListSynced();
     bool IsMasternodeListSynced();
     bool IsBlockchainSynced();
     void ClearFulfilledRequest();
+
+private:
+    void RequestFromPeers(CMasternodeSyncAsset& asset, const std::string& strRequest, const std::function<void(CNode*)>& request);
+    void DropDisconnectedPeers(CMasternodeSyncAsset& asset);
+    void SetFailed(const std::string& strAsset);
 };
 
 #endif
@@ -140,7 +140,7 @@ bool CMasternode::UpdateFromNewBroadcast(CMasternodeBroadcast& mnb)
         int nDoS = 0;
         if (mnb.lastPing.IsNull() || (!mnb.lastPing.IsNull() && mnb.lastPing.CheckAndUpdate(nDoS, false))) {
             lastPing = mnb.lastPing;
-            mnodeman.mapSeenMasternodePing.insert(std::make_pair(lastPing.GetHash(), lastPing));
+            mnodeman.AddSeenMasternodePing(lastPing);
         }
         return true;
     }
@@ -282,31 +282,29 @@ int64_t CMasternode::GetLastPaid()
         }
         n++;
 
-        if (masternodePayments.mapMasternodeBlocks.count(BlockReading->nHeight)) {
-            if(sporkManager.IsSporkActive(SPORK_112_MASTERNODE_LAST_PAID_V2)) {
-                /*
-                    Search for this payee, on the blockchain
-                */
-                if (masternodePayments.mapMasternodeBlocks[BlockReading->nHeight].HasPaidPayee(mnpayee)) {
-                    return BlockReading->nTime; // doesn't need the offset because it is deterministically read from the blockchain
-                }
-            } else {
-
-                CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-                ss << vin;
-                ss << sigTime;
-                uint256 hash = ss.GetHash();
-
-                // use a deterministic offset to break a tie -- 2.5 minutes
-                int64_t nOffset = hash.GetCompact(false) % 150;
-
-                /*
-                    Search for this payee, with at least 2 votes. This will aid in consensus allowing the network
-                    to converge on the same payees quickly, then keep the same schedule.
-                */
-                if (masternodePayments.mapMasternodeBlocks[BlockReading->nHeight].HasPayeeWithVotes(mnpayee, 2)) {
-                    return BlockReading->nTime + nOffset;
-                }
+        if(sporkManager.IsSporkActive(SPORK_112_MASTERNODE_LAST_PAID_V2)) {
+            /*
+                Search for this payee, on the blockchain
+            */
+            if (masternodePayments.HasPaidPayee(BlockReading->nHeight, mnpayee)) {
+                return BlockReading->nTime; // doesn't need the offset because it is deterministically read from the blockchain
+            }
+        } else {
+
+            CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+            ss << vin;
+            ss << sigTime;
+            uint256 hash = ss.GetHash();
+
+            // use a deterministic offset to break a tie -- 2.5 minutes
+            int64_t nOffset = hash.GetCompact(false) % 150;
+
+            /*
+                Search for this payee, with at least 2 votes. This will aid in consensus allowing the network
+                to converge on the same payees quickly, then keep the same schedule.
+            */
+            if (masternodePayments.HasPayeeWithVotes(BlockReading->nHeight, mnpayee, 2)) {
+                return BlockReading->nTime + nOffset;
             }
         }
 
@@ -714,8 +712,7 @@ bool CMasternodeBroadcast::CheckInputsAndAdd(int& nDoS)
         TRY_LOCK(cs_main, lockMain);
         if (!lockMain) {
             // not mnb fault, let it to be checked again later
-            mnodeman.mapSeenMasternodeBroadcast.erase(GetHash());
-            masternodeSync.mapSeenSyncMNB.erase(GetHash());
+            mnodeman.RemoveSeenMasternodeBroadcast(GetHash());
             return false;
         }
 
@@ -733,8 +730,7 @@ bool CMasternodeBroadcast::CheckInputsAndAdd(int& nDoS)
     if (pcoinsTip->GetCoinDepthAtHeight(vin.prevout, nChainHeight) < MASTERNODE_MIN_CONFIRMATIONS) {
         LogPrint(BCLog::MASTERNODE,"mnb - Input must have at least %d confirmations\n", MASTERNODE_MIN_CONFIRMATIONS);
         // maybe we miss few blocks, let this mnb to be checked again later
-        mnodeman.mapSeenMasternodeBroadcast.erase(GetHash());
-        masternodeSync.mapSeenSyncMNB.erase(GetHash());
+        mnodeman.RemoveSeenMasternodeBroadcast(GetHash());
         return false;
     }
 
@@ -890,10 +886,7 @@ bool CMasternodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled, bool fChec
 
             //mnodeman.mapSeenMasternodeBroadcast.lastPing is probably outdated, so we'll update it
             CMasternodeBroadcast mnb(*pmn);
-            uint256 hash = mnb.GetHash();
-            if (mnodeman.mapSeenMasternodeBroadcast.count(hash)) {
-                mnodeman.mapSeenMasternodeBroadcast[hash].lastPing = *this;
-            }
+            mnodeman.UpdateSeenMasternodePing(mnb.GetHash(), *this);
 
             pmn->Check(true);
             if (!pmn->IsEnabled()) return false;
@@ -8,6 +8,7 @@
 
 #include "addrman.h"
 #include "fs.h"
+#include "layer2db.h"
 #include "masternode-payments.h"
 #include "masternode-sync.h"
 #include "masternode.h"
@@ -62,38 +63,92 @@ CMasternodeDB::CMasternodeDB()
 
 bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave)
 {
+    if (!pLayer2DB)
+        return false;
+
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssMasternodes(SER_DISK, CLIENT_VERSION);
-    ssMasternodes << strMagicMessage;                   // masternode cache file specific magic message
-    ssMasternodes << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssMasternodes << mnodemanToSave;
-    uint256 hash = Hash(ssMasternodes.begin(), ssMasternodes.end());
-    ssMasternodes << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fsbridge::fopen(pathMN, "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathMN.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssMasternodes;
-    } catch (const std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+    CDBBatch batch;
+    {
+        LOCK(mnodemanToSave.cs);
+
+        std::set<std::vector<unsigned char> > setKeys;
+        for (const CMasternode& mn : mnodemanToSave.vMasternodes)
+            pLayer2DB->WriteIfChanged(batch, DB_MN_LIST, mn.vin.prevout, mn, setKeys);
+        pLayer2DB->EraseMissing(batch, DB_MN_LIST, setKeys);
+
+        pLayer2DB->WriteMap(batch, DB_MN_ASKED_US, mnodemanToSave.mAskedUsForMasternodeList);
+        pLayer2DB->WriteMap(batch, DB_MN_WE_ASKED, mnodemanToSave.mWeAskedForMasternodeList);
+        pLayer2DB->WriteMap(batch, DB_MN_WE_ASKED_ENTRY, mnodemanToSave.mWeAskedForMasternodeListEntry);
+        pLayer2DB->WriteMap(batch, DB_MN_SEEN_BROADCAST, mnodemanToSave.mapSeenMasternodeBroadcast);
+        pLayer2DB->WriteMap(batch, DB_MN_SEEN_PING, mnodemanToSave.mapSeenMasternodePing);
+        batch.Write(DB_MN_DSQ_COUNT, mnodemanToSave.nDsqCount);
     }
-    //    FileCommit(fileout);
-    fileout.fclose();
 
-    LogPrint(BCLog::MASTERNODE,"Written info to mncache.dat  %dms\n", GetTimeMillis() - nStart);
+    if (!pLayer2DB->Commit(batch, strMagicMessage))
+        return error("%s : Failed to write masternode cache", __func__);
+
+    LogPrint(BCLog::MASTERNODE,"Written masternode cache  %dms\n", GetTimeMillis() - nStart);
     LogPrint(BCLog::MASTERNODE,"  %s\n", mnodemanToSave.ToString());
 
     return true;
 }
 
 CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad, bool fDryRun)
+{
+    int64_t nStart = GetTimeMillis();
+
+    switch (pLayer2DB->ReadSectionHeader(strMagicMessage)) {
+    case CLayer2DB::SECTION_MISSING: {
+        // nothing flushed yet, pick up the flat file of older versions
+        ReadResult result = ReadFlatFile(mnodemanToLoad);
+        if (result != Ok)
+            return result;
+        break;
+    }
+    case CLayer2DB::SECTION_WRONG_NETWORK:
+        error("%s : Invalid network magic number", __func__);
+        return IncorrectMagicNumber;
+    case CLayer2DB::SECTION_OK: {
+        LOCK(mnodemanToLoad.cs);
+        std::map<COutPoint, CMasternode> mapMasternodes;
+        if (!pLayer2DB->ReadMap(DB_MN_LIST, mapMasternodes) ||
+            !pLayer2DB->ReadMap(DB_MN_ASKED_US, mnodemanToLoad.mAskedUsForMasternodeList) ||
+            !pLayer2DB->ReadMap(DB_MN_WE_ASKED, mnodemanToLoad.mWeAskedForMasternodeList) ||
+            !pLayer2DB->ReadMap(DB_MN_WE_ASKED_ENTRY, mnodemanToLoad.mWeAskedForMasternodeListEntry) ||
+            !pLayer2DB->ReadMap(DB_MN_SEEN_BROADCAST, mnodemanToLoad.mapSeenMasternodeBroadcast) ||
+            !pLayer2DB->ReadMap(DB_MN_SEEN_PING, mnodemanToLoad.mapSeenMasternodePing)) {
+            mnodemanToLoad.Clear();
+            error("%s : Deserialize error in masternode cache", __func__);
+            return IncorrectFormat;
+        }
+        for (const auto& it : mapMasternodes)
+            mnodemanToLoad.vMasternodes.push_back(it.second);
+        pLayer2DB->Read(DB_MN_DSQ_COUNT, mnodemanToLoad.nDsqCount);
+        break;
+    }
+    }
+
+    {
+        // the seen messages age from their signature time, not from the restart
+        LOCK(mnodemanToLoad.cs);
+        mnodemanToLoad.mapSeenMasternodeBroadcast.SetTimes([](const CMasternodeBroadcast& mnb) { return mnb.lastPing.sigTime; });
+        mnodemanToLoad.mapSeenMasternodePing.SetTimes([](const CMasternodePing& mnp) { return mnp.sigTime; });
+    }
+
+    LogPrint(BCLog::MASTERNODE,"Loaded masternode cache  %dms\n", GetTimeMillis() - nStart);
+    LogPrint(BCLog::MASTERNODE,"  %s\n", mnodemanToLoad.ToString());
+    if (!fDryRun) {
+        LogPrint(BCLog::MASTERNODE,"Masternode manager - cleaning....\n");
+        mnodemanToLoad.CheckAndRemove(true);
+        LogPrint(BCLog::MASTERNODE,"Masternode manager - result:\n");
+        LogPrint(BCLog::MASTERNODE,"  %s\n", mnodemanToLoad.ToString());
+    }
+
+    return Ok;
+}
+
+CMasternodeDB::ReadResult CMasternodeDB::ReadFlatFile(CMasternodeMan& mnodemanToLoad)
 {
     int64_t nStart = GetTimeMillis();
     // open input file, and associate with CAutoFile
@@ -163,14 +218,6 @@ CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad, bo
     }
 
     LogPrint(BCLog::MASTERNODE,"Loaded info from mncache.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint(BCLog::MASTERNODE,"  %s\n", mnodemanToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint(BCLog::MASTERNODE,"Masternode manager - cleaning....\n");
-        mnodemanToLoad.CheckAndRemove(true);
-        LogPrint(BCLog::MASTERNODE,"Masternode manager - result:\n");
-        LogPrint(BCLog::MASTERNODE,"  %s\n", mnodemanToLoad.ToString());
-    }
-
     return Ok;
 }
 
@@ -179,29 +226,14 @@ void DumpMasternodes()
     int64_t nStart = GetTimeMillis();
 
     CMasternodeDB mndb;
-    CMasternodeMan tempMnodeman;
-
-    LogPrint(BCLog::MASTERNODE,"Verifying mncache.dat format...\n");
-    CMasternodeDB::ReadResult readResult = mndb.Read(tempMnodeman, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CMasternodeDB::FileError)
-        LogPrint(BCLog::MASTERNODE,"Missing masternode cache file - mncache.dat, will try to recreate\n");
-    else if (readResult != CMasternodeDB::Ok) {
-        LogPrint(BCLog::MASTERNODE,"Error reading mncache.dat: ");
-        if (readResult == CMasternodeDB::IncorrectFormat)
-            LogPrint(BCLog::MASTERNODE,"magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint(BCLog::MASTERNODE,"file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
-    LogPrint(BCLog::MASTERNODE,"Writting info to mncache.dat...\n");
     mndb.Write(mnodeman);
 
     LogPrint(BCLog::MASTERNODE,"Masternode dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
-CMasternodeMan::CMasternodeMan()
+CMasternodeMan::CMasternodeMan() :
+    mapSeenMasternodeBroadcast(MASTERNODES_SEEN_SECONDS, MASTERNODES_SEEN_MAX_USAGE),
+    mapSeenMasternodePing(MASTERNODES_SEEN_SECONDS, MASTERNODES_SEEN_MAX_USAGE)
 {
     nDsqCount = 0;
 }
@@ -257,7 +289,8 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     LOCK(cs);
 
     //remove inactive and outdated
-    std::vector<CMasternode>::iterator it = vMasternodes.begin();
+    std::set<COutPoint> setRemoved;
+    auto it = vMasternodes.begin();
     while (it != vMasternodes.end()) {
         if ((*it).activeState == CMasternode::MASTERNODE_REMOVE ||
             (*it).activeState == CMasternode::MASTERNODE_VIN_SPENT ||
@@ -265,28 +298,9 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             (*it).protocolVersion < ActiveProtocol()) {
             LogPrint(BCLog::MASTERNODE, "CMasternodeMan: Removing inactive Masternode %s - %i now\n", (*it).vin.prevout.ToStringShort(), size() - 1);
 
-            //erase all of the broadcasts we've seen from this vin
-            // -- if we missed a few pings and the node was removed, this will allow is to get it back without them
-            //    sending a brand new mnb
-            std::map<uint256, CMasternodeBroadcast>::iterator it3 = mapSeenMasternodeBroadcast.begin();
-            while (it3 != mapSeenMasternodeBroadcast.end()) {
-                if ((*it3).second.vin == (*it).vin) {
-                    masternodeSync.mapSeenSyncMNB.erase((*it3).first);
-                    mapSeenMasternodeBroadcast.erase(it3++);
-                } else {
-                    ++it3;
-                }
-            }
-
+            setRemoved.insert((*it).vin.prevout);
             // allow us to ask for this masternode again if we see another ping
-            std::map<COutPoint, int64_t>::iterator it2 = mWeAskedForMasternodeListEntry.begin();
-            while (it2 != mWeAskedForMasternodeListEntry.end()) {
-                if ((*it2).first == (*it).vin.prevout) {
-                    mWeAskedForMasternodeListEntry.erase(it2++);
-                } else {
-                    ++it2;
-                }
-            }
+            mWeAskedForMasternodeListEntry.erase((*it).vin.prevout);
 
             it = vMasternodes.erase(it);
         } else {
@@ -294,8 +308,24 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
         }
     }
 
+    //erase all of the broadcasts we've seen from the removed masternodes, in a single pass
+    // -- if we missed a few pings and the node was removed, this will allow is to get it back without them
+    //    sending a brand new mnb
+    if (!setRemoved.empty()) {
+        LOCK(masternodeSync.cs);
+        auto it3 = mapSeenMasternodeBroadcast.begin();
+        while (it3 != mapSeenMasternodeBroadcast.end()) {
+            if (setRemoved.count((*it3).second.vin.prevout)) {
+                masternodeSync.mapSeenSyncMNB.erase((*it3).first);
+                it3 = mapSeenMasternodeBroadcast.erase(it3);
+            } else {
+                ++it3;
+            }
+        }
+    }
+
     // check who's asked for the Masternode list
-    std::map<CNetAddr, int64_t>::iterator it1 = mAskedUsForMasternodeList.begin();
+    auto it1 = mAskedUsForMasternodeList.begin();
     while (it1 != mAskedUsForMasternodeList.end()) {
         if ((*it1).second < GetTime()) {
             mAskedUsForMasternodeList.erase(it1++);
@@ -315,7 +345,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     }
 
     // check which Masternodes we've asked for
-    std::map<COutPoint, int64_t>::iterator it2 = mWeAskedForMasternodeListEntry.begin();
+    auto it2 = mWeAskedForMasternodeListEntry.begin();
     while (it2 != mWeAskedForMasternodeListEntry.end()) {
         if ((*it2).second < GetTime()) {
             mWeAskedForMasternodeListEntry.erase(it2++);
@@ -324,28 +354,76 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
         }
     }
 
-    // remove expired mapSeenMasternodeBroadcast
-    std::map<uint256, CMasternodeBroadcast>::iterator it3 = mapSeenMasternodeBroadcast.begin();
-    while (it3 != mapSeenMasternodeBroadcast.end()) {
-        if ((*it3).second.lastPing.sigTime < GetTime() - (MASTERNODE_REMOVAL_SECONDS * 2)) {
-            mapSeenMasternodeBroadcast.erase(it3++);
-            masternodeSync.mapSeenSyncMNB.erase((*it3).second.GetHash());
-        } else {
-            ++it3;
-        }
-    }
+    // drop the seen broadcasts and pings that were not refreshed for a while
+    mapSeenMasternodeBroadcast.expire();
+    mapSeenMasternodePing.expire();
+    WITH_LOCK(masternodeSync.cs, masternodeSync.mapSeenSyncMNB.expire());
+}
 
-    // remove expired mapSeenMasternodePing
-    std::map<uint256, CMasternodePing>::iterator it4 = mapSeenMasternodePing.begin();
-    while (it4 != mapSeenMasternodePing.end()) {
-        if ((*it4).second.sigTime < GetTime() - (MASTERNODE_REMOVAL_SECONDS * 2)) {
-            mapSeenMasternodePing.erase(it4++);
-        } else {
-            ++it4;
-        }
+void CMasternodeMan::GetSeenCacheStats(expiringmap_stats& seenBroadcasts, expiringmap_stats& seenPings) const
+{
+    LOCK(cs);
+    seenBroadcasts = mapSeenMasternodeBroadcast.GetStats();
+    seenPings = mapSeenMasternodePing.GetStats();
+}
+
+bool CMasternodeMan::HaveSeenMasternodeBroadcast(const uint256& hash) const
+{
+    LOCK(cs);
+    return mapSeenMasternodeBroadcast.count(hash);
+}
+
+bool CMasternodeMan::HaveSeenMasternodePing(const uint256& hash) const
+{
+    LOCK(cs);
+    return mapSeenMasternodePing.count(hash);
+}
+
+bool CMasternodeMan::GetMasternodeBroadcastSerialized(const uint256& hash, CDataStream& ss) const
+{
+    LOCK(cs);
+    auto it = mapSeenMasternodeBroadcast.find(hash);
+    if (it == mapSeenMasternodeBroadcast.end())
+        return false;
+    ss.reserve(1000);
+    ss << it->second;
+    return true;
+}
+
+bool CMasternodeMan::GetMasternodePingSerialized(const uint256& hash, CDataStream& ss) const
+{
+    LOCK(cs);
+    auto it = mapSeenMasternodePing.find(hash);
+    if (it == mapSeenMasternodePing.end())
+        return false;
+    ss.reserve(1000);
+    ss << it->second;
+    return true;
+}
+
+void CMasternodeMan::AddSeenMasternodePing(const CMasternodePing& mnp)
+{
+    LOCK(cs);
+    mapSeenMasternodePing.insert(std::make_pair(mnp.GetHash(), mnp));
+}
+
+void CMasternodeMan::UpdateSeenMasternodePing(const uint256& hashBroadcast, const CMasternodePing& mnp)
+{
+    LOCK(cs);
+    auto it = mapSeenMasternodeBroadcast.find(hashBroadcast);
+    if (it != mapSeenMasternodeBroadcast.end()) {
+        it->second.lastPing = mnp;
+        mapSeenMasternodeBroadcast.touch(hashBroadcast);
     }
 }
 
+void CMasternodeMan::RemoveSeenMasternodeBroadcast(const uint256& hash)
+{
+    LOCK2(cs, masternodeSync.cs);
+    mapSeenMasternodeBroadcast.erase(hash);
+    masternodeSync.mapSeenSyncMNB.erase(hash);
+}
+
 void CMasternodeMan::Clear()
 {
     LOCK(cs);
@@ -688,11 +766,17 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         CMasternodeBroadcast mnb;
         vRecv >> mnb;
 
-        if (mapSeenMasternodeBroadcast.count(mnb.GetHash())) { //seen
+        bool fSeen;
+        {
+            LOCK(cs);
+            fSeen = mapSeenMasternodeBroadcast.count(mnb.GetHash());
+            if (!fSeen)
+                mapSeenMasternodeBroadcast.insert(std::make_pair(mnb.GetHash(), mnb));
+        }
+        if (fSeen) {
             masternodeSync.AddedMasternodeList(mnb.GetHash());
             return;
         }
-        mapSeenMasternodeBroadcast.insert(std::make_pair(mnb.GetHash(), mnb));
 
         int nDoS = 0;
         if (!mnb.CheckAndUpdate(nDoS)) {
@@ -735,8 +819,11 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
 
         LogPrint(BCLog::MNPING, "mnp - Masternode ping, vin: %s\n", mnp.vin.prevout.ToStringShort());
 
-        if (mapSeenMasternodePing.count(mnp.GetHash())) return; //seen
-        mapSeenMasternodePing.insert(std::make_pair(mnp.GetHash(), mnp));
+        {
+            LOCK(cs);
+            if (mapSeenMasternodePing.count(mnp.GetHash())) return; //seen
+            mapSeenMasternodePing.insert(std::make_pair(mnp.GetHash(), mnp));
+        }
 
         int nDoS = 0;
         if (mnp.CheckAndUpdate(nDoS)) return;
@@ -793,7 +880,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
                     pfrom->PushInventory(CInv(MSG_MASTERNODE_ANNOUNCE, hash));
                     nInvCount++;
 
-                    if (!mapSeenMasternodeBroadcast.count(hash)) mapSeenMasternodeBroadcast.insert(std::make_pair(hash, mnb));
+                    WITH_LOCK(cs, mapSeenMasternodeBroadcast.insert(std::make_pair(hash, mnb)));
 
                     if (vin == mn.vin) {
                         LogPrint(BCLog::MASTERNODE, "dseg - Sent 1 Masternode entry to peer %i\n", pfrom->GetId());
@@ -827,8 +914,11 @@ void CMasternodeMan::Remove(CTxIn vin)
 
 void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb)
 {
-    mapSeenMasternodePing.insert(std::make_pair(mnb.lastPing.GetHash(), mnb.lastPing));
-    mapSeenMasternodeBroadcast.insert(std::make_pair(mnb.GetHash(), mnb));
+    {
+        LOCK(cs);
+        mapSeenMasternodePing.insert(std::make_pair(mnb.lastPing.GetHash(), mnb.lastPing));
+        mapSeenMasternodeBroadcast.insert(std::make_pair(mnb.GetHash(), mnb));
+    }
     masternodeSync.AddedMasternodeList(mnb.GetHash());
 
     LogPrint(BCLog::MASTERNODE,"CMasternodeMan::UpdateMasternodeList() -- masternode=%s\n", mnb.vin.prevout.ToStringShort());
@@ -9,6 +9,7 @@
 
 #include "activemasternode.h"
 #include "base58.h"
+#include "expiringmap.h"
 #include "key.h"
 #include "main.h"
 #include "masternode.h"
@@ -16,8 +17,11 @@
 #include "sync.h"
 #include "util.h"
 
-#define MASTERNODES_DUMP_SECONDS (15 * 60)
+#define MASTERNODES_DUMP_SECONDS (5 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
+#define MASTERNODES_SEEN_SECONDS (MASTERNODE_REMOVAL_SECONDS * 2)
+#define MASTERNODES_SEEN_MAX_USAGE (16 << 20)
+#define MASTERNODES_SEEN_SYNC_MAX_USAGE (4 << 20)
 
 
 class CMasternodeMan;
@@ -29,7 +33,7 @@ extern std::string strMasterNodePrivKey;
 
 void DumpMasternodes();
 
-/** Access to the MN database (mncache.dat)
+/** Access to the MN database (layer 2 store, mncache.dat of older versions)
  */
 class CMasternodeDB
 {
@@ -48,6 +52,10 @@ public:
         IncorrectFormat
     };
 
+private:
+    ReadResult ReadFlatFile(CMasternodeMan& mnodemanToLoad);
+
+public:
     CMasternodeDB();
     bool Write(const CMasternodeMan& mnodemanToSave);
     ReadResult Read(CMasternodeMan& mnodemanToLoad, bool fDryRun = false);
@@ -55,6 +63,8 @@ public:
 
 class CMasternodeMan
 {
+    friend class CMasternodeDB;
+
 private:
     // critical section to protect the inner data structures
     mutable RecursiveMutex cs;
@@ -72,10 +82,10 @@ private:
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
 public:
-    // Keep track of all broadcasts I've seen
-    std::map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
-    // Keep track of all pings I've seen
-    std::map<uint256, CMasternodePing> mapSeenMasternodePing;
+    // Keep track of the broadcasts I've seen recently
+    expiringmap<uint256, CMasternodeBroadcast, SaltedTxidHasher> mapSeenMasternodeBroadcast;
+    // Keep track of the pings I've seen recently
+    expiringmap<uint256, CMasternodePing, SaltedTxidHasher> mapSeenMasternodePing;
 
     // keep track of dsq count to prevent masternodes from gaming obfuscation queue
     // TODO: Remove this from serialization
@@ -116,6 +126,19 @@ public:
 
     int CountEnabled(int protocolVersion = -1);
 
+    void GetSeenCacheStats(expiringmap_stats& seenBroadcasts, expiringmap_stats& seenPings) const;
+
+    bool HaveSeenMasternodeBroadcast(const uint256& hash) const;
+    bool HaveSeenMasternodePing(const uint256& hash) const;
+    /// Serialize a seen broadcast or ping for a getdata, false if it's not known (anymore)
+    bool GetMasternodeBroadcastSerialized(const uint256& hash, CDataStream& ss) const;
+    bool GetMasternodePingSerialized(const uint256& hash, CDataStream& ss) const;
+    void AddSeenMasternodePing(const CMasternodePing& mnp);
+    /// Refresh the last ping of a seen broadcast
+    void UpdateSeenMasternodePing(const uint256& hashBroadcast, const CMasternodePing& mnp);
+    /// Forget a broadcast, so that it gets checked again when it's received again
+    void RemoveSeenMasternodeBroadcast(const uint256& hash);
+
     void CountNetworks(int protocolVersion, int& ipv4, int& ipv6, int& onion);
 
     void DsegUpdate(CNode* pnode);
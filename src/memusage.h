@@ -6,6 +6,10 @@
 #ifndef BITCOIN_MEMUSAGE_H
 #define BITCOIN_MEMUSAGE_H
 
+#include "prevector.h"
+
+#include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include <map>
@@ -36,8 +36,11 @@
 #include "zpivchain.h"
 
 
+#include <limits>
+#include <memory>
+
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
-#include <boost/tuple/tuple.hpp>
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -45,53 +48,9 @@
 // Miner
 //
 
-//
-// Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
-//
-class COrphan
-{
-public:
-    const CTransaction* ptx;
-    std::set<uint256> setDependsOn;
-    CFeeRate feeRate;
-    double dPriority;
-
-    COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
-    {
-    }
-};
-
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
-// We want to sort transactions by priority and fee rate, so:
-typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
-class TxPriorityCompare
-{
-    bool byFee;
-
-public:
-    TxPriorityCompare(bool _byFee) : byFee(_byFee) {}
-
-    bool operator()(const TxPriority& a, const TxPriority& b)
-    {
-        if (byFee) {
-            if (a.get<1>() == b.get<1>())
-                return a.get<0>() < b.get<0>();
-            return a.get<1>() < b.get<1>();
-        } else {
-            if (a.get<0>() == b.get<0>())
-                return a.get<1>() < b.get<1>();
-            return a.get<0>() < b.get<0>();
-        }
-    }
-};
-
 void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
 {
     pblock->nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
@@ -147,6 +106,515 @@ bool CheckForDuplicatedSerials(const CTransaction& tx, const Consensus::Params&
     return true;
 }
 
+namespace {
+
+// Package state of a mempool transaction: the transaction together with all
+// its in-mempool ancestors that are not in the block yet.
+struct CTxPackageInfo {
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    unsigned int nSigOpsWithAncestors;
+    bool fFailed;
+};
+
+// Entry of the package queue, best ancestor fee rate first
+struct CTxPackageScore {
+    CTxMemPool::txiter iter;
+    uint64_t nSize;
+    CAmount nFees;
+
+    bool operator<(const CTxPackageScore& b) const
+    {
+        const double f1 = (double)nFees * b.nSize;
+        const double f2 = (double)b.nFees * nSize;
+        if (f1 == f2)
+            return CTxMemPool::CompareIteratorByHash()(iter, b.iter);
+        return f1 > f2;
+    }
+};
+
+// Sort the transactions of a package so that parents come before their children
+struct CompareTxIterByAncestorCount {
+    const std::map<CTxMemPool::txiter, CTxPackageInfo, CTxMemPool::CompareIteratorByHash>& mapPackages;
+
+    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
+    {
+        const uint64_t nCountA = mapPackages.at(a).nCountWithAncestors;
+        const uint64_t nCountB = mapPackages.at(b).nCountWithAncestors;
+        if (nCountA == nCountB)
+            return CTxMemPool::CompareIteratorByHash()(a, b);
+        return nCountA < nCountB;
+    }
+};
+
+// Failed packages tried in a row after which we stop when the block is almost full
+static const int MAX_CONSECUTIVE_PACKAGE_FAILURES = 1000;
+
+/** Selects the mempool transactions of a new block.
+ *  The ancestor state of every candidate is computed once from the mempool
+ *  links, then packages are picked by ancestor fee rate and the state of the
+ *  descendants of what made it into the block is updated in place.
+ *  Requires cs_main and mempool.cs whenever it is used, and must be dropped
+ *  as soon as the tip changes or one of the tracked entries leaves the mempool.
+ */
+class BlockAssembler
+{
+private:
+    typedef std::map<CTxMemPool::txiter, CTxPackageInfo, CTxMemPool::CompareIteratorByHash> packageMap;
+
+    enum PackageResult {
+        PACKAGE_ADDED,
+        PACKAGE_TOO_LARGE,
+        PACKAGE_INVALID
+    };
+
+    const Consensus::Params& consensus;
+    const int nHeight;
+    const uint64_t nBlockMaxSize;
+    const uint64_t nBlockMinSize;
+    const uint64_t nBlockPrioritySize;
+    const bool fPrintPriority;
+
+    // coins of the chain tip plus the transactions in the block
+    CCoinsViewCache view;
+    std::vector<CBigNum> vBlockSerials;
+
+    // selected transactions, in block order
+    std::vector<CTransaction> vtx;
+    std::vector<CAmount> vTxFees;
+    std::vector<int64_t> vTxSigOps;
+
+    uint64_t nBlockSize;
+    uint64_t nBlockTx;
+    unsigned int nBlockSigOps;
+    CAmount nFees;
+
+    CTxMemPool::setEntries inBlock;
+    size_t nCandidates;
+    // candidates and their package state, and the queue of packages still to try
+    packageMap mapPackages;
+    std::set<CTxPackageScore> setPackages;
+
+    static CTxPackageScore ScoreOf(packageMap::const_iterator mit)
+    {
+        CTxPackageScore score;
+        score.iter = mit->first;
+        score.nSize = mit->second.nSizeWithAncestors;
+        score.nFees = mit->second.nModFeesWithAncestors;
+        return score;
+    }
+
+    bool IsCandidate(const CTransaction& tx) const
+    {
+        return !tx.IsCoinBase() && !tx.IsCoinStake() && !tx.ContainsZerocoins() && IsFinalTx(tx, nHeight);
+    }
+
+    /** Start tracking the package of a candidate, false if one of its ancestors can't be mined */
+    bool TrackPackage(CTxMemPool::txiter it, bool fCheckAncestors)
+    {
+        const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        CTxMemPool::setEntries setAncestors;
+        mempool.CalculateMemPoolAncestors(*it, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+
+        CTxPackageInfo info;
+        info.nCountWithAncestors = setAncestors.size() + 1;
+        info.nSizeWithAncestors = it->GetTxSize();
+        info.nModFeesWithAncestors = it->GetModifiedFee();
+        info.nSigOpsWithAncestors = it->GetSigOpCount();
+        info.fFailed = false;
+        for (CTxMemPool::txiter ancestor : setAncestors) {
+            if (inBlock.count(ancestor))
+                continue;
+            if (fCheckAncestors && !mapPackages.count(ancestor))
+                return false;
+            info.nSizeWithAncestors += ancestor->GetTxSize();
+            info.nModFeesWithAncestors += ancestor->GetModifiedFee();
+            info.nSigOpsWithAncestors += ancestor->GetSigOpCount();
+        }
+
+        packageMap::iterator mit = mapPackages.emplace(it, info).first;
+        setPackages.insert(ScoreOf(mit));
+        return true;
+    }
+
+    void BuildPackages()
+    {
+        CTxMemPool::setEntries setExcluded;
+        for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it) {
+            if (!IsCandidate(it->GetTx()))
+                mempool.CalculateDescendants(it, setExcluded);
+        }
+
+        // the descendants of excluded entries are excluded as well, no need to check the ancestors
+        for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it) {
+            if (!setExcluded.count(it))
+                TrackPackage(it, false);
+        }
+    }
+
+    /** Drop a transaction that can't be mined, along with all its descendants */
+    void Exclude(CTxMemPool::txiter it)
+    {
+        CTxMemPool::setEntries setDescendants;
+        mempool.CalculateDescendants(it, setDescendants);
+        for (CTxMemPool::txiter desc : setDescendants) {
+            packageMap::iterator mit = mapPackages.find(desc);
+            if (mit == mapPackages.end())
+                continue;
+            setPackages.erase(ScoreOf(mit));
+            mapPackages.erase(mit);
+        }
+    }
+
+    /** Take the transactions just added to the block out of the packages of their descendants */
+    void UpdatePackagesForAdded(const std::vector<CTxMemPool::txiter>& vAdded)
+    {
+        for (CTxMemPool::txiter it : vAdded) {
+            packageMap::iterator mitAdded = mapPackages.find(it);
+            setPackages.erase(ScoreOf(mitAdded));
+            mapPackages.erase(mitAdded);
+
+            CTxMemPool::setEntries setDescendants;
+            mempool.CalculateDescendants(it, setDescendants);
+            for (CTxMemPool::txiter desc : setDescendants) {
+                if (desc == it || inBlock.count(desc))
+                    continue;
+                packageMap::iterator mit = mapPackages.find(desc);
+                if (mit == mapPackages.end())
+                    continue;
+                if (!mit->second.fFailed)
+                    setPackages.erase(ScoreOf(mit));
+                mit->second.nSizeWithAncestors -= it->GetTxSize();
+                mit->second.nModFeesWithAncestors -= it->GetModifiedFee();
+                mit->second.nSigOpsWithAncestors -= it->GetSigOpCount();
+                if (!mit->second.fFailed)
+                    setPackages.insert(ScoreOf(mit));
+            }
+        }
+    }
+
+    /** Check a package against the block limits and the coins, and add it to the block if it fits */
+    PackageResult AddPackage(const CTxMemPool::setEntries& package)
+    {
+        std::vector<CTxMemPool::txiter> vSorted(package.begin(), package.end());
+        std::sort(vSorted.begin(), vSorted.end(), CompareTxIterByAncestorCount{mapPackages});
+
+        // validate on top of the block so far, a rejected package leaves no trace
+        CCoinsViewCache viewPackage(&view);
+        std::vector<CBigNum> vSerials(vBlockSerials);
+        uint64_t nPackageSize = 0;
+        unsigned int nPackageSigOps = 0;
+        std::vector<std::pair<CAmount, unsigned int> > vFeesSigOps;
+        for (CTxMemPool::txiter it : vSorted) {
+            const CTransaction& tx = it->GetTx();
+            nPackageSize += it->GetTxSize();
+            if (nBlockSize + nPackageSize >= nBlockMaxSize)
+                return PACKAGE_TOO_LARGE;
+
+            // This should never happen; all transactions in the memory
+            // pool should connect to either transactions in the chain
+            // or other transactions in the memory pool.
+            if (!viewPackage.HaveInputs(tx)) {
+                LogPrintf("ERROR: mempool transaction missing input\n");
+                Exclude(it);
+                return PACKAGE_INVALID;
+            }
+
+            // zSTUDS check to not include duplicated serials in the same block.
+            if (!CheckForDuplicatedSerials(tx, consensus, vSerials)) {
+                Exclude(it);
+                return PACKAGE_INVALID;
+            }
+
+            const unsigned int nTxSigOps = GetLegacySigOpCount(tx) + GetP2SHSigOpCount(tx, viewPackage);
+            nPackageSigOps += nTxSigOps;
+            if (nBlockSigOps + nPackageSigOps >= MAX_BLOCK_SIGOPS_CURRENT)
+                return PACKAGE_TOO_LARGE;
+
+            // Note that flags: we don't want to set mempool/IsStandard()
+            // policy here, but we still have to ensure that the block we
+            // create only contains transactions that are valid in new blocks.
+            // The signatures were cached when the transaction entered the mempool.
+            CValidationState state;
+            PrecomputedTransactionData precomTxData(tx);
+            if (!CheckInputs(tx, state, viewPackage, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, precomTxData)) {
+                Exclude(it);
+                return PACKAGE_INVALID;
+            }
+
+            vFeesSigOps.emplace_back(viewPackage.GetValueIn(tx) - tx.GetValueOut(), nTxSigOps);
+            UpdateCoins(tx, viewPackage, nHeight);
+        }
+
+        viewPackage.Flush();
+        vBlockSerials.swap(vSerials);
+        for (size_t i = 0; i < vSorted.size(); i++) {
+            vtx.push_back(vSorted[i]->GetTx());
+            vTxFees.push_back(vFeesSigOps[i].first);
+            vTxSigOps.push_back(vFeesSigOps[i].second);
+            nFees += vFeesSigOps[i].first;
+            inBlock.insert(vSorted[i]);
+        }
+        nBlockSize += nPackageSize;
+        nBlockTx += vSorted.size();
+        nBlockSigOps += nPackageSigOps;
+
+        UpdatePackagesForAdded(vSorted);
+        return PACKAGE_ADDED;
+    }
+
+    bool ParentsInBlock(CTxMemPool::txiter it) const
+    {
+        for (CTxMemPool::txiter parent : mempool.GetMemPoolParents(it)) {
+            if (!inBlock.count(parent))
+                return false;
+        }
+        return true;
+    }
+
+public:
+    BlockAssembler(int nHeightIn, uint64_t nBlockMaxSizeIn, uint64_t nBlockMinSizeIn, uint64_t nBlockPrioritySizeIn) :
+        consensus(Params().GetConsensus()),
+        nHeight(nHeightIn),
+        nBlockMaxSize(nBlockMaxSizeIn),
+        nBlockMinSize(nBlockMinSizeIn),
+        nBlockPrioritySize(nBlockPrioritySizeIn),
+        fPrintPriority(GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY)),
+        view(pcoinsTip),
+        nBlockSize(1000),
+        nBlockTx(0),
+        nBlockSigOps(100),
+        nFees(0)
+    {
+        AssertLockHeld(cs_main);
+        AssertLockHeld(mempool.cs);
+        BuildPackages();
+        nCandidates = mapPackages.size();
+    }
+
+    /** Fill the first -blockprioritysize bytes with the oldest coins, regardless of the fees */
+    void AddPriorityTxs()
+    {
+        if (nBlockPrioritySize == 0)
+            return;
+
+        std::vector<TxCoinAgePriority> vecPriority;
+        vecPriority.reserve(mapPackages.size());
+        for (packageMap::const_iterator mit = mapPackages.begin(); mit != mapPackages.end(); ++mit) {
+            double dPriority = mit->first->GetPriority(nHeight);
+            CAmount dummy = 0;
+            mempool.ApplyDeltas(mit->first->GetTx().GetHash(), dPriority, dummy);
+            vecPriority.emplace_back(dPriority, mit->first);
+        }
+
+        // children wait for their parents to be in the block
+        std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
+        TxCoinAgePriorityCompare comparer;
+        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+        while (!vecPriority.empty()) {
+            const double dPriority = vecPriority.front().first;
+            CTxMemPool::txiter iter = vecPriority.front().second;
+            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+            vecPriority.pop_back();
+
+            if (!mapPackages.count(iter))
+                continue;
+            if (!ParentsInBlock(iter)) {
+                waitPriMap.emplace(iter, dPriority);
+                continue;
+            }
+
+            CTxMemPool::setEntries package;
+            package.insert(iter);
+            if (AddPackage(package) != PACKAGE_ADDED)
+                continue;
+
+            if (fPrintPriority) {
+                LogPrintf("priority %.1f fee %s txid %s\n",
+                    dPriority, CFeeRate(iter->GetModifiedFee(), iter->GetTxSize()).ToString(), iter->GetTx().GetHash().ToString());
+            }
+
+            // Prioritise by fee once past the priority size or we run out of high-priority transactions
+            if (nBlockSize >= nBlockPrioritySize || !AllowFree(dPriority))
+                break;
+
+            for (CTxMemPool::txiter child : mempool.GetMemPoolChildren(iter)) {
+                auto wit = waitPriMap.find(child);
+                if (wit != waitPriMap.end()) {
+                    vecPriority.emplace_back(wit->second, child);
+                    std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                    waitPriMap.erase(wit);
+                }
+            }
+        }
+    }
+
+    /** Consider an entry that entered the mempool after the packages were built */
+    void AddCandidate(CTxMemPool::txiter it)
+    {
+        AssertLockHeld(mempool.cs);
+        if (inBlock.count(it) || mapPackages.count(it) || !IsCandidate(it->GetTx()))
+            return;
+        if (TrackPackage(it, true))
+            nCandidates++;
+    }
+
+    /** Fill the rest of the block with the packages of highest ancestor fee rate */
+    void AddPackageTxs()
+    {
+        const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        int nConsecutiveFailed = 0;
+        while (!setPackages.empty()) {
+            const CTxPackageScore best = *setPackages.begin();
+
+            // Skip free transactions if we're past the minimum block size
+            if (best.nFees < ::minRelayTxFee.GetFee(best.nSize) && nBlockSize + best.nSize >= nBlockMinSize)
+                break;
+
+            PackageResult result = PACKAGE_TOO_LARGE;
+            packageMap::iterator mit = mapPackages.find(best.iter);
+            if (nBlockSize + best.nSize < nBlockMaxSize && nBlockSigOps + mit->second.nSigOpsWithAncestors < MAX_BLOCK_SIGOPS_CURRENT) {
+                CTxMemPool::setEntries package;
+                mempool.CalculateMemPoolAncestors(*best.iter, package, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+                for (CTxMemPool::setEntries::iterator it = package.begin(); it != package.end();) {
+                    if (inBlock.count(*it))
+                        it = package.erase(it);
+                    else
+                        ++it;
+                }
+                package.insert(best.iter);
+                result = AddPackage(package);
+            }
+
+            if (result == PACKAGE_ADDED) {
+                nConsecutiveFailed = 0;
+                continue;
+            }
+            if (result == PACKAGE_TOO_LARGE) {
+                // may still be mined in a later block, or as part of a smaller package
+                setPackages.erase(best);
+                mit->second.fFailed = true;
+                if (++nConsecutiveFailed > MAX_CONSECUTIVE_PACKAGE_FAILURES && nBlockSize + 4000 > nBlockMaxSize)
+                    break;
+            }
+        }
+    }
+
+    bool IsFor(int nHeightIn, uint64_t nBlockMaxSizeIn, uint64_t nBlockMinSizeIn, uint64_t nBlockPrioritySizeIn) const
+    {
+        return nHeight == nHeightIn && nBlockMaxSize == nBlockMaxSizeIn && nBlockMinSize == nBlockMinSizeIn && nBlockPrioritySize == nBlockPrioritySizeIn;
+    }
+
+    const std::vector<CTransaction>& GetTxs() const { return vtx; }
+    const std::vector<CAmount>& GetTxFees() const { return vTxFees; }
+    const std::vector<int64_t>& GetTxSigOps() const { return vTxSigOps; }
+    size_t GetPackageCount() const { return nCandidates; }
+    uint64_t GetBlockTx() const { return nBlockTx; }
+    uint64_t GetBlockSize() const { return nBlockSize; }
+    CAmount GetFees() const { return nFees; }
+};
+
+// Seconds after which the cached selection is rebuilt anyway, so that time locked
+// transactions and the coin age priority catch up
+static const int64_t BLOCK_TEMPLATE_CACHE_MAX_AGE = 60;
+
+/** Mempool transactions selected for the next block on top of the current tip.
+ *  The selection is kept across CreateNewBlock calls and extended with the
+ *  transactions entering the mempool, so that only the coinbase or coinstake
+ *  and the payee outputs are left to build on request. It is dropped on a new
+ *  tip, when the block limits change or when a tracked transaction leaves the
+ *  mempool or gets prioritised. Any mempool update that was not notified as
+ *  an addition drops it as well.
+ *  Guarded by mempool.cs, which is held by the mempool notifications as well.
+ */
+class CBlockTemplateCache
+{
+private:
+    std::unique_ptr<BlockAssembler> passembler;
+    uint256 hashTip;
+    const CCoinsViewCache* pcoinsBase;
+    int64_t nTimeBuilt;
+    // mempool entries added since the selection was last updated
+    std::vector<uint256> vAdded;
+    // expected mempool update counter
+    unsigned int nTransactionsUpdated;
+
+    boost::signals2::scoped_connection connAdded;
+    boost::signals2::scoped_connection connRemoved;
+    boost::signals2::scoped_connection connPrioritised;
+
+    void TransactionAdded(const CTransaction& tx)
+    {
+        if (passembler) {
+            vAdded.push_back(tx.GetHash());
+            nTransactionsUpdated++;
+        }
+    }
+
+    void Invalidate()
+    {
+        passembler.reset();
+        vAdded.clear();
+    }
+
+public:
+    CBlockTemplateCache() : pcoinsBase(nullptr), nTimeBuilt(0), nTransactionsUpdated(0) {}
+
+    /** Selection of transactions for a block on top of pindexPrev, built or brought up to date */
+    const BlockAssembler& Get(const CBlockIndex* pindexPrev, uint64_t nBlockMaxSize, uint64_t nBlockMinSize, uint64_t nBlockPrioritySize)
+    {
+        AssertLockHeld(cs_main);
+        AssertLockHeld(mempool.cs);
+        if (!connAdded.connected()) {
+            connAdded = mempool.NotifyEntryAdded.connect(boost::bind(&CBlockTemplateCache::TransactionAdded, this, _1));
+            connRemoved = mempool.NotifyEntryRemoved.connect(boost::bind(&CBlockTemplateCache::Invalidate, this));
+            connPrioritised = mempool.NotifyEntryPrioritised.connect(boost::bind(&CBlockTemplateCache::Invalidate, this));
+        }
+
+        const int nHeight = pindexPrev->nHeight + 1;
+        const int64_t nTimeStart = GetTimeMicros();
+        if (passembler && hashTip == pindexPrev->GetBlockHash() && pcoinsBase == pcoinsTip &&
+            mempool.GetTransactionsUpdated() == nTransactionsUpdated && GetTime() - nTimeBuilt <= BLOCK_TEMPLATE_CACHE_MAX_AGE &&
+            passembler->IsFor(nHeight, nBlockMaxSize, nBlockMinSize, nBlockPrioritySize)) {
+            const size_t nAdded = vAdded.size();
+            for (const uint256& hash : vAdded) {
+                CTxMemPool::txiter it = mempool.mapTx.find(hash);
+                if (it != mempool.mapTx.end())
+                    passembler->AddCandidate(it);
+            }
+            vAdded.clear();
+            if (nAdded)
+                passembler->AddPackageTxs();
+            LogPrint(BCLog::BENCH, "CreateNewBlock() : template updated with %u new entries %.2fms, %u txs (%u bytes)\n",
+                     nAdded, 0.001 * (GetTimeMicros() - nTimeStart), passembler->GetBlockTx(), passembler->GetBlockSize());
+            return *passembler;
+        }
+
+        Invalidate();
+        passembler.reset(new BlockAssembler(nHeight, nBlockMaxSize, nBlockMinSize, nBlockPrioritySize));
+        hashTip = pindexPrev->GetBlockHash();
+        pcoinsBase = pcoinsTip;
+        nTimeBuilt = GetTime();
+        nTransactionsUpdated = mempool.GetTransactionsUpdated();
+        const int64_t nTimePackages = GetTimeMicros();
+        passembler->AddPriorityTxs();
+        const int64_t nTimePriority = GetTimeMicros();
+        passembler->AddPackageTxs();
+        const int64_t nTimeSelected = GetTimeMicros();
+        LogPrint(BCLog::BENCH, "CreateNewBlock() : template built from %u packages %.2fms, priority %.2fms, packages %.2fms, %u txs (%u bytes)\n",
+                 passembler->GetPackageCount(), 0.001 * (nTimePackages - nTimeStart), 0.001 * (nTimePriority - nTimePackages),
+                 0.001 * (nTimeSelected - nTimePriority), passembler->GetBlockTx(), passembler->GetBlockSize());
+        return *passembler;
+    }
+};
+
+CBlockTemplateCache blockTemplateCache;
+
+} // anonymous namespace
+
 bool CreateCoinbaseTx(CBlock* pblock, const CScript& scriptPubKeyIn, CBlockIndex* pindexPrev)
 {
     // Create coinbase tx
@@ -260,189 +728,16 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
 
     {
         LOCK2(cs_main, mempool.cs);
-        CCoinsViewCache view(pcoinsTip);
-
-        // Priority order to process transactions
-        std::list<COrphan> vOrphan; // list memory doesn't move
-        std::map<uint256, std::vector<COrphan*> > mapDependers;
-        bool fPrintPriority = GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
-
-        // This vector will be sorted into a priority queue:
-        std::vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi) {
-            const CTransaction& tx = mi->GetTx();
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight)){
-                continue;
-            }
-            if(tx.ContainsZerocoins()){
-                continue;
-            }
-
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            bool hasZerocoinSpends = tx.HasZerocoinSpendInputs();
-            if (hasZerocoinSpends)
-                nTotalIn = tx.GetZerocoinSpent();
-
-            for (const CTxIn& txin : tx.vin) {
-                // Read prev transaction
-                if (!view.HaveCoin(txin.prevout)) {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash)) {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
-
-                    // Has to wait for dependencies
-                    if (!porphan) {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx.find(txin.prevout.hash)->GetTx().vout[txin.prevout.n].nValue;
-                    continue;
-                }
-
-                const Coin& coin = view.AccessCoin(txin.prevout);
-                assert(hasZerocoinSpends || !coin.IsSpent());
-
-                CAmount nValueIn = coin.out.nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = nHeight - coin.nHeight;
+        const int64_t nTimeStart = GetTimeMicros();
 
-                // zSTUDS spends can have very large priority, use non-overflowing safe functions
-                dPriority = double_safe_addition(dPriority, ((double)nValueIn * nConf));
-
-            }
-            if (fMissingInputs) continue;
-
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
-
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
-
-            CFeeRate feeRate(nTotalIn - tx.GetValueOut(), nTxSize);
-
-            if (porphan) {
-                porphan->dPriority = dPriority;
-                porphan->feeRate = feeRate;
-            } else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->GetTx()));
-        }
-
-        // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-        std::vector<CBigNum> vBlockSerials;
-        while (!vecPriority.empty()) {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
-
-            // Legacy limits on sigOps:
-            unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
-
-            // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (!tx.HasZerocoinSpendInputs() && fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
-
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
-
-            if (!view.HaveInputs(tx))
-                continue;
-
-            // zSTUDS check to not include duplicated serials in the same block.
-            if (!CheckForDuplicatedSerials(tx, consensus, vBlockSerials)) {
-                continue;
-            }
-
-            CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
-
-            nTxSigOps += GetP2SHSigOpCount(tx, view);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
-
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
-
-            CValidationState state;
-            PrecomputedTransactionData precomTxData(tx);
-            if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, precomTxData))
-                continue;
-
-            UpdateCoins(tx, view, nHeight);
-
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            if (fPrintPriority) {
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                    dPriority, feeRate.ToString(), tx.GetHash().ToString());
-            }
-
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash)) {
-                for (COrphan* porphan : mapDependers[hash]) {
-                    if (!porphan->setDependsOn.empty()) {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty()) {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
-                }
-            }
-        }
+        const BlockAssembler& assembler = blockTemplateCache.Get(pindexPrev, nBlockMaxSize, nBlockMinSize, nBlockPrioritySize);
+        pblock->vtx.insert(pblock->vtx.end(), assembler.GetTxs().begin(), assembler.GetTxs().end());
+        pblocktemplate->vTxFees.insert(pblocktemplate->vTxFees.end(), assembler.GetTxFees().begin(), assembler.GetTxFees().end());
+        pblocktemplate->vTxSigOps.insert(pblocktemplate->vTxSigOps.end(), assembler.GetTxSigOps().begin(), assembler.GetTxSigOps().end());
+        nFees = assembler.GetFees();
+        const uint64_t nBlockTx = assembler.GetBlockTx();
+        const uint64_t nBlockSize = assembler.GetBlockSize();
+        const int64_t nTimeSelected = GetTimeMicros();
 
         if (!fProofOfStake) {
             // Coinbase can get the fees.
@@ -478,11 +773,20 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
             mempool.clear();
             return nullptr;
         }
+        const int64_t nTimeValidated = GetTimeMicros();
+        LogPrint(BCLog::BENCH, "%s : validity %.2fms (total %.2fms)\n", __func__,
+                 0.001 * (nTimeValidated - nTimeSelected), 0.001 * (nTimeValidated - nTimeStart));
     }
 
     return pblocktemplate.release();
 }
 
+std::vector<CTransaction> GetBlockTemplateTxs(const CBlockIndex* pindexPrev, uint64_t nBlockMaxSize, uint64_t nBlockMinSize, uint64_t nBlockPrioritySize)
+{
+    LOCK2(cs_main, mempool.cs);
+    return blockTemplateCache.Get(pindexPrev, nBlockMaxSize, nBlockMinSize, nBlockPrioritySize).GetTxs();
+}
+
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
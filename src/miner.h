@@ -30,6 +30,8 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 /** Check mined block */
 void UpdateTime(CBlockHeader* block, const CBlockIndex* pindexPrev);
+/** Mempool transactions selected for a block on top of pindexPrev, in block order */
+std::vector<CTransaction> GetBlockTemplateTxs(const CBlockIndex* pindexPrev, uint64_t nBlockMaxSize, uint64_t nBlockMinSize, uint64_t nBlockPrioritySize);
 
 #ifdef ENABLE_WALLET
     /** Run the miner threads */
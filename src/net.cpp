@@ -25,12 +25,14 @@
 #include "netmessagemaker.h"
 #include "primitives/transaction.h"
 #include "netbase.h"
+#include "netpoller.h"
 #include "scheduler.h"
 
 #ifdef WIN32
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_UPNP
@@ -55,6 +57,20 @@
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+// Released send buffers kept for reuse, and the largest capacity worth keeping
+#define SEND_BUFFER_POOL_SIZE 256
+#define SEND_BUFFER_POOL_MAX_CAPACITY (16 * 1024)
+
+// Queued send buffers handed to a single sendmsg()
+#define MAX_SEND_IOVECS 64
+
+// Receive buffers are pooled from 256 bytes to the largest message, at most
+// RECV_BUFFER_POOL_BUCKET_SIZE of each power of two and RECV_BUFFER_POOL_MAX_BYTES in all
+#define RECV_BUFFER_POOL_MIN_CLASS 8
+#define RECV_BUFFER_POOL_MAX_CLASS 21
+#define RECV_BUFFER_POOL_BUCKET_SIZE 32
+#define RECV_BUFFER_POOL_MAX_BYTES (32 * 1024 * 1024)
+
 #if !defined(HAVE_MSG_NOSIGNAL) && !defined(MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -417,7 +433,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char* pszDest, bool fCo
     bool proxyConnectionFailed = false;
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed)) {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!IsWatchableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -706,14 +722,26 @@ void CNode::copyStats(CNodeStats& stats)
     {
         LOCK(cs_vSend);
         X(mapSendBytesPerMsgCmd);
+        X(mapSendMsgsPerMsgCmd);
         X(nSendBytes);
     }
     {
         LOCK(cs_vRecv);
         X(mapRecvBytesPerMsgCmd);
+        X(mapRecvMsgsPerMsgCmd);
         X(nRecvBytes);
     }
+    {
+        LOCK(cs_vProcessMsg);
+        X(mapProcessTimePerMsgCmd);
+    }
     X(fWhitelisted);
+    {
+        LOCK(cs_inventory);
+        stats.nTxInvQueued = setInventoryTxToSend.size();
+        X(nTxInvSent);
+        X(nTxInvFlushes);
+    }
 
     // It is common for nodes with good ping times to suddenly become lagged,
     // due to a new block arriving or other large transfer.
@@ -778,6 +806,7 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes, bool& complete
                 i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
             assert(i != mapRecvBytesPerMsgCmd.end());
             i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
+            mapRecvMsgsPerMsgCmd[i->first]++;
 
             msg.nTime = nTimeMicros;
             complete = true;
@@ -813,6 +842,213 @@ int CNode::GetSendVersion() const
     return nSendVersion;
 }
 
+CNetMessage::~CNetMessage()
+{
+    CSerializeData vch;
+    vRecv.Swap(vch);
+    GetRecvBufferPool().Recycle(std::move(vch));
+}
+
+// floor(log2(n)) for n > 0
+static int RecvBufferClass(size_t n)
+{
+    int nClass = 0;
+    while (n >>= 1)
+        nClass++;
+    return nClass;
+}
+
+CRecvBufferPool::CRecvBufferPool() : vBuckets(RECV_BUFFER_POOL_MAX_CLASS + 1)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+CSerializeData CRecvBufferPool::Get(size_t nSize)
+{
+    CSerializeData vch;
+    if (nSize == 0)
+        return vch;
+
+    // the class of nSize may hold a large enough buffer, any buffer of the next
+    // class is (and less than 4 times the size)
+    const int nClass = std::max(RecvBufferClass(nSize), RECV_BUFFER_POOL_MIN_CLASS);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = nClass; i <= std::min(nClass + 1, RECV_BUFFER_POOL_MAX_CLASS); i++) {
+            std::vector<CSerializeData>& vBucket = vBuckets[i];
+            for (auto it = vBucket.rbegin(); it != vBucket.rend(); ++it) {
+                if (it->capacity() < nSize)
+                    continue;
+                vch.swap(*it);
+                vBucket.erase(std::next(it).base());
+                stats.nHits++;
+                stats.nBytesReused += vch.capacity();
+                stats.nPooledBuffers--;
+                stats.nPooledBytes -= vch.capacity();
+                return vch;
+            }
+        }
+        stats.nMisses++;
+    }
+    vch.reserve(nSize);
+    return vch;
+}
+
+void CRecvBufferPool::Recycle(CSerializeData&& vch)
+{
+    const size_t nCapacity = vch.capacity();
+    if (nCapacity < ((size_t)1 << RECV_BUFFER_POOL_MIN_CLASS))
+        return;
+    const int nClass = RecvBufferClass(nCapacity);
+    if (nClass > RECV_BUFFER_POOL_MAX_CLASS)
+        return;
+
+    // no need to scrub what is handed out again: only network data lives here
+    vch.clear();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (vBuckets[nClass].size() >= RECV_BUFFER_POOL_BUCKET_SIZE || stats.nPooledBytes + nCapacity > RECV_BUFFER_POOL_MAX_BYTES)
+        return;
+    vBuckets[nClass].emplace_back(std::move(vch));
+    stats.nPooledBuffers++;
+    stats.nPooledBytes += nCapacity;
+}
+
+CRecvBufferPoolStats CRecvBufferPool::GetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+CRecvBufferPool& GetRecvBufferPool()
+{
+    // never destroyed, like the send buffer pool
+    static CRecvBufferPool* pool = new CRecvBufferPool();
+    return *pool;
+}
+
+void CMessageWorkerPool::Start(int nThreads, size_t nReceiveFloodSizeIn, Handler handlerIn)
+{
+    assert(vThreads.empty());
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        fRunning = true;
+    }
+    handler = handlerIn;
+    nReceiveFloodSize = nReceiveFloodSizeIn;
+    for (int i = 0; i < nThreads; i++)
+        vThreads.emplace_back(&TraceThread<std::function<void()> >, "msgworker", std::function<void()>(std::bind(&CMessageWorkerPool::ThreadWorker, this)));
+}
+
+void CMessageWorkerPool::Interrupt()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        fRunning = false;
+    }
+    cond.notify_all();
+}
+
+void CMessageWorkerPool::Stop()
+{
+    Interrupt();
+    for (std::thread& thread : vThreads)
+        thread.join();
+    vThreads.clear();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (std::pair<const NodeId, PeerQueue>& entry : mapQueues) {
+        for (QueuedMessage& msg : entry.second.dqMessages)
+            Release(msg);
+    }
+    mapQueues.clear();
+    dqReady.clear();
+    nQueued = 0;
+}
+
+void CMessageWorkerPool::Release(QueuedMessage& msg)
+{
+    {
+        LOCK(msg.pnode->cs_vProcessMsg);
+        msg.pnode->nProcessQueueSize -= msg.vRecv.size() + CMessageHeader::HEADER_SIZE;
+        msg.pnode->fPauseRecv = msg.pnode->nProcessQueueSize > nReceiveFloodSize;
+    }
+    msg.pnode->Release();
+}
+
+bool CMessageWorkerPool::Enqueue(CNode* pnode, const std::string& strCommand, CDataStream& vRecv)
+{
+    if (vThreads.empty())
+        return false;
+
+    {
+        LOCK(pnode->cs_vProcessMsg);
+        pnode->nProcessQueueSize += vRecv.size() + CMessageHeader::HEADER_SIZE;
+        pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
+    }
+    pnode->AddRef();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        PeerQueue& queue = mapQueues[pnode->GetId()];
+        queue.dqMessages.push_back(QueuedMessage{pnode, strCommand, std::move(vRecv), GetTimeMicros()});
+        nQueued++;
+        if (!queue.fScheduled) {
+            queue.fScheduled = true;
+            dqReady.push_back(pnode->GetId());
+        }
+    }
+    cond.notify_one();
+    return true;
+}
+
+void CMessageWorkerPool::ThreadWorker()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cond.wait(lock, [this] { return !fRunning || !dqReady.empty(); });
+        if (!fRunning)
+            return;
+
+        // one message of the next peer in line, its others wait for the next turn
+        const NodeId nodeid = dqReady.front();
+        dqReady.pop_front();
+        QueuedMessage msg = std::move(mapQueues[nodeid].dqMessages.front());
+        mapQueues[nodeid].dqMessages.pop_front();
+        nQueued--;
+        lock.unlock();
+
+        const int64_t nStart = GetTimeMicros();
+        if (!msg.pnode->fDisconnect)
+            handler(msg.pnode, msg.strCommand, msg.vRecv);
+        const int64_t nEnd = GetTimeMicros();
+        Release(msg);
+
+        lock.lock();
+        CMessageWorkerStats& stats = mapStats[msg.strCommand];
+        stats.nMessages++;
+        stats.nTotalWait += nStart - msg.nTimeQueued;
+        stats.nMaxWait = std::max(stats.nMaxWait, nStart - msg.nTimeQueued);
+        stats.nTotalTime += nEnd - nStart;
+
+        PeerQueue& queue = mapQueues[nodeid];
+        if (queue.dqMessages.empty())
+            mapQueues.erase(nodeid);
+        else
+            dqReady.push_back(nodeid);
+    }
+}
+
+size_t CMessageWorkerPool::GetQueueSize()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return nQueued;
+}
+
+std::map<std::string, CMessageWorkerStats> CMessageWorkerPool::GetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return mapStats;
+}
+
 int CNetMessage::readHeader(const char* pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
@@ -850,7 +1086,17 @@ int CNetMessage::readData(const char* pch, unsigned int nBytes)
 
     if (vRecv.size() < nDataPos + nCopy) {
         // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        // Blocks are expected in full: their buffer is sized once, from the header.
+        const bool fBlock = strncmp(hdr.pchCommand, NetMsgType::BLOCK, CMessageHeader::COMMAND_SIZE) == 0;
+        const unsigned int nSize = std::min(hdr.nMessageSize, nDataPos + nCopy + (fBlock ? hdr.nMessageSize : 256 * 1024));
+        if (vRecv.capacity() < nSize) {
+            CRecvBufferPool& pool = GetRecvBufferPool();
+            CSerializeData vch = pool.Get(nSize);
+            vch.assign(vRecv.begin(), vRecv.begin() + nDataPos);
+            vRecv.Swap(vch);
+            pool.Recycle(std::move(vch));
+        }
+        vRecv.resize(nSize);
     }
 
     memcpy(&vRecv[nDataPos], pch, nCopy);
@@ -863,31 +1109,59 @@ int CNetMessage::readData(const char* pch, unsigned int nBytes)
 // requires LOCK(cs_vSend)
 size_t CConnman::SocketSendData(CNode* pnode)
 {
-    auto it = pnode->vSendMsg.begin();
     size_t nSentSize = 0;
 
-    while (it != pnode->vSendMsg.end()) {
-        const auto& data = *it;
-        assert(data.size() > pnode->nSendOffset);
+    while (!pnode->vSendMsg.empty()) {
+        assert(pnode->vSendMsg.front()->size() > pnode->nSendOffset);
+        size_t nRequested = 0;
         int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+            const CSendBuffer& data = pnode->vSendMsg.front();
+            nRequested = data->size() - pnode->nSendOffset;
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data->data()) + pnode->nSendOffset, nRequested, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            // hand the queued buffers to the kernel as they are, without gathering them first
+            struct iovec vIov[MAX_SEND_IOVECS];
+            size_t nIov = 0;
+            size_t nOffset = pnode->nSendOffset;
+            for (auto it = pnode->vSendMsg.begin(); it != pnode->vSendMsg.end() && nIov < MAX_SEND_IOVECS; ++it) {
+                vIov[nIov].iov_base = const_cast<unsigned char*>((*it)->data()) + nOffset;
+                vIov[nIov].iov_len = (*it)->size() - nOffset;
+                nRequested += vIov[nIov].iov_len;
+                nIov++;
+                nOffset = 0;
+            }
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = vIov;
+            msg.msg_iovlen = nIov;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetTime();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // release the buffers sent in full
+            size_t nLeft = nBytes;
+            while (nLeft > 0) {
+                const size_t nBufferSize = pnode->vSendMsg.front()->size();
+                if (nLeft < nBufferSize - pnode->nSendOffset) {
+                    pnode->nSendOffset += nLeft;
+                    break;
+                }
+                nLeft -= nBufferSize - pnode->nSendOffset;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= nBufferSize;
                 pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-                it++;
-            } else {
-                // could not send full message; stop sending more
+                pnode->vSendMsg.pop_front();
+            }
+            if ((size_t)nBytes < nRequested) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -904,11 +1178,10 @@ size_t CConnman::SocketSendData(CNode* pnode)
         }
     }
 
-    if (it == pnode->vSendMsg.end()) {
+    if (pnode->vSendMsg.empty()) {
         assert(pnode->nSendOffset == 0);
         assert(pnode->nSendSize == 0);
     }
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
     return nSentSize;
 }
 
@@ -1085,7 +1358,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket)) {
+    if (!IsWatchableSocket(hSocket)) {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
         return;
@@ -1130,8 +1403,48 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     }
 }
 
+bool CConnman::IsWatchableSocket(SOCKET hSocket) const
+{
+    return socketPoller ? socketPoller->CanWatch(hSocket) : IsSelectableSocket(hSocket);
+}
+
+void CConnman::WatchNode(CNode* pnode)
+{
+    AssertLockHeld(pnode->cs_hSocket);
+    if (!socketPoller->Add(pnode->hSocket, false)) {
+        pnode->fDisconnect = true;
+        return;
+    }
+    // the descriptor of a socket closed elsewhere may have been reused already
+    mapPolledNodes[pnode->hSocket] = pnode;
+    pnode->hPolledSocket = pnode->hSocket;
+    pnode->fPollRecvReady = false;
+    pnode->fPollSendReady = false;
+}
+
+void CConnman::UnwatchNode(CNode* pnode)
+{
+    if (pnode->hPolledSocket == INVALID_SOCKET)
+        return;
+    {
+        LOCK(pnode->cs_hSocket);
+        // a closed socket already left the poller, and its descriptor isn't ours anymore
+        if (pnode->hSocket != INVALID_SOCKET)
+            socketPoller->Remove(pnode->hSocket);
+    }
+    auto it = mapPolledNodes.find(pnode->hPolledSocket);
+    if (it != mapPolledNodes.end() && it->second == pnode)
+        mapPolledNodes.erase(it);
+    pnode->hPolledSocket = INVALID_SOCKET;
+}
+
 void CConnman::ThreadSocketHandler()
 {
+    const bool fEdgeTriggered = socketPoller->IsEdgeTriggered();
+    for (const ListenSocket& hListenSocket : vhListenSocket)
+        socketPoller->Add(hListenSocket.socket, true);
+    std::vector<CSocketPoller::Event> vEvents;
+
     unsigned int nPrevNodeCount = 0;
     while (!interruptNet) {
         //
@@ -1150,6 +1463,7 @@ void CConnman::ThreadSocketHandler()
                     pnode->grantOutbound.Release();
 
                     // close socket and cleanup
+                    UnwatchNode(pnode);
                     pnode->CloseSocketDisconnect();
 
                     // hold in disconnected pool until all refs are released
@@ -1195,24 +1509,10 @@ void CConnman::ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
+        int64_t nTimeoutMs = 50; // frequency to poll pnode->vSend
 
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
+        for (const ListenSocket& hListenSocket : vhListenSocket)
+            socketPoller->SetInterest(hListenSocket.socket, true, false);
 
         {
             LOCK(cs_vNodes);
@@ -1227,6 +1527,9 @@ void CConnman::ThreadSocketHandler()
                 //   receiving data.
                 // * Hand off all complete messages to the processor, to be handled without
                 //   blocking here.
+                // Edge-triggered pollers watch both directions all along, the same choice
+                // is made when servicing the socket. Don't wait when one of them already
+                // reported the direction we are after.
 
                 bool select_recv = !pnode->fPauseRecv;
                 bool select_send;
@@ -1239,44 +1542,55 @@ void CConnman::ThreadSocketHandler()
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
 
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
+                if (pnode->hPolledSocket == INVALID_SOCKET) {
+                    WatchNode(pnode);
+                    if (pnode->hPolledSocket == INVALID_SOCKET)
+                        continue;
+                }
+                if (!fEdgeTriggered) {
+                    pnode->fPollRecvReady = false;
+                    pnode->fPollSendReady = false;
+                }
 
                 if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
+                    socketPoller->SetInterest(pnode->hSocket, false, true);
+                    if (pnode->fPollSendReady)
+                        nTimeoutMs = 0;
                     continue;
                 }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
+                socketPoller->SetInterest(pnode->hSocket, select_recv, false);
+                if (select_recv && pnode->fPollRecvReady)
+                    nTimeoutMs = 0;
             }
         }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        if (!socketPoller->Wait(nTimeoutMs, vEvents)) {
+            if (!interruptNet.sleep_for(std::chrono::milliseconds(50)))
+                return;
+        }
         if (interruptNet)
             return;
 
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
+        std::vector<const ListenSocket*> vListenReady;
+        for (const CSocketPoller::Event& event : vEvents) {
+            auto it = mapPolledNodes.find(event.hSocket);
+            if (it != mapPolledNodes.end()) {
+                it->second->fPollRecvReady |= event.fRecv || event.fError;
+                it->second->fPollSendReady |= event.fSend;
+                continue;
+            }
+            for (const ListenSocket& hListenSocket : vhListenSocket) {
+                if (hListenSocket.socket == event.hSocket && event.fRecv)
+                    vListenReady.push_back(&hListenSocket);
             }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
-                return;
         }
 
         //
         // Accept new connections
         //
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
-                AcceptConnection(hListenSocket);
+        for (const ListenSocket* pListenSocket : vListenReady) {
+            if (pListenSocket->socket != INVALID_SOCKET) {
+                AcceptConnection(*pListenSocket);
             }
         }
 
@@ -1299,16 +1613,21 @@ void CConnman::ThreadSocketHandler()
             //
             bool recvSet = false;
             bool sendSet = false;
-            bool errorSet = false;
             {
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                recvSet = pnode->fPollRecvReady;
+                sendSet = pnode->fPollSendReady;
+            }
+            if (fEdgeTriggered && (recvSet || sendSet)) {
+                // same choice as the interest of a level-triggered poller
+                LOCK(pnode->cs_vSend);
+                const bool fSendPending = !pnode->vSendMsg.empty();
+                sendSet = sendSet && fSendPending;
+                recvSet = recvSet && !fSendPending && !pnode->fPauseRecv;
             }
-            if (recvSet || errorSet) {
+            if (recvSet) {
                 {
                     {
                         // typical socket buffer is 8K-64K
@@ -1332,6 +1651,7 @@ void CConnman::ThreadSocketHandler()
                                     if (!it->complete())
                                         break;
                                     nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+                                    RecordMessageRecv(it->hdr.GetCommand(), it->vRecv.size() + CMessageHeader::HEADER_SIZE);
                                 }
                                 {
                                     LOCK(pnode->cs_vProcessMsg);
@@ -1353,6 +1673,9 @@ void CConnman::ThreadSocketHandler()
                                 if (!pnode->fDisconnect)
                                     LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
                                 pnode->CloseSocketDisconnect();
+                            } else if (nErr == WSAEWOULDBLOCK) {
+                                // drained: wait for the poller to report new data
+                                pnode->fPollRecvReady = false;
                             }
                         }
                     }
@@ -1367,6 +1690,9 @@ void CConnman::ThreadSocketHandler()
                 size_t nBytes = SocketSendData(pnode);
                 if (nBytes)
                     RecordBytesSent(nBytes);
+                // the socket buffer is full: wait for the poller to report it writable again
+                if (!pnode->vSendMsg.empty())
+                    pnode->fPollSendReady = false;
             }
 
             //
@@ -2096,6 +2422,10 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     nBestHeight = 0;
     clientInterface = NULL;
     flagInterruptMsgProc = false;
+
+    for (const std::string& msg : getAllNetMessageTypes())
+        mapMsgCmdTotals[msg];
+    mapMsgCmdTotals[NET_MESSAGE_COMMAND_OTHER];
 }
 
 NodeId CConnman::GetNewNodeId()
@@ -2117,6 +2447,9 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
     nReceiveFloodSize = connOptions.nReceiveFloodSize;
 
+    socketPoller = MakeSocketPoller(connOptions.strSocketEvents);
+    LogPrintf("Using %s for socket events\n", socketPoller->Name());
+
     SetBestHeight(connOptions.nBestHeight);
 
     clientInterface = connOptions.uiInterface;
@@ -2202,6 +2535,13 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     if (!mapArgs.count("-connect") || mapMultiArgs["-connect"].size() != 1 || mapMultiArgs["-connect"][0] != "0")
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this)));
 
+    // Masternode, budget and spork messages
+    if (connOptions.nMessageWorkers > 0) {
+        messageWorkers.Start(connOptions.nMessageWorkers, nReceiveFloodSize, [this](CNode* pnode, const std::string& strCommand, CDataStream& vRecv) {
+            GetNodeSignals().ProcessOffloadedMessage(pnode, strCommand, vRecv, *this);
+        });
+    }
+
     // Process messages
     threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
 
@@ -2247,6 +2587,7 @@ void CConnman::Interrupt()
 
     interruptNet();
     InterruptSocks5(true);
+    messageWorkers.Interrupt();
 
     if (semOutbound)
         for (int i=0; i<(nMaxOutbound + nMaxFeeler); i++)
@@ -2259,6 +2600,7 @@ void CConnman::Stop()
 
     if (threadMessageHandler.joinable())
         threadMessageHandler.join();
+    messageWorkers.Stop();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2292,6 +2634,8 @@ void CConnman::Stop()
     vNodes.clear();
     vNodesDisconnected.clear();
     vhListenSocket.clear();
+    mapPolledNodes.clear();
+    socketPoller.reset();
     delete semOutbound;
     semOutbound = NULL;
     if(pnodeLocalHost)
@@ -2433,6 +2777,61 @@ void CConnman::RecordBytesRecv(uint64_t bytes)
     nTotalBytesRecv += bytes;
 }
 
+CMsgCmdStats& CConnman::GetMsgCmdTotals(const std::string& strCommand)
+{
+    AssertLockHeld(cs_msgCmdStats);
+    // to prevent a memory DOS, only the known commands get their own entry
+    mapMsgCmdStats::iterator it = mapMsgCmdTotals.find(strCommand);
+    if (it == mapMsgCmdTotals.end())
+        it = mapMsgCmdTotals.find(NET_MESSAGE_COMMAND_OTHER);
+    assert(it != mapMsgCmdTotals.end());
+    return it->second;
+}
+
+void CConnman::RecordMessageRecv(const std::string& strCommand, uint64_t nBytes)
+{
+    LOCK(cs_msgCmdStats);
+    CMsgCmdStats& stats = GetMsgCmdTotals(strCommand);
+    stats.nRecvMsgs++;
+    stats.nRecvBytes += nBytes;
+}
+
+void CConnman::RecordMessageSent(const std::string& strCommand, uint64_t nBytes)
+{
+    LOCK(cs_msgCmdStats);
+    CMsgCmdStats& stats = GetMsgCmdTotals(strCommand);
+    stats.nSendMsgs++;
+    stats.nSendBytes += nBytes;
+}
+
+void CConnman::RecordMessageProcessed(CNode* pnode, const std::string& strCommand, int64_t nMicros)
+{
+    {
+        LOCK(pnode->cs_vProcessMsg);
+        mapMsgCmdSize::iterator it = pnode->mapProcessTimePerMsgCmd.find(strCommand);
+        if (it == pnode->mapProcessTimePerMsgCmd.end())
+            it = pnode->mapProcessTimePerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+        assert(it != pnode->mapProcessTimePerMsgCmd.end());
+        it->second += nMicros;
+    }
+
+    size_t nBucket = 0;
+    while (nBucket < MSG_PROCESS_TIME_BUCKET_COUNT - 1 && nMicros >= MSG_PROCESS_TIME_BUCKETS[nBucket])
+        nBucket++;
+    LOCK(cs_msgCmdStats);
+    CMsgCmdStats& stats = GetMsgCmdTotals(strCommand);
+    stats.nProcessed++;
+    stats.nProcessTime += nMicros;
+    stats.nProcessTimeMax = std::max(stats.nProcessTimeMax, nMicros);
+    stats.vProcessTimeHist[nBucket]++;
+}
+
+mapMsgCmdStats CConnman::GetMsgCmdStats()
+{
+    LOCK(cs_msgCmdStats);
+    return mapMsgCmdTotals;
+}
+
 void CConnman::RecordBytesSent(uint64_t bytes)
 {
     LOCK(cs_totalBytesSent);
@@ -2467,6 +2866,11 @@ int CConnman::GetBestHeight() const
 }
 
 unsigned int CConnman::GetReceiveFloodSize() const { return nReceiveFloodSize; }
+
+bool CConnman::OffloadMessage(CNode* pnode, const std::string& strCommand, CDataStream& vRecv)
+{
+    return messageWorkers.Enqueue(pnode, strCommand, vRecv);
+}
 unsigned int CConnman::GetSendBufferSize() const{ return nSendBufferMaxSize; }
 
 CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn, SOCKET hSocketIn, const CAddress& addrIn, uint64_t nKeyedNetGroupIn, uint64_t nLocalHostNonceIn, const std::string& addrNameIn, bool fInboundIn) :
@@ -2511,6 +2915,8 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nNextLocalAddrSend = 0;
     nNextAddrSend = 0;
     nNextInvSend = 0;
+    nTxInvSent = 0;
+    nTxInvFlushes = 0;
     fRelayTxes = false;
     pfilter = new CBloomFilter();
     nPingNonceSent = 0;
@@ -2520,11 +2926,19 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nMinPingUsecTime = std::numeric_limits<int64_t>::max();
     fPauseRecv = false;
     fPauseSend = false;
+    hPolledSocket = INVALID_SOCKET;
+    fPollRecvReady = false;
+    fPollSendReady = false;
     nProcessQueueSize = 0;
 
-    for (const std::string &msg : getAllNetMessageTypes())
+    for (const std::string &msg : getAllNetMessageTypes()) {
         mapRecvBytesPerMsgCmd[msg] = 0;
+        mapRecvMsgsPerMsgCmd[msg] = 0;
+        mapProcessTimePerMsgCmd[msg] = 0;
+    }
     mapRecvBytesPerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
+    mapRecvMsgsPerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
+    mapProcessTimePerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
 
     if (fLogIPs)
         LogPrint(BCLog::NET, "Added connection to %s peer=%d\n", addrName, id);
@@ -2575,11 +2989,46 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
 }
 
-void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
+std::vector<unsigned char> CSendBufferPool::Get()
+{
+    std::vector<unsigned char> vch;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!vFree.empty()) {
+        vch.swap(vFree.back());
+        vFree.pop_back();
+    }
+    return vch;
+}
+
+void CSendBufferPool::Recycle(std::vector<unsigned char>&& vch)
+{
+    if (vch.capacity() == 0 || vch.capacity() > SEND_BUFFER_POOL_MAX_CAPACITY)
+        return;
+    vch.clear();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (vFree.size() < SEND_BUFFER_POOL_SIZE)
+        vFree.push_back(std::move(vch));
+}
+
+CSendBuffer CSendBufferPool::Share(std::vector<unsigned char>&& vch)
+{
+    return CSendBuffer(new std::vector<unsigned char>(std::move(vch)), [this](const std::vector<unsigned char>* pvch) {
+        Recycle(std::move(*const_cast<std::vector<unsigned char>*>(pvch)));
+        delete pvch;
+    });
+}
+
+CSendBufferPool& GetSendBufferPool()
+{
+    // never destroyed: buffers may still be queued to nodes when static objects go away
+    static CSendBufferPool* pool = new CSendBufferPool();
+    return *pool;
+}
+
+CSharedNetMsg CConnman::ShareMessage(CSerializedNetMsg&& msg) const
 {
     size_t nMessageSize = msg.data.size();
-    size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
-    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->id);
+    CSendBufferPool& pool = GetSendBufferPool();
 
     std::vector<unsigned char> serializedHeader;
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
@@ -2589,6 +3038,25 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
 
+    CSharedNetMsg shared;
+    shared.header = pool.Share(std::move(serializedHeader));
+    if (nMessageSize)
+        shared.payload = pool.Share(std::move(msg.data));
+    shared.command = std::move(msg.command);
+    return shared;
+}
+
+void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
+{
+    PushMessage(pnode, ShareMessage(std::move(msg)));
+}
+
+void CConnman::PushMessage(CNode* pnode, const CSharedNetMsg& msg)
+{
+    size_t nMessageSize = msg.PayloadSize();
+    size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
+    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->id);
+
     size_t nBytesSent = 0;
     {
         LOCK(pnode->cs_vSend);
@@ -2596,13 +3064,14 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         //log total amount of bytes per command
         pnode->mapSendBytesPerMsgCmd[msg.command] += nTotalSize;
+        pnode->mapSendMsgsPerMsgCmd[msg.command]++;
         pnode->nSendSize += nTotalSize;
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
+        pnode->vSendMsg.push_back(msg.header);
         if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+            pnode->vSendMsg.push_back(msg.payload);
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
@@ -2610,6 +3079,7 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
     }
     if (nBytesSent)
         RecordBytesSent(nBytesSent);
+    RecordMessageSent(msg.command, nTotalSize);
 }
 
 bool CConnman::ForNode(NodeId id, std::function<bool(CNode* pnode)> func)
@@ -26,10 +26,14 @@
 
 #include <atomic>
 #include <deque>
+#include <functional>
+#include <map>
 #include <stdint.h>
 #include <thread>
 #include <memory>
 #include <condition_variable>
+#include <mutex>
+#include <unordered_map>
 
 #ifndef WIN32
 #include <arpa/inet.h>
@@ -41,6 +45,7 @@ class CAddrMan;
 class CBlockIndex;
 class CScheduler;
 class CNode;
+class CSocketPoller;
 
 namespace boost
 {
@@ -87,6 +92,9 @@ static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 static const bool DEFAULT_FORCEDNSSEED = true;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** -msgworkers default, the threads handling masternode and spork messages */
+static const int DEFAULT_MESSAGE_WORKERS = 1;
+static const int MAX_MESSAGE_WORKERS = 8;
 
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
@@ -107,6 +115,27 @@ class CTransaction;
 class CNodeStats;
 class CClientUIInterface;
 
+/** Immutable refcounted send buffer, the same one can be queued to any number of peers */
+typedef std::shared_ptr<const std::vector<unsigned char> > CSendBuffer;
+
+/** Keeps the storage of released send buffers, to serialize the next messages into */
+class CSendBufferPool
+{
+private:
+    std::mutex mutex;
+    std::vector<std::vector<unsigned char> > vFree;
+
+public:
+    /** An empty vector, with the capacity of a recycled one if there is any */
+    std::vector<unsigned char> Get();
+    /** Hand the storage back to the pool, when small enough to be worth keeping */
+    void Recycle(std::vector<unsigned char>&& vch);
+    /** Wrap serialized data into a send buffer, its storage gets recycled once every peer sent it */
+    CSendBuffer Share(std::vector<unsigned char>&& vch);
+};
+
+CSendBufferPool& GetSendBufferPool();
+
 struct CSerializedNetMsg
 {
     CSerializedNetMsg() = default;
@@ -120,6 +149,95 @@ struct CSerializedNetMsg
     std::string command;
 };
 
+/** A message framed once (header and checksum), that can be pushed to many peers without copying */
+struct CSharedNetMsg
+{
+    CSendBuffer header;
+    CSendBuffer payload; // null when empty
+    std::string command;
+
+    size_t PayloadSize() const { return payload ? payload->size() : 0; }
+};
+
+struct CMessageWorkerStats
+{
+    uint64_t nMessages = 0;
+    int64_t nTotalWait = 0; // microseconds spent queued
+    int64_t nMaxWait = 0;
+    int64_t nTotalTime = 0; // microseconds spent handling
+};
+
+/** Threads handling the messages that don't need the message handler thread, off its
+ *  queue. The messages of a peer are handled in order, one at a time, while the peers
+ *  with messages queued take turns: a peer flooding us only delays itself. */
+class CMessageWorkerPool
+{
+public:
+    typedef std::function<void(CNode*, const std::string&, CDataStream&)> Handler;
+
+private:
+    struct QueuedMessage {
+        CNode* pnode;
+        std::string strCommand;
+        CDataStream vRecv;
+        int64_t nTimeQueued;
+    };
+    struct PeerQueue {
+        std::deque<QueuedMessage> dqMessages;
+        // in dqReady or being handled by a worker
+        bool fScheduled = false;
+    };
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool fRunning = false;
+    std::map<NodeId, PeerQueue> mapQueues;
+    std::deque<NodeId> dqReady;
+    size_t nQueued = 0;
+    std::map<std::string, CMessageWorkerStats> mapStats;
+
+    std::vector<std::thread> vThreads;
+    Handler handler;
+    size_t nReceiveFloodSize = 0;
+
+    void ThreadWorker();
+    void Release(QueuedMessage& msg);
+
+public:
+    ~CMessageWorkerPool() { Stop(); }
+
+    void Start(int nThreads, size_t nReceiveFloodSizeIn, Handler handlerIn);
+    void Interrupt();
+    /** Join the workers and drop the messages they didn't get to */
+    void Stop();
+
+    /** Queue a message for the workers, false when there are none. The message counts
+     *  towards the peer's receive flood size until it is handled. */
+    bool Enqueue(CNode* pnode, const std::string& strCommand, CDataStream& vRecv);
+
+    int GetThreadCount() const { return vThreads.size(); }
+    size_t GetQueueSize();
+    std::map<std::string, CMessageWorkerStats> GetStats();
+};
+
+/** Upper bounds of the buckets of the message processing time histograms, in microseconds. The last bucket is open. */
+static const int64_t MSG_PROCESS_TIME_BUCKETS[] = {10, 100, 1000, 10000, 100000, 1000000};
+static const size_t MSG_PROCESS_TIME_BUCKET_COUNT = sizeof(MSG_PROCESS_TIME_BUCKETS) / sizeof(MSG_PROCESS_TIME_BUCKETS[0]) + 1;
+
+/** Traffic and processing time of a message type, over all peers */
+struct CMsgCmdStats
+{
+    uint64_t nSendMsgs = 0;
+    uint64_t nSendBytes = 0;
+    uint64_t nRecvMsgs = 0;
+    uint64_t nRecvBytes = 0;
+    uint64_t nProcessed = 0;
+    int64_t nProcessTime = 0; // microseconds
+    int64_t nProcessTimeMax = 0;
+    uint64_t vProcessTimeHist[MSG_PROCESS_TIME_BUCKET_COUNT] = {};
+};
+typedef std::map<std::string, CMsgCmdStats> mapMsgCmdStats;
+
 
 class CConnman
 {
@@ -143,6 +261,8 @@ public:
         CClientUIInterface* uiInterface = nullptr;
         unsigned int nSendBufferMaxSize = 0;
         unsigned int nReceiveFloodSize = 0;
+        std::string strSocketEvents = "select";
+        int nMessageWorkers = 0;
     };
     CConnman(uint64_t seed0, uint64_t seed1);
     ~CConnman();
@@ -155,7 +275,9 @@ public:
 
     bool ForNode(NodeId id, std::function<bool(CNode* pnode)> func);
 
+    CSharedNetMsg ShareMessage(CSerializedNetMsg&& msg) const;
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
+    void PushMessage(CNode* pnode, const CSharedNetMsg& msg);
 
     template<typename Callable>
     bool ForEachNodeContinueIf(Callable&& func)
@@ -274,6 +396,16 @@ public:
     CSipHasher GetDeterministicRandomizer(uint64_t id);
 
     unsigned int GetReceiveFloodSize() const;
+
+    /** Hand a message to the worker threads, false when it has to be handled inline */
+    bool OffloadMessage(CNode* pnode, const std::string& strCommand, CDataStream& vRecv);
+    int GetMessageWorkerCount() const { return messageWorkers.GetThreadCount(); }
+    size_t GetMessageWorkerQueueSize() { return messageWorkers.GetQueueSize(); }
+    std::map<std::string, CMessageWorkerStats> GetMessageWorkerStats() { return messageWorkers.GetStats(); }
+
+    /** Account the time the message handler spent on a message of the peer */
+    void RecordMessageProcessed(CNode* pnode, const std::string& strCommand, int64_t nMicros);
+    mapMsgCmdStats GetMsgCmdStats();
 private:
     struct ListenSocket {
         SOCKET socket;
@@ -287,6 +419,9 @@ private:
     void ThreadOpenConnections();
     void ThreadMessageHandler();
     void AcceptConnection(const ListenSocket& hListenSocket);
+    bool IsWatchableSocket(SOCKET hSocket) const;
+    void WatchNode(CNode* pnode);
+    void UnwatchNode(CNode* pnode);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -321,6 +456,9 @@ private:
     // Network stats
     void RecordBytesRecv(uint64_t bytes);
     void RecordBytesSent(uint64_t bytes);
+    void RecordMessageRecv(const std::string& strCommand, uint64_t nBytes);
+    void RecordMessageSent(const std::string& strCommand, uint64_t nBytes);
+    CMsgCmdStats& GetMsgCmdTotals(const std::string& strCommand);
 
     // Whether the node should be passed out in ForEach* callbacks
     static bool NodeFullyConnected(const CNode* pnode);
@@ -331,6 +469,10 @@ private:
     uint64_t nTotalBytesRecv;
     uint64_t nTotalBytesSent;
 
+    // Per message type totals, the known types are all there from the start
+    RecursiveMutex cs_msgCmdStats;
+    mapMsgCmdStats mapMsgCmdTotals;
+
     // Whitelisted ranges. Any node connecting from these is automatically
     // whitelisted (as well as those connecting to whitelisted binds).
     std::vector<CSubNet> vWhitelistedRange;
@@ -340,6 +482,9 @@ private:
     unsigned int nReceiveFloodSize;
 
     std::vector<ListenSocket> vhListenSocket;
+    // readiness of the sockets, only used by the socket handler thread once started
+    std::unique_ptr<CSocketPoller> socketPoller;
+    std::unordered_map<SOCKET, CNode*> mapPolledNodes;
     banmap_t setBanned;
     RecursiveMutex cs_setBanned;
     bool setBannedIsDirty;
@@ -384,6 +529,7 @@ private:
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
     std::thread threadMessageHandler;
+    CMessageWorkerPool messageWorkers;
 
     bool stopping = false;
 };
@@ -413,6 +559,7 @@ struct CNodeSignals
 {
     boost::signals2::signal<bool (CNode*, CConnman&, std::atomic<bool>&), CombinerAll> ProcessMessages;
     boost::signals2::signal<bool (CNode*, CConnman&, std::atomic<bool>&), CombinerAll> SendMessages;
+    boost::signals2::signal<void (CNode*, const std::string&, CDataStream&, CConnman&)> ProcessOffloadedMessage;
     boost::signals2::signal<void (CNode*, CConnman&)> InitializeNode;
     boost::signals2::signal<void (NodeId, bool&)> FinalizeNode;
 };
@@ -486,15 +633,52 @@ public:
     int nStartingHeight;
     uint64_t nSendBytes;
     mapMsgCmdSize mapSendBytesPerMsgCmd;
+    mapMsgCmdSize mapSendMsgsPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdSize mapRecvMsgsPerMsgCmd;
+    mapMsgCmdSize mapProcessTimePerMsgCmd;
     bool fWhitelisted;
+    size_t nTxInvQueued;
+    uint64_t nTxInvSent;
+    uint64_t nTxInvFlushes;
     double dPingTime;
     double dPingWait;
     std::string addrLocal;
 };
 
 
+struct CRecvBufferPoolStats
+{
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nBytesReused;
+    size_t nPooledBuffers;
+    size_t nPooledBytes;
+};
+
+/** Keeps the storage of processed messages, by capacity, for the next messages to be received into */
+class CRecvBufferPool
+{
+private:
+    std::mutex mutex;
+    // free buffers by floor(log2(capacity))
+    std::vector<std::vector<CSerializeData> > vBuckets;
+    CRecvBufferPoolStats stats;
+
+public:
+    CRecvBufferPool();
+
+    /** An empty buffer with room for at least nSize bytes, recycled if possible */
+    CSerializeData Get(size_t nSize);
+    /** Hand the storage back to the pool, while there is room for it */
+    void Recycle(CSerializeData&& vch);
+
+    CRecvBufferPoolStats GetStats();
+};
+
+CRecvBufferPool& GetRecvBufferPool();
+
 class CNetMessage
 {
 public:
@@ -516,6 +700,9 @@ public:
         nDataPos = 0;
         nTime = 0;
     }
+    CNetMessage(CNetMessage&&) = default;
+    CNetMessage& operator=(CNetMessage&&) = default;
+    ~CNetMessage();
 
     bool complete() const
     {
@@ -547,7 +734,7 @@ public:
     size_t nSendSize;   // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    std::deque<CSendBuffer> vSendMsg;
     RecursiveMutex cs_vSend;
     RecursiveMutex cs_hSocket;
     RecursiveMutex cs_vRecv;
@@ -596,9 +783,18 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    // socket handler thread only: the socket as given to the poller, and the directions
+    // it reported ready (kept until the socket would block, for edge-triggered pollers)
+    SOCKET hPolledSocket;
+    bool fPollRecvReady;
+    bool fPollSendReady;
 protected:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
+    mapMsgCmdSize mapSendMsgsPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdSize mapRecvMsgsPerMsgCmd;
+    // microseconds in the message handler, guarded by cs_vProcessMsg
+    mapMsgCmdSize mapProcessTimePerMsgCmd;
 
     std::vector<std::string> vecRequestsFulfilled; //keep track of what client has asked for
 
@@ -617,6 +813,13 @@ public:
     // inventory based relay
     CRollingBloomFilter filterInventoryKnown;
     std::vector<CInv> vInventoryToSend;
+    // Transactions to announce at the next trickle, protected by cs_inventory
+    std::set<uint256> setInventoryTxToSend;
+    // Transaction invs trickled so far and the number of trickles that sent any, protected by cs_inventory
+    uint64_t nTxInvSent;
+    uint64_t nTxInvFlushes;
+    // Set of new tips to announce, as headers when the peer has their parents, protected by cs_inventory
+    std::vector<uint256> vBlockHashesToAnnounce;
     RecursiveMutex cs_inventory;
     std::multimap<int64_t, CInv> mapAskFor;
     std::vector<uint256> vBlockRequested;
@@ -743,12 +946,21 @@ public:
     {
         {
             LOCK(cs_inventory);
-            if (inv.type == MSG_TX && filterInventoryKnown.contains(inv.hash))
+            if (inv.type == MSG_TX) {
+                if (!filterInventoryKnown.contains(inv.hash))
+                    setInventoryTxToSend.insert(inv.hash);
                 return;
+            }
             vInventoryToSend.push_back(inv);
         }
     }
 
+    void PushBlockHash(const uint256& hash)
+    {
+        LOCK(cs_inventory);
+        vBlockHashesToAnnounce.push_back(hash);
+    }
+
     void AskFor(const CInv& inv);
 
     bool HasFulfilledRequest(std::string strRequest)
@@ -20,6 +20,7 @@ public:
     {
         CSerializedNetMsg msg;
         msg.command = std::move(sCommand);
+        msg.data = GetSendBufferPool().Get();
         CVectorWriter{ SER_NETWORK, nFlags | nVersion, msg.data, 0, std::forward<Args>(args)... };
         return msg;
     }
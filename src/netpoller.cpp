@@ -0,0 +1,169 @@
+// Copyright (c) 2021-2022 The Studscoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "netpoller.h"
+
+#include "netbase.h"
+#include "util.h"
+
+#include <algorithm>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+namespace
+{
+/** select() over the sockets given to SetInterest() since the last Wait() */
+class CSelectPoller : public CSocketPoller
+{
+private:
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    SOCKET hSocketMax;
+    std::vector<SOCKET> vWatched;
+
+    void Reset()
+    {
+        FD_ZERO(&fdsetRecv);
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        hSocketMax = 0;
+        vWatched.clear();
+    }
+
+public:
+    CSelectPoller() { Reset(); }
+
+    const char* Name() const override { return "select"; }
+    bool IsEdgeTriggered() const override { return false; }
+    bool CanWatch(SOCKET hSocket) const override { return IsSelectableSocket(hSocket); }
+
+    bool Add(SOCKET hSocket, bool fListen) override { return CanWatch(hSocket); }
+    void Remove(SOCKET hSocket) override {}
+
+    void SetInterest(SOCKET hSocket, bool fRecv, bool fSend) override
+    {
+        if (fRecv)
+            FD_SET(hSocket, &fdsetRecv);
+        if (fSend)
+            FD_SET(hSocket, &fdsetSend);
+        FD_SET(hSocket, &fdsetError);
+        hSocketMax = std::max(hSocketMax, hSocket);
+        vWatched.push_back(hSocket);
+    }
+
+    bool Wait(int64_t nTimeoutMs, std::vector<Event>& vEvents) override
+    {
+        vEvents.clear();
+        struct timeval timeout = MillisToTimeval(nTimeoutMs);
+        int nSelect = select(vWatched.empty() ? 0 : hSocketMax + 1, &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        bool fOk = nSelect != SOCKET_ERROR;
+        if (!fOk && !vWatched.empty())
+            LogPrintf("socket select error %s\n", NetworkErrorString(WSAGetLastError()));
+
+        for (SOCKET hSocket : vWatched) {
+            Event event;
+            event.hSocket = hSocket;
+            event.fRecv = !fOk || FD_ISSET(hSocket, &fdsetRecv);
+            event.fSend = fOk && FD_ISSET(hSocket, &fdsetSend);
+            event.fError = fOk && FD_ISSET(hSocket, &fdsetError);
+            if (event.fRecv || event.fSend || event.fError)
+                vEvents.push_back(event);
+        }
+        Reset();
+        return fOk;
+    }
+};
+
+#ifdef HAVE_SYS_EPOLL_H
+/** Edge-triggered epoll, the kernel keeps the interest list between waits */
+class CEpollPoller : public CSocketPoller
+{
+private:
+    static const int MAX_EVENTS = 512;
+
+    int fdEpoll;
+    struct epoll_event events[MAX_EVENTS];
+
+public:
+    CEpollPoller() { fdEpoll = epoll_create1(EPOLL_CLOEXEC); }
+    ~CEpollPoller()
+    {
+        if (fdEpoll != -1)
+            close(fdEpoll);
+    }
+
+    bool IsValid() const { return fdEpoll != -1; }
+
+    const char* Name() const override { return "epoll"; }
+    bool IsEdgeTriggered() const override { return true; }
+    bool CanWatch(SOCKET hSocket) const override { return true; }
+
+    bool Add(SOCKET hSocket, bool fListen) override
+    {
+        struct epoll_event event;
+        event.events = fListen ? EPOLLIN : (EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+        event.data.fd = hSocket;
+        if (epoll_ctl(fdEpoll, EPOLL_CTL_ADD, hSocket, &event) != 0)
+            return error("%s : epoll_ctl add failed: %s", __func__, NetworkErrorString(WSAGetLastError()));
+        return true;
+    }
+
+    void Remove(SOCKET hSocket) override
+    {
+        if (epoll_ctl(fdEpoll, EPOLL_CTL_DEL, hSocket, NULL) != 0)
+            LogPrint(BCLog::NET, "%s : epoll_ctl del failed: %s\n", __func__, NetworkErrorString(WSAGetLastError()));
+    }
+
+    void SetInterest(SOCKET hSocket, bool fRecv, bool fSend) override {}
+
+    bool Wait(int64_t nTimeoutMs, std::vector<Event>& vEvents) override
+    {
+        vEvents.clear();
+        int nEvents = epoll_wait(fdEpoll, events, MAX_EVENTS, nTimeoutMs);
+        if (nEvents < 0) {
+            if (WSAGetLastError() == WSAEINTR)
+                return true;
+            LogPrintf("socket epoll error %s\n", NetworkErrorString(WSAGetLastError()));
+            return false;
+        }
+
+        vEvents.reserve(nEvents);
+        for (int i = 0; i < nEvents; i++) {
+            Event event;
+            event.hSocket = events[i].data.fd;
+            event.fRecv = events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP);
+            event.fSend = events[i].events & EPOLLOUT;
+            event.fError = events[i].events & (EPOLLERR | EPOLLHUP);
+            vEvents.push_back(event);
+        }
+        return true;
+    }
+};
+#endif
+} // namespace
+
+bool IsSocketEventsModeSupported(const std::string& strMode)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (strMode == "epoll")
+        return true;
+#endif
+    return strMode == "select";
+}
+
+std::unique_ptr<CSocketPoller> MakeSocketPoller(const std::string& strMode)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (strMode == "epoll") {
+        std::unique_ptr<CEpollPoller> poller(new CEpollPoller());
+        if (poller->IsValid())
+            return std::move(poller);
+        LogPrintf("%s : epoll_create1 failed (%s), falling back to select\n", __func__, NetworkErrorString(WSAGetLastError()));
+    }
+#endif
+    return std::unique_ptr<CSocketPoller>(new CSelectPoller());
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2021-2022 The Studscoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NETPOLLER_H
+#define BITCOIN_NETPOLLER_H
+
+#if defined(HAVE_CONFIG_H)
+#include "config/pivx-config.h"
+#endif
+
+#include "compat.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_SYS_EPOLL_H
+static const char* const DEFAULT_SOCKETEVENTS = "epoll";
+#else
+static const char* const DEFAULT_SOCKETEVENTS = "select";
+#endif
+
+/** Waits for readiness on a set of sockets, on behalf of the socket handler thread.
+ *
+ *  Level-triggered pollers only watch what SetInterest() asked for since the
+ *  previous Wait(). Edge-triggered pollers watch every socket given to Add()
+ *  for both directions, and only report a direction when it becomes ready:
+ *  the caller has to remember it until the socket would block again.
+ */
+class CSocketPoller
+{
+public:
+    struct Event {
+        SOCKET hSocket;
+        bool fRecv;
+        bool fSend;
+        bool fError;
+    };
+
+    virtual ~CSocketPoller() {}
+
+    virtual const char* Name() const = 0;
+    virtual bool IsEdgeTriggered() const = 0;
+    /** Whether the socket can be watched at all (select() is limited to FD_SETSIZE) */
+    virtual bool CanWatch(SOCKET hSocket) const = 0;
+
+    /** Start watching a socket, listening sockets stay level-triggered */
+    virtual bool Add(SOCKET hSocket, bool fListen) = 0;
+    /** Stop watching a socket, must be called before it is closed */
+    virtual void Remove(SOCKET hSocket) = 0;
+    /** Ask for the directions to wait for on the next Wait() */
+    virtual void SetInterest(SOCKET hSocket, bool fRecv, bool fSend) = 0;
+
+    /** Wait up to nTimeoutMs for events, false on error. A failed select() reports every
+     *  watched socket readable, so that the one that broke it gets noticed by recv() */
+    virtual bool Wait(int64_t nTimeoutMs, std::vector<Event>& vEvents) = 0;
+};
+
+/** Whether the -socketevents mode is known and available on this platform */
+bool IsSocketEventsModeSupported(const std::string& strMode);
+
+/** Create the poller for a -socketevents mode, falling back to select() */
+std::unique_ptr<CSocketPoller> MakeSocketPoller(const std::string& strMode);
+
+#endif // BITCOIN_NETPOLLER_H
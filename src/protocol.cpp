@@ -39,6 +39,10 @@ const char* FILTERADD = "filteradd";
 const char* FILTERCLEAR = "filterclear";
 const char* REJECT = "reject";
 const char* SENDHEADERS = "sendheaders";
+const char* SENDCMPCT = "sendcmpct";
+const char* CMPCTBLOCK = "cmpctblock";
+const char* GETBLOCKTXN = "getblocktxn";
+const char* BLOCKTXN = "blocktxn";
 const char* IX = "ix";
 const char* IXLOCKVOTE = "txlvote";
 const char* SPORK = "spork";
@@ -102,6 +106,10 @@ const static std::string allNetMessageTypes[] = {
     NetMsgType::FILTERCLEAR,
     NetMsgType::REJECT,
     NetMsgType::SENDHEADERS,
+    NetMsgType::SENDCMPCT,
+    NetMsgType::CMPCTBLOCK,
+    NetMsgType::GETBLOCKTXN,
+    NetMsgType::BLOCKTXN,
     NetMsgType::IX,
     NetMsgType::IXLOCKVOTE,
     NetMsgType::SPORK,
@@ -223,7 +231,7 @@ bool CInv::IsKnownType() const
 }
 
 bool CInv::IsMasterNodeType() const{
-     return (type >= 6);
+     return (type >= MSG_SPORK && type <= MSG_DSTX);
 }
 
 const char* CInv::GetCommand() const
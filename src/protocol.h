@@ -221,6 +221,33 @@ extern const char* REJECT;
  * @see https://bitcoin.org/en/developer-reference#sendheaders
  */
 extern const char* SENDHEADERS;
+/**
+ * Contains a 1-byte bool and 8-byte LE version number.
+ * Indicates that a node is willing to provide blocks via "cmpctblock" messages.
+ * May indicate that a node prefers to receive new block announcements via a
+ * "cmpctblock" message rather than an "inv", depending on message contents.
+ * @since protocol version 90103, as described by BIP152.
+ */
+extern const char* SENDCMPCT;
+/**
+ * Contains a CBlockHeaderAndShortTxIDs object - providing a header and
+ * list of "short txids", along with the coinbase, the coinstake and the
+ * block signature of the block.
+ * @since protocol version 90103, as described by BIP152.
+ */
+extern const char* CMPCTBLOCK;
+/**
+ * Contains a BlockTransactionsRequest
+ * Peer should respond with "blocktxn" message.
+ * @since protocol version 90103, as described by BIP152.
+ */
+extern const char* GETBLOCKTXN;
+/**
+ * Contains a BlockTransactions.
+ * Sent in response to a "getblocktxn" message.
+ * @since protocol version 90103, as described by BIP152.
+ */
+extern const char* BLOCKTXN;
 /**
  * The spork message is used to send spork values to connected
  * peers
@@ -392,6 +419,9 @@ enum {
     MSG_MASTERNODE_ANNOUNCE         = 14,
     MSG_MASTERNODE_PING             = 15,
     MSG_DSTX                        = 16,
+    // Like MSG_FILTERED_BLOCK, only for getdata: the reply is a cmpctblock message.
+    // BIP152 uses 4, which is reserved here for the old swiftx types.
+    MSG_CMPCT_BLOCK                 = 20,
 };
 
 #endif // BITCOIN_PROTOCOL_H
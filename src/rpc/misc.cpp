@@ -12,12 +12,15 @@
 #include "consensus/zerocoin_verify.h"
 #include "init.h"
 #include "main.h"
+#include "masternode-budget.h"
 #include "masternode-sync.h"
+#include "masternodeman.h"
 #include "net.h"
 #include "netbase.h"
 #include "rpc/server.h"
 #include "spork.h"
 #include "timedata.h"
+#include "txdb.h"
 #include "util.h"
 #ifdef ENABLE_WALLET
 #include "wallet/wallet.h"
@@ -151,6 +154,20 @@ UniValue getinfo(const JSONRPCRequest& request)
     return obj;
 }
 
+static UniValue SyncAssetToJSON(const CMasternodeSyncAsset& asset)
+{
+    const int64_t nNow = GetTime();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("peersAsked", asset.nPeersAsked));
+    obj.push_back(Pair("peersReplied", asset.nPeersReplied));
+    obj.push_back(Pair("expected", asset.nExpected));
+    obj.push_back(Pair("items", asset.nItems));
+    obj.push_back(Pair("seconds", asset.nStarted == 0 ? 0 : (asset.IsFinished() ? asset.nFinished : nNow) - asset.nStarted));
+    obj.push_back(Pair("itemsPerSecond", asset.GetThroughput(nNow)));
+    obj.push_back(Pair("complete", asset.IsFinished()));
+    return obj;
+}
+
 UniValue mnsync(const JSONRPCRequest& request)
 {
     std::string strMode;
@@ -183,6 +200,18 @@ UniValue mnsync(const JSONRPCRequest& request)
             "  \"countBudgetItemFin\": n,       (numeric) Number of MN budget finalization messages (local)\n"
             "  \"RequestedMasternodeAssets\": n, (numeric) Status code of last sync phase\n"
             "  \"RequestedMasternodeAttempt\": n, (numeric) Status code of last sync attempt\n"
+            "  \"nSyncPeers\": n,              (numeric) Peers asked for each asset at once\n"
+            "  \"assets\": {                   (json object) Progress of each asset\n"
+            "    \"list\"|\"winners\"|\"budget\": {\n"
+            "      \"peersAsked\": n,         (numeric) Peers the asset was requested from\n"
+            "      \"peersReplied\": n,       (numeric) Peers that reported their inventory count\n"
+            "      \"expected\": n,           (numeric) Highest inventory count reported by a peer\n"
+            "      \"items\": n,              (numeric) Distinct items announced\n"
+            "      \"seconds\": n,            (numeric) Time since the first request, or taken to complete\n"
+            "      \"itemsPerSecond\": x.xxx, (numeric) Sync throughput\n"
+            "      \"complete\": true|false   (boolean) Whether the asset is synced\n"
+            "    }\n"
+            "  }\n"
             "}\n"
 
             "\nResult ('reset' mode):\n"
@@ -211,6 +240,13 @@ UniValue mnsync(const JSONRPCRequest& request)
         obj.push_back(Pair("countBudgetItemFin", masternodeSync.countBudgetItemFin));
         obj.push_back(Pair("RequestedMasternodeAssets", masternodeSync.RequestedMasternodeAssets));
         obj.push_back(Pair("RequestedMasternodeAttempt", masternodeSync.RequestedMasternodeAttempt));
+        obj.push_back(Pair("nSyncPeers", masternodeSync.nSyncPeers));
+
+        UniValue assets(UniValue::VOBJ);
+        assets.push_back(Pair("list", SyncAssetToJSON(masternodeSync.assetList)));
+        assets.push_back(Pair("winners", SyncAssetToJSON(masternodeSync.assetWinners)));
+        assets.push_back(Pair("budget", SyncAssetToJSON(masternodeSync.assetBudget)));
+        obj.push_back(Pair("assets", assets));
 
         return obj;
     }
@@ -606,6 +642,81 @@ UniValue setmocktime(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue CacheMemoryInfo(const expiringmap_stats& stats)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("entries", (int64_t)stats.nEntries));
+    obj.push_back(Pair("usage", (int64_t)stats.nUsage));
+    obj.push_back(Pair("expired", (int64_t)stats.nExpired));
+    obj.push_back(Pair("evicted", (int64_t)stats.nEvicted));
+    return obj;
+}
+
+static UniValue KeyFilterInfo(const zerocoinfilter_stats& stats)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("keys", (int64_t)stats.nKeys));
+    obj.push_back(Pair("usage", (int64_t)stats.nUsage));
+    obj.push_back(Pair("lookups", (int64_t)stats.nLookups));
+    obj.push_back(Pair("filtered", (int64_t)stats.nFiltered));
+    obj.push_back(Pair("falsepositives", (int64_t)stats.nFalsePositives));
+    return obj;
+}
+
+UniValue getmemoryinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getmemoryinfo\n"
+            "\nReturns information about the bounded caches of seen masternode and budget messages,\n"
+            "and about the filters in front of the zerocoin database.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"mnbroadcasts\": {          (json object) seen masternode broadcasts\n"
+            "    \"entries\": xxxxx,        (numeric) Number of cached entries\n"
+            "    \"usage\": xxxxx,          (numeric) Estimated memory usage in bytes\n"
+            "    \"expired\": xxxxx,        (numeric) Entries dropped since startup because they expired\n"
+            "    \"evicted\": xxxxx         (numeric) Entries dropped since startup to stay within the memory limit\n"
+            "  },\n"
+            "  \"mnpings\": {...},           (json object) seen masternode pings, same fields\n"
+            "  \"budgetvotes\": {...},       (json object) seen proposal votes, same fields\n"
+            "  \"budgetorphanvotes\": {...}, (json object) orphan proposal votes, same fields\n"
+            "  \"finalbudgetvotes\": {...},  (json object) seen finalized budget votes, same fields\n"
+            "  \"finalbudgetorphanvotes\": {...}, (json object) orphan finalized budget votes, same fields\n"
+            "  \"zerocoinspends\": {           (json object) filter of spent zerocoin serials\n"
+            "    \"keys\": xxxxx,           (numeric) Number of keys added since the filter was built\n"
+            "    \"usage\": xxxxx,          (numeric) Memory usage in bytes\n"
+            "    \"lookups\": xxxxx,        (numeric) Database reads asked for since startup\n"
+            "    \"filtered\": xxxxx,       (numeric) Reads answered by the filter without touching the database\n"
+            "    \"falsepositives\": xxxxx  (numeric) Reads that passed the filter but found nothing\n"
+            "  },\n"
+            "  \"zerocoinmints\": {...}     (json object) filter of minted zerocoin pubcoins, same fields\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getmemoryinfo", "") + HelpExampleRpc("getmemoryinfo", ""));
+
+    expiringmap_stats mnb, mnp, votes, orphanVotes, finalVotes, orphanFinalVotes;
+    mnodeman.GetSeenCacheStats(mnb, mnp);
+    budget.GetSeenCacheStats(votes, orphanVotes, finalVotes, orphanFinalVotes);
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("mnbroadcasts", CacheMemoryInfo(mnb)));
+    obj.push_back(Pair("mnpings", CacheMemoryInfo(mnp)));
+    obj.push_back(Pair("budgetvotes", CacheMemoryInfo(votes)));
+    obj.push_back(Pair("budgetorphanvotes", CacheMemoryInfo(orphanVotes)));
+    obj.push_back(Pair("finalbudgetvotes", CacheMemoryInfo(finalVotes)));
+    obj.push_back(Pair("finalbudgetorphanvotes", CacheMemoryInfo(orphanFinalVotes)));
+    if (zerocoinDB) {
+        zerocoinfilter_stats spends, mints;
+        zerocoinDB->GetKeyFilterStats(spends, mints);
+        obj.push_back(Pair("zerocoinspends", KeyFilterInfo(spends)));
+        obj.push_back(Pair("zerocoinmints", KeyFilterInfo(mints)));
+    }
+    return obj;
+}
+
 void EnableOrDisableLogCategories(UniValue cats, bool enable) {
     cats = cats.get_array();
     for (unsigned int i = 0; i < cats.size(); ++i) {
@@ -96,6 +96,22 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ]\n"
+            "    \"blockdownload\": {\n"
+            "       \"window\": n,            (numeric) The number of blocks we ask this peer for at once\n"
+            "       \"inflight\": n,          (numeric) The number of blocks currently asked from this peer\n"
+            "       \"blocks\": n,            (numeric) The blocks downloaded from this peer\n"
+            "       \"bytes\": n,             (numeric) The bytes of the blocks downloaded from this peer\n"
+            "       \"avglatency\": n,        (numeric) The average time between a block request and its arrival, in ms\n"
+            "       \"rate\": n,              (numeric) The average block download rate, in bytes per second\n"
+            "       \"reassigned\": n,        (numeric) The blocks asked from this peer that were given to a faster one\n"
+            "       \"announced\": n          (numeric) The blocks queued for download that this peer announced\n"
+            "    }\n"
+            "    \"txinv\": {\n"
+            "       \"queued\": n,            (numeric) The transactions waiting for the next announcement to this peer\n"
+            "       \"sent\": n,              (numeric) The transactions announced to this peer\n"
+            "       \"batches\": n,           (numeric) The announcements that carried transactions\n"
+            "       \"avgbatch\": n           (numeric) The average number of transactions per announcement\n"
+            "    }\n"
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,             (numeric) The total bytes sent aggregated by message type\n"
             "       ...\n"
@@ -104,6 +120,18 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       \"addr\": n,             (numeric) The total bytes received aggregated by message type\n"
             "       ...\n"
             "    }\n"
+            "    \"msgssent_per_msg\": {\n"
+            "       \"addr\": n,             (numeric) The number of messages sent by message type\n"
+            "       ...\n"
+            "    }\n"
+            "    \"msgsrecv_per_msg\": {\n"
+            "       \"addr\": n,             (numeric) The number of messages received by message type\n"
+            "       ...\n"
+            "    }\n"
+            "    \"processtime_per_msg\": {\n"
+            "       \"addr\": n,             (numeric) The microseconds the message handler spent by message type\n"
+            "       ...\n"
+            "    }\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -153,8 +181,24 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            UniValue download(UniValue::VOBJ);
+            download.push_back(Pair("window", statestats.nDownloadWindow));
+            download.push_back(Pair("inflight", statestats.nBlocksInFlight));
+            download.push_back(Pair("blocks", statestats.nBlocksDownloaded));
+            download.push_back(Pair("bytes", statestats.nBytesDownloaded));
+            download.push_back(Pair("avglatency", statestats.nAvgBlockLatency / 1000));
+            download.push_back(Pair("rate", statestats.nDownloadRate));
+            download.push_back(Pair("reassigned", statestats.nBlocksReassigned));
+            download.push_back(Pair("announced", statestats.nBlocksAnnounced));
+            obj.push_back(Pair("blockdownload", download));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
+        UniValue txinv(UniValue::VOBJ);
+        txinv.push_back(Pair("queued", (uint64_t)stats.nTxInvQueued));
+        txinv.push_back(Pair("sent", stats.nTxInvSent));
+        txinv.push_back(Pair("batches", stats.nTxInvFlushes));
+        txinv.push_back(Pair("avgbatch", stats.nTxInvFlushes ? (double)stats.nTxInvSent / stats.nTxInvFlushes : 0.0));
+        obj.push_back(Pair("txinv", txinv));
 
         UniValue sendPerMsgCmd(UniValue::VOBJ);
         for (const mapMsgCmdSize::value_type &i : stats.mapSendBytesPerMsgCmd) {
@@ -170,6 +214,27 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
         }
         obj.pushKV("bytesrecv_per_msg", recvPerMsgCmd);
 
+        UniValue sendMsgsPerMsgCmd(UniValue::VOBJ);
+        for (const mapMsgCmdSize::value_type &i : stats.mapSendMsgsPerMsgCmd) {
+            if (i.second > 0)
+                sendMsgsPerMsgCmd.pushKV(i.first, i.second);
+        }
+        obj.pushKV("msgssent_per_msg", sendMsgsPerMsgCmd);
+
+        UniValue recvMsgsPerMsgCmd(UniValue::VOBJ);
+        for (const mapMsgCmdSize::value_type &i : stats.mapRecvMsgsPerMsgCmd) {
+            if (i.second > 0)
+                recvMsgsPerMsgCmd.pushKV(i.first, i.second);
+        }
+        obj.pushKV("msgsrecv_per_msg", recvMsgsPerMsgCmd);
+
+        UniValue processTimePerMsgCmd(UniValue::VOBJ);
+        for (const mapMsgCmdSize::value_type &i : stats.mapProcessTimePerMsgCmd) {
+            if (i.second > 0)
+                processTimePerMsgCmd.pushKV(i.first, i.second);
+        }
+        obj.pushKV("processtime_per_msg", processTimePerMsgCmd);
+
         ret.push_back(obj);
     }
 
@@ -311,6 +376,23 @@ UniValue getaddednodeinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+static std::string FormatProcessTime(int64_t nMicros)
+{
+    if (nMicros >= 1000000)
+        return strprintf("%ds", nMicros / 1000000);
+    if (nMicros >= 1000)
+        return strprintf("%dms", nMicros / 1000);
+    return strprintf("%dus", nMicros);
+}
+
+// "<10us", ... "<1s", ">=1s"
+static std::string ProcessTimeBucketName(size_t nBucket)
+{
+    if (nBucket < MSG_PROCESS_TIME_BUCKET_COUNT - 1)
+        return "<" + FormatProcessTime(MSG_PROCESS_TIME_BUCKETS[nBucket]);
+    return ">=" + FormatProcessTime(MSG_PROCESS_TIME_BUCKETS[nBucket - 1]);
+}
+
 UniValue getnettotals(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 0)
@@ -323,7 +405,45 @@ UniValue getnettotals(const JSONRPCRequest& request)
             "{\n"
             "  \"totalbytesrecv\": n,   (numeric) Total bytes received\n"
             "  \"totalbytessent\": n,   (numeric) Total bytes sent\n"
-            "  \"timemillis\": t        (numeric) Total cpu time\n"
+            "  \"timemillis\": t,       (numeric) Total cpu time\n"
+            "  \"recvbufferpool\": {    (json object) Buffers recycled for the received messages\n"
+            "    \"hits\": n,           (numeric) Messages received into a recycled buffer\n"
+            "    \"misses\": n,         (numeric) Messages that needed a new buffer\n"
+            "    \"hitrate\": x.xxx,    (numeric) Share of the messages received into a recycled buffer\n"
+            "    \"bytesreused\": n,    (numeric) Total capacity of the recycled buffers handed out\n"
+            "    \"buffers\": n,        (numeric) Buffers currently pooled\n"
+            "    \"bytes\": n           (numeric) Capacity of the buffers currently pooled\n"
+            "  },\n"
+            "  \"messageworkers\": {    (json object) Threads handling the masternode, budget and spork messages\n"
+            "    \"threads\": n,        (numeric) Number of worker threads, 0 when handled with the other messages\n"
+            "    \"queued\": n,         (numeric) Messages waiting for a worker\n"
+            "    \"commands\": {        (json object) Statistics by message type\n"
+            "      \"mnp\": {\n"
+            "        \"count\": n,      (numeric) Messages handled\n"
+            "        \"avgwait\": n,    (numeric) Average time spent queued, in microseconds\n"
+            "        \"maxwait\": n,    (numeric) Longest time spent queued, in microseconds\n"
+            "        \"avgtime\": n     (numeric) Average handling time, in microseconds\n"
+            "      },\n"
+            "      ...\n"
+            "    }\n"
+            "  },\n"
+            "  \"messages\": {         (json object) Traffic and processing time by message type, over all peers\n"
+            "    \"inv\": {\n"
+            "      \"msgssent\": n,     (numeric) Messages sent\n"
+            "      \"bytessent\": n,    (numeric) Bytes sent, headers included\n"
+            "      \"msgsrecv\": n,     (numeric) Messages received\n"
+            "      \"bytesrecv\": n,    (numeric) Bytes received, headers included\n"
+            "      \"processed\": n,    (numeric) Messages processed by the message handler\n"
+            "      \"processtime\": n,  (numeric) Total processing time, in microseconds\n"
+            "      \"maxprocesstime\": n, (numeric) Longest processing time, in microseconds\n"
+            "      \"processtimes\": {  (json object) Messages processed by processing time\n"
+            "        \"<10us\": n,\n"
+            "        ...\n"
+            "        \">=1s\": n\n"
+            "      }\n"
+            "    },\n"
+            "    ...\n"
+            "  }\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -336,6 +456,53 @@ UniValue getnettotals(const JSONRPCRequest& request)
     obj.push_back(Pair("totalbytesrecv", g_connman->GetTotalBytesRecv()));
     obj.push_back(Pair("totalbytessent", g_connman->GetTotalBytesSent()));
     obj.push_back(Pair("timemillis", GetTimeMillis()));
+
+    const CRecvBufferPoolStats stats = GetRecvBufferPool().GetStats();
+    UniValue pool(UniValue::VOBJ);
+    pool.push_back(Pair("hits", stats.nHits));
+    pool.push_back(Pair("misses", stats.nMisses));
+    pool.push_back(Pair("hitrate", stats.nHits + stats.nMisses ? (double)stats.nHits / (stats.nHits + stats.nMisses) : 0.0));
+    pool.push_back(Pair("bytesreused", stats.nBytesReused));
+    pool.push_back(Pair("buffers", (uint64_t)stats.nPooledBuffers));
+    pool.push_back(Pair("bytes", (uint64_t)stats.nPooledBytes));
+    obj.push_back(Pair("recvbufferpool", pool));
+
+    UniValue workers(UniValue::VOBJ);
+    workers.push_back(Pair("threads", g_connman->GetMessageWorkerCount()));
+    workers.push_back(Pair("queued", (uint64_t)g_connman->GetMessageWorkerQueueSize()));
+    UniValue commands(UniValue::VOBJ);
+    for (const std::pair<const std::string, CMessageWorkerStats>& entry : g_connman->GetMessageWorkerStats()) {
+        const CMessageWorkerStats& cmdStats = entry.second;
+        UniValue cmd(UniValue::VOBJ);
+        cmd.push_back(Pair("count", cmdStats.nMessages));
+        cmd.push_back(Pair("avgwait", cmdStats.nMessages ? cmdStats.nTotalWait / (int64_t)cmdStats.nMessages : 0));
+        cmd.push_back(Pair("maxwait", cmdStats.nMaxWait));
+        cmd.push_back(Pair("avgtime", cmdStats.nMessages ? cmdStats.nTotalTime / (int64_t)cmdStats.nMessages : 0));
+        commands.push_back(Pair(entry.first, cmd));
+    }
+    workers.push_back(Pair("commands", commands));
+    obj.push_back(Pair("messageworkers", workers));
+
+    UniValue messages(UniValue::VOBJ);
+    for (const std::pair<const std::string, CMsgCmdStats>& entry : g_connman->GetMsgCmdStats()) {
+        const CMsgCmdStats& cmdStats = entry.second;
+        if (!cmdStats.nSendMsgs && !cmdStats.nRecvMsgs && !cmdStats.nProcessed)
+            continue;
+        UniValue cmd(UniValue::VOBJ);
+        cmd.push_back(Pair("msgssent", cmdStats.nSendMsgs));
+        cmd.push_back(Pair("bytessent", cmdStats.nSendBytes));
+        cmd.push_back(Pair("msgsrecv", cmdStats.nRecvMsgs));
+        cmd.push_back(Pair("bytesrecv", cmdStats.nRecvBytes));
+        cmd.push_back(Pair("processed", cmdStats.nProcessed));
+        cmd.push_back(Pair("processtime", cmdStats.nProcessTime));
+        cmd.push_back(Pair("maxprocesstime", cmdStats.nProcessTimeMax));
+        UniValue hist(UniValue::VOBJ);
+        for (size_t i = 0; i < MSG_PROCESS_TIME_BUCKET_COUNT; i++)
+            hist.push_back(Pair(ProcessTimeBucketName(i), cmdStats.vProcessTimeHist[i]));
+        cmd.push_back(Pair("processtimes", hist));
+        messages.push_back(Pair(entry.first, cmd));
+    }
+    obj.push_back(Pair("messages", messages));
     return obj;
 }
 
@@ -318,6 +318,7 @@ static const CRPCCommand vRPCCommands[] =
         {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true },
         {"blockchain", "invalidateblock", &invalidateblock, true },
         {"blockchain", "reconsiderblock", &reconsiderblock, true },
+        {"blockchain", "savemempool", &savemempool, true },
         {"blockchain", "verifychain", &verifychain, true },
         {"blockchain", "getburnaddresses", &getburnaddresses, true },
 
@@ -347,6 +348,7 @@ static const CRPCCommand vRPCCommands[] =
 
         /* Utility functions */
         {"util", "createmultisig", &createmultisig, true },
+        {"util", "getmemoryinfo", &getmemoryinfo, true },
         {"util", "logging", &logging, true },
         {"util", "validateaddress", &validateaddress, true }, /* uses wallet if enabled */
         {"util", "verifymessage", &verifymessage, true },
@@ -258,6 +258,7 @@ extern UniValue waitforblock(const JSONRPCRequest& request);
 extern UniValue waitforblockheight(const JSONRPCRequest& request);
 extern UniValue getdifficulty(const JSONRPCRequest& request);
 extern UniValue getmempoolinfo(const JSONRPCRequest& request);
+extern UniValue savemempool(const JSONRPCRequest& request);
 extern UniValue getrawmempool(const JSONRPCRequest& request);
 extern UniValue getblockhash(const JSONRPCRequest& request);
 extern UniValue getblock(const JSONRPCRequest& request);
@@ -301,6 +302,7 @@ extern UniValue mnfinalbudget(const JSONRPCRequest& request);
 extern UniValue checkbudgets(const JSONRPCRequest& request);
 
 extern UniValue getinfo(const JSONRPCRequest& request); // in rpc/misc.cpp
+extern UniValue getmemoryinfo(const JSONRPCRequest& request);
 extern UniValue logging(const JSONRPCRequest& request);
 extern UniValue mnsync(const JSONRPCRequest& request);
 extern UniValue spork(const JSONRPCRequest& request);
@@ -0,0 +1,28 @@
+// Copyright (c) 2021-2022 The Studscoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SALTEDHASHER_H
+#define BITCOIN_SALTEDHASHER_H
+
+#include "hash.h"
+#include "uint256.h"
+
+#include <stdint.h>
+
+/** Hasher of txids and other uint256 keys for unordered containers, salted so a peer can't pick colliding keys */
+class SaltedTxidHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedTxidHasher();
+
+    size_t operator()(const uint256& txid) const {
+        return SipHashUint256(k0, k1, txid);
+    }
+};
+
+#endif // BITCOIN_SALTEDHASHER_H
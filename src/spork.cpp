@@ -273,6 +273,23 @@ bool CSporkManager::SetPrivKey(std::string strPrivKey)
     return false;
 }
 
+bool CSporkManager::HaveSeenSpork(const uint256& hash) const
+{
+    LOCK(cs);
+    return mapSporks.count(hash);
+}
+
+bool CSporkManager::GetSporkSerialized(const uint256& hash, CDataStream& ss) const
+{
+    LOCK(cs);
+    std::map<uint256, CSporkMessage>::const_iterator it = mapSporks.find(hash);
+    if (it == mapSporks.end())
+        return false;
+    ss.reserve(1000);
+    ss << it->second;
+    return true;
+}
+
 std::string CSporkManager::ToString() const
 {
     LOCK(cs);
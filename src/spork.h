@@ -115,6 +115,8 @@ public:
     bool UpdateSpork(SporkId nSporkID, int64_t nValue);
 
     bool IsSporkActive(SporkId nSporkID);
+    bool HaveSeenSpork(const uint256& hash) const;
+    bool GetSporkSerialized(const uint256& hash, CDataStream& ss) const;
     std::string GetSporkNameByID(SporkId id);
     SporkId GetSporkIDByName(std::string strName);
 
@@ -295,6 +295,15 @@ public:
         data.insert(data.end(), begin(), end());
         clear();
     }
+
+    //! Exchange the underlying storage with vchOther, rewinding the stream
+    void Swap(vector_type& vchOther)
+    {
+        vch.swap(vchOther);
+        nReadPos = 0;
+    }
+
+    size_type capacity() const { return vch.capacity(); }
 };
 
 /* Minimal stream for overwriting and/or appending to an existing byte vector
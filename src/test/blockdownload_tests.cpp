@@ -0,0 +1,171 @@
+// Copyright (c) 2021-2022 The Studscoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "main.h"
+#include "net.h"
+#include "netmessagemaker.h"
+#include "random.h"
+#include "utiltime.h"
+
+#include "test/test_pivx.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockdownload_tests, TestingSetup)
+
+// A peer ahead of our chain
+static std::unique_ptr<CNode> ConnectNode(NodeId id, CConnman& connman)
+{
+    std::unique_ptr<CNode> pnode = ConnectTestNode(id, connman);
+    pnode->nStartingHeight = 1000;
+    return pnode;
+}
+
+static CNodeStateStats GetStats(const CNode& node)
+{
+    CNodeStateStats stats;
+    BOOST_CHECK(GetNodeStateStats(node.GetId(), stats));
+    return stats;
+}
+
+// A header that doesn't connect to our chain, which the peer is sent a getblocks for
+static void AskForBlocks(CNode& node, CConnman& connman)
+{
+    std::atomic<bool> interruptDummy(false);
+    CBlock header;
+    header.nVersion = 4;
+    header.hashPrevBlock = GetRandHash();
+    header.nTime = 1;
+    ReceiveMessage(node, CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::HEADERS, std::vector<CBlock>(1, header)));
+    ProcessMessages(&node, connman, interruptDummy);
+}
+
+static std::vector<CInv> RandomBlockInvs(int nCount)
+{
+    std::vector<CInv> vInv;
+    for (int i = 0; i < nCount; i++)
+        vInv.push_back(CInv(MSG_BLOCK, GetRandHash()));
+    return vInv;
+}
+
+static void AnnounceBlocks(CNode& node, CConnman& connman, const std::vector<CInv>& vInv)
+{
+    std::atomic<bool> interruptDummy(false);
+    ReceiveMessage(node, CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::INV, vInv));
+    ProcessMessages(&node, connman, interruptDummy);
+}
+
+BOOST_AUTO_TEST_CASE(blockdownload_unsolicited_inv)
+{
+    std::unique_ptr<CNode> pnode = ConnectNode(1200, *connman);
+
+    // more blocks than a peer announces on its own are only queued from a getblocks result
+    AnnounceBlocks(*pnode, *connman, RandomBlockInvs(100));
+    BOOST_CHECK_EQUAL(GetStats(*pnode).nBlocksAnnounced, 0);
+
+    AskForBlocks(*pnode, *connman);
+    AnnounceBlocks(*pnode, *connman, RandomBlockInvs(100));
+    BOOST_CHECK_EQUAL(GetStats(*pnode).nBlocksAnnounced, 100);
+
+    // and only once per getblocks
+    AnnounceBlocks(*pnode, *connman, RandomBlockInvs(100));
+    BOOST_CHECK_EQUAL(GetStats(*pnode).nBlocksAnnounced, 100);
+
+    // a result can't announce more than MAX_GETBLOCKS_RESULTS blocks
+    DisconnectTestNode(*pnode);
+    pnode = ConnectNode(1205, *connman);
+    AskForBlocks(*pnode, *connman);
+    AnnounceBlocks(*pnode, *connman, RandomBlockInvs(MAX_GETBLOCKS_RESULTS + 100));
+    BOOST_CHECK_EQUAL(GetStats(*pnode).nBlocksAnnounced, (int)MAX_GETBLOCKS_RESULTS);
+
+    DisconnectTestNode(*pnode);
+}
+
+BOOST_AUTO_TEST_CASE(blockdownload_getblocks_result)
+{
+    std::unique_ptr<CNode> pnode = ConnectNode(1204, *connman);
+
+    // a new tip announced before the result doesn't take its place
+    AskForBlocks(*pnode, *connman);
+    AnnounceBlocks(*pnode, *connman, RandomBlockInvs(1));
+    AnnounceBlocks(*pnode, *connman, RandomBlockInvs(100));
+    BOOST_CHECK_EQUAL(GetStats(*pnode).nBlocksAnnounced, 100);
+
+    // asking again before the result still gets only one result queued
+    DisconnectTestNode(*pnode);
+    pnode = ConnectNode(1206, *connman);
+    AskForBlocks(*pnode, *connman);
+    AskForBlocks(*pnode, *connman);
+    AnnounceBlocks(*pnode, *connman, RandomBlockInvs(100));
+    AnnounceBlocks(*pnode, *connman, RandomBlockInvs(100));
+    BOOST_CHECK_EQUAL(GetStats(*pnode).nBlocksAnnounced, 100);
+
+    // a result that comes too late is unsolicited
+    DisconnectTestNode(*pnode);
+    pnode = ConnectNode(1207, *connman);
+    AskForBlocks(*pnode, *connman);
+    SetMockTime(GetTime() + GETBLOCKS_RESULT_TIMEOUT + 1);
+    AnnounceBlocks(*pnode, *connman, RandomBlockInvs(100));
+    BOOST_CHECK_EQUAL(GetStats(*pnode).nBlocksAnnounced, 0);
+    SetMockTime(0);
+
+    DisconnectTestNode(*pnode);
+}
+
+BOOST_AUTO_TEST_CASE(blockdownload_announcers)
+{
+    std::atomic<bool> interruptDummy(false);
+    std::unique_ptr<CNode> pnodeA = ConnectNode(1201, *connman);
+    std::unique_ptr<CNode> pnodeB = ConnectNode(1202, *connman);
+    CNode& nodeA = *pnodeA;
+    CNode& nodeB = *pnodeB;
+
+    const std::vector<CInv> vInv = RandomBlockInvs(100);
+    AskForBlocks(nodeA, *connman);
+    AnnounceBlocks(nodeA, *connman, vInv);
+
+    // the blocks are only asked from the peer that announced them
+    SendMessages(&nodeB, *connman, interruptDummy);
+    BOOST_CHECK_EQUAL(GetStats(nodeB).nBlocksInFlight, 0);
+    SendMessages(&nodeA, *connman, interruptDummy);
+    CNodeStateStats statsA = GetStats(nodeA);
+    BOOST_CHECK_EQUAL(statsA.nBlocksInFlight, statsA.nDownloadWindow);
+
+    // the other peer was asked for the same blocks, once it announced them it gets its share
+    AnnounceBlocks(nodeB, *connman, vInv);
+    BOOST_CHECK_EQUAL(GetStats(nodeB).nBlocksAnnounced, 100);
+    SendMessages(&nodeB, *connman, interruptDummy);
+    CNodeStateStats statsB = GetStats(nodeB);
+    BOOST_CHECK_EQUAL(statsB.nBlocksInFlight, statsB.nDownloadWindow);
+    BOOST_CHECK_EQUAL(GetStats(nodeA).nBlocksInFlight, statsA.nDownloadWindow);
+
+    // the blocks stay queued while a peer that announced them is connected
+    DisconnectTestNode(nodeA);
+    BOOST_CHECK_EQUAL(GetStats(nodeB).nBlocksAnnounced, 100);
+
+    DisconnectTestNode(nodeB);
+}
+
+BOOST_AUTO_TEST_CASE(blockdownload_expiry)
+{
+    std::atomic<bool> interruptDummy(false);
+    std::unique_ptr<CNode> pnode = ConnectNode(1203, *connman);
+    CNode& node = *pnode;
+
+    AskForBlocks(node, *connman);
+    AnnounceBlocks(node, *connman, RandomBlockInvs(100));
+    BOOST_CHECK_EQUAL(GetStats(node).nBlocksAnnounced, 100);
+
+    // the blocks that weren't asked for in time are dropped
+    SetMockTime(GetTime() + BLOCK_DOWNLOAD_EXPIRY + 1);
+    SendMessages(&node, *connman, interruptDummy);
+    BOOST_CHECK_EQUAL(GetStats(node).nBlocksAnnounced, 0);
+    BOOST_CHECK_EQUAL(GetStats(node).nBlocksInFlight, 0);
+    SetMockTime(0);
+
+    DisconnectTestNode(node);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,213 @@
+// Copyright (c) 2011-2016 The Bitcoin Core developers
+// Copyright (c) 2021-2022 The Studscoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "main.h"
+#include "net.h"
+#include "netmessagemaker.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+
+#include "test/test_pivx.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockencodings_tests, BasicTestingSetup)
+
+static CMutableTransaction BuildSpend(const uint256& hashPrev, CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(hashPrev, 0);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx.vout[0].nValue = nValue;
+    return tx;
+}
+
+// coinbase, (coinstake,) and three transactions spending each other
+static CBlock BuildBlock(bool fProofOfStake)
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.hashPrevBlock = GetRandHash();
+    block.nBits = 0x207fffff;
+    block.nTime = 1;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << OP_1 << OP_1;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = fProofOfStake ? 0 : 42;
+    if (fProofOfStake)
+        coinbase.vout[0].SetEmpty();
+    block.vtx.push_back(coinbase);
+
+    if (fProofOfStake) {
+        CMutableTransaction coinstake = BuildSpend(GetRandHash(), 0);
+        coinstake.vout.resize(2);
+        coinstake.vout[0].SetEmpty();
+        coinstake.vout[1].scriptPubKey = CScript() << OP_TRUE;
+        coinstake.vout[1].nValue = 42;
+        block.vtx.push_back(coinstake);
+        block.vchBlockSig = std::vector<unsigned char>(72, 0x30);
+    }
+
+    CMutableTransaction tx = BuildSpend(GetRandHash(), 3000);
+    block.vtx.push_back(tx);
+    tx = BuildSpend(tx.GetHash(), 2000);
+    block.vtx.push_back(tx);
+    tx = BuildSpend(tx.GetHash(), 1000);
+    block.vtx.push_back(tx);
+
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    assert(!mutated);
+    return block;
+}
+
+static CBlockHeaderAndShortTxIDs RoundTrip(const CBlockHeaderAndShortTxIDs& cmpctblock)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << cmpctblock;
+    CBlockHeaderAndShortTxIDs cmpctblock2;
+    stream >> cmpctblock2;
+    return cmpctblock2;
+}
+
+BOOST_AUTO_TEST_CASE(SimpleRoundTripTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlock(false));
+
+    CMutableTransaction txInPool(block.vtx[2]);
+    pool.addUnchecked(block.vtx[2].GetHash(), entry.FromTx(txInPool));
+
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    BOOST_CHECK_EQUAL(cmpctblock.BlockTxCount(), block.vtx.size());
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(cmpctblock) == READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(partialBlock.IsTxAvailable(2));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(3));
+    BOOST_CHECK_EQUAL(partialBlock.GetPrefilledCount(), 1U);
+    BOOST_CHECK_EQUAL(partialBlock.GetMempoolCount(), 1U);
+
+    CBlock block2;
+    std::vector<CTransaction> vtx_missing;
+    BOOST_CHECK(partialBlock.FillBlock(block2, vtx_missing) == READ_STATUS_INVALID); // No transactions
+
+    // Wrong transaction: the merkle root doesn't match anymore
+    vtx_missing.push_back(block.vtx[2]);
+    vtx_missing.push_back(block.vtx[3]);
+    BOOST_CHECK(partialBlock.FillBlock(block2, vtx_missing) == READ_STATUS_FAILED);
+
+    vtx_missing[0] = block.vtx[1];
+    BOOST_CHECK(partialBlock.FillBlock(block2, vtx_missing) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block.GetHash().ToString(), block2.GetHash().ToString());
+    BOOST_CHECK(block2.vtx == block.vtx);
+}
+
+BOOST_AUTO_TEST_CASE(ProofOfStakeTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlock(true));
+    BOOST_CHECK(block.IsProofOfStake());
+
+    for (size_t i = 2; i < block.vtx.size(); i++) {
+        CMutableTransaction txInPool(block.vtx[i]);
+        pool.addUnchecked(block.vtx[i].GetHash(), entry.FromTx(txInPool));
+    }
+
+    // The coinstake and the signature travel with the header
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    BOOST_CHECK(cmpctblock.vchBlockSig == block.vchBlockSig);
+    CBlock stub = cmpctblock.GetSignedStub();
+    BOOST_CHECK_EQUAL(stub.GetHash().ToString(), block.GetHash().ToString());
+    BOOST_CHECK_EQUAL(stub.vtx.size(), 2U);
+    BOOST_CHECK(stub.IsProofOfStake());
+    BOOST_CHECK(stub.vchBlockSig == block.vchBlockSig);
+
+    // Everything else is in the mempool: no round trip
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(cmpctblock) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(partialBlock.GetPrefilledCount(), 2U);
+    BOOST_CHECK_EQUAL(partialBlock.GetMempoolCount(), 3U);
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, std::vector<CTransaction>()) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block.GetHash().ToString(), block2.GetHash().ToString());
+    BOOST_CHECK(block2.vchBlockSig == block.vchBlockSig);
+    BOOST_CHECK(block2.vtx == block.vtx);
+
+    // A signed block without its coinstake is bogus
+    CBlock blockPoW(BuildBlock(false));
+    blockPoW.vchBlockSig = block.vchBlockSig;
+    PartiallyDownloadedBlock partialBlock2(&pool);
+    BOOST_CHECK(partialBlock2.InitData(CBlockHeaderAndShortTxIDs(blockPoW)) == READ_STATUS_INVALID);
+}
+
+BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest)
+{
+    BlockTransactionsRequest req1;
+    req1.blockhash = GetRandHash();
+    req1.indexes.resize(4);
+    req1.indexes[0] = 0;
+    req1.indexes[1] = 1;
+    req1.indexes[2] = 3;
+    req1.indexes[3] = 4;
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req1;
+
+    BlockTransactionsRequest req2;
+    stream >> req2;
+
+    BOOST_CHECK_EQUAL(req1.blockhash.ToString(), req2.blockhash.ToString());
+    BOOST_CHECK_EQUAL(req1.indexes.size(), req2.indexes.size());
+    BOOST_CHECK_EQUAL(req1.indexes[0], req2.indexes[0]);
+    BOOST_CHECK_EQUAL(req1.indexes[1], req2.indexes[1]);
+    BOOST_CHECK_EQUAL(req1.indexes[2], req2.indexes[2]);
+    BOOST_CHECK_EQUAL(req1.indexes[3], req2.indexes[3]);
+}
+
+// A bad block signature gets the same punishment whether the block comes whole or compact
+BOOST_FIXTURE_TEST_CASE(BadBlockSignatureTest, TestingSetup)
+{
+    std::atomic<bool> interruptDummy(false);
+    CBlock block(BuildBlock(true));
+    {
+        LOCK(cs_main);
+        block.hashPrevBlock = chainActive.Tip()->GetBlockHash();
+    }
+
+    std::vector<std::unique_ptr<CNode> > vNodes;
+    for (NodeId id = 1000; id < 1002; id++)
+        vNodes.push_back(ConnectTestNode(id, *connman));
+
+    ReceiveMessage(*vNodes[0], CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::CMPCTBLOCK, CBlockHeaderAndShortTxIDs(block)));
+    ProcessMessages(vNodes[0].get(), *connman, interruptDummy);
+    BOOST_CHECK_EQUAL(GetMisbehavior(vNodes[0]->GetId()), 100);
+
+    ReceiveMessage(*vNodes[1], CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::BLOCK, block));
+    ProcessMessages(vNodes[1].get(), *connman, interruptDummy);
+    BOOST_CHECK_EQUAL(GetMisbehavior(vNodes[1]->GetId()), 100);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(!mapBlockIndex.count(block.GetHash()));
+    }
+
+    for (const std::unique_ptr<CNode>& node : vNodes)
+        DisconnectTestNode(*node);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "masternode-budget.h"
+#include "random.h"
 #include "tinyformat.h"
 #include "utilmoneystr.h"
 #include "test_pivx.h"
@@ -31,4 +32,49 @@ BOOST_AUTO_TEST_CASE(budget_value)
     CheckBudgetValue(nHeightTest, "mainnet", 43200*COIN);
 }
 
+BOOST_AUTO_TEST_CASE(budget_vote_tally)
+{
+    CBudgetProposal proposal("test", "https://test.org", 0, 0, CScript(), 10 * COIN, UINT256_ZERO);
+    const uint256 nProposalHash = proposal.GetHash();
+    const int64_t nNow = GetTime();
+    std::string strError;
+
+    std::vector<CTxIn> vin;
+    for (int i = 0; i < 4; i++)
+        vin.emplace_back(COutPoint(GetRandHash(), 0));
+
+    CBudgetVote::VoteDirection directions[] = {CBudgetVote::VOTE_YES, CBudgetVote::VOTE_YES, CBudgetVote::VOTE_NO, CBudgetVote::VOTE_ABSTAIN};
+    for (int i = 0; i < 4; i++) {
+        CBudgetVote vote(vin[i], nProposalHash, directions[i]);
+        vote.SetTime(nNow - BUDGET_VOTE_UPDATE_MIN);
+        BOOST_CHECK(proposal.AddOrUpdateVote(vote, strError));
+    }
+    BOOST_CHECK_EQUAL(proposal.GetYeas(), 2);
+    BOOST_CHECK_EQUAL(proposal.GetNays(), 1);
+    BOOST_CHECK_EQUAL(proposal.GetAbstains(), 1);
+
+    // a masternode changing its vote moves it to the other count
+    CBudgetVote voteChanged(vin[0], nProposalHash, CBudgetVote::VOTE_NO);
+    voteChanged.SetTime(nNow);
+    BOOST_CHECK(proposal.AddOrUpdateVote(voteChanged, strError));
+    BOOST_CHECK_EQUAL(proposal.GetYeas(), 1);
+    BOOST_CHECK_EQUAL(proposal.GetNays(), 2);
+
+    // too soon to change it again
+    CBudgetVote voteTooSoon(vin[0], nProposalHash, CBudgetVote::VOTE_YES);
+    voteTooSoon.SetTime(nNow + 1);
+    BOOST_CHECK(!proposal.AddOrUpdateVote(voteTooSoon, strError));
+    BOOST_CHECK_EQUAL(proposal.GetYeas(), 1);
+
+    // the tally is rebuilt when loaded
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << proposal;
+    CBudgetProposal proposalLoaded;
+    ss >> proposalLoaded;
+    BOOST_CHECK_EQUAL(proposalLoaded.GetYeas(), 1);
+    BOOST_CHECK_EQUAL(proposalLoaded.GetNays(), 2);
+    BOOST_CHECK_EQUAL(proposalLoaded.GetAbstains(), 1);
+    BOOST_CHECK_EQUAL(proposalLoaded.GetRatio(), 1.0 / 3.0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,109 @@
+// Copyright (c) 2021-2022 The Studscoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "expiringmap.h"
+#include "random.h"
+#include "saltedhasher.h"
+#include "test/test_pivx.h"
+#include "uint256.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(expiringmap_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(expiringmap_expiry)
+{
+    const int64_t nStartTime = GetTime();
+    SetMockTime(nStartTime);
+
+    expiringmap<uint256, int64_t, SaltedTxidHasher> cache(60);
+    const uint256 hashOld = GetRandHash();
+    const uint256 hashTouched = GetRandHash();
+    BOOST_CHECK(cache.insert(std::make_pair(hashOld, 1)).second);
+    BOOST_CHECK(cache.insert(std::make_pair(hashTouched, 2)).second);
+    BOOST_CHECK(!cache.insert(std::make_pair(hashOld, 3)).second);
+    BOOST_CHECK_EQUAL(cache.at(hashOld), 1);
+
+    SetMockTime(nStartTime + 50);
+    cache.touch(hashTouched);
+
+    // hashOld is now too old, hashTouched was refreshed
+    SetMockTime(nStartTime + 61);
+    const uint256 hashNew = GetRandHash();
+    cache[hashNew] = 4;
+    BOOST_CHECK(!cache.count(hashOld));
+    BOOST_CHECK(cache.count(hashTouched));
+    BOOST_CHECK(cache.count(hashNew));
+    BOOST_CHECK_EQUAL(cache.GetExpiredCount(), 1);
+
+    // expire() drops the rest without an insertion
+    SetMockTime(nStartTime + 200);
+    cache.expire();
+    BOOST_CHECK(cache.empty());
+    BOOST_CHECK_EQUAL(cache.GetExpiredCount(), 3);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(expiringmap_eviction)
+{
+    expiringmap<uint256, std::vector<unsigned char>, SaltedTxidHasher> cache(0, 16 * 1024);
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 100; i++) {
+        vHashes.push_back(GetRandHash());
+        cache.insert(std::make_pair(vHashes.back(), std::vector<unsigned char>(1000, i)));
+        BOOST_CHECK(cache.DynamicMemoryUsage() <= 16 * 1024 + memusage::MallocUsage(sizeof(void*) * 1024));
+    }
+    BOOST_CHECK(cache.GetEvictedCount() > 0);
+    BOOST_CHECK_EQUAL(cache.size() + cache.GetEvictedCount(), vHashes.size());
+    // the oldest entries went first
+    BOOST_CHECK(!cache.count(vHashes.front()));
+    BOOST_CHECK(cache.count(vHashes.back()));
+
+    // erase returns the next entry in age order
+    auto it = cache.begin();
+    const uint256 hashSecond = std::next(it)->first;
+    it = cache.erase(it);
+    BOOST_CHECK(it->first == hashSecond);
+}
+
+BOOST_AUTO_TEST_CASE(expiringmap_settimes)
+{
+    const int64_t nStartTime = GetTime();
+    SetMockTime(nStartTime);
+
+    // values hold their own creation time, as signed messages do
+    expiringmap<uint256, int64_t, SaltedTxidHasher> cache(60);
+    const uint256 hashStale = GetRandHash();
+    const uint256 hashRecent = GetRandHash();
+    const uint256 hashOlder = GetRandHash();
+    const uint256 hashFuture = GetRandHash();
+    cache.insert(std::make_pair(hashRecent, nStartTime - 10));
+    cache.insert(std::make_pair(hashStale, nStartTime - 100));
+    cache.insert(std::make_pair(hashOlder, nStartTime - 30));
+    cache.insert(std::make_pair(hashFuture, nStartTime + 1000));
+
+    cache.SetTimes([](int64_t nTime) { return nTime; });
+    BOOST_CHECK(!cache.count(hashStale));
+    BOOST_CHECK_EQUAL(cache.size(), 3);
+    BOOST_CHECK(cache.begin()->first == hashOlder);
+
+    // the remaining entries expire in the order of their own time
+    SetMockTime(nStartTime + 40);
+    cache.expire();
+    BOOST_CHECK(!cache.count(hashOlder));
+    BOOST_CHECK(cache.count(hashRecent));
+    SetMockTime(nStartTime + 55);
+    cache.expire();
+    BOOST_CHECK(!cache.count(hashRecent));
+    // a time in the future counts as now
+    BOOST_CHECK(cache.count(hashFuture));
+    SetMockTime(nStartTime + 61);
+    cache.expire();
+    BOOST_CHECK(cache.empty());
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
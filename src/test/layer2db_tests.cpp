@@ -0,0 +1,54 @@
+// Copyright (c) 2021-2022 The Studscoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "layer2db.h"
+#include "random.h"
+#include "test/test_pivx.h"
+#include "uint256.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(layer2db_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(layer2db_incremental_flush)
+{
+    CLayer2DB db(1 << 20, true, true);
+    BOOST_CHECK(db.ReadSectionHeader("test") == CLayer2DB::SECTION_MISSING);
+
+    std::map<uint256, int64_t> mapIn;
+    for (int i = 0; i < 10; i++)
+        mapIn.emplace(GetRandHash(), i);
+
+    CDBBatch batch;
+    db.WriteMap(batch, 'x', mapIn);
+    BOOST_CHECK(batch.SizeEstimate() > 0);
+    BOOST_CHECK(db.Commit(batch, "test"));
+    BOOST_CHECK(db.ReadSectionHeader("test") == CLayer2DB::SECTION_OK);
+
+    // nothing changed: nothing to write
+    CDBBatch batch2;
+    db.WriteMap(batch2, 'x', mapIn);
+    BOOST_CHECK_EQUAL(batch2.SizeEstimate(), 0);
+
+    // one update and one removal
+    const uint256 hashErased = mapIn.begin()->first;
+    mapIn.erase(mapIn.begin());
+    mapIn.begin()->second = 100;
+    CDBBatch batch3;
+    db.WriteMap(batch3, 'x', mapIn);
+    BOOST_CHECK(batch3.SizeEstimate() > 0);
+    BOOST_CHECK(db.Commit(batch3, "test"));
+
+    std::map<uint256, int64_t> mapOut;
+    BOOST_CHECK(db.ReadMap('x', mapOut));
+    BOOST_CHECK(mapOut == mapIn);
+    BOOST_CHECK(!mapOut.count(hashErased));
+
+    // other prefixes are not affected
+    std::map<uint256, int64_t> mapOther;
+    BOOST_CHECK(db.ReadMap('y', mapOther));
+    BOOST_CHECK(mapOther.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -166,4 +166,36 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     BOOST_CHECK(Test());
 }
 
+BOOST_AUTO_TEST_CASE(raw_block_reader)
+{
+    // two blocks one after the other, in a file of their own
+    CBlock block1(Params().GenesisBlock());
+    CBlock block2(block1);
+    block2.nTime++;
+    CDiskBlockPos pos1(99, 0);
+    BOOST_REQUIRE(WriteBlockToDisk(block1, pos1));
+    CDiskBlockPos pos2(99, pos1.nPos + ::GetSerializeSize(block1, SER_DISK, CLIENT_VERSION));
+    BOOST_REQUIRE(WriteBlockToDisk(block2, pos2));
+
+    CDataStream ss1(SER_NETWORK, PROTOCOL_VERSION);
+    ss1 << block1;
+    CDataStream ss2(SER_NETWORK, PROTOCOL_VERSION);
+    ss2 << block2;
+
+    CRawBlockReader reader;
+    reader.Prefetch({pos2, pos1});
+    std::vector<unsigned char> vch;
+    // sequentially, then backwards
+    BOOST_CHECK(reader.Read(vch, pos1));
+    BOOST_CHECK(std::equal(ss1.begin(), ss1.end(), vch.begin()) && vch.size() == ss1.size());
+    BOOST_CHECK(reader.Read(vch, pos2));
+    BOOST_CHECK(std::equal(ss2.begin(), ss2.end(), vch.begin()) && vch.size() == ss2.size());
+    BOOST_CHECK(reader.Read(vch, pos1));
+    BOOST_CHECK(std::equal(ss1.begin(), ss1.end(), vch.begin()) && vch.size() == ss1.size());
+
+    // not the start of a block
+    BOOST_CHECK(!reader.Read(vch, CDiskBlockPos(99, pos1.nPos + 1)));
+    BOOST_CHECK(!reader.Read(vch, CDiskBlockPos(98, 8)));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,7 +3,9 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "chainparams.h"
 #include "main.h"
+#include "net.h"
 #include "test_pivx.h"
 #include "txmempool.h"
 #include "util.h"
@@ -319,6 +321,97 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
 }
 
 
+BOOST_AUTO_TEST_CASE(MempoolSortForRelayTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    /* low fee parent of a high fee child */
+    CMutableTransaction txParent = CMutableTransaction();
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(1000LL).FromTx(txParent));
+
+    CMutableTransaction txChild = CMutableTransaction();
+    txChild.vin.resize(1);
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 9 * COIN;
+    pool.addUnchecked(txChild.GetHash(), entry.Fee(100000LL).FromTx(txChild));
+
+    /* unrelated, in between */
+    CMutableTransaction txOther = CMutableTransaction();
+    txOther.vout.resize(1);
+    txOther.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txOther.vout[0].nValue = 5 * COIN;
+    pool.addUnchecked(txOther.GetHash(), entry.Fee(10000LL).FromTx(txOther));
+
+    std::vector<uint256> vHashes;
+    vHashes.push_back(txOther.GetHash());
+    vHashes.push_back(GetRandHash()); // not in the mempool
+    vHashes.push_back(txParent.GetHash());
+    vHashes.push_back(txChild.GetHash());
+    pool.SortForRelay(vHashes);
+    BOOST_CHECK_EQUAL(vHashes.size(), 3);
+    BOOST_CHECK(vHashes[0] == txParent.GetHash());
+    BOOST_CHECK(vHashes[1] == txChild.GetHash());
+    BOOST_CHECK(vHashes[2] == txOther.GetHash());
+
+    /* a parent that isn't queued doesn't hold its child back */
+    vHashes.clear();
+    vHashes.push_back(txOther.GetHash());
+    vHashes.push_back(txChild.GetHash());
+    pool.SortForRelay(vHashes);
+    BOOST_CHECK_EQUAL(vHashes.size(), 2);
+    BOOST_CHECK(vHashes[0] == txChild.GetHash());
+    BOOST_CHECK(vHashes[1] == txOther.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolRelayBatchTest)
+{
+    std::atomic<bool> interruptDummy(false);
+    TestMemPoolEntryHelper entry;
+    std::unique_ptr<CNode> pnodeIn = ConnectTestNode(1300, *connman, true);
+    std::unique_ptr<CNode> pnodeOut = ConnectTestNode(1301, *connman, false);
+    CNode& nodeIn = *pnodeIn;
+    CNode& nodeOut = *pnodeOut;
+
+    const size_t nTxs = 100;
+    for (size_t i = 0; i < nTxs; i++) {
+        CMutableTransaction tx = CMutableTransaction();
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = COIN;
+        mempool.addUnchecked(tx.GetHash(), entry.Fee(10000LL).FromTx(tx));
+        nodeIn.PushInventory(CInv(MSG_TX, tx.GetHash()));
+        nodeOut.PushInventory(CInv(MSG_TX, tx.GetHash()));
+    }
+
+    // the first flush is due at once, a batch covers the average interval of the peer,
+    // which is half as long for outbound peers
+    SendMessages(&nodeIn, *connman, interruptDummy);
+    SendMessages(&nodeOut, *connman, interruptDummy);
+    const size_t nMaxIn = INVENTORY_BROADCAST_PER_SECOND * std::max<int64_t>(nInvBroadcastInterval, 1);
+    const size_t nMaxOut = INVENTORY_BROADCAST_PER_SECOND * std::max<int64_t>(nInvBroadcastInterval / 2, 1);
+    {
+        LOCK(nodeIn.cs_inventory);
+        BOOST_CHECK_EQUAL(nodeIn.setInventoryTxToSend.size(), nTxs - nMaxIn);
+    }
+    {
+        LOCK(nodeOut.cs_inventory);
+        BOOST_CHECK_EQUAL(nodeOut.setInventoryTxToSend.size(), nTxs - nMaxOut);
+    }
+
+    DisconnectTestNode(nodeIn);
+    DisconnectTestNode(nodeOut);
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
 {
     CTxMemPool pool(CFeeRate(1000));
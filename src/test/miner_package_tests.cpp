@@ -0,0 +1,140 @@
+// Copyright (c) 2021-2022 The Studscoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coins.h"
+#include "main.h"
+#include "miner.h"
+#include "policy/policy.h"
+#include "random.h"
+#include "txmempool.h"
+
+#include "test/test_pivx.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(miner_package_tests, TestingSetup)
+
+// A confirmed transaction with outputs anyone can spend, added to the coins of the tip
+static CTransaction AddSpendableCoins(int nOutputs)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+    tx.vout.resize(nOutputs);
+    for (CTxOut& out : tx.vout) {
+        out.nValue = 10 * COIN;
+        out.scriptPubKey = CScript() << OP_TRUE;
+    }
+
+    CTransaction txFund(tx);
+    LOCK(cs_main);
+    AddCoins(*pcoinsTip, txFund, 0);
+    return txFund;
+}
+
+static CMutableTransaction Spend(const CTransaction& txPrev, uint32_t n, CAmount nFee)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txPrev.GetHash(), n);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = txPrev.vout[n].nValue - nFee;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    return tx;
+}
+
+static std::vector<CTransaction> SelectTxs()
+{
+    CBlockIndex* pindexTip;
+    {
+        LOCK(cs_main);
+        pindexTip = chainActive.Tip();
+    }
+    // no priority area and no minimum size, so that only the fees decide
+    return GetBlockTemplateTxs(pindexTip, DEFAULT_BLOCK_MAX_SIZE, 0, 0);
+}
+
+BOOST_AUTO_TEST_CASE(miner_package_selection)
+{
+    const CTransaction txFund = AddSpendableCoins(3);
+    TestMemPoolEntryHelper entry;
+    entry.Time(GetTime());
+
+    // a parent below the relay fee, and its child paying for both
+    CMutableTransaction txParent = Spend(txFund, 0, 0);
+    mempool.addUnchecked(txParent.GetHash(), entry.Fee(0).FromTx(txParent));
+    CMutableTransaction txChild = Spend(CTransaction(txParent), 0, COIN);
+    mempool.addUnchecked(txChild.GetHash(), entry.Fee(COIN).FromTx(txChild));
+
+    // pays more than the parent alone, less than the package
+    CMutableTransaction txOther = Spend(txFund, 1, 100000);
+    mempool.addUnchecked(txOther.GetHash(), entry.Fee(100000).FromTx(txOther));
+
+    // below the relay fee and without descendants
+    CMutableTransaction txFree = Spend(txFund, 2, 0);
+    mempool.addUnchecked(txFree.GetHash(), entry.Fee(0).FromTx(txFree));
+
+    const std::vector<CTransaction> vtx = SelectTxs();
+    BOOST_CHECK_EQUAL(vtx.size(), 3U);
+    if (vtx.size() == 3) {
+        BOOST_CHECK(vtx[0].GetHash() == txParent.GetHash());
+        BOOST_CHECK(vtx[1].GetHash() == txChild.GetHash());
+        BOOST_CHECK(vtx[2].GetHash() == txOther.GetHash());
+    }
+
+    // every input is confirmed or spends a transaction earlier in the block
+    std::set<uint256> setInBlock;
+    for (const CTransaction& tx : vtx) {
+        for (const CTxIn& in : tx.vin)
+            BOOST_CHECK(in.prevout.hash == txFund.GetHash() || setInBlock.count(in.prevout.hash));
+        setInBlock.insert(tx.GetHash());
+    }
+
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(miner_template_cache)
+{
+    const CTransaction txFund = AddSpendableCoins(3);
+    TestMemPoolEntryHelper entry;
+    entry.Time(GetTime());
+
+    CMutableTransaction txA = Spend(txFund, 0, 100000);
+    mempool.addUnchecked(txA.GetHash(), entry.Fee(100000).FromTx(txA));
+    CMutableTransaction txFree = Spend(txFund, 1, 0);
+    mempool.addUnchecked(txFree.GetHash(), entry.Fee(0).FromTx(txFree));
+
+    std::vector<CTransaction> vtx = SelectTxs();
+    BOOST_CHECK_EQUAL(vtx.size(), 1U);
+    BOOST_CHECK(!vtx.empty() && vtx[0].GetHash() == txA.GetHash());
+
+    // a new entry is appended to the cached selection
+    CMutableTransaction txB = Spend(txFund, 2, 200000);
+    mempool.addUnchecked(txB.GetHash(), entry.Fee(200000).FromTx(txB));
+    vtx = SelectTxs();
+    BOOST_CHECK_EQUAL(vtx.size(), 2U);
+    if (vtx.size() == 2) {
+        BOOST_CHECK(vtx[0].GetHash() == txA.GetHash());
+        BOOST_CHECK(vtx[1].GetHash() == txB.GetHash());
+    }
+
+    // prioritising an entry rebuilds the selection
+    mempool.PrioritiseTransaction(txFree.GetHash(), txFree.GetHash().ToString(), 0, COIN);
+    vtx = SelectTxs();
+    BOOST_CHECK_EQUAL(vtx.size(), 3U);
+    BOOST_CHECK(!vtx.empty() && vtx[0].GetHash() == txFree.GetHash());
+
+    // and so does removing one
+    std::list<CTransaction> removed;
+    mempool.remove(CTransaction(txB), removed);
+    vtx = SelectTxs();
+    BOOST_CHECK_EQUAL(vtx.size(), 2U);
+    for (const CTransaction& tx : vtx)
+        BOOST_CHECK(tx.GetHash() != txB.GetHash());
+
+    mempool.ClearPrioritisation(txFree.GetHash());
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,112 @@
+// Copyright (c) 2021-2022 The Studscoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-payments.h"
+#include "streams.h"
+#include "test/test_pivx.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mnpayments_tests, TestingSetup)
+
+static CScript GetTestPayee(unsigned char n)
+{
+    return CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, n) << OP_EQUALVERIFY << OP_CHECKSIG;
+}
+
+BOOST_AUTO_TEST_CASE(mnpayments_block_payees)
+{
+    CMasternodeBlockPayees blockPayees(100);
+    CScript payee;
+    BOOST_CHECK(!blockPayees.GetPayee(payee));
+
+    blockPayees.AddPayee(GetTestPayee(1), 1);
+    blockPayees.AddPayee(GetTestPayee(2), 1);
+    blockPayees.AddPayee(GetTestPayee(2), 1);
+    BOOST_CHECK(blockPayees.GetPayee(payee) && payee == GetTestPayee(2));
+    BOOST_CHECK(blockPayees.HasPayeeWithVotes(GetTestPayee(2), 2));
+    BOOST_CHECK(!blockPayees.HasPayeeWithVotes(GetTestPayee(1), 2));
+    BOOST_CHECK(!blockPayees.HasPayeeWithVotes(GetTestPayee(3), 1));
+
+    // on a tie the payee voted for first wins
+    blockPayees.AddPayee(GetTestPayee(1), 1);
+    BOOST_CHECK(blockPayees.GetPayee(payee) && payee == GetTestPayee(1));
+
+    // the index is rebuilt on deserialization
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << blockPayees;
+    CMasternodeBlockPayees blockPayees2;
+    ss >> blockPayees2;
+    BOOST_CHECK_EQUAL(blockPayees2.nBlockHeight, 100);
+    BOOST_CHECK(blockPayees2.GetPayee(payee) && payee == GetTestPayee(1));
+    BOOST_CHECK(blockPayees2.HasPayeeWithVotes(GetTestPayee(2), 2));
+}
+
+BOOST_AUTO_TEST_CASE(mnpayments_block_window)
+{
+    CMasternodeBlockWindow window(10);
+    for (int h = 100; h < 110; h++)
+        window.Get(h)->AddPayee(GetTestPayee(h % 256), 1);
+    BOOST_CHECK_EQUAL(window.size(), 10);
+    BOOST_CHECK(window.Find(100) && window.Find(109));
+
+    // a newer height takes the slot of the oldest one, an older one is dropped
+    BOOST_CHECK(window.Get(110));
+    BOOST_CHECK(!window.Find(100));
+    BOOST_CHECK(!window.Get(100));
+    BOOST_CHECK_EQUAL(window.size(), 10);
+
+    BOOST_CHECK_EQUAL(window.erase(105), 1);
+    BOOST_CHECK_EQUAL(window.erase(105), 0);
+    BOOST_CHECK_EQUAL(window.size(), 9);
+
+    // serialized like a map
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << window;
+    std::map<int, CMasternodeBlockPayees> mapBlocks;
+    ss >> mapBlocks;
+    BOOST_CHECK_EQUAL(mapBlocks.size(), 9);
+    BOOST_CHECK(mapBlocks.count(110) && !mapBlocks.count(105));
+
+    // shrinking keeps the most recent heights
+    window.Resize(4);
+    BOOST_CHECK_EQUAL(window.size(), 4);
+    for (int h = 107; h <= 110; h++)
+        BOOST_CHECK(window.Find(h) && window.Find(h)->nBlockHeight == h);
+    BOOST_CHECK(!window.Find(106));
+}
+
+BOOST_AUTO_TEST_CASE(mnpayments_block_window_load)
+{
+    // more history stored than the window holds by default
+    std::map<int, CMasternodeBlockPayees> mapBlocks;
+    for (int h = 100; h < 150; h++) {
+        mapBlocks[h] = CMasternodeBlockPayees(h);
+        mapBlocks[h].AddPayee(GetTestPayee(h % 256), 1);
+    }
+
+    CMasternodeBlockWindow window(10);
+    window.Assign(mapBlocks);
+    BOOST_CHECK(window.capacity() >= 50);
+    BOOST_CHECK_EQUAL(window.size(), 50);
+    for (int h = 100; h < 150; h++)
+        BOOST_CHECK(window.Find(h) && window.Find(h)->nBlockHeight == h);
+
+    // nothing is lost through the cache either
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << mapBlocks;
+    CMasternodeBlockWindow window2(10);
+    ss >> window2;
+    BOOST_CHECK_EQUAL(window2.size(), 50);
+    BOOST_CHECK(window2.Find(100) && window2.Find(149));
+
+    // a stray height far from the others doesn't size the window for the whole span
+    mapBlocks[1000000000] = CMasternodeBlockPayees(1000000000);
+    CMasternodeBlockWindow window3(10);
+    window3.Assign(mapBlocks);
+    BOOST_CHECK_EQUAL(window3.capacity(), (size_t)MNPAYMENTS_WINDOW_MAX_LOAD);
+    BOOST_CHECK(window3.Find(1000000000) && window3.Find(100) && window3.Find(149));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
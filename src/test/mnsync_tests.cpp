@@ -0,0 +1,116 @@
+// Copyright (c) 2021-2022 The Studscoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-sync.h"
+#include "test/test_pivx.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mnsync_tests, BasicTestingSetup)
+
+static const int SYNC_PEERS = 3;
+
+BOOST_AUTO_TEST_CASE(mnsync_asset_peers)
+{
+    CMasternodeSyncAsset asset;
+    BOOST_CHECK(asset.NeedsPeers(SYNC_PEERS));
+    BOOST_CHECK_EQUAL(asset.Check(SYNC_PEERS, 1000), 0);
+
+    asset.Asked(1, 1000);
+    asset.Asked(2, 1001);
+    asset.Asked(2, 1001); // asked twice, counted once
+    BOOST_CHECK_EQUAL(asset.nPeersAsked, 2);
+    BOOST_CHECK_EQUAL(asset.nStarted, 1000);
+    BOOST_CHECK(asset.NeedsPeers(SYNC_PEERS));
+    asset.Asked(3, 1002);
+    BOOST_CHECK(!asset.NeedsPeers(SYNC_PEERS));
+
+    // only the peers asked count, once each
+    BOOST_CHECK(asset.Replied(1));
+    BOOST_CHECK(!asset.Replied(1));
+    BOOST_CHECK(!asset.Replied(4));
+    BOOST_CHECK_EQUAL(asset.nPeersReplied, 1);
+
+    // a peer that replied keeps its slot when it leaves
+    asset.DropPeer(1);
+    BOOST_CHECK_EQUAL(asset.nPeersAsked, 3);
+    BOOST_CHECK(!asset.NeedsPeers(SYNC_PEERS));
+}
+
+BOOST_AUTO_TEST_CASE(mnsync_asset_completion)
+{
+    CMasternodeSyncAsset asset;
+    const int64_t nNow = 1000;
+    for (NodeId id = 1; id <= SYNC_PEERS; id++)
+        asset.Asked(id, nNow);
+    for (NodeId id = 1; id <= SYNC_PEERS; id++) {
+        BOOST_CHECK(asset.Replied(id));
+        asset.nExpected = std::max(asset.nExpected, 10);
+    }
+
+    // some items still missing
+    asset.nItems = 9;
+    asset.nLastItem = nNow + 1;
+    BOOST_CHECK_EQUAL(asset.Check(SYNC_PEERS, nNow + 2), 0);
+
+    // everything arrived: complete once the items had time to be fetched
+    asset.nItems = 10;
+    BOOST_CHECK_EQUAL(asset.Check(SYNC_PEERS, nNow + 1 + MASTERNODE_SYNC_TIMEOUT), 0);
+    BOOST_CHECK_EQUAL(asset.Check(SYNC_PEERS, nNow + 2 + MASTERNODE_SYNC_TIMEOUT), 1);
+
+    // short of the expected count, a quiet period completes it too
+    asset.nItems = 9;
+    BOOST_CHECK_EQUAL(asset.Check(SYNC_PEERS, nNow + 2 + MASTERNODE_SYNC_TIMEOUT), 0);
+    BOOST_CHECK_EQUAL(asset.Check(SYNC_PEERS, nNow + 2 + MASTERNODE_SYNC_TIMEOUT * 2), 1);
+}
+
+BOOST_AUTO_TEST_CASE(mnsync_asset_empty)
+{
+    // the peers have nothing: complete as soon as they all said so
+    CMasternodeSyncAsset asset;
+    asset.Asked(1, 1000);
+    asset.Asked(2, 1000);
+    BOOST_CHECK(asset.Replied(1));
+    BOOST_CHECK_EQUAL(asset.Check(SYNC_PEERS, 1001), 0);
+    BOOST_CHECK(asset.Replied(2));
+    BOOST_CHECK_EQUAL(asset.Check(SYNC_PEERS, 1001), 1);
+
+    // nobody answers: times out
+    CMasternodeSyncAsset assetSilent;
+    assetSilent.Asked(1, 1000);
+    BOOST_CHECK_EQUAL(assetSilent.Check(SYNC_PEERS, 1000 + MASTERNODE_SYNC_TIMEOUT * 5), 0);
+    BOOST_CHECK_EQUAL(assetSilent.Check(SYNC_PEERS, 1001 + MASTERNODE_SYNC_TIMEOUT * 5), -1);
+}
+
+BOOST_AUTO_TEST_CASE(mnsync_asset_peer_dropped)
+{
+    CMasternodeSyncAsset asset;
+    asset.Asked(1, 1000);
+    asset.Asked(2, 1000);
+    asset.Asked(3, 1000);
+    BOOST_CHECK(asset.Replied(1));
+    BOOST_CHECK(asset.Replied(2));
+    asset.nExpected = 5;
+    asset.nItems = 5;
+    asset.nLastItem = 1001;
+
+    // peer 3 never replies: the asset waits for it until the quiet period
+    BOOST_CHECK_EQUAL(asset.Check(SYNC_PEERS, 1002 + MASTERNODE_SYNC_TIMEOUT), 0);
+
+    // once it disconnects its slot is freed for another peer
+    asset.DropPeer(3);
+    BOOST_CHECK_EQUAL(asset.nPeersAsked, 2);
+    BOOST_CHECK(asset.NeedsPeers(SYNC_PEERS));
+    BOOST_CHECK(!asset.Replied(3));
+    BOOST_CHECK_EQUAL(asset.Check(SYNC_PEERS, 1002 + MASTERNODE_SYNC_TIMEOUT), 1);
+
+    // the replacement has to reply as well
+    asset.Asked(4, 1003);
+    BOOST_CHECK_EQUAL(asset.nStarted, 1000);
+    BOOST_CHECK_EQUAL(asset.Check(SYNC_PEERS, 1002 + MASTERNODE_SYNC_TIMEOUT), 0);
+    BOOST_CHECK(asset.Replied(4));
+    BOOST_CHECK_EQUAL(asset.Check(SYNC_PEERS, 1002 + MASTERNODE_SYNC_TIMEOUT), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
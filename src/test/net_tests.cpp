@@ -8,11 +8,14 @@
 #include "hash.h"
 #include "net.h"
 #include "netbase.h"
+#include "netmessagemaker.h"
+#include "netpoller.h"
 #include "serialize.h"
 #include "streams.h"
 
 #include "test/test_pivx.h"
 
+#include <condition_variable>
 #include <string>
 
 #include <boost/test/unit_test.hpp>
@@ -177,4 +180,216 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(pooled_recv_buffers)
+{
+    CConnman connman(0x1337, 0x1337);
+    std::vector<unsigned char> vchPayload(300 * 1024, 0x42);
+    CSharedNetMsg shared = connman.ShareMessage(CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::BLOCK, vchPayload));
+
+    const CRecvBufferPoolStats statsBefore = GetRecvBufferPool().GetStats();
+    for (int i = 0; i < 2; i++) {
+        CNetMessage msg(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+        BOOST_CHECK_EQUAL(msg.readHeader((const char*)shared.header->data(), shared.header->size()), (int)CMessageHeader::HEADER_SIZE);
+        BOOST_CHECK(msg.in_data);
+
+        // the first chunk already gets room for the whole block
+        const char* pchPayload = (const char*)shared.payload->data();
+        BOOST_CHECK_EQUAL(msg.readData(pchPayload, 1000), 1000);
+        BOOST_CHECK(!msg.complete());
+        BOOST_CHECK(msg.vRecv.capacity() >= shared.PayloadSize());
+        BOOST_CHECK_EQUAL(msg.readData(pchPayload + 1000, shared.PayloadSize() - 1000), (int)shared.PayloadSize() - 1000);
+        BOOST_CHECK(msg.complete());
+        BOOST_CHECK(std::equal(shared.payload->begin(), shared.payload->end(), (unsigned char*)&msg.vRecv[0]));
+        // once processed, the buffer goes back to the pool for the next one
+    }
+    const CRecvBufferPoolStats statsAfter = GetRecvBufferPool().GetStats();
+    BOOST_CHECK(statsAfter.nHits > statsBefore.nHits);
+    BOOST_CHECK(statsAfter.nBytesReused >= statsBefore.nBytesReused + shared.PayloadSize());
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(shared_send_buffers)
+{
+    CConnman connman(0x1337, 0x1337);
+    CAddress addr(LookupNumeric("127.0.0.1", 7777), NODE_NETWORK);
+    int fds[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    CNode* pnodeIdle = new CNode(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, "", true);
+    CNode* pnodeConnected = new CNode(1, NODE_NETWORK, 0, fds[0], addr, 1, 1, "", true);
+
+    std::vector<unsigned char> vchPayload(1000, 0x42);
+    CSharedNetMsg msg = connman.ShareMessage(CNetMsgMaker(PROTOCOL_VERSION).Make("test", vchPayload));
+    BOOST_CHECK_EQUAL(msg.header->size(), CMessageHeader::HEADER_SIZE);
+    const size_t nMessageSize = CMessageHeader::HEADER_SIZE + msg.PayloadSize();
+
+    // queued by reference, not copied
+    connman.PushMessage(pnodeIdle, msg);
+    BOOST_CHECK_EQUAL(pnodeIdle->vSendMsg.size(), 2);
+    BOOST_CHECK(pnodeIdle->vSendMsg[1] == msg.payload);
+    BOOST_CHECK_EQUAL(pnodeIdle->nSendSize, nMessageSize);
+
+    // the header and the payload leave in one go
+    connman.PushMessage(pnodeConnected, msg);
+    BOOST_CHECK(pnodeConnected->vSendMsg.empty());
+    BOOST_CHECK_EQUAL(pnodeConnected->nSendSize, 0);
+    std::vector<unsigned char> vchReceived(nMessageSize + 1);
+    BOOST_CHECK_EQUAL(recv(fds[1], vchReceived.data(), vchReceived.size(), MSG_DONTWAIT), (ssize_t)nMessageSize);
+    BOOST_CHECK(std::equal(msg.header->begin(), msg.header->end(), vchReceived.begin()));
+    BOOST_CHECK(std::equal(msg.payload->begin(), msg.payload->end(), vchReceived.begin() + CMessageHeader::HEADER_SIZE));
+
+    delete pnodeIdle;
+    delete pnodeConnected;
+    close(fds[1]);
+}
+
+static bool HasPollerEvent(const std::vector<CSocketPoller::Event>& vEvents, SOCKET hSocket, bool fRecv)
+{
+    for (const CSocketPoller::Event& event : vEvents) {
+        if (event.hSocket == hSocket && (fRecv ? event.fRecv : event.fSend))
+            return true;
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(socket_poller)
+{
+    std::vector<std::string> vModes = {"select"};
+    if (IsSocketEventsModeSupported("epoll"))
+        vModes.push_back("epoll");
+    BOOST_CHECK(!IsSocketEventsModeSupported("kqueue"));
+
+    for (const std::string& strMode : vModes) {
+        int fds[2];
+        BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        std::unique_ptr<CSocketPoller> poller = MakeSocketPoller(strMode);
+        BOOST_CHECK_EQUAL(poller->Name(), strMode);
+        BOOST_CHECK(poller->Add(fds[0], false));
+
+        std::vector<CSocketPoller::Event> vEvents;
+        // nothing to read yet
+        poller->SetInterest(fds[0], true, false);
+        BOOST_CHECK(poller->Wait(0, vEvents));
+        BOOST_CHECK(!HasPollerEvent(vEvents, fds[0], true));
+
+        char pchBuf[4] = {'a', 'b', 'c', 'd'};
+        BOOST_CHECK_EQUAL(send(fds[1], pchBuf, sizeof(pchBuf), 0), (ssize_t)sizeof(pchBuf));
+        poller->SetInterest(fds[0], true, false);
+        BOOST_CHECK(poller->Wait(1000, vEvents));
+        BOOST_CHECK(HasPollerEvent(vEvents, fds[0], true));
+
+        // level-triggered pollers keep reporting unread data, edge-triggered ones only new data
+        poller->SetInterest(fds[0], true, false);
+        BOOST_CHECK(poller->Wait(0, vEvents));
+        BOOST_CHECK_EQUAL(HasPollerEvent(vEvents, fds[0], true), !poller->IsEdgeTriggered());
+
+        // an emptied socket is only reported again on new data
+        BOOST_CHECK_EQUAL(recv(fds[0], pchBuf, sizeof(pchBuf), 0), (ssize_t)sizeof(pchBuf));
+        BOOST_CHECK_EQUAL(send(fds[1], pchBuf, 1, 0), 1);
+        poller->SetInterest(fds[0], true, false);
+        BOOST_CHECK(poller->Wait(1000, vEvents));
+        BOOST_CHECK(HasPollerEvent(vEvents, fds[0], true));
+
+        // no longer watched
+        poller->Remove(fds[0]);
+        BOOST_CHECK(poller->Wait(0, vEvents));
+        BOOST_CHECK(!HasPollerEvent(vEvents, fds[0], true));
+
+        close(fds[0]);
+        close(fds[1]);
+    }
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(message_workers_fair_queues)
+{
+    CAddress addr(LookupNumeric("127.0.0.1", 7777), NODE_NETWORK);
+    CNode* pnodeFlood = new CNode(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, "", true);
+    CNode* pnodeOther = new CNode(1, NODE_NETWORK, 0, INVALID_SOCKET, addr, 1, 1, "", true);
+
+    CMessageWorkerPool idle;
+    CDataStream ssIdle(SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK(!idle.Enqueue(pnodeOther, NetMsgType::SPORK, ssIdle));
+
+    // the worker holds on to the first message until every other one is queued
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool fGo = false;
+    std::vector<std::pair<NodeId, int> > vHandled;
+    CMessageWorkerPool workers;
+    workers.Start(1, 100, [&](CNode* pnode, const std::string& strCommand, CDataStream& vRecv) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&] { return fGo; });
+        int n;
+        vRecv >> n;
+        vHandled.emplace_back(pnode->GetId(), n);
+        cond.notify_all();
+    });
+    for (int i = 0; i < 4; i++) {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << i;
+        BOOST_CHECK(workers.Enqueue(pnodeFlood, NetMsgType::MNPING, ss));
+    }
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << 100;
+    BOOST_CHECK(workers.Enqueue(pnodeOther, NetMsgType::SPORK, ss));
+    // the queued messages count towards the receive flood size
+    BOOST_CHECK(pnodeFlood->fPauseRecv);
+    BOOST_CHECK(!pnodeOther->fPauseRecv);
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        fGo = true;
+        cond.notify_all();
+        cond.wait(lock, [&] { return vHandled.size() == 5; });
+    }
+    workers.Stop();
+
+    // the other peer doesn't wait behind the whole flood, each peer's messages stay in order
+    std::vector<std::pair<NodeId, int> > vExpected = {{0, 0}, {1, 100}, {0, 1}, {0, 2}, {0, 3}};
+    BOOST_CHECK(vHandled == vExpected);
+    BOOST_CHECK(!pnodeFlood->fPauseRecv);
+    BOOST_CHECK_EQUAL(pnodeFlood->nProcessQueueSize, 0U);
+    BOOST_CHECK_EQUAL(pnodeFlood->GetRefCount(), 0);
+    BOOST_CHECK_EQUAL(workers.GetQueueSize(), 0U);
+
+    std::map<std::string, CMessageWorkerStats> mapStats = workers.GetStats();
+    BOOST_CHECK_EQUAL(mapStats[NetMsgType::MNPING].nMessages, 4U);
+    BOOST_CHECK_EQUAL(mapStats[NetMsgType::SPORK].nMessages, 1U);
+    BOOST_CHECK(mapStats[NetMsgType::MNPING].nMaxWait >= mapStats[NetMsgType::MNPING].nTotalWait / 4);
+
+    delete pnodeFlood;
+    delete pnodeOther;
+}
+
+BOOST_AUTO_TEST_CASE(message_process_time_stats)
+{
+    CConnman connman(0x1337, 0x1337);
+    CAddress addr(LookupNumeric("127.0.0.1", 7777), NODE_NETWORK);
+    CNode* pnode = new CNode(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, "", true);
+
+    connman.RecordMessageProcessed(pnode, NetMsgType::INV, 5);
+    connman.RecordMessageProcessed(pnode, NetMsgType::INV, 1500);
+    connman.RecordMessageProcessed(pnode, NetMsgType::INV, 5000000);
+    // unknown commands share a single entry
+    connman.RecordMessageProcessed(pnode, "bogus", 20);
+
+    mapMsgCmdStats mapStats = connman.GetMsgCmdStats();
+    BOOST_CHECK(!mapStats.count("bogus"));
+    const CMsgCmdStats& inv = mapStats[NetMsgType::INV];
+    BOOST_CHECK_EQUAL(inv.nProcessed, 3U);
+    BOOST_CHECK_EQUAL(inv.nProcessTime, 5001505);
+    BOOST_CHECK_EQUAL(inv.nProcessTimeMax, 5000000);
+    BOOST_CHECK_EQUAL(inv.vProcessTimeHist[0], 1U);
+    BOOST_CHECK_EQUAL(inv.vProcessTimeHist[3], 1U);
+    BOOST_CHECK_EQUAL(inv.vProcessTimeHist[MSG_PROCESS_TIME_BUCKET_COUNT - 1], 1U);
+    BOOST_CHECK_EQUAL(mapStats["*other*"].nProcessed, 1U);
+
+    CNodeStats stats;
+    pnode->copyStats(stats);
+    BOOST_CHECK_EQUAL(stats.mapProcessTimePerMsgCmd[NetMsgType::INV], 5001505U);
+    BOOST_CHECK_EQUAL(stats.mapProcessTimePerMsgCmd["*other*"], 20U);
+
+    delete pnode;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
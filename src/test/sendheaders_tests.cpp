@@ -0,0 +1,189 @@
+// Copyright (c) 2021-2022 The Studscoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "checkpoints.h"
+#include "main.h"
+#include "net.h"
+#include "netmessagemaker.h"
+#include "random.h"
+
+#include "test/test_pivx.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sendheaders_tests, TestingSetup)
+
+// A chain of nBlocks blocks, the index entries are owned by the caller
+static void BuildChain(std::vector<uint256>& vHashes, std::vector<CBlockIndex>& vBlocks, CChain& chain, int nBlocks)
+{
+    vHashes.resize(nBlocks);
+    vBlocks.resize(nBlocks);
+    for (int i = 0; i < nBlocks; i++) {
+        vHashes[i] = GetRandHash();
+        vBlocks[i].phashBlock = &vHashes[i];
+        vBlocks[i].nHeight = i;
+        vBlocks[i].pprev = i ? &vBlocks[i - 1] : NULL;
+        vBlocks[i].BuildSkip();
+    }
+    chain.SetTip(&vBlocks.back());
+}
+
+static std::vector<CBlockIndex*> Range(std::vector<CBlockIndex>& vBlocks, int nFirst, int nLast)
+{
+    std::vector<CBlockIndex*> vRange;
+    for (int i = nFirst; i <= nLast; i++)
+        vRange.push_back(&vBlocks[i]);
+    return vRange;
+}
+
+BOOST_AUTO_TEST_CASE(sendheaders_find_headers)
+{
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vBlocks;
+    CChain chain;
+    BuildChain(vHashes, vBlocks, chain, 30);
+
+    // the peer knows the parent of the first new block: all of them go as headers
+    std::vector<CBlockIndex*> vHeaders;
+    BOOST_CHECK(FindHeadersToAnnounce(chain, Range(vBlocks, 11, 13), &vBlocks[10], NULL, vHeaders));
+    BOOST_CHECK(vHeaders == Range(vBlocks, 11, 13));
+
+    // the headers already sent are skipped
+    vHeaders.clear();
+    BOOST_CHECK(FindHeadersToAnnounce(chain, Range(vBlocks, 11, 13), &vBlocks[5], &vBlocks[11], vHeaders));
+    BOOST_CHECK(vHeaders == Range(vBlocks, 12, 13));
+
+    // nothing left to announce
+    vHeaders.clear();
+    BOOST_CHECK(FindHeadersToAnnounce(chain, Range(vBlocks, 11, 13), &vBlocks[20], NULL, vHeaders));
+    BOOST_CHECK(vHeaders.empty());
+
+    // the headers wouldn't connect to what the peer knows: inv
+    vHeaders.clear();
+    BOOST_CHECK(!FindHeadersToAnnounce(chain, Range(vBlocks, 11, 13), &vBlocks[5], NULL, vHeaders));
+    BOOST_CHECK(!FindHeadersToAnnounce(chain, Range(vBlocks, 11, 13), NULL, NULL, vHeaders));
+
+    // blocks that don't connect to each other: inv
+    std::vector<CBlockIndex*> vGap = Range(vBlocks, 11, 12);
+    vGap.push_back(&vBlocks[14]);
+    BOOST_CHECK(!FindHeadersToAnnounce(chain, vGap, &vBlocks[10], NULL, vHeaders));
+
+    // a block we reorged away from: inv
+    uint256 hashFork = GetRandHash();
+    CBlockIndex indexFork;
+    indexFork.phashBlock = &hashFork;
+    indexFork.nHeight = 11;
+    indexFork.pprev = &vBlocks[10];
+    BOOST_CHECK(!FindHeadersToAnnounce(chain, std::vector<CBlockIndex*>(1, &indexFork), &vBlocks[10], NULL, vHeaders));
+
+    // up to MAX_BLOCKS_TO_ANNOUNCE blocks go as headers, more are announced with an inv of the tip
+    vHeaders.clear();
+    BOOST_CHECK(FindHeadersToAnnounce(chain, Range(vBlocks, 11, 10 + MAX_BLOCKS_TO_ANNOUNCE), &vBlocks[10], NULL, vHeaders));
+    BOOST_CHECK_EQUAL(vHeaders.size(), MAX_BLOCKS_TO_ANNOUNCE);
+    vHeaders.clear();
+    BOOST_CHECK(!FindHeadersToAnnounce(chain, Range(vBlocks, 11, 11 + MAX_BLOCKS_TO_ANNOUNCE), &vBlocks[10], NULL, vHeaders));
+}
+
+BOOST_AUTO_TEST_CASE(sendheaders_push_block_hash)
+{
+    CAddress addr(CService(CNetAddr(), Params().GetDefaultPort()), NODE_NONE);
+    CNode node(1100, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, "", true);
+    std::vector<uint256> vHashes;
+    for (unsigned int i = 0; i < MAX_BLOCKS_TO_ANNOUNCE; i++) {
+        vHashes.push_back(GetRandHash());
+        node.PushBlockHash(vHashes.back());
+    }
+    // queued in the order the blocks were connected
+    LOCK(node.cs_inventory);
+    BOOST_CHECK(node.vBlockHashesToAnnounce == vHashes);
+}
+
+static std::vector<CBlock> BuildHeaders(int nCount, bool fContinuous)
+{
+    std::vector<CBlock> vHeaders(nCount);
+    uint256 hashPrev = GetRandHash();
+    for (CBlock& header : vHeaders) {
+        header.nVersion = 4;
+        header.hashPrevBlock = fContinuous ? hashPrev : GetRandHash();
+        header.nTime = 1;
+        hashPrev = header.GetHash();
+    }
+    return vHeaders;
+}
+
+BOOST_AUTO_TEST_CASE(sendheaders_headers_handler)
+{
+    std::atomic<bool> interruptDummy(false);
+    std::unique_ptr<CNode> pnode = ConnectTestNode(1101, *connman);
+    CNode& node = *pnode;
+    CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+
+    // headers that don't connect to our chain are synced with getblocks, not punished
+    ReceiveMessage(node, msgMaker.Make(NetMsgType::HEADERS, BuildHeaders(3, true)));
+    ProcessMessages(&node, *connman, interruptDummy);
+    BOOST_CHECK_EQUAL(GetMisbehavior(node.GetId()), 0);
+
+    // a broken sequence is
+    ReceiveMessage(node, msgMaker.Make(NetMsgType::HEADERS, BuildHeaders(3, false)));
+    ProcessMessages(&node, *connman, interruptDummy);
+    BOOST_CHECK_EQUAL(GetMisbehavior(node.GetId()), 20);
+
+    // and so are too many headers
+    ReceiveMessage(node, msgMaker.Make(NetMsgType::HEADERS, BuildHeaders(MAX_HEADERS_RESULTS + 1, true)));
+    ProcessMessages(&node, *connman, interruptDummy);
+    BOOST_CHECK_EQUAL(GetMisbehavior(node.GetId()), 40);
+
+    DisconnectTestNode(node);
+}
+
+BOOST_AUTO_TEST_CASE(sendheaders_headers_in_flight)
+{
+    std::atomic<bool> interruptDummy(false);
+    std::unique_ptr<CNode> pnode = ConnectTestNode(1102, *connman);
+    CNode& node = *pnode;
+    CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+
+    // announced blocks are only fetched outside of the initial download, which is
+    // never entered again once left
+    const bool fCheckpointsEnabled = Checkpoints::fEnabled;
+    const int64_t nMaxTipAgeOld = nMaxTipAge;
+    Checkpoints::fEnabled = false;
+    nMaxTipAge = std::numeric_limits<int64_t>::max() / 2;
+    BOOST_CHECK(!IsInitialBlockDownload());
+
+    ReceiveMessage(node, msgMaker.Make(NetMsgType::SENDCMPCT, false, CMPCTBLOCKS_VERSION));
+    ProcessMessages(&node, *connman, interruptDummy);
+
+    std::vector<CBlock> vHeaders = BuildHeaders(2, true);
+    vHeaders[0].hashPrevBlock = chainActive.Tip()->GetBlockHash();
+    vHeaders[1].hashPrevBlock = vHeaders[0].GetHash();
+    const uint256 hashFirst = vHeaders[0].GetHash();
+
+    ReceiveMessage(node, msgMaker.Make(NetMsgType::HEADERS, std::vector<CBlock>(1, vHeaders[0])));
+    ProcessMessages(&node, *connman, interruptDummy);
+    CNodeStateStats stats;
+    BOOST_CHECK(GetNodeStateStats(node.GetId(), stats));
+    BOOST_CHECK_EQUAL(stats.nBlocksInFlight, 1);
+
+    // the first one is still in flight: only the second is asked for, and its unknown parent
+    // must not end up in the block index
+    ReceiveMessage(node, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+    ProcessMessages(&node, *connman, interruptDummy);
+    BOOST_CHECK(GetNodeStateStats(node.GetId(), stats));
+    BOOST_CHECK_EQUAL(stats.nBlocksInFlight, 2);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(!mapBlockIndex.count(hashFirst));
+    }
+
+    Checkpoints::fEnabled = fCheckpointsEnabled;
+    nMaxTipAge = nMaxTipAgeOld;
+
+    DisconnectTestNode(node);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
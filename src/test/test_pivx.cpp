@@ -8,7 +8,11 @@
 
 #include "test_pivx.h"
 
+#include "chainparams.h"
+#include "consensus/zerocoin_verify.h"
+#include "hash.h"
 #include "main.h"
+#include "net.h"
 #include "random.h"
 #include "script/sigcache.h"
 #include "txdb.h"
@@ -32,6 +36,7 @@ BasicTestingSetup::BasicTestingSetup()
         ECC_Start();
         SetupEnvironment();
         InitSignatureCache();
+        InitZerocoinSpendCache();
         fCheckBlockIndex = true;
         SelectParams(CBaseChainParams::MAIN);
 }
@@ -57,8 +62,11 @@ TestingSetup::TestingSetup()
             BOOST_CHECK(ok);
         }
         nScriptCheckThreads = 3;
-        for (int i=0; i < nScriptCheckThreads-1; i++)
+        for (int i=0; i < nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            if (ZerocoinSpendsPossible())
+                threadGroup.create_thread(&ThreadZerocoinCheck);
+        }
         g_connman = std::unique_ptr<CConnman>(new CConnman(0x1337, 0x1337)); // Deterministic randomness for tests.
         connman = g_connman.get();
         RegisterNodeSignals(GetNodeSignals());
@@ -76,6 +84,46 @@ TestingSetup::~TestingSetup()
         fs::remove_all(pathTemp);
 }
 
+void ReceiveMessage(CNode& node, CSerializedNetMsg&& msg)
+{
+    CNetMessage netmsg(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION);
+    netmsg.hdr = CMessageHeader(Params().MessageStart(), msg.command.c_str(), msg.data.size());
+    uint256 hash = Hash(msg.data.begin(), msg.data.end());
+    memcpy(netmsg.hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    netmsg.vRecv.write((const char*)msg.data.data(), msg.data.size());
+    netmsg.in_data = true;
+    netmsg.nDataPos = msg.data.size();
+
+    LOCK(node.cs_vProcessMsg);
+    node.nProcessQueueSize += msg.data.size() + CMessageHeader::HEADER_SIZE;
+    node.vProcessMsg.push_back(std::move(netmsg));
+}
+
+std::unique_ptr<CNode> ConnectTestNode(NodeId id, CConnman& connman, bool fInbound)
+{
+    CAddress addr(CService(CNetAddr(), Params().GetDefaultPort()), NODE_NONE);
+    std::unique_ptr<CNode> pnode(new CNode(id, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, "", fInbound));
+    pnode->SetSendVersion(PROTOCOL_VERSION);
+    pnode->SetRecvVersion(PROTOCOL_VERSION);
+    GetNodeSignals().InitializeNode(pnode.get(), connman);
+    pnode->nVersion = PROTOCOL_VERSION;
+    pnode->fSuccessfullyConnected = true;
+    return pnode;
+}
+
+void DisconnectTestNode(CNode& node)
+{
+    bool fUpdateConnectionTime = false;
+    GetNodeSignals().FinalizeNode(node.GetId(), fUpdateConnectionTime);
+}
+
+int GetMisbehavior(NodeId nodeid)
+{
+    CNodeStateStats stats;
+    BOOST_CHECK(GetNodeStateStats(nodeid, stats));
+    return stats.nMisbehavior;
+}
+
 CTxMemPoolEntry TestMemPoolEntryHelper::FromTx(CMutableTransaction &tx, CTxMemPool *pool) {
     CTransaction txn(tx);
     bool hasNoDependencies = pool ? pool->HasNoInputsOf(tx) : hadNoDependencies;
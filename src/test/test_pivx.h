@@ -7,8 +7,11 @@
 #define PIVX_TEST_TEST_PIVX_H
 
 #include "fs.h"
+#include "net.h"
 #include "txdb.h"
 
+#include <memory>
+
 #include <boost/thread.hpp>
 
 extern uint256 insecure_rand_seed;
@@ -55,6 +58,14 @@ struct TestingSetup: public BasicTestingSetup {
     ~TestingSetup();
 };
 
+/** Queue a message as if it had been received from the peer */
+void ReceiveMessage(CNode& node, CSerializedNetMsg&& msg);
+/** A peer done with the version handshake, to feed messages to. Remove it with DisconnectTestNode */
+std::unique_ptr<CNode> ConnectTestNode(NodeId id, CConnman& connman, bool fInbound = true);
+void DisconnectTestNode(CNode& node);
+/** The misbehavior score of a connected peer */
+int GetMisbehavior(NodeId nodeid);
+
 class CTxMemPoolEntry;
 class CTxMemPool;
 
@@ -88,4 +88,25 @@ BOOST_AUTO_TEST_CASE(bignum_random_generation_tests)
     }
 }
 
+BOOST_AUTO_TEST_CASE(bignum_fixed_base_tests)
+{
+    CBigNum modulus;
+    modulus.SetHex(strHexModulus);
+    const CBigNum base = CBigNum::randBignum(modulus);
+
+    for (unsigned int nWindow = 1; nWindow <= 8; nWindow += 3) {
+        CBigNumFixedBase table(base, modulus, 256, nWindow);
+        BOOST_CHECK(table.pow_mod(BN_ZERO) == BN_ONE);
+        BOOST_CHECK(table.pow_mod(BN_ONE) == base);
+        for (int i = 0; i < 20; i++) {
+            const CBigNum e = CBigNum::randKBitBignum(1 + GetRand(256));
+            BOOST_CHECK(table.pow_mod(e) == base.pow_mod(e, modulus));
+            BOOST_CHECK(table.pow_mod(-e) == base.pow_mod(-e, modulus));
+        }
+        // wider than the table
+        const CBigNum e = CBigNum::randKBitBignum(512);
+        BOOST_CHECK(table.pow_mod(e) == base.pow_mod(e, modulus));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,226 @@
+// Copyright (c) 2021-2022 The Studscoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "main.h"
+#include "random.h"
+#include "test/test_pivx.h"
+#include "txdb.h"
+#include "uint256.h"
+#include "zpiv/zerocoin.h"
+#include "zpiv/zpivmodule.h"
+#include "zpivchain.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(zerocoindb_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(zerocoindb_key_filter)
+{
+    CZerocoinKeyFilter filter;
+    // an unloaded filter rules nothing out
+    BOOST_CHECK(filter.MayContain(GetRandHash()));
+
+    filter.Reset(0);
+    BOOST_CHECK_EQUAL(filter.GetMaxKeys(), ZC_KEY_FILTER_MIN_KEYS);
+
+    std::vector<uint256> vHashes;
+    for (size_t i = 0; i < ZC_KEY_FILTER_MIN_KEYS; i++) {
+        vHashes.push_back(GetRandHash());
+        filter.Insert(vHashes.back());
+    }
+    BOOST_CHECK_EQUAL(filter.GetKeys(), ZC_KEY_FILTER_MIN_KEYS);
+
+    // no false negatives
+    for (const uint256& hash : vHashes)
+        BOOST_CHECK(filter.MayContain(hash));
+
+    // few false positives when full
+    int nFalsePositives = 0;
+    for (int i = 0; i < 10000; i++)
+        nFalsePositives += filter.MayContain(GetRandHash());
+    BOOST_CHECK(nFalsePositives < 200);
+
+    filter.Reset(0);
+    BOOST_CHECK_EQUAL(filter.GetKeys(), 0);
+    BOOST_CHECK(!filter.MayContain(vHashes.front()));
+}
+
+BOOST_AUTO_TEST_CASE(zerocoindb_filtered_reads)
+{
+    CZerocoinDB db(0, true, true);
+    uint256 hashTx;
+    BOOST_CHECK(!db.ReadCoinSpend(GetRandHash(), hashTx));
+    BOOST_CHECK(!db.ReadCoinMint(GetRandHash(), hashTx));
+
+    zerocoinfilter_stats spends, mints;
+    db.GetKeyFilterStats(spends, mints);
+    BOOST_CHECK_EQUAL(spends.nLookups, 1U);
+    BOOST_CHECK_EQUAL(mints.nLookups, 1U);
+    BOOST_CHECK_EQUAL(spends.nFiltered + spends.nFalsePositives, 1U);
+    BOOST_CHECK_EQUAL(mints.nFiltered + mints.nFalsePositives, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(zerocoindb_read_mint_batch)
+{
+    CZerocoinDB db(0, true, true);
+    libzerocoin::ZerocoinParams* params = Params().GetConsensus().Zerocoin_Params(false);
+
+    std::vector<std::pair<libzerocoin::PublicCoin, uint256> > vMints;
+    std::map<uint256, uint256> mapWritten;
+    for (int i = 0; i < 10; i++) {
+        CBigNum bnValue = CBigNum(GetRandHash()) + i;
+        const uint256 hashTx = GetRandHash();
+        vMints.emplace_back(libzerocoin::PublicCoin(params, bnValue, libzerocoin::ZQ_ONE), hashTx);
+        mapWritten[GetPubCoinHash(bnValue)] = hashTx;
+    }
+    BOOST_CHECK(db.WriteCoinMintBatch(vMints));
+
+    // the written mints among random pubcoin hashes
+    std::vector<uint256> vHashes;
+    for (const auto& it : mapWritten) {
+        vHashes.push_back(it.first);
+        vHashes.push_back(GetRandHash());
+    }
+    std::vector<std::pair<uint256, uint256> > vFound;
+    db.ReadCoinMintBatch(vHashes, vFound);
+    BOOST_CHECK_EQUAL(vFound.size(), mapWritten.size());
+    for (const auto& it : vFound) {
+        BOOST_CHECK(mapWritten.count(it.first));
+        BOOST_CHECK(mapWritten[it.first] == it.second);
+    }
+
+    // every hash of the batch counts as one lookup
+    zerocoinfilter_stats spends, mints;
+    db.GetKeyFilterStats(spends, mints);
+    BOOST_CHECK_EQUAL(mints.nLookups, vHashes.size());
+    BOOST_CHECK_EQUAL(mints.nFiltered + mints.nFalsePositives, vHashes.size() - mapWritten.size());
+
+    // found entries are appended
+    db.ReadCoinMintBatch(std::vector<uint256>(1, vHashes.front()), vFound);
+    BOOST_CHECK_EQUAL(vFound.size(), mapWritten.size() + 1);
+}
+
+BOOST_AUTO_TEST_CASE(zerocoindb_reindex)
+{
+    CZerocoinDB db(0, true, true);
+    libzerocoin::ZerocoinParams* params = Params().GetConsensus().Zerocoin_Params(false);
+
+    std::vector<std::pair<libzerocoin::PublicCoin, uint256> > vMints;
+    for (int i = 0; i < 10; i++)
+        vMints.emplace_back(libzerocoin::PublicCoin(params, CBigNum(GetRandHash()) + i, libzerocoin::ZQ_ONE), GetRandHash());
+    BOOST_CHECK(db.WriteCoinMintBatch(vMints));
+    for (auto& denom : libzerocoin::zerocoinDenomList)
+        mapZerocoinSupply[denom] = 1;
+
+    // zerocoin never activates on main: no block is read, the DB is wiped and the supply reset
+    CZerocoinDB* zerocoinDBOld = zerocoinDB;
+    zerocoinDB = &db;
+    BOOST_CHECK_EQUAL(ReindexZerocoinDB(), "");
+    zerocoinDB = zerocoinDBOld;
+
+    uint256 hashTx;
+    for (const auto& it : vMints)
+        BOOST_CHECK(!db.ReadCoinMint(it.first.getValue(), hashTx));
+    BOOST_CHECK_EQUAL(mapZerocoinSupply.size(), libzerocoin::zerocoinDenomList.size());
+    for (const auto& it : mapZerocoinSupply)
+        BOOST_CHECK_EQUAL(it.second, 0);
+}
+
+static CMutableTransaction MintTx(const CBigNum& bnValue)
+{
+    CMutableTransaction tx;
+    CScript script = CScript() << OP_ZEROCOINMINT << bnValue.getvch().size() << bnValue.getvch();
+    tx.vout.push_back(CTxOut(libzerocoin::ZerocoinDenominationToAmount(libzerocoin::ZQ_ONE), script));
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(zerocoindb_reindex_blocks)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const Consensus::Params& consensus = Params().GetConsensus();
+    const int nZerocoinStart = consensus.vUpgrades[Consensus::UPGRADE_ZC].nActivationHeight;
+
+    // a v2 coin minted right away and spent publicly past the first windows
+    libzerocoin::PrivateCoin privCoin(consensus.Zerocoin_Params(false), libzerocoin::ZQ_ONE, true);
+    CPrivKey privKey = privCoin.getPrivKey();
+    CZerocoinMint mint(libzerocoin::ZQ_ONE, privCoin.getPublicCoin().getValue(), privCoin.getRandomness(),
+                       privCoin.getSerialNumber(), false, privCoin.getVersion(), &privKey);
+    CMutableTransaction txMint = MintTx(privCoin.getPublicCoin().getValue());
+    mint.SetTxHash(txMint.GetHash());
+    mint.SetOutputIndex(0);
+    CMutableTransaction txSpend;
+    txSpend.vout.push_back(CTxOut(CENT, CScript() << OP_TRUE));
+    CTxIn in;
+    BOOST_CHECK(ZPIVModule::createInput(in, mint, txSpend.GetHash(), 4));
+    txSpend.vin.push_back(in);
+    // the mint a public spend spends is looked up like any transaction
+    TestMemPoolEntryHelper entry;
+    mempool.addUnchecked(txMint.GetHash(), entry.FromTx(txMint));
+
+    // more blocks than fit the window of the workers, each zerocoin block with another mint
+    const int nHeightMint = nZerocoinStart + 5;
+    const int nHeightSpend = nZerocoinStart + 2 * ZC_REINDEX_WINDOW + 10;
+    const int nBlocks = nZerocoinStart + 3 * ZC_REINDEX_WINDOW;
+    std::map<uint256, uint256> mapMints;
+    mapMints[GetPubCoinHash(privCoin.getPublicCoin().getValue())] = txMint.GetHash();
+    std::vector<uint256> vHashes(nBlocks);
+    std::vector<CBlockIndex> vIndex(nBlocks);
+    CDiskBlockPos pos(100, 0);
+    for (int i = 0; i < nBlocks; i++) {
+        CBlock block;
+        block.nTime = i;
+        block.hashPrevBlock = i ? vHashes[i - 1] : UINT256_ZERO;
+        if (i == nHeightMint) {
+            block.vtx.push_back(txMint);
+        } else if (i == nHeightSpend) {
+            block.vtx.push_back(txSpend);
+        } else if (i >= nZerocoinStart) {
+            CBigNum bnValue(GetRandHash());
+            CMutableTransaction tx = MintTx(bnValue);
+            block.vtx.push_back(tx);
+            mapMints[GetPubCoinHash(bnValue)] = tx.GetHash();
+        }
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+        BOOST_CHECK(WriteBlockToDisk(block, pos));
+
+        vHashes[i] = block.GetHash();
+        vIndex[i].phashBlock = &vHashes[i];
+        vIndex[i].nHeight = i;
+        vIndex[i].pprev = i ? &vIndex[i - 1] : NULL;
+        vIndex[i].nFile = pos.nFile;
+        vIndex[i].nDataPos = pos.nPos;
+        vIndex[i].nStatus |= BLOCK_HAVE_DATA;
+        pos.nPos += ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+    }
+
+    CZerocoinDB db(0, true, true);
+    CZerocoinDB* zerocoinDBOld = zerocoinDB;
+    zerocoinDB = &db;
+    CBlockIndex* pindexTipOld;
+    {
+        LOCK(cs_main);
+        pindexTipOld = chainActive.Tip();
+        chainActive.SetTip(&vIndex.back());
+    }
+    BOOST_CHECK_EQUAL(ReindexZerocoinDB(), "");
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(pindexTipOld);
+    }
+    zerocoinDB = zerocoinDBOld;
+    mempool.clear();
+    SelectParams(CBaseChainParams::MAIN);
+
+    uint256 hashTx;
+    for (const auto& it : mapMints) {
+        BOOST_CHECK(db.ReadCoinMint(it.first, hashTx));
+        BOOST_CHECK(hashTx == it.second);
+    }
+    BOOST_CHECK(db.ReadCoinSpend(privCoin.getSerialNumber(), hashTx));
+    BOOST_CHECK(hashTx == txSpend.GetHash());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -310,23 +310,155 @@ bool CBlockTreeDB::ReadLegacyBlockIndex(const uint256& blockHash, CLegacyBlockIn
     return Read(std::make_pair(DB_BLOCK_INDEX, blockHash), biRet);
 }
 
+uint64_t CZerocoinKeyFilter::BlockMask(const uint256& hash, size_t& nBlock) const
+{
+    // the key hashes are uniform: the first word picks the block, the second the bits in it
+    const uint64_t nWord0 = hash.GetUint64(0);
+    const uint64_t nWord1 = hash.GetUint64(1);
+    nBlock = nWord0 % vBlocks.size();
+    uint64_t nMask = 0;
+    for (int i = 0; i < 4; i++)
+        nMask |= (uint64_t)1 << ((nWord1 >> (6 * i)) & 63);
+    return nMask;
+}
+
+void CZerocoinKeyFilter::Reset(size_t nMaxKeysIn)
+{
+    nMaxKeys = std::max(nMaxKeysIn, ZC_KEY_FILTER_MIN_KEYS);
+    nKeys = 0;
+    vBlocks.assign(nMaxKeys, 0);
+}
+
+void CZerocoinKeyFilter::Insert(const uint256& hash)
+{
+    if (vBlocks.empty())
+        return;
+    size_t nBlock;
+    const uint64_t nMask = BlockMask(hash, nBlock);
+    vBlocks[nBlock] |= nMask;
+    nKeys++;
+}
+
+bool CZerocoinKeyFilter::MayContain(const uint256& hash) const
+{
+    // not loaded: everything may be there
+    if (vBlocks.empty())
+        return true;
+    size_t nBlock;
+    const uint64_t nMask = BlockMask(hash, nBlock);
+    return (vBlocks[nBlock] & nMask) == nMask;
+}
+
 CZerocoinDB::CZerocoinDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "zerocoin", nCacheSize, fMemory, fWipe)
 {
+    memset(&statsSpends, 0, sizeof(statsSpends));
+    memset(&statsMints, 0, sizeof(statsMints));
+    LoadKeyFilter('s', 0);
+    LoadKeyFilter('m', 0);
+}
+
+bool CZerocoinDB::LoadKeyFilter(char chType, size_t nMinKeys)
+{
+    LOCK(cs_filter);
+    CZerocoinKeyFilter& filter = (chType == 's' ? filterSpends : filterMints);
+    const std::multiset<uint256>& setPending = (chType == 's' ? setSpendsPending : setMintsPending);
+
+    std::vector<uint256> vHashes;
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(chType, UINT256_ZERO));
+    while (pcursor->Valid()) {
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != chType)
+            break;
+        vHashes.push_back(key.second);
+        pcursor->Next();
+    }
+
+    // room to grow before the next rebuild
+    filter.Reset(std::max(nMinKeys, (vHashes.size() + setPending.size()) * 2));
+    for (const uint256& hash : vHashes)
+        filter.Insert(hash);
+    for (const uint256& hash : setPending)
+        filter.Insert(hash);
+
+    LogPrint(BCLog::COINDB, "Loaded %u zerocoin %s into the key filter\n", vHashes.size(), chType == 's' ? "spends" : "mints");
+    return true;
+}
+
+void CZerocoinDB::AddToKeyFilter(char chType, const std::vector<uint256>& vHashes)
+{
+    LOCK(cs_filter);
+    CZerocoinKeyFilter& filter = (chType == 's' ? filterSpends : filterMints);
+    if (filter.GetKeys() + vHashes.size() > filter.GetMaxKeys())
+        LoadKeyFilter(chType, (filter.GetKeys() + vHashes.size()) * 2);
+    std::multiset<uint256>& setPending = (chType == 's' ? setSpendsPending : setMintsPending);
+    for (const uint256& hash : vHashes) {
+        filter.Insert(hash);
+        setPending.insert(hash);
+    }
+}
+
+void CZerocoinDB::RemovePendingKeys(char chType, const std::vector<uint256>& vHashes)
+{
+    LOCK(cs_filter);
+    std::multiset<uint256>& setPending = (chType == 's' ? setSpendsPending : setMintsPending);
+    for (const uint256& hash : vHashes) {
+        std::multiset<uint256>::iterator it = setPending.find(hash);
+        if (it != setPending.end())
+            setPending.erase(it);
+    }
+}
+
+bool CZerocoinDB::ReadFiltered(char chType, const uint256& hash, uint256& hashTx)
+{
+    {
+        LOCK(cs_filter);
+        const CZerocoinKeyFilter& filter = (chType == 's' ? filterSpends : filterMints);
+        zerocoinfilter_stats& stats = (chType == 's' ? statsSpends : statsMints);
+        stats.nLookups++;
+        if (!filter.MayContain(hash)) {
+            stats.nFiltered++;
+            return false;
+        }
+    }
+
+    if (Read(std::make_pair(chType, hash), hashTx))
+        return true;
+
+    LOCK(cs_filter);
+    (chType == 's' ? statsSpends : statsMints).nFalsePositives++;
+    return false;
+}
+
+void CZerocoinDB::GetKeyFilterStats(zerocoinfilter_stats& spends, zerocoinfilter_stats& mints) const
+{
+    LOCK(cs_filter);
+    spends = statsSpends;
+    spends.nKeys = filterSpends.GetKeys();
+    spends.nUsage = filterSpends.DynamicMemoryUsage();
+    mints = statsMints;
+    mints.nKeys = filterMints.GetKeys();
+    mints.nUsage = filterMints.DynamicMemoryUsage();
 }
 
 bool CZerocoinDB::WriteCoinMintBatch(const std::vector<std::pair<libzerocoin::PublicCoin, uint256> >& mintInfo)
 {
     CDBBatch batch;
-    size_t count = 0;
+    std::vector<uint256> vHashes;
     for (std::vector<std::pair<libzerocoin::PublicCoin, uint256> >::const_iterator it=mintInfo.begin(); it != mintInfo.end(); it++) {
         libzerocoin::PublicCoin pubCoin = it->first;
         uint256 hash = GetPubCoinHash(pubCoin.getValue());
         batch.Write(std::make_pair('m', hash), it->second);
-        ++count;
+        vHashes.push_back(hash);
     }
 
-    LogPrint(BCLog::COINDB, "Writing %u coin mints to db.\n", (unsigned int)count);
-    return WriteBatch(batch, true);
+    // into the filter before the DB, so a concurrent read can't be filtered out
+    AddToKeyFilter('m', vHashes);
+
+    LogPrint(BCLog::COINDB, "Writing %u coin mints to db.\n", (unsigned int)vHashes.size());
+    const bool ret = WriteBatch(batch, true);
+    RemovePendingKeys('m', vHashes);
+    return ret;
 }
 
 bool CZerocoinDB::ReadCoinMint(const CBigNum& bnPubcoin, uint256& hashTx)
@@ -336,7 +468,34 @@ bool CZerocoinDB::ReadCoinMint(const CBigNum& bnPubcoin, uint256& hashTx)
 
 bool CZerocoinDB::ReadCoinMint(const uint256& hashPubcoin, uint256& hashTx)
 {
-    return Read(std::make_pair('m', hashPubcoin), hashTx);
+    return ReadFiltered('m', hashPubcoin, hashTx);
+}
+
+void CZerocoinDB::ReadCoinMintBatch(const std::vector<uint256>& vHashPubcoin, std::vector<std::pair<uint256, uint256> >& vFound)
+{
+    // screen the whole batch with the filter first, only the survivors need a DB read
+    std::vector<uint256> vCandidates;
+    {
+        LOCK(cs_filter);
+        statsMints.nLookups += vHashPubcoin.size();
+        for (const uint256& hash : vHashPubcoin) {
+            if (filterMints.MayContain(hash))
+                vCandidates.push_back(hash);
+        }
+        statsMints.nFiltered += vHashPubcoin.size() - vCandidates.size();
+    }
+
+    size_t nMissing = 0;
+    for (const uint256& hash : vCandidates) {
+        uint256 hashTx;
+        if (Read(std::make_pair('m', hash), hashTx))
+            vFound.emplace_back(hash, hashTx);
+        else
+            nMissing++;
+    }
+
+    LOCK(cs_filter);
+    statsMints.nFalsePositives += nMissing;
 }
 
 bool CZerocoinDB::EraseCoinMint(const CBigNum& bnPubcoin)
@@ -348,18 +507,23 @@ bool CZerocoinDB::EraseCoinMint(const CBigNum& bnPubcoin)
 bool CZerocoinDB::WriteCoinSpendBatch(const std::vector<std::pair<libzerocoin::CoinSpend, uint256> >& spendInfo)
 {
     CDBBatch batch;
-    size_t count = 0;
+    std::vector<uint256> vHashes;
     for (std::vector<std::pair<libzerocoin::CoinSpend, uint256> >::const_iterator it=spendInfo.begin(); it != spendInfo.end(); it++) {
         CBigNum bnSerial = it->first.getCoinSerialNumber();
         CDataStream ss(SER_GETHASH, 0);
         ss << bnSerial;
         uint256 hash = Hash(ss.begin(), ss.end());
         batch.Write(std::make_pair('s', hash), it->second);
-        ++count;
+        vHashes.push_back(hash);
     }
 
-    LogPrint(BCLog::COINDB, "Writing %u coin spends to db.\n", (unsigned int)count);
-    return WriteBatch(batch, true);
+    // into the filter before the DB, so a concurrent read can't be filtered out
+    AddToKeyFilter('s', vHashes);
+
+    LogPrint(BCLog::COINDB, "Writing %u coin spends to db.\n", (unsigned int)vHashes.size());
+    const bool ret = WriteBatch(batch, true);
+    RemovePendingKeys('s', vHashes);
+    return ret;
 }
 
 bool CZerocoinDB::ReadCoinSpend(const CBigNum& bnSerial, uint256& txHash)
@@ -368,12 +532,12 @@ bool CZerocoinDB::ReadCoinSpend(const CBigNum& bnSerial, uint256& txHash)
     ss << bnSerial;
     uint256 hash = Hash(ss.begin(), ss.end());
 
-    return Read(std::make_pair('s', hash), txHash);
+    return ReadFiltered('s', hash, txHash);
 }
 
 bool CZerocoinDB::ReadCoinSpend(const uint256& hashSerial, uint256 &txHash)
 {
-    return Read(std::make_pair('s', hashSerial), txHash);
+    return ReadFiltered('s', hashSerial, txHash);
 }
 
 bool CZerocoinDB::EraseCoinSpend(const CBigNum& bnSerial)
@@ -400,13 +564,8 @@ bool CZerocoinDB::WipeCoins(std::string strType)
         boost::this_thread::interruption_point();
         std::pair<char, uint256> key;
         if (pcursor->GetKey(key) && key.first == type) {
-            uint256 hash;
-            if (pcursor->GetValue(hash)) {
-                setDelete.insert(hash);
-                pcursor->Next();
-            } else {
-                return error("%s : failed to read value", __func__);
-            }
+            setDelete.insert(key.second);
+            pcursor->Next();
         } else {
             break;
         }
@@ -417,7 +576,7 @@ bool CZerocoinDB::WipeCoins(std::string strType)
             LogPrintf("%s: error failed to delete %s\n", __func__, hash.GetHex());
     }
 
-    return true;
+    return LoadKeyFilter(type, 0);
 }
 
 
@@ -13,8 +13,10 @@
 #include "dbwrapper.h"
 #include "libzerocoin/Coin.h"
 #include "libzerocoin/CoinSpend.h"
+#include "sync.h"
 
 #include <map>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -136,6 +138,46 @@ public:
     bool ReadMoneySupply(int64_t& nSupply) const;
 };
 
+//! Minimum number of keys a zerocoin DB key filter is sized for
+static const size_t ZC_KEY_FILTER_MIN_KEYS = 1 << 14;
+
+/** Counters of a zerocoin DB key filter */
+struct zerocoinfilter_stats {
+    size_t nKeys;
+    size_t nUsage;
+    uint64_t nLookups;
+    uint64_t nFiltered;
+    uint64_t nFalsePositives;
+};
+
+/**
+ * Blocked bloom filter over the (already uniformly distributed) hashes the
+ * zerocoin DB keys spends and mints by. A key it doesn't contain is certainly
+ * not in the DB. Erased keys keep their bits, so they only cost a DB read.
+ */
+class CZerocoinKeyFilter
+{
+private:
+    // one 64 bit block per key slot, 4 bits set in it per key
+    std::vector<uint64_t> vBlocks;
+    size_t nMaxKeys;
+    size_t nKeys;
+
+    uint64_t BlockMask(const uint256& hash, size_t& nBlock) const;
+
+public:
+    CZerocoinKeyFilter() : nMaxKeys(0), nKeys(0) {}
+
+    /** Drop every key and size the filter for nMaxKeysIn keys */
+    void Reset(size_t nMaxKeysIn);
+    void Insert(const uint256& hash);
+    bool MayContain(const uint256& hash) const;
+
+    size_t GetKeys() const { return nKeys; }
+    size_t GetMaxKeys() const { return nMaxKeys; }
+    size_t DynamicMemoryUsage() const { return vBlocks.capacity() * sizeof(uint64_t); }
+};
+
 /** Zerocoin database (zerocoin/) */
 class CZerocoinDB : public CDBWrapper
 {
@@ -146,11 +188,35 @@ private:
     CZerocoinDB(const CZerocoinDB&);
     void operator=(const CZerocoinDB&);
 
+    // protects the key filters and their counters
+    mutable RecursiveMutex cs_filter;
+    CZerocoinKeyFilter filterSpends;
+    CZerocoinKeyFilter filterMints;
+    zerocoinfilter_stats statsSpends;
+    zerocoinfilter_stats statsMints;
+    // keys in the filters whose batch isn't written yet, a rebuild from the DB puts them back
+    std::multiset<uint256> setSpendsPending;
+    std::multiset<uint256> setMintsPending;
+
+    /** Rebuild the filter of chType ('s' or 'm') from the DB, sized for at least nMinKeys */
+    bool LoadKeyFilter(char chType, size_t nMinKeys);
+    /** Add keys about to be written, growing the filter if it's full */
+    void AddToKeyFilter(char chType, const std::vector<uint256>& vHashes);
+    /** Done with keys added by AddToKeyFilter, once their batch is written */
+    void RemovePendingKeys(char chType, const std::vector<uint256>& vHashes);
+    /** Read a spend or mint, skipping the DB when the filter rules it out */
+    bool ReadFiltered(char chType, const uint256& hash, uint256& hashTx);
+
 public:
+    /** Counters of the spend and mint key filters */
+    void GetKeyFilterStats(zerocoinfilter_stats& spends, zerocoinfilter_stats& mints) const;
+
     /** Write zSTUDS mints to the zerocoinDB in a batch */
     bool WriteCoinMintBatch(const std::vector<std::pair<libzerocoin::PublicCoin, uint256> >& mintInfo);
     bool ReadCoinMint(const CBigNum& bnPubcoin, uint256& txHash);
     bool ReadCoinMint(const uint256& hashPubcoin, uint256& hashTx);
+    /** Look up many pubcoin hashes at once, the (pubcoin hash, tx hash) pairs found are appended to vFound */
+    void ReadCoinMintBatch(const std::vector<uint256>& vHashPubcoin, std::vector<std::pair<uint256, uint256> >& vFound);
     /** Write zSTUDS spends to the zerocoinDB in a batch */
     bool WriteCoinSpendBatch(const std::vector<std::pair<libzerocoin::CoinSpend, uint256> >& spendInfo);
     bool ReadCoinSpend(const CBigNum& bnSerial, uint256& txHash);
@@ -18,6 +18,9 @@
 #include "utiltime.h"
 #include "version.h"
 
+#include <algorithm>
+#include <functional>
+
 #include <boost/foreach.hpp>
 
 
@@ -153,10 +156,12 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
         if (it == mapTx.end()) {
             continue;
         }
-        std::map<COutPoint, CInPoint>::iterator iter = mapNextTx.lower_bound(COutPoint(hash, 0));
         // First calculate the children, and update setMemPoolChildren to
         // include them, and update their setMemPoolParents to include this tx.
-        for (; iter != mapNextTx.end() && iter->first.hash == hash; ++iter) {
+        for (unsigned int n = 0; n < it->GetTx().vout.size(); n++) {
+            nextTxMap::iterator iter = mapNextTx.find(COutPoint(hash, n));
+            if (iter == mapNextTx.end())
+                continue;
             const uint256 &childHash = iter->second.ptx->GetHash();
             txiter childIter = mapTx.find(childHash);
             assert(childIter != mapTx.end());
@@ -398,7 +403,7 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     UpdateAncestorsOf(true, newit, setAncestors);
 
     // Update transaction's score for any feeDelta created by PrioritiseTransaction
-    std::map<uint256, std::pair<double, CAmount> >::const_iterator pos = mapDeltas.find(hash);
+    deltaMap::const_iterator pos = mapDeltas.find(hash);
     if (pos != mapDeltas.end()) {
         const std::pair<double, CAmount> &deltas = pos->second;
         if (deltas.second) {
@@ -409,12 +414,14 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
     minerPolicyEstimator->processTransaction(entry, fCurrentEstimate);
+    NotifyEntryAdded(tx);
 
     return true;
 }
 
 void CTxMemPool::removeUnchecked(txiter it)
 {
+    NotifyEntryRemoved(it->GetTx());
     const uint256 hash = it->GetTx().GetHash();
     for (const CTxIn& txin : it->GetTx().vin)
         mapNextTx.erase(txin.prevout);
@@ -472,7 +479,7 @@ void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& rem
             // happen during chain re-orgs if origTx isn't re-accepted into
             // the mempool for any reason.
             for (unsigned int i = 0; i < origTx.vout.size(); i++) {
-                std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(origTx.GetHash(), i));
+                nextTxMap::iterator it = mapNextTx.find(COutPoint(origTx.GetHash(), i));
                 if (it == mapNextTx.end())
                     continue;
                 txiter nextit = mapTx.find(it->second.ptx->GetHash());
@@ -530,7 +537,7 @@ void CTxMemPool::removeConflicts(const CTransaction& tx, std::list<CTransaction>
     std::list<CTransaction> result;
     LOCK(cs);
     for (const CTxIn& txin : tx.vin) {
-        std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(txin.prevout);
+        nextTxMap::iterator it = mapNextTx.find(txin.prevout);
         if (it != mapNextTx.end()) {
             const CTransaction& txConflict = *it->second.ptx;
             if (txConflict != tx) {
@@ -568,6 +575,8 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
 
 void CTxMemPool::_clear()
 {
+    for (const CTxMemPoolEntry& entry : mapTx)
+        NotifyEntryRemoved(entry.GetTx());
     mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
@@ -629,7 +638,7 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
             }
             // Check whether its inputs are marked in mapNextTx.
             if(!fHasZerocoinSpends) {
-                std::map<COutPoint, CInPoint>::const_iterator it3 = mapNextTx.find(txin.prevout);
+                nextTxMap::const_iterator it3 = mapNextTx.find(txin.prevout);
                 assert(it3 != mapNextTx.end());
                 assert(it3->second.ptx == &tx);
                 assert(it3->second.n == i);
@@ -642,10 +651,12 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
         // Check children against mapNextTx
         if (!fHasZerocoinSpends) {
             CTxMemPool::setEntries setChildrenCheck;
-            std::map<COutPoint, CInPoint>::const_iterator iter = mapNextTx.lower_bound(COutPoint(tx.GetHash(), 0));
             int64_t childSizes = 0;
             CAmount childFees = 0;
-            for (; iter != mapNextTx.end() && iter->first.hash == tx.GetHash(); ++iter) {
+            for (unsigned int n = 0; n < tx.vout.size(); n++) {
+                nextTxMap::const_iterator iter = mapNextTx.find(COutPoint(tx.GetHash(), n));
+                if (iter == mapNextTx.end())
+                    continue;
                 txiter childit = mapTx.find(iter->second.ptx->GetHash());
                 assert(childit != mapTx.end()); // mapNextTx points to in-mempool transactions
                 if (setChildrenCheck.insert(childit).second) {
@@ -693,7 +704,7 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
             stepsSinceLastRemove = 0;
         }
     }
-    for (std::map<COutPoint, CInPoint>::const_iterator it = mapNextTx.begin(); it != mapNextTx.end(); it++) {
+    for (nextTxMap::const_iterator it = mapNextTx.begin(); it != mapNextTx.end(); it++) {
         uint256 hash = it->second.ptx->GetHash();
         indexed_transaction_set::const_iterator it2 = mapTx.find(hash);
         const CTransaction& tx = it2->GetTx();
@@ -717,6 +728,38 @@ void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
         vtxid.push_back(mi->GetTx().GetHash());
 }
 
+void CTxMemPool::SortForRelay(std::vector<uint256>& vHashes) const
+{
+    LOCK(cs);
+    std::vector<txiter> vEntries;
+    vEntries.reserve(vHashes.size());
+    for (const uint256& hash : vHashes) {
+        txiter it = mapTx.find(hash);
+        if (it != mapTx.end())
+            vEntries.push_back(it);
+    }
+    CompareTxMemPoolEntryByScore compare;
+    std::sort(vEntries.begin(), vEntries.end(), [&compare](const txiter& a, const txiter& b) {
+        return compare(*a, *b);
+    });
+
+    // A peer that hears of a child first would ask for it and get an orphan
+    setEntries setQueued(vEntries.begin(), vEntries.end());
+    setEntries setDone;
+    vHashes.clear();
+    std::function<void(txiter)> visit = [&](txiter it) {
+        if (!setDone.insert(it).second)
+            return;
+        for (txiter parent : GetMemPoolParents(it)) {
+            if (setQueued.count(parent))
+                visit(parent);
+        }
+        vHashes.push_back(it->GetTx().GetHash());
+    };
+    for (txiter it : vEntries)
+        visit(it);
+}
+
 void CTxMemPool::getTransactions(std::set<uint256>& setTxid)
 {
     setTxid.clear();
@@ -797,6 +840,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const std::string str
         txiter it = mapTx.find(hash);
         if (it != mapTx.end()) {
             mapTx.modify(it, update_fee_delta(deltas.second));
+            NotifyEntryPrioritised(hash);
         }
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
@@ -805,7 +849,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const std::string str
 void CTxMemPool::ApplyDeltas(const uint256 hash, double& dPriorityDelta, CAmount& nFeeDelta) const
 {
     LOCK(cs);
-    std::map<uint256, std::pair<double, CAmount> >::const_iterator pos = mapDeltas.find(hash);
+    deltaMap::const_iterator pos = mapDeltas.find(hash);
     if (pos == mapDeltas.end())
         return;
     const std::pair<double, CAmount>& deltas = pos->second;
@@ -1011,5 +1055,4 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
         LogPrint(BCLog::MEMPOOL, "Removed %u txn, rolling minimum fee bumped to %s\n", nTxnRemoved, maxFeeRateRemoved.ToString());
 }
 
-SaltedTxidHasher::SaltedTxidHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
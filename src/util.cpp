@@ -622,6 +622,22 @@ void AllocateFileRange(FILE* file, unsigned int offset, unsigned int length)
 #endif
 }
 
+/**
+ * this function hints the OS that a range of a file is about to be read, so that it gets
+ * read ahead of the reads. It is advisory.
+ */
+void ReadAheadFileRange(FILE* file, unsigned int offset, unsigned int length)
+{
+#if defined(MAC_OSX)
+    struct radvisory advice;
+    advice.ra_offset = offset;
+    advice.ra_count = length;
+    fcntl(fileno(file), F_RDADVISE, &advice);
+#elif defined(__linux__)
+    posix_fadvise(fileno(file), offset, length, POSIX_FADV_WILLNEED);
+#endif
+}
+
 #ifdef WIN32
 fs::path GetSpecialFolderPath(int nFolder, bool fCreate)
 {
@@ -110,6 +110,14 @@ bool CzPIVTracker::GetMetaFromStakeHash(const uint256& hashStake, CMintMeta& met
     return false;
 }
 
+std::set<uint256> CzPIVTracker::GetPubcoinHashes() const
+{
+    std::set<uint256> setHashes;
+    for (const auto& it : mapSerialHashes)
+        setHashes.insert(it.second.hashPubcoin);
+    return setHashes;
+}
+
 std::vector<uint256> CzPIVTracker::GetSerialHashes()
 {
     std::vector<uint256> vHashes;
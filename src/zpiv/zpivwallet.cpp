@@ -12,6 +12,10 @@
 #include "deterministicmint.h"
 #include "zpivchain.h"
 
+#include <atomic>
+
+#include <boost/thread.hpp>
+
 
 CzPIVWallet::CzPIVWallet(CWallet* parent)
 {
@@ -121,38 +125,74 @@ void CzPIVWallet::GenerateMintPool(uint32_t nCountStart, uint32_t nCountEnd)
     if (nCountEnd > 0)
         nStop = std::max(n, n + nCountEnd);
 
-    bool fFound;
+    // Prevent unnecessary repeated minted
+    std::set<uint32_t> setInPool;
+    for (auto& pair : mintPool)
+        setInPool.insert(pair.second);
+    std::vector<uint32_t> vCounts;
+    for (uint32_t i = n; i < nStop; ++i) {
+        if (!setInPool.count(i))
+            vCounts.push_back(i);
+    }
+    if (vCounts.empty())
+        return;
 
     uint256 hashSeed = Hash(seedMaster.begin(), seedMaster.end());
     LogPrintf("%s : n=%d nStop=%d\n", __func__, n, nStop - 1);
-    for (uint32_t i = n; i < nStop; ++i) {
-        if (ShutdownRequested())
-            return;
 
-        fFound = false;
+    const int nThreads = std::max(1, std::min(GetNumCores(), MINTPOOL_MAX_THREADS));
+    const bool fShowProgress = vCounts.size() > MINTPOOL_GENERATE_BATCH;
+    if (fShowProgress)
+        wallet->ShowProgress(_("Generating zerocoin mint pool..."), 0);
 
-        // Prevent unnecessary repeated minted
-        for (auto& pair : mintPool) {
-            if(pair.second == i) {
-                fFound = true;
-                break;
+    CWalletDB walletdb(wallet->strWalletFile);
+    std::vector<CBigNum> vValues;
+    for (size_t nBatchStart = 0; nBatchStart < vCounts.size(); nBatchStart += MINTPOOL_GENERATE_BATCH) {
+        if (ShutdownRequested())
+            break;
+
+        // derive the batch on every core, each worker picking the next count
+        const size_t nBatchEnd = std::min(vCounts.size(), nBatchStart + MINTPOOL_GENERATE_BATCH);
+        vValues.assign(nBatchEnd - nBatchStart, CBigNum());
+        std::atomic<size_t> nNext(nBatchStart);
+        std::atomic<bool> fFailed(false);
+        auto derive = [&]() {
+            try {
+                for (size_t i = nNext++; i < nBatchEnd; i = nNext++) {
+                    CBigNum bnSerial;
+                    CBigNum bnRandomness;
+                    CKey key;
+                    SeedToZPIV(GetZerocoinSeed(vCounts[i]), vValues[i - nBatchStart], bnSerial, bnRandomness, key);
+                }
+            } catch (const std::exception& e) {
+                LogPrintf("%s : %s\n", __func__, e.what());
+                fFailed = true;
             }
+        };
+        boost::thread_group workers;
+        for (int i = 1; i < nThreads; i++)
+            workers.create_thread(derive);
+        derive();
+        workers.join_all();
+        if (fFailed)
+            break;
+
+        // one wallet transaction per batch
+        walletdb.TxnBegin();
+        for (size_t i = nBatchStart; i < nBatchEnd; i++) {
+            const CBigNum& bnValue = vValues[i - nBatchStart];
+            mintPool.Add(bnValue, vCounts[i]);
+            walletdb.WriteMintPoolPair(hashSeed, GetPubCoinHash(bnValue), vCounts[i]);
+            LogPrintf("%s : %s count=%d\n", __func__, bnValue.GetHex().substr(0, 6), vCounts[i]);
         }
+        walletdb.TxnCommit();
 
-        if(fFound)
-            continue;
-
-        uint512 seedZerocoin = GetZerocoinSeed(i);
-        CBigNum bnValue;
-        CBigNum bnSerial;
-        CBigNum bnRandomness;
-        CKey key;
-        SeedToZPIV(seedZerocoin, bnValue, bnSerial, bnRandomness, key);
-
-        mintPool.Add(bnValue, i);
-        CWalletDB(wallet->strWalletFile).WriteMintPoolPair(hashSeed, GetPubCoinHash(bnValue), i);
-        LogPrintf("%s : %s count=%d\n", __func__, bnValue.GetHex().substr(0, 6), i);
+        if (fShowProgress)
+            wallet->ShowProgress(_("Generating zerocoin mint pool..."), std::max(1, std::min(99, (int)(nBatchEnd * 100 / vCounts.size()))));
     }
+
+    if (fShowProgress)
+        wallet->ShowProgress(_("Generating zerocoin mint pool..."), 100);
 }
 
 // pubcoin hashes are stored to db so that a full accounting of mints belonging to the seed can be tracked without regenerating
@@ -192,25 +232,53 @@ void CzPIVWallet::SyncWithChain(bool fGenerateMintPool)
             GenerateMintPool();
         LogPrintf("%s: Mintpool size=%d\n", __func__, mintPool.size());
 
+        // drop the mints the tracker already knows, the others are looked up in the zerocoin DB by batch
         std::set<uint256> setChecked;
-        std::list<std::pair<uint256,uint32_t> > listMints = mintPool.List();
-        for (std::pair<uint256, uint32_t> pMint : listMints) {
-            LOCK(cs_main);
-            if (setChecked.count(pMint.first))
-                return;
-            setChecked.insert(pMint.first);
+        std::vector<std::pair<uint256, uint32_t> > vCandidates;
+        {
+            LOCK2(cs_main, wallet->cs_wallet);
+            const std::set<uint256> setTracked = wallet->zpivTracker->GetPubcoinHashes();
+            std::list<std::pair<uint256,uint32_t> > listMints = mintPool.List();
+            for (std::pair<uint256, uint32_t> pMint : listMints) {
+                if (setChecked.count(pMint.first))
+                    return;
+                setChecked.insert(pMint.first);
+
+                if (setTracked.count(pMint.first)) {
+                    mintPool.Remove(pMint.first);
+                    continue;
+                }
+                vCandidates.push_back(pMint);
+            }
+        }
+
+        const bool fShowProgress = vCandidates.size() > MINTPOOL_SYNC_BATCH;
+        if (fShowProgress)
+            wallet->ShowProgress(_("Syncing zerocoin mint pool..."), 0);
 
-            if (ShutdownRequested())
+        bool fAbort = false;
+        for (size_t nBatchStart = 0; nBatchStart < vCandidates.size() && !fAbort; nBatchStart += MINTPOOL_SYNC_BATCH) {
+            if (ShutdownRequested()) {
+                if (fShowProgress)
+                    wallet->ShowProgress(_("Syncing zerocoin mint pool..."), 100);
                 return;
+            }
 
-            if (wallet->zpivTracker->HasPubcoinHash(pMint.first)) {
-                mintPool.Remove(pMint.first);
-                continue;
+            const size_t nBatchEnd = std::min(vCandidates.size(), nBatchStart + MINTPOOL_SYNC_BATCH);
+            std::vector<uint256> vHashes;
+            std::map<uint256, uint32_t> mapCounts;
+            for (size_t i = nBatchStart; i < nBatchEnd; i++) {
+                vHashes.push_back(vCandidates[i].first);
+                mapCounts.emplace(vCandidates[i]);
             }
+            std::vector<std::pair<uint256, uint256> > vFound;
+            zerocoinDB->ReadCoinMintBatch(vHashes, vFound);
+
+            for (const std::pair<uint256, uint256>& itFound : vFound) {
+                LOCK(cs_main);
+                const std::pair<uint256, uint32_t> pMint(itFound.first, mapCounts.at(itFound.first));
+                const uint256& txHash = itFound.second;
 
-            uint256 txHash;
-            CZerocoinMint mint;
-            if (zerocoinDB->ReadCoinMint(pMint.first, txHash)) {
                 //this mint has already occurred on the chain, increment counter's state to reflect this
                 LogPrintf("%s : Found wallet coin mint=%s count=%d tx=%s\n", __func__, pMint.first.GetHex(), pMint.second, txHash.GetHex());
                 found = true;
@@ -252,6 +320,7 @@ void CzPIVWallet::SyncWithChain(bool fGenerateMintPool)
                 if (!fFoundMint || denomination == libzerocoin::ZQ_ERROR) {
                     LogPrintf("%s : failed to get mint %s from tx %s!\n", __func__, pMint.first.GetHex(), tx.GetHash().GetHex());
                     found = false;
+                    fAbort = true;
                     break;
                 }
 
@@ -283,7 +352,13 @@ void CzPIVWallet::SyncWithChain(bool fGenerateMintPool)
                 nCountLastUsed = std::max(nLastCountUsed, nCountLastUsed);
                 LogPrint(BCLog::LEGACYZC, "%s: updated count to %d\n", __func__, nCountLastUsed);
             }
+
+            if (fShowProgress)
+                wallet->ShowProgress(_("Syncing zerocoin mint pool..."), std::max(1, std::min(99, (int)(nBatchEnd * 100 / vCandidates.size()))));
         }
+
+        if (fShowProgress)
+            wallet->ShowProgress(_("Syncing zerocoin mint pool..."), 100);
     }
 }
 
@@ -385,8 +460,8 @@ void CzPIVWallet::SeedToZPIV(const uint512& seedZerocoin, CBigNum& bnValue, CBig
 
     //See if serial and randomness make a valid commitment
     // Generate a Pedersen commitment to the serial number
-    CBigNum commitmentValue = params->coinCommitmentGroup.g.pow_mod(bnSerial, params->coinCommitmentGroup.modulus).mul_mod(
-                        params->coinCommitmentGroup.h.pow_mod(bnRandomness, params->coinCommitmentGroup.modulus),
+    CBigNum commitmentValue = params->coinCommitmentGroup.pow_g(bnSerial).mul_mod(
+                        params->coinCommitmentGroup.pow_h(bnRandomness),
                         params->coinCommitmentGroup.modulus);
 
     CBigNum random;
@@ -408,7 +483,7 @@ void CzPIVWallet::SeedToZPIV(const uint512& seedZerocoin, CBigNum& bnValue, CBig
                               attempts256.begin(), attempts256.end());
         random.setuint256(hashRandomness);
         bnRandomness = (bnRandomness + random) % params->coinCommitmentGroup.groupOrder;
-        commitmentValue = commitmentValue.mul_mod(params->coinCommitmentGroup.h.pow_mod(random, params->coinCommitmentGroup.modulus), params->coinCommitmentGroup.modulus);
+        commitmentValue = commitmentValue.mul_mod(params->coinCommitmentGroup.pow_h(random), params->coinCommitmentGroup.modulus);
     }
 }
 
@@ -15,6 +15,13 @@
 
 class CDeterministicMint;
 
+//! Mints derived in parallel between two writes of the mint pool to the wallet
+static const size_t MINTPOOL_GENERATE_BATCH = 200;
+//! Maximum number of threads deriving the mint pool
+static const int MINTPOOL_MAX_THREADS = 16;
+//! Mint pool entries looked up in the zerocoin DB at once while syncing
+static const size_t MINTPOOL_SYNC_BATCH = 1000;
+
 class CzPIVWallet
 {
 private:
@@ -6,12 +6,17 @@
 #include "zpivchain.h"
 
 #include "guiinterface.h"
+#include "init.h"
 #include "invalid.h"
 #include "main.h"
 #include "txdb.h"
 #include "wallet/wallet.h"
 #include "zpiv/zpivmodule.h"
 
+#include <iterator>
+
+#include <boost/thread.hpp>
+
 // 6 comes from OPCODE (1) + vch.size() (1) + BIGNUM size (4)
 #define SCRIPT_OFFSET 6
 // For Script size (BIGNUM/Uint256 size)
@@ -248,101 +253,228 @@ bool IsSerialInBlockchain(const uint256& hashSerial, int& nHeightTx, uint256& tx
     return IsTransactionInChain(txidSpend, nHeightTx, tx);
 }
 
-std::string ReindexZerocoinDB()
+namespace {
+
+/** A block of the zerocoin reindex, read from disk and parsed by a worker */
+struct CZerocoinReindexBlock {
+    CBlock block;
+    std::vector<std::pair<libzerocoin::CoinSpend, uint256> > vSpendInfo;
+    std::vector<std::pair<libzerocoin::PublicCoin, uint256> > vMintInfo;
+    std::string strError;
+    bool fDone;
+
+    CZerocoinReindexBlock() : fDone(false) {}
+};
+
+bool ParseZerocoinReindexBlock(const CBlockIndex* pindex, CZerocoinReindexBlock& entry)
 {
-    AssertLockHeld(cs_main);
+    if (!ReadBlockFromDisk(entry.block, pindex)) {
+        entry.strError = _("Reindexing zerocoin failed");
+        return false;
+    }
+
+    const Consensus::Params& consensus = Params().GetConsensus();
+    for (const CTransaction& tx : entry.block.vtx) {
+        if (tx.IsCoinBase() || !tx.ContainsZerocoins())
+            continue;
+
+        uint256 txid = tx.GetHash();
+        //Record Serials
+        if (tx.HasZerocoinSpendInputs()) {
+            for (auto& in : tx.vin) {
+                bool isPublicSpend = in.IsZerocoinPublicSpend();
+                if (!in.IsZerocoinSpend() && !isPublicSpend)
+                    continue;
+                if (isPublicSpend) {
+                    libzerocoin::ZerocoinParams* params = consensus.Zerocoin_Params(false);
+                    PublicCoinSpend publicSpend(params);
+                    CValidationState state;
+                    if (!ZPIVModule::ParseZerocoinPublicSpend(in, tx, state, publicSpend)) {
+                        entry.strError = _("Failed to parse public spend");
+                        return false;
+                    }
+                    entry.vSpendInfo.push_back(std::make_pair(publicSpend, txid));
+                } else {
+                    libzerocoin::CoinSpend spend = TxInToZerocoinSpend(in);
+                    entry.vSpendInfo.push_back(std::make_pair(spend, txid));
+                }
+            }
+        }
+
+        //Record mints
+        if (tx.HasZerocoinMintOutputs()) {
+            for (auto& out : tx.vout) {
+                if (!out.IsZerocoinMint())
+                    continue;
+
+                CValidationState state;
+                const bool v1params = !consensus.NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_ZC_V2);
+                libzerocoin::PublicCoin coin(consensus.Zerocoin_Params(v1params));
+                TxOutToPublicCoin(out, coin, state);
+                entry.vMintInfo.push_back(std::make_pair(coin, txid));
+            }
+        }
+    }
+    return true;
+}
+
+/** The workers of the zerocoin reindex, stopped however the writer leaves as they share its stack */
+class CZerocoinReindexWorkers
+{
+private:
+    boost::mutex& mutex;
+    boost::condition_variable& condWorker;
+    bool& fAbort;
+
+public:
+    boost::thread_group threads;
+
+    CZerocoinReindexWorkers(boost::mutex& mutexIn, boost::condition_variable& condWorkerIn, bool& fAbortIn) :
+        mutex(mutexIn), condWorker(condWorkerIn), fAbort(fAbortIn) {}
+
+    ~CZerocoinReindexWorkers()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fAbort = true;
+        }
+        condWorker.notify_all();
+        threads.interrupt_all();
+        threads.join_all();
+    }
+};
 
+} // anon namespace
+
+std::string ReindexZerocoinDB()
+{
     if (!zerocoinDB->WipeCoins("spends") || !zerocoinDB->WipeCoins("mints")) {
         return _("Failed to wipe zerocoinDB");
     }
 
     uiInterface.ShowProgress(_("Reindexing zerocoin database..."), 0);
 
-    // initialize supply to 0
-    mapZerocoinSupply.clear();
-    for (auto& denom : libzerocoin::zerocoinDenomList) mapZerocoinSupply.insert(std::make_pair(denom, 0));
+    // the chain is only read here, the blocks are read and parsed without cs_main
+    std::vector<CBlockIndex*> vBlocks;
+    {
+        LOCK(cs_main);
+        // initialize supply to 0
+        mapZerocoinSupply.clear();
+        for (auto& denom : libzerocoin::zerocoinDenomList) mapZerocoinSupply.insert(std::make_pair(denom, 0));
+
+        const int zc_start_height = Params().GetConsensus().vUpgrades[Consensus::UPGRADE_ZC].nActivationHeight;
+        for (CBlockIndex* pindex = chainActive[zc_start_height]; pindex; pindex = chainActive.Next(pindex))
+            vBlocks.push_back(pindex);
+    }
+
+    // workers read and parse the blocks ahead of the writer, at most ZC_REINDEX_WINDOW of them
+    std::vector<CZerocoinReindexBlock> vWindow(ZC_REINDEX_WINDOW);
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    boost::condition_variable condWriter;
+    size_t nNextRead = 0;
+    size_t nNextWrite = 0;
+    bool fAbort = false;
+
+    auto worker = [&]() {
+        while (true) {
+            size_t i;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fAbort && nNextRead < vBlocks.size() && nNextRead >= nNextWrite + ZC_REINDEX_WINDOW)
+                    condWorker.wait(lock);
+                if (fAbort || nNextRead >= vBlocks.size())
+                    return;
+                i = nNextRead++;
+            }
 
-    const Consensus::Params& consensus = Params().GetConsensus();
-    const int zc_start_height = consensus.vUpgrades[Consensus::UPGRADE_ZC].nActivationHeight;
-    CBlockIndex* pindex = chainActive[zc_start_height];
+            CZerocoinReindexBlock entry;
+            try {
+                ParseZerocoinReindexBlock(vBlocks[i], entry);
+            } catch (const std::exception& e) {
+                entry.strError = _("Reindexing zerocoin failed");
+                LogPrintf("%s : %s\n", __func__, e.what());
+            }
+            entry.fDone = true;
+
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                std::swap(vWindow[i % ZC_REINDEX_WINDOW], entry);
+            }
+            condWriter.notify_one();
+        }
+    };
+
+    // the writer: supply update and large DB batches, in chain order
+    std::string strError;
     std::vector<std::pair<libzerocoin::CoinSpend, uint256> > vSpendInfo;
     std::vector<std::pair<libzerocoin::PublicCoin, uint256> > vMintInfo;
-    while (pindex) {
-        uiInterface.ShowProgress(_("Reindexing zerocoin database..."), std::max(1, std::min(99, (int)((double)(pindex->nHeight - zc_start_height) / (double)(chainActive.Height() - zc_start_height) * 100))));
+    int nLastProgress = 0;
+    {
+        CZerocoinReindexWorkers workers(mutex, condWorker, fAbort);
+        const int nWorkers = std::max(1, std::min(GetNumCores(), ZC_REINDEX_MAX_THREADS));
+        for (int i = 0; i < nWorkers; i++)
+            workers.threads.create_thread(worker);
+
+        for (size_t i = 0; i < vBlocks.size(); i++) {
+            CZerocoinReindexBlock entry;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!vWindow[i % ZC_REINDEX_WINDOW].fDone)
+                    condWriter.wait(lock);
+                std::swap(vWindow[i % ZC_REINDEX_WINDOW], entry);
+                nNextWrite++;
+            }
+            condWorker.notify_all();
 
-        if (pindex->nHeight % 1000 == 0)
-            LogPrintf("Reindexing zerocoin : block %d...\n", pindex->nHeight);
+            if (!entry.strError.empty()) {
+                strError = entry.strError;
+                break;
+            }
+            if (ShutdownRequested()) {
+                strError = _("Reindexing zerocoin interrupted");
+                break;
+            }
 
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex)) {
-            return _("Reindexing zerocoin failed");
-        }
-        // update supply
-        UpdateZPIVSupplyConnect(block, pindex, true);
+            CBlockIndex* pindex = vBlocks[i];
+            if (pindex->nHeight % 1000 == 0)
+                LogPrintf("Reindexing zerocoin : block %d...\n", pindex->nHeight);
 
-        for (const CTransaction& tx : block.vtx) {
-            for (unsigned int i = 0; i < tx.vin.size(); i++) {
-                if (tx.IsCoinBase())
-                    break;
+            {
+                // update supply
+                LOCK(cs_main);
+                UpdateZPIVSupplyConnect(entry.block, pindex, true);
+            }
 
-                if (tx.ContainsZerocoins()) {
-                    uint256 txid = tx.GetHash();
-                    //Record Serials
-                    if (tx.HasZerocoinSpendInputs()) {
-                        for (auto& in : tx.vin) {
-                            bool isPublicSpend = in.IsZerocoinPublicSpend();
-                            if (!in.IsZerocoinSpend() && !isPublicSpend)
-                                continue;
-                            if (isPublicSpend) {
-                                libzerocoin::ZerocoinParams* params = consensus.Zerocoin_Params(false);
-                                PublicCoinSpend publicSpend(params);
-                                CValidationState state;
-                                if (!ZPIVModule::ParseZerocoinPublicSpend(in, tx, state, publicSpend)){
-                                    return _("Failed to parse public spend");
-                                }
-                                vSpendInfo.push_back(std::make_pair(publicSpend, txid));
-                            } else {
-                                libzerocoin::CoinSpend spend = TxInToZerocoinSpend(in);
-                                vSpendInfo.push_back(std::make_pair(spend, txid));
-                            }
-                        }
-                    }
+            std::move(entry.vSpendInfo.begin(), entry.vSpendInfo.end(), std::back_inserter(vSpendInfo));
+            std::move(entry.vMintInfo.begin(), entry.vMintInfo.end(), std::back_inserter(vMintInfo));
 
-                    //Record mints
-                    if (tx.HasZerocoinMintOutputs()) {
-                        for (auto& out : tx.vout) {
-                            if (!out.IsZerocoinMint())
-                                continue;
-
-                            CValidationState state;
-                            const bool v1params = !consensus.NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_ZC_V2);
-                            libzerocoin::PublicCoin coin(consensus.Zerocoin_Params(v1params));
-                            TxOutToPublicCoin(out, coin, state);
-                            vMintInfo.push_back(std::make_pair(coin, txid));
-                        }
-                    }
+            // Flush the zerocoinDB to disk in large batches
+            if (vSpendInfo.size() + vMintInfo.size() >= ZC_REINDEX_FLUSH_ENTRIES) {
+                if ((!vSpendInfo.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpendInfo)) || (!vMintInfo.empty() && !zerocoinDB->WriteCoinMintBatch(vMintInfo))) {
+                    strError = _("Error writing zerocoinDB to disk");
+                    break;
                 }
+                vSpendInfo.clear();
+                vMintInfo.clear();
             }
-        }
 
-        // Flush the zerocoinDB to disk every 100 blocks
-        if (pindex->nHeight % 100 == 0) {
-            if ((!vSpendInfo.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpendInfo)) || (!vMintInfo.empty() && !zerocoinDB->WriteCoinMintBatch(vMintInfo)))
-                return _("Error writing zerocoinDB to disk");
-            vSpendInfo.clear();
-            vMintInfo.clear();
+            const int nProgress = std::max(1, std::min(99, (int)((i + 1) * 100 / vBlocks.size())));
+            if (nProgress != nLastProgress) {
+                uiInterface.ShowProgress(_("Reindexing zerocoin database..."), nProgress);
+                nLastProgress = nProgress;
+            }
         }
-
-        pindex = chainActive.Next(pindex);
     }
+
     uiInterface.ShowProgress("", 100);
+    if (!strError.empty())
+        return strError;
 
     // Final flush to disk in case any remaining information exists
     if ((!vSpendInfo.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpendInfo)) || (!vMintInfo.empty() && !zerocoinDB->WriteCoinMintBatch(vMintInfo)))
         return _("Error writing zerocoinDB to disk");
 
-    uiInterface.ShowProgress("", 100);
-
     return "";
 }
 
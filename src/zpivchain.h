@@ -24,6 +24,13 @@ class CValidationState;
 class CZerocoinMint;
 class uint256;
 
+//! Blocks the zerocoin reindex reads and parses ahead of the writer
+static const size_t ZC_REINDEX_WINDOW = 256;
+//! Maximum number of threads reading and parsing blocks for the zerocoin reindex
+static const int ZC_REINDEX_MAX_THREADS = 8;
+//! Spends and mints written to the zerocoin DB at once by the zerocoin reindex
+static const size_t ZC_REINDEX_FLUSH_ENTRIES = 2000;
+
 bool BlockToMintValueVector(const CBlock& block, const libzerocoin::CoinDenomination denom, std::vector<CBigNum>& vValues);
 bool BlockToPubcoinList(const CBlock& block, std::list<libzerocoin::PublicCoin>& listPubcoins, bool fFilterInvalid);
 bool BlockToZerocoinMintList(const CBlock& block, std::list<CZerocoinMint>& vMints, bool fFilterInvalid);
@@ -99,6 +99,7 @@ BASE_SCRIPTS= [
     'wallet_labels.py',                         # ~ 57 sec
     'rpc_signmessage.py',                       # ~ 54 sec
     'mempool_resurrect.py',                     # ~ 51 sec
+    'mempool_persist.py',                       # ~ 50 sec
     'rpc_budget.py',                            # ~ 50 sec
     'mempool_spend_coinbase.py',                # ~ 50 sec
     'rpc_signrawtransaction.py',                # ~ 50 sec
@@ -115,7 +116,6 @@ BASE_SCRIPTS= [
     # 'mempool_limit.py', # We currently don't limit our mempool_reorg
     # 'interface_zmq.py',
     # 'rpc_getchaintips.py',
-    # 'mempool_persist.py',
     # 'rpc_users.py',
     # 'p2p_mempool.py',
     # 'mining_prioritisetransaction.py',